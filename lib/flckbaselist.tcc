@@ -21,6 +21,7 @@
 #include <string.h>
 #include <sched.h>
 #include <errno.h>
+#include <limits.h>
 #include <string>
 #include <iostream>
 
@@ -31,10 +32,28 @@
 //---------------------------------------------------------
 #define	FLCK_FLCKPID_TRYLOCK_LIMIT			1000
 
+#define	FLCK_LOCKID_PAUSE_LIMIT				10			// PAUSE backoff rounds(1, 2, 4 ... 512 PAUSEs)
+#define	FLCK_LOCKID_YIELD_LIMIT				60			// sched_yield phase is until this count
+#define	FLCK_LOCKID_PARK_NSEC				(1000 * 1000)	// max parking time at once(1ms)
+#define	FLCK_LOCKID_PARK_WEIGHT				100			// one parking is counted as this loop count for checking owner dead
+#define	FLCK_LOCKID_WAITER					(static_cast<flckpid_t>(1) << 63)	// pid does not use top bit
+#define	FLCK_LOCKID_OWNER(val)				((val) & ~FLCK_LOCKID_WAITER)
+#define	IS_FLCK_LOCKID_WAITER(val)			(FLCK_LOCKID_WAITER == ((val) & FLCK_LOCKID_WAITER))
+
 #define	FLCK_ROBUST_CHKCNT_NOLIMIT			-1
 #define	FLCK_ROBUST_CHKCNT_DEFAULT			5000		// == 10-20ns * 5000 = 50-100us
 #define	FLCK_ROBUST_CHKCNT_MIN				50			//
 
+#define	FLCK_RWLOCK_SPIN_LIMIT				100			// spin count before parking on futex
+#define	FLCK_RWLOCK_PARK_NSEC				(1000 * 1000)	// max parking time at once(1ms)
+#define	FLCK_RWLOCK_PARK_WEIGHT				100			// one parking is counted as this loop count for max_count
+
+#define	FLCK_MUTEX_SPIN_LIMIT				100			// spin count before parking on futex for named mutex
+#define	FLCK_MUTEX_PARK_NSEC				(10 * 1000 * 1000)	// max parking time at once(10ms)
+#define	FLCK_MUTEX_PARK_WEIGHT				1000		// one parking is counted as this loop count for max_count
+
+#define	FLCK_COND_SPIN_LIMIT				100			// spin count before parking on futex for named cond
+
 #define	FLCK_NOSHARED_MUTEX_VAL_LOCKED		1
 #define	FLCK_NOSHARED_MUTEX_VAL_UNLOCKED	0
 
@@ -56,38 +75,160 @@ namespace fullock
 	//---------------------------------------------------------
 	// Utility
 	//---------------------------------------------------------
+	//
+	// Statistics for lockid backoff phases(process local)
+	//
+	typedef struct fl_lockid_stat{
+		volatile uint64_t	pause_cnt;						// count of reaching PAUSE backoff phase
+		volatile uint64_t	yield_cnt;						// count of reaching sched_yield phase
+		volatile uint64_t	park_cnt;						// count of reaching futex parking phase
+	}FLLOCKIDSTAT, *PFLLOCKIDSTAT;
+
+	inline FLLOCKIDSTAT& fl_get_lockid_stat(void)
+	{
+		static FLLOCKIDSTAT	stat = {0, 0, 0};				// POD, so no need to care initializing order
+		return stat;
+	}
+
+	// [NOTE]
+	// The futex word for lockid is the upper 32bit of flckpid_t, it has pid
+	// and FLCK_LOCKID_WAITER bit. Then a waiter is woken up(or gets EAGAIN)
+	// when the waiter bit is cleared or the owner process is changed.
+	//
+	inline int* fl_lockid_futex_addr(flckpid_t* pflckpid)
+	{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		return reinterpret_cast<int*>(pflckpid) + 1;
+#else
+		return reinterpret_cast<int*>(pflckpid);
+#endif
+	}
+
+	inline int fl_lockid_futex_val(flckpid_t lockid)
+	{
+		return static_cast<int>(static_cast<uint32_t>(lockid >> 32));
+	}
+
+	// [NOTE]
+	// The futex word for named mutex is the lower 32bit of flckpid_t, it has
+	// tid and FLCK_MUTEX_WAITER/FLCK_MUTEX_OWNER_DIED bits as same as the
+	// kernel robust futex.
+	//
+	inline int* fl_mutex_futex_addr(flck_mutex_t* plockval)
+	{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		return reinterpret_cast<int*>(plockval);
+#else
+		return reinterpret_cast<int*>(plockval) + 1;
+#endif
+	}
+
+	inline int fl_mutex_futex_val(flck_mutex_t lockval)
+	{
+		return static_cast<int>(static_cast<uint32_t>(lockval));
+	}
+
+	// Returns	true	: parked(or the lockid was changed while parking)
+	//			false	: could not set waiter bit, lockid was changed
+	//
+	inline bool fl_park_lockid(flckpid_t* pflckpid, flckpid_t oldval)
+	{
+		if(!IS_FLCK_LOCKID_WAITER(oldval)){
+			flckpid_t	newval = oldval | FLCK_LOCKID_WAITER;
+			if(oldval != __sync_val_compare_and_swap(pflckpid, oldval, newval)){
+				return false;
+			}
+			oldval = newval;
+		}
+		struct timespec	parktime = {0, FLCK_LOCKID_PARK_NSEC};
+		flck_futex_wait(fl_lockid_futex_addr(pflckpid), fl_lockid_futex_val(oldval), &parktime);
+		return true;
+	}
+
+	// [NOTE]
+	// Unlocking the lockid which has the waiter bit leaves only the waiter
+	// bit(no owner) and wakes one waiter. If no thread was woken, nobody is
+	// parking, then the left waiter bit is cleared. A thread which is
+	// parking can not miss this, because the futex word is changed by
+	// clearing it.
+	//
+	inline void fl_wake_lockid(flckpid_t* pflckpid)
+	{
+		if(0 == flck_futex_wake(fl_lockid_futex_addr(pflckpid), 1)){
+			__sync_bool_compare_and_swap(pflckpid, FLCK_LOCKID_WAITER, FLCK_INVALID_ID);
+		}
+	}
+
+	// [NOTE]
+	// Contended locking is adaptive as following phases:
+	//	1) PAUSE instruction with exponential backoff(FLCK_LOCKID_PAUSE_LIMIT rounds)
+	//	2) sched_yield(until FLCK_LOCKID_YIELD_LIMIT)
+	//	3) parking on futex with waiter bit, and timeout(FLCK_LOCKID_PARK_NSEC)
+	// The lockid is got by CAS from the free value which is read, and the
+	// waiter bit in it is kept, so that a thread which wins in any phase
+	// does not clear the waiter bit while other waiters are parking. The
+	// lockid which is got after parking always has the waiter bit. And the
+	// owner dead is checked when same owner keeps lockid over
+	// FLCK_FLCKPID_TRYLOCK_LIMIT(one parking is counted as
+	// FLCK_LOCKID_PARK_WEIGHT).
+	//
 	inline void fl_lock_lockid(flckpid_t* pflckpid, flckpid_t newid)
 	{
-		flckpid_t	oldval1;
-		flckpid_t	oldval2 = FLCK_INVALID_ID;
-		for(int cnt = 0; FLCK_INVALID_ID != (oldval1 = __sync_val_compare_and_swap(pflckpid, FLCK_INVALID_ID, newid)); ++cnt){
-			if(oldval1 == newid){
+		flckpid_t	oldval;
+		flckpid_t	lastowner	= FLCK_INVALID_ID;
+		flckpid_t	waiterbit	= 0;
+		int			stablecnt	= 0;
+		for(int cnt = 0; FLCK_INVALID_ID != (oldval = __sync_val_compare_and_swap(pflckpid, FLCK_INVALID_ID, (newid | waiterbit))); ++cnt){
+			flckpid_t	owner = FLCK_LOCKID_OWNER(oldval);
+			if(FLCK_INVALID_ID == owner){
+				// lockid is free but the waiter bit is left, so get it with keeping the bit.
+				if(oldval == __sync_val_compare_and_swap(pflckpid, oldval, (newid | FLCK_LOCKID_WAITER))){
+					break;
+				}
+				continue;
+			}else if(owner == newid){
 				// already lockid is newid.
 				break;
-			}else if(oldval1 != oldval2){
-				cnt = 0;		// reset
-			}else if(FLCK_FLCKPID_TRYLOCK_LIMIT < cnt){
+			}else if(owner != lastowner){
+				stablecnt = 0;		// reset
+				lastowner = owner;
+			}else if(FLCK_FLCKPID_TRYLOCK_LIMIT < stablecnt){
 				// check thread(process) dead.
-				pid_t	pid = decompose_pid(oldval1);
-				tid_t	tid = decompose_tid(oldval1);
-
-				if(!FindThreadProcess(pid, tid)){
-					// thread(process) does not run, so force to set this tid.
-					// cppcheck-suppress unmatchedSuppression
-					// cppcheck-suppress redundantAssignment
-					oldval2 = oldval1;
-					if(oldval2 == (oldval1 = __sync_val_compare_and_swap(pflckpid, oldval2, newid))){
+				if(!FindThreadProcess(decompose_pid(owner), decompose_tid(owner))){
+					// thread(process) does not run, so force to set this tid.(keep waiter bit)
+					if(oldval == __sync_val_compare_and_swap(pflckpid, oldval, (newid | (oldval & FLCK_LOCKID_WAITER)))){
 						// success to switch newid.
 						break;
 					}
 					// retry...
 				}
+				stablecnt = 0;
 			}
-			oldval2 = oldval1;
 
-			// [NOTE]
-			// we do not call sched_yield but spinning loop
-			//sched_yield();
+			// backoff
+			if(cnt < FLCK_LOCKID_PAUSE_LIMIT){
+				if(0 == cnt){
+					__sync_fetch_and_add(&(fl_get_lockid_stat().pause_cnt), 1);
+				}
+				for(int pausecnt = (1 << cnt); 0 < pausecnt; --pausecnt){
+					flck_cpu_relax();
+				}
+				++stablecnt;
+			}else if(cnt < FLCK_LOCKID_YIELD_LIMIT){
+				if(FLCK_LOCKID_PAUSE_LIMIT == cnt){
+					__sync_fetch_and_add(&(fl_get_lockid_stat().yield_cnt), 1);
+				}
+				sched_yield();
+				++stablecnt;
+			}else{
+				if(FLCK_LOCKID_YIELD_LIMIT == cnt){
+					__sync_fetch_and_add(&(fl_get_lockid_stat().park_cnt), 1);
+				}
+				if(fl_park_lockid(pflckpid, oldval)){
+					waiterbit	= FLCK_LOCKID_WAITER;
+					stablecnt	+= FLCK_LOCKID_PARK_WEIGHT;
+				}
+			}
 		}
 	}
 
@@ -96,23 +237,33 @@ namespace fullock
 		flckpid_t	oldval1;
 		flckpid_t	oldval2 = FLCK_INVALID_ID;
 		for(int cnt = 0; oldid != (oldval1 = __sync_val_compare_and_swap(pflckpid, oldid, FLCK_INVALID_ID)); ++cnt){
-			if(oldval1 == FLCK_INVALID_ID){
+			if(FLCK_LOCKID_OWNER(oldval1) == FLCK_INVALID_ID){
 				// already lockid is FLCK_INVALID_ID.
 				break;
+			}else if(FLCK_LOCKID_OWNER(oldval1) == oldid){
+				// waiter bit is set, so clear owner with keeping the bit and wake up one waiter.
+				if(oldval1 == __sync_val_compare_and_swap(pflckpid, oldval1, FLCK_LOCKID_WAITER)){
+					fl_wake_lockid(pflckpid);
+					break;
+				}
+				continue;
 			}else if(oldval1 != oldval2){
 				cnt = 0;		// reset
 			}else if(FLCK_FLCKPID_TRYLOCK_LIMIT < cnt){
 				// check thread(process) dead.
-				pid_t	pid = decompose_pid(oldval1);
-				tid_t	tid = decompose_tid(oldval1);
+				pid_t	pid = decompose_pid(FLCK_LOCKID_OWNER(oldval1));
+				tid_t	tid = decompose_tid(FLCK_LOCKID_OWNER(oldval1));
 
 				if(!FindThreadProcess(pid, tid)){
 					// thread(process) does not run, so force to set this tid.
 					// cppcheck-suppress unmatchedSuppression
 					// cppcheck-suppress redundantAssignment
 					oldval2 = oldval1;
-					if(oldval2 == (oldval1 = __sync_val_compare_and_swap(pflckpid, oldval2, FLCK_INVALID_ID))){
+					if(oldval2 == (oldval1 = __sync_val_compare_and_swap(pflckpid, oldval2, (oldval2 & FLCK_LOCKID_WAITER)))){
 						// success to switch newid.
+						if(IS_FLCK_LOCKID_WAITER(oldval2)){
+							fl_wake_lockid(pflckpid);
+						}
 						break;
 					}
 					// retry...
@@ -128,42 +279,86 @@ namespace fullock
 
 	inline bool fl_try_unlock_lockid(flckpid_t* pflckpid, flckpid_t oldid)
 	{
-		if(oldid != __sync_val_compare_and_swap(pflckpid, oldid, FLCK_INVALID_ID)){
-			return false;
+		flckpid_t	oldval;
+		if(oldid != (oldval = __sync_val_compare_and_swap(pflckpid, oldid, FLCK_INVALID_ID))){
+			if(FLCK_LOCKID_OWNER(oldval) != oldid || oldval != __sync_val_compare_and_swap(pflckpid, oldval, FLCK_LOCKID_WAITER)){
+				return false;
+			}
+			fl_wake_lockid(pflckpid);
 		}
 		return true;
 	}
 
 	inline bool fl_islock_lockid(const flckpid_t* pflckpid)
 	{
-		if(pflckpid && FLCK_INVALID_ID != *pflckpid){
+		if(pflckpid && FLCK_INVALID_ID != FLCK_LOCKID_OWNER(*pflckpid)){
 			return true;
 		}
 		return false;
 	}
 
+	//
+	// Parking for rwlock
+	//
+	// [NOTE]
+	// When the rwlock can not be got, the caller spins with sched_yield
+	// up to FLCK_RWLOCK_SPIN_LIMIT times, and after that parks on futex.
+	// Parking sets FLCK_RWLOCK_WAITER bit in lock value and waits on it
+	// with timeout(FLCK_RWLOCK_PARK_NSEC), then unlocking calls FUTEX_WAKE
+	// only when that bit is set.
+	// The timeout is for the case that the lock owner is dead. Each parking
+	// is counted as FLCK_RWLOCK_PARK_WEIGHT loops, so that the caller with
+	// max_count can return ETIMEDOUT for checking dead lock as same as before.
+	// Timed locking parks until its deadline, because all changes which the
+	// waiter waits for wake it up.
+	//
+	inline void fl_park_rwlock(flck_rwlock_t* plockval, flck_rwlock_t beforeval, const struct timespec* pdeadline = NULL)
+	{
+		if(!IS_FLCK_RWLOCK_WAITER(beforeval)){
+			flck_rwlock_t	newval = beforeval | FLCK_RWLOCK_WAITER;
+			if(beforeval != __sync_val_compare_and_swap(plockval, beforeval, newval)){
+				// lock value is changed, so retry locking without parking
+				return;
+			}
+			beforeval = newval;
+		}
+		// not need to check result(woken up, timeouted, or value was changed)
+		if(pdeadline){
+			flck_futex_wait_until(plockval, beforeval, pdeadline);
+		}else{
+			struct timespec	parktime = {0, FLCK_RWLOCK_PARK_NSEC};
+			flck_futex_wait(plockval, beforeval, &parktime);
+		}
+	}
+
 	inline int fl_rdlock_rwlock(flck_rwlock_t* plockval, int max_count = FLCK_ROBUST_CHKCNT_NOLIMIT)
 	{
-		flck_rwlock_t	newval;
 		flck_rwlock_t	beforeval;
-		int				cnt = 0;
-		do{
+		for(int cnt = 0; true; ){
+			beforeval = *plockval;
+			if(!IS_FLCK_RWLOCK_RBLOCKED(beforeval) && beforeval == __sync_val_compare_and_swap(plockval, beforeval, beforeval + FLCK_RWLOCK_RLOCK)){
+				break;
+			}
 			if(FLCK_ROBUST_CHKCNT_NOLIMIT != max_count && max_count < cnt){
 				return ETIMEDOUT;
+			}
+			if(!IS_FLCK_RWLOCK_RBLOCKED(beforeval) || cnt < FLCK_RWLOCK_SPIN_LIMIT){
+				// conflict with other readers, or spinning phase
+				++cnt;
+				sched_yield();
 			}else{
-				cnt++;
+				cnt += FLCK_RWLOCK_PARK_WEIGHT;
+				fl_park_rwlock(plockval, beforeval);
 			}
-			beforeval	= *plockval;
-			newval		= beforeval + 1;
-		}while((FLCK_RWLOCK_UNLOCK > beforeval || beforeval != __sync_val_compare_and_swap(plockval, beforeval, newval)) && -1 <= sched_yield());
+		}
 		return 0;
 	}
 
 	inline int fl_tryrdlock_rwlock(flck_rwlock_t* plockval)
 	{
 		flck_rwlock_t	beforeval	= *plockval;
-		flck_rwlock_t	newval		= beforeval + 1;
-		if(FLCK_RWLOCK_UNLOCK > beforeval){
+		flck_rwlock_t	newval		= beforeval + FLCK_RWLOCK_RLOCK;
+		if(IS_FLCK_RWLOCK_RBLOCKED(beforeval)){
 			return EBUSY;
 		}
 		if(beforeval != __sync_val_compare_and_swap(plockval, beforeval, newval)){
@@ -172,73 +367,126 @@ namespace fullock
 		return 0;
 	}
 
-	inline int fl_timedrdlock_rwlock(flck_rwlock_t* plockval, const struct timespec* limittime)
+	inline int fl_timedrdlock_rwlock(flck_rwlock_t* plockval, const struct timespec* pdeadline)
 	{
-		struct timespec	starttime;
-		if(-1 == clock_gettime(CLOCK_MONOTONIC, &starttime)){
-			return EBUSY;
-		}
-
-		while(true){
-			flck_rwlock_t	newval;
-			flck_rwlock_t	beforeval;
-
-			beforeval	= *plockval;
-			newval		= beforeval + 1;
-			if(FLCK_RWLOCK_UNLOCK <= beforeval){
-				if(beforeval == __sync_val_compare_and_swap(plockval, beforeval, newval)){
-					break;
-				}
-			}
-
-			struct timespec	endtime;
-			if(-1 == clock_gettime(CLOCK_MONOTONIC, &endtime)){
-				return EBUSY;
+		for(int cnt = 0; true; ++cnt){
+			flck_rwlock_t	beforeval = *plockval;
+			if(!IS_FLCK_RWLOCK_RBLOCKED(beforeval) && beforeval == __sync_val_compare_and_swap(plockval, beforeval, beforeval + FLCK_RWLOCK_RLOCK)){
+				break;
 			}
-			if(IS_OVER_TIMESPEC(&starttime, &endtime, limittime)){
+			if(flck_check_deadline(pdeadline, cnt)){
 				return ETIMEDOUT;
 			}
-			sched_yield();
+			if(!IS_FLCK_RWLOCK_RBLOCKED(beforeval) || cnt < FLCK_RWLOCK_SPIN_LIMIT){
+				sched_yield();
+			}else{
+				fl_park_rwlock(plockval, beforeval, pdeadline);
+				if(flck_is_over_deadline(pdeadline)){
+					return ETIMEDOUT;
+				}
+			}
 		}
 		return 0;
 	}
 
-	inline int fl_wrlock_rwlock(flck_rwlock_t* plockval, int max_count = FLCK_ROBUST_CHKCNT_NOLIMIT)
+	//
+	// Writer preference for rwlock
+	//
+	// [NOTE]
+	// The writer with preference sets FLCK_RWLOCK_WPENDING bit when it can
+	// not get the lock, then new readers back off until a writer gets the
+	// lock(the bit is cleared by getting writer lock). Readers always check
+	// the bit, so the preference is selected only by writer side.
+	// The bit is cleared when the writer gives up(timeouted) or is dead, and
+	// the other pending writers set it again.
+	//
+	inline void fl_pending_wrlock_rwlock(flck_rwlock_t* plockval, flck_rwlock_t beforeval)
 	{
-		int			cnt = 0;
+		if(!IS_FLCK_RWLOCK_WPENDING(beforeval) && !IS_FLCK_RWLOCK_WLOCKABLE(beforeval)){
+			// not need to check result(retry at next loop)
+			__sync_val_compare_and_swap(plockval, beforeval, (beforeval | FLCK_RWLOCK_WPENDING));
+		}
+	}
+
+	inline void fl_cancel_pending_rwlock(flck_rwlock_t* plockval)
+	{
+		flck_rwlock_t	beforeval;
 		do{
+			beforeval = *plockval;
+			if(!IS_FLCK_RWLOCK_WPENDING(beforeval)){
+				return;
+			}
+		}while(beforeval != __sync_val_compare_and_swap(plockval, beforeval, (beforeval & ~(FLCK_RWLOCK_WPENDING | FLCK_RWLOCK_WAITER))));
+
+		if(IS_FLCK_RWLOCK_WAITER(beforeval)){
+			flck_futex_wake(plockval, INT_MAX);
+		}
+	}
+
+	inline int fl_wrlock_rwlock(flck_rwlock_t* plockval, int max_count = FLCK_ROBUST_CHKCNT_NOLIMIT, bool is_prefer = false)
+	{
+		flck_rwlock_t	beforeval;
+		for(int cnt = 0; true; ){
+			beforeval = *plockval;
+			if(IS_FLCK_RWLOCK_WLOCKABLE(beforeval) && beforeval == __sync_val_compare_and_swap(plockval, beforeval, ((beforeval & FLCK_RWLOCK_WAITER) | FLCK_RWLOCK_WLOCK))){
+				break;
+			}
 			if(FLCK_ROBUST_CHKCNT_NOLIMIT != max_count && max_count < cnt){
 				return ETIMEDOUT;
+			}
+			if(is_prefer){
+				fl_pending_wrlock_rwlock(plockval, beforeval);
+			}
+			if(IS_FLCK_RWLOCK_WLOCKABLE(beforeval) || cnt < FLCK_RWLOCK_SPIN_LIMIT){
+				++cnt;
+				sched_yield();
 			}else{
-				cnt++;
+				cnt += FLCK_RWLOCK_PARK_WEIGHT;
+				fl_park_rwlock(plockval, beforeval);
 			}
-		}while(FLCK_RWLOCK_UNLOCK != __sync_val_compare_and_swap(plockval, FLCK_RWLOCK_UNLOCK, FLCK_RWLOCK_WLOCK) && -1 <= sched_yield());
+		}
 		return 0;
 	}
 
 	inline int fl_trywrlock_rwlock(flck_rwlock_t* plockval)
 	{
-		if(FLCK_RWLOCK_UNLOCK != __sync_val_compare_and_swap(plockval, FLCK_RWLOCK_UNLOCK, FLCK_RWLOCK_WLOCK)){
+		flck_rwlock_t	beforeval = *plockval;
+		if(!IS_FLCK_RWLOCK_WLOCKABLE(beforeval)){
+			return EBUSY;
+		}
+		if(beforeval != __sync_val_compare_and_swap(plockval, beforeval, ((beforeval & FLCK_RWLOCK_WAITER) | FLCK_RWLOCK_WLOCK))){
 			return EBUSY;
 		}
 		return 0;
 	}
 
-	inline int fl_timedwrlock_rwlock(flck_rwlock_t* plockval, const struct timespec* limittime)
+	inline int fl_timedwrlock_rwlock(flck_rwlock_t* plockval, const struct timespec* pdeadline, bool is_prefer = false)
 	{
-		struct timespec	starttime;
-		if(-1 == clock_gettime(CLOCK_MONOTONIC, &starttime)){
-			return EBUSY;
-		}
-		while(FLCK_RWLOCK_UNLOCK != __sync_val_compare_and_swap(plockval, FLCK_RWLOCK_UNLOCK, FLCK_RWLOCK_WLOCK)){
-			struct timespec	endtime;
-			if(-1 == clock_gettime(CLOCK_MONOTONIC, &endtime)){
-				return EBUSY;
+		for(int cnt = 0; true; ++cnt){
+			flck_rwlock_t	beforeval = *plockval;
+			if(IS_FLCK_RWLOCK_WLOCKABLE(beforeval) && beforeval == __sync_val_compare_and_swap(plockval, beforeval, ((beforeval & FLCK_RWLOCK_WAITER) | FLCK_RWLOCK_WLOCK))){
+				break;
 			}
-			if(IS_OVER_TIMESPEC(&starttime, &endtime, limittime)){
+			if(flck_check_deadline(pdeadline, cnt)){
+				if(is_prefer){
+					fl_cancel_pending_rwlock(plockval);
+				}
 				return ETIMEDOUT;
 			}
-			sched_yield();
+			if(is_prefer){
+				fl_pending_wrlock_rwlock(plockval, beforeval);
+			}
+			if(IS_FLCK_RWLOCK_WLOCKABLE(beforeval) || cnt < FLCK_RWLOCK_SPIN_LIMIT){
+				sched_yield();
+			}else{
+				fl_park_rwlock(plockval, beforeval, pdeadline);
+				if(flck_is_over_deadline(pdeadline)){
+					if(is_prefer){
+						fl_cancel_pending_rwlock(plockval);
+					}
+					return ETIMEDOUT;
+				}
+			}
 		}
 		return 0;
 	}
@@ -249,121 +497,517 @@ namespace fullock
 		flck_rwlock_t	beforeval;
 		do{
 			beforeval		= *plockval;
-			if(FLCK_RWLOCK_UNLOCK == beforeval){
-				// already unlocked
-				break;
-			}else if(FLCK_RWLOCK_WLOCK >= beforeval){
-				beforeval	= FLCK_RWLOCK_WLOCK;
+			if(IS_FLCK_RWLOCK_WLOCKABLE(beforeval)){
+				// already unlocked(pending bit is left for pending writer)
+				return 0;
+			}else if(IS_FLCK_RWLOCK_WLOCKED(beforeval)){
 				newval		= FLCK_RWLOCK_UNLOCK;
 			}else{
-				newval		= beforeval - 1;
+				newval		= beforeval - FLCK_RWLOCK_RLOCK;
+				if(IS_FLCK_RWLOCK_WLOCKABLE(newval) || (FLCK_RWLOCK_UPGRADE | FLCK_RWLOCK_RLOCK) == (FLCK_RWLOCK_STATE(newval) & ~FLCK_RWLOCK_WPENDING)){
+					newval	= FLCK_RWLOCK_STATE(newval);	// clear waiter bit because waking up all waiters(and upgrader, pending writer)
+				}
 			}
 		}while(beforeval != __sync_val_compare_and_swap(plockval, beforeval, newval) && -1 <= sched_yield());
+
+		// wake up waiters only when the waiter bit was set and is cleared now
+		if(IS_FLCK_RWLOCK_WAITER(beforeval) && !IS_FLCK_RWLOCK_WAITER(newval)){
+			flck_futex_wake(plockval, INT_MAX);
+		}
 		return 0;
 	}
 
-	inline int fl_lock_mutex(flck_mutex_t* plockval, int* plockcnt, flckpid_t lockid, int max_count = FLCK_ROBUST_CHKCNT_NOLIMIT)
+	//
+	// Upgrade/Downgrade for rwlock
+	//
+	// [NOTE]
+	// Upgrading is two steps. At first, the reader sets FLCK_RWLOCK_UPGRADE
+	// bit, then new readers and writers can not get the lock. If the bit is
+	// already set by other reader, it returns EDEADLK because both readers
+	// wait for each other. Next, the reader waits until it is the last reader
+	// and changes it to writer lock by one CAS.
+	//
+	inline int fl_request_upgrade_rwlock(flck_rwlock_t* plockval)
 	{
-		int	cnt = 0;
+		flck_rwlock_t	beforeval;
 		do{
+			beforeval = *plockval;
+			if(IS_FLCK_RWLOCK_WLOCKED(beforeval) || 0 == (beforeval & FLCK_RWLOCK_RCNT_MASK)){
+				return EINVAL;
+			}
+			if(IS_FLCK_RWLOCK_UPGRADE(beforeval)){
+				return EDEADLK;
+			}
+		}while(beforeval != __sync_val_compare_and_swap(plockval, beforeval, (beforeval | FLCK_RWLOCK_UPGRADE)));
+		return 0;
+	}
+
+	inline int fl_wait_upgrade_rwlock(flck_rwlock_t* plockval, int max_count = FLCK_ROBUST_CHKCNT_NOLIMIT)
+	{
+		flck_rwlock_t	beforeval;
+		for(int cnt = 0; true; ){
+			beforeval = *plockval;
+			if((FLCK_RWLOCK_UPGRADE | FLCK_RWLOCK_RLOCK) == (FLCK_RWLOCK_STATE(beforeval) & ~FLCK_RWLOCK_WPENDING) && beforeval == __sync_val_compare_and_swap(plockval, beforeval, (FLCK_RWLOCK_WLOCK | (beforeval & FLCK_RWLOCK_WAITER)))){
+				break;
+			}
 			if(FLCK_ROBUST_CHKCNT_NOLIMIT != max_count && max_count < cnt){
-				return EWOULDBLOCK;			// EWOULDBLOCK
+				return ETIMEDOUT;
+			}
+			if(cnt < FLCK_RWLOCK_SPIN_LIMIT){
+				++cnt;
+				sched_yield();
 			}else{
-				cnt++;
+				cnt += FLCK_RWLOCK_PARK_WEIGHT;
+				fl_park_rwlock(plockval, beforeval);
 			}
+		}
+		return 0;
+	}
 
-			// do lock
-			if(lockid == *plockval){
-				// already locked --> count up lockcnt
-				int	oldcnt = __sync_fetch_and_add(plockcnt, 1);
-				if(0 <= oldcnt){
-					// success to count up --> check lockval(this is failed but get old value)
-					if(lockid == __sync_val_compare_and_swap(plockval, lockid, lockid)){
-						// success to lock
-						break;
-					}
+	// Clear FLCK_RWLOCK_UPGRADE bit(for upgrader which is dead)
+	//
+	inline void fl_cancel_upgrade_rwlock(flck_rwlock_t* plockval)
+	{
+		flck_rwlock_t	beforeval;
+		do{
+			beforeval = *plockval;
+			if(!IS_FLCK_RWLOCK_UPGRADE(beforeval)){
+				return;
+			}
+		}while(beforeval != __sync_val_compare_and_swap(plockval, beforeval, (beforeval & ~(FLCK_RWLOCK_UPGRADE | FLCK_RWLOCK_WAITER))));
+
+		if(IS_FLCK_RWLOCK_WAITER(beforeval)){
+			flck_futex_wake(plockval, INT_MAX);
+		}
+	}
+
+	inline int fl_downgrade_rwlock(flck_rwlock_t* plockval)
+	{
+		flck_rwlock_t	beforeval;
+		do{
+			beforeval = *plockval;
+			if(!IS_FLCK_RWLOCK_WLOCKED(beforeval)){
+				return EINVAL;
+			}
+		}while(beforeval != __sync_val_compare_and_swap(plockval, beforeval, FLCK_RWLOCK_RLOCK));
+
+		// wake up waiters, because readers can get lock now
+		if(IS_FLCK_RWLOCK_WAITER(beforeval)){
+			flck_futex_wake(plockval, INT_MAX);
+		}
+		return 0;
+	}
+
+	//
+	// Phase-fair ticket rwlock
+	//
+	// [NOTE]
+	// The ticket is kept in the caller's locker, so that blocking lock can
+	// return ETIMEDOUT(for checking dead lock) and can be called again with
+	// same ticket. Try and timed lock do not take any ticket until they can
+	// get the lock, because the ticket can not be canceled while waiting.
+	// Then only blocking lock is served by ticket order.
+	// If try writer can not set phase bits after taking ticket, it returns
+	// EBUSY with the ticket in its turn. Timed writer in that case sets the
+	// phase bits and waits for readers, and returns ETIMEDOUT with the ticket
+	// if it is timeouted. The caller releases these tickets by
+	// fl_release_pfrwlock while locking the list of lockers.
+	// Waiters park on the counter which they are waiting for, and unlocking
+	// wakes them only when some waiter is parking.
+	//
+	inline int* fl_pfrwlock_futex_addr(volatile flck_ticket_t* pcounter)
+	{
+		return reinterpret_cast<int*>(const_cast<flck_ticket_t*>(pcounter));
+	}
+
+	inline void fl_park_pfrwlock(PFLPFRWLOCK plock, volatile flck_ticket_t* pcounter, flck_ticket_t beforeval, const struct timespec* pdeadline = NULL)
+	{
+		__sync_fetch_and_add(&(plock->parked), 1);
+		// not need to check result(woken up, timeouted, or value was changed)
+		if(pdeadline){
+			flck_futex_wait_until(fl_pfrwlock_futex_addr(pcounter), static_cast<int>(beforeval), pdeadline);
+		}else{
+			struct timespec	parktime = {0, FLCK_RWLOCK_PARK_NSEC};
+			flck_futex_wait(fl_pfrwlock_futex_addr(pcounter), static_cast<int>(beforeval), &parktime);
+		}
+		__sync_fetch_and_sub(&(plock->parked), 1);
+	}
+
+	inline void fl_wake_pfrwlock(PFLPFRWLOCK plock, volatile flck_ticket_t* pcounter)
+	{
+		if(0 < plock->parked){
+			flck_futex_wake(fl_pfrwlock_futex_addr(pcounter), INT_MAX);
+		}
+	}
+
+	// Wait until the counter reaches the ticket
+	//
+	inline int fl_wait_ticket_pfrwlock(PFLPFRWLOCK plock, volatile flck_ticket_t* pcounter, flck_ticket_t ticket, int& cnt, int max_count)
+	{
+		flck_ticket_t	beforeval;
+		while(ticket != (beforeval = *pcounter)){
+			if(FLCK_ROBUST_CHKCNT_NOLIMIT != max_count && max_count < cnt){
+				return ETIMEDOUT;
+			}
+			if(cnt < FLCK_RWLOCK_SPIN_LIMIT){
+				++cnt;
+				sched_yield();
+			}else{
+				cnt += FLCK_RWLOCK_PARK_WEIGHT;
+				fl_park_pfrwlock(plock, pcounter, beforeval);
+			}
+		}
+		return 0;
+	}
+
+	inline int fl_rdlock_pfrwlock(PFLPFRWLOCK plock, PFLPFTICKET pticket, int max_count = FLCK_ROBUST_CHKCNT_NOLIMIT)
+	{
+		if(FLCK_PFTICKET_NONE == pticket->type){
+			pticket->ticket	= __sync_fetch_and_add(&(plock->rin), FLCK_PFRW_RINC);
+			pticket->type	= FLCK_PFTICKET_READER;
+		}
+		// wait while the writer phase at entering is going on
+		flck_ticket_t	phase = pticket->ticket & FLCK_PFRW_WBITS;
+		flck_ticket_t	beforeval;
+		for(int cnt = 0; 0 != phase && phase == ((beforeval = plock->rin) & FLCK_PFRW_WBITS); ){
+			if(FLCK_ROBUST_CHKCNT_NOLIMIT != max_count && max_count < cnt){
+				return ETIMEDOUT;
+			}
+			if(cnt < FLCK_RWLOCK_SPIN_LIMIT){
+				++cnt;
+				sched_yield();
+			}else{
+				cnt += FLCK_RWLOCK_PARK_WEIGHT;
+				fl_park_pfrwlock(plock, &(plock->rin), beforeval);
+			}
+		}
+		return 0;
+	}
+
+	inline int fl_tryrdlock_pfrwlock(PFLPFRWLOCK plock, PFLPFTICKET pticket)
+	{
+		flck_ticket_t	beforeval = plock->rin;
+		if(0 != (beforeval & FLCK_PFRW_WBITS)){
+			return EBUSY;
+		}
+		if(beforeval != __sync_val_compare_and_swap(&(plock->rin), beforeval, beforeval + FLCK_PFRW_RINC)){
+			return EBUSY;
+		}
+		pticket->ticket	= beforeval;
+		pticket->type	= FLCK_PFTICKET_READER;
+		return 0;
+	}
+
+	inline int fl_timedrdlock_pfrwlock(PFLPFRWLOCK plock, PFLPFTICKET pticket, const struct timespec* pdeadline)
+	{
+		for(int cnt = 0; true; ++cnt){
+			flck_ticket_t	beforeval = plock->rin;
+			if(0 == (beforeval & FLCK_PFRW_WBITS) && beforeval == __sync_val_compare_and_swap(&(plock->rin), beforeval, beforeval + FLCK_PFRW_RINC)){
+				pticket->ticket	= beforeval;
+				pticket->type	= FLCK_PFTICKET_READER;
+				break;
+			}
+			if(flck_check_deadline(pdeadline, cnt)){
+				return ETIMEDOUT;
+			}
+			if(0 == (beforeval & FLCK_PFRW_WBITS) || cnt < FLCK_RWLOCK_SPIN_LIMIT){
+				sched_yield();
+			}else{
+				fl_park_pfrwlock(plock, &(plock->rin), beforeval, pdeadline);
+				if(flck_is_over_deadline(pdeadline)){
+					return ETIMEDOUT;
 				}
-				// this case is unlocked before count up. So need to count down and retry.
-				__sync_fetch_and_sub(plockcnt, 1);
+			}
+		}
+		return 0;
+	}
+
+	inline int fl_wrlock_pfrwlock(PFLPFRWLOCK plock, PFLPFTICKET pticket, int max_count = FLCK_ROBUST_CHKCNT_NOLIMIT)
+	{
+		int	cnt = 0;
+		int	result;
+		if(FLCK_PFTICKET_NONE == pticket->type){
+			pticket->ticket	= __sync_fetch_and_add(&(plock->win), 1);
+			pticket->type	= FLCK_PFTICKET_WRITER;
+		}
+		if(FLCK_PFTICKET_WRITER == pticket->type){
+			// wait for own turn
+			if(0 != (result = fl_wait_ticket_pfrwlock(plock, &(plock->wout), pticket->ticket, cnt, max_count))){
+				return result;
+			}
+			// set phase bits, then new readers wait
+			pticket->rticket= FLCK_PFRW_RCNT(__sync_fetch_and_add(&(plock->rin), (FLCK_PFRW_PRES | (pticket->ticket & FLCK_PFRW_PHID))));
+			pticket->type	= FLCK_PFTICKET_WPRESENT;
+		}
+		// wait for readers which entered before
+		return fl_wait_ticket_pfrwlock(plock, &(plock->rout), pticket->rticket, cnt, max_count);
+	}
 
+	// Set phase bits only when there is no reader, because try(timed) writer
+	// can not wait for readers. The ticket is taken by CAS for not waiting.
+	//
+	inline int fl_trywrlock_pfrwlock(PFLPFRWLOCK plock, PFLPFTICKET pticket)
+	{
+		flck_ticket_t	ticket	= plock->win;
+		flck_ticket_t	rin		= plock->rin;
+		if(ticket != plock->wout || 0 != (rin & FLCK_PFRW_WBITS) || rin != plock->rout){
+			return EBUSY;
+		}
+		if(ticket != __sync_val_compare_and_swap(&(plock->win), ticket, ticket + 1)){
+			return EBUSY;
+		}
+		pticket->ticket	= ticket;
+		pticket->type	= FLCK_PFTICKET_WRITER;
+
+		// it is own turn now, set phase bits if no reader entered
+		if(rin != __sync_val_compare_and_swap(&(plock->rin), rin, (rin | FLCK_PFRW_PRES | (ticket & FLCK_PFRW_PHID)))){
+			return EBUSY;					// caller must release the ticket
+		}
+		pticket->rticket= rin;
+		pticket->type	= FLCK_PFTICKET_WPRESENT;
+		return 0;
+	}
+
+	inline int fl_timedwrlock_pfrwlock(PFLPFRWLOCK plock, PFLPFTICKET pticket, const struct timespec* pdeadline)
+	{
+		int	cnt;
+		for(cnt = 0; true; ++cnt){
+			flck_ticket_t	wout = plock->wout;
+			flck_ticket_t	rout = plock->rout;
+			if(0 == fl_trywrlock_pfrwlock(plock, pticket)){
+				return 0;
+			}
+			if(FLCK_PFTICKET_NONE != pticket->type){
+				break;						// own turn, but some readers entered
+			}
+			if(flck_check_deadline(pdeadline, cnt)){
+				return ETIMEDOUT;
+			}
+			if(cnt < FLCK_RWLOCK_SPIN_LIMIT){
+				sched_yield();
+				continue;
+			}else if(wout != plock->win){
+				fl_park_pfrwlock(plock, &(plock->wout), wout, pdeadline);		// wait for other writers
 			}else{
-				// try lock
-				if(FLCK_MUTEX_UNLOCK == __sync_val_compare_and_swap(plockval, FLCK_MUTEX_UNLOCK, lockid)){
-					// get lock --> count up lockcnt
-					__sync_fetch_and_add(plockcnt, 1);		// not need to check return value
-					break;
+				fl_park_pfrwlock(plock, &(plock->rout), rout, pdeadline);		// wait for readers
+			}
+			if(flck_is_over_deadline(pdeadline)){
+				return ETIMEDOUT;
+			}
+		}
+
+		// set phase bits, and wait for readers which entered before
+		pticket->rticket= FLCK_PFRW_RCNT(__sync_fetch_and_add(&(plock->rin), (FLCK_PFRW_PRES | (pticket->ticket & FLCK_PFRW_PHID))));
+		pticket->type	= FLCK_PFTICKET_WPRESENT;
+
+		flck_ticket_t	beforeval;
+		for(cnt = 0; pticket->rticket != (beforeval = plock->rout); ++cnt){
+			if(flck_check_deadline(pdeadline, cnt)){
+				return ETIMEDOUT;			// caller must release the ticket
+			}
+			if(cnt < FLCK_RWLOCK_SPIN_LIMIT){
+				sched_yield();
+			}else{
+				fl_park_pfrwlock(plock, &(plock->rout), beforeval, pdeadline);
+				if(pticket->rticket != plock->rout && flck_is_over_deadline(pdeadline)){
+					return ETIMEDOUT;		// caller must release the ticket
 				}
 			}
-		}while(-1 <= sched_yield());
+		}
 		return 0;
 	}
 
-	inline int fl_trylock_mutex(flck_mutex_t* plockval, int* plockcnt, flckpid_t lockid)
+	inline int fl_unlock_pfrwlock(PFLPFRWLOCK plock, PFLPFTICKET pticket)
+	{
+		if(FLCK_PFTICKET_READER == pticket->type){
+			__sync_fetch_and_add(&(plock->rout), FLCK_PFRW_RINC);
+			pticket->type = FLCK_PFTICKET_NONE;
+			fl_wake_pfrwlock(plock, &(plock->rout));
+
+		}else if(FLCK_PFTICKET_WPRESENT == pticket->type){
+			__sync_fetch_and_and(&(plock->rin), ~static_cast<flck_ticket_t>(FLCK_PFRW_WBITS));
+			__sync_fetch_and_add(&(plock->wout), 1);
+			pticket->type = FLCK_PFTICKET_NONE;
+			fl_wake_pfrwlock(plock, &(plock->rin));
+			fl_wake_pfrwlock(plock, &(plock->wout));
+
+		}else{
+			return EINVAL;
+		}
+		return 0;
+	}
+
+	// Release the ticket of dead locker(or the ticket which try writer left)
+	//
+	// Returns	true	: released(or does not have ticket)
+	//			false	: could not release it now, because it is waiting for its turn
+	//
+	inline bool fl_release_pfrwlock(PFLPFRWLOCK plock, PFLPFTICKET pticket)
+	{
+		if(FLCK_PFTICKET_NONE == pticket->type){
+			return true;
+		}
+		if(FLCK_PFTICKET_READER == pticket->type){
+			flck_ticket_t	phase = pticket->ticket & FLCK_PFRW_WBITS;
+			if(0 != phase && phase == (plock->rin & FLCK_PFRW_WBITS)){
+				// the writer phase at entering is going on, so the writer waits only for readers before it.
+				return false;
+			}
+			return (0 == fl_unlock_pfrwlock(plock, pticket));
+		}
+
+		// writer
+		flck_ticket_t	wout = plock->wout;
+		if(wout != pticket->ticket){
+			if(0 < static_cast<int32_t>(pticket->ticket - wout)){
+				// waiting for its turn yet
+				return false;
+			}
+			// already unlocked
+			pticket->type = FLCK_PFTICKET_NONE;
+			return true;
+		}
+		// [NOTE]
+		// In its turn, phase bits are set only by this writer. The type may
+		// not be FLCK_PFTICKET_WPRESENT if it was dead just after setting.
+		//
+		if(0 != (plock->rin & FLCK_PFRW_PRES)){
+			__sync_fetch_and_and(&(plock->rin), ~static_cast<flck_ticket_t>(FLCK_PFRW_WBITS));
+		}
+		__sync_fetch_and_add(&(plock->wout), 1);
+		pticket->type = FLCK_PFTICKET_NONE;
+		fl_wake_pfrwlock(plock, &(plock->rin));
+		fl_wake_pfrwlock(plock, &(plock->wout));
+		return true;
+	}
+
+	//
+	// Parking for named mutex
+	//
+	// [NOTE]
+	// The named mutex value is owner's flckpid with FLCK_MUTEX_WAITER bit,
+	// and the futex word is the lower 32bit of it(tid and bits). When
+	// the mutex can not be got, the caller spins with sched_yield up to
+	// FLCK_MUTEX_SPIN_LIMIT times, and after that sets the waiter bit and
+	// parks on futex with timeout(FLCK_MUTEX_PARK_NSEC). The mutex which is
+	// got after parking keeps the waiter bit, because other waiters may be
+	// parking yet. Unlocking calls FUTEX_WAKE only when the bit is set.
+	// The timeout is for the case that the owner is dead, and one parking
+	// is counted as FLCK_MUTEX_PARK_WEIGHT loops for max_count. Timed locking
+	// parks until its deadline, and passes the wakeup to another waiter if it
+	// is timeouted after parking, because unlocking wakes up only one.
+	// The mutex which has FLCK_MUTEX_OWNER_DIED bit is set by the kernel when
+	// the owner exited, it can be got as same as unlocked mutex.
+	//
+	inline void fl_park_mutex(flck_mutex_t* plockval, flck_mutex_t beforeval, const struct timespec* pdeadline = NULL)
 	{
-		// do lock
-		if(lockid == *plockval){
+		if(!IS_FLCK_MUTEX_WAITER(beforeval)){
+			flck_mutex_t	newval = beforeval | FLCK_MUTEX_WAITER;
+			if(beforeval != __sync_val_compare_and_swap(plockval, beforeval, newval)){
+				// lock value is changed, so retry locking without parking
+				return;
+			}
+			beforeval = newval;
+		}
+		// not need to check result(woken up, timeouted, or value was changed)
+		if(pdeadline){
+			flck_futex_wait_until(fl_mutex_futex_addr(plockval), fl_mutex_futex_val(beforeval), pdeadline);
+		}else{
+			struct timespec	parktime = {0, FLCK_MUTEX_PARK_NSEC};
+			flck_futex_wait(fl_mutex_futex_addr(plockval), fl_mutex_futex_val(beforeval), &parktime);
+		}
+	}
+
+	// Returns	0		: got the mutex(or counted up recursive lock)
+	//			EBUSY	: the mutex is locked by another
+	//
+	inline int fl_raw_trylock_mutex(flck_mutex_t* plockval, int* plockcnt, flckpid_t lockid, flck_mutex_t waiterbit, flck_mutex_t& oldval)
+	{
+		oldval = *plockval;
+		if(lockid == FLCK_MUTEX_OWNER(oldval)){
 			// already locked --> count up lockcnt
 			int	oldcnt = __sync_fetch_and_add(plockcnt, 1);
-			if(0 <= oldcnt){
-				// success to count up --> check lockval(this is failed but get old value)
-				if(lockid == __sync_val_compare_and_swap(plockval, lockid, lockid)){
-					// success to lock
-					return 0;
-				}
+			if(0 <= oldcnt && lockid == FLCK_MUTEX_OWNER(*plockval)){
+				// success to lock
+				return 0;
 			}
 			// this case is unlocked before count up. So need to count down.
 			__sync_fetch_and_sub(plockcnt, 1);
 
-		}else{
+		}else if(FLCK_MUTEX_UNLOCK == oldval){
 			// try lock
-			if(FLCK_MUTEX_UNLOCK == __sync_val_compare_and_swap(plockval, FLCK_MUTEX_UNLOCK, lockid)){
+			if(FLCK_MUTEX_UNLOCK == (oldval = __sync_val_compare_and_swap(plockval, FLCK_MUTEX_UNLOCK, (lockid | waiterbit)))){
 				// get lock --> count up lockcnt
 				__sync_fetch_and_add(plockcnt, 1);		// not need to check return value
 				return 0;
 			}
+
+		}else if(IS_FLCK_MUTEX_OWNER_DIED(oldval)){
+			// owner is dead --> take over it with keeping waiter bit
+			flck_mutex_t	deadval = oldval;
+			if(deadval == (oldval = __sync_val_compare_and_swap(plockval, deadval, (lockid | waiterbit | (deadval & FLCK_MUTEX_WAITER))))){
+				// lockcnt is dead owner's count, so reset it.
+				__sync_lock_test_and_set(plockcnt, 1);
+				return 0;
+			}
 		}
 		return EBUSY;
 	}
 
-	inline int fl_timedlock_mutex(flck_mutex_t* plockval, int* plockcnt, flckpid_t lockid, const struct timespec* limittime)
+	inline int fl_lock_mutex(flck_mutex_t* plockval, int* plockcnt, flckpid_t lockid, int max_count = FLCK_ROBUST_CHKCNT_NOLIMIT)
 	{
-		struct timespec	starttime;
-		if(-1 == clock_gettime(CLOCK_MONOTONIC, &starttime)){
-			return EBUSY;
-		}
-
-		do{
-			// do lock
-			if(lockid == *plockval){
-				// already locked --> count up lockcnt
-				int	oldcnt = __sync_fetch_and_add(plockcnt, 1);
-				if(0 <= oldcnt){
-					// success to count up --> check lockval(this is failed but get old value)
-					if(lockid == __sync_val_compare_and_swap(plockval, lockid, lockid)){
-						// success to lock
-						break;
-					}
-				}
-				// this case is unlocked before count up. So need to count down and retry.
-				__sync_fetch_and_sub(plockcnt, 1);
-
+		flck_mutex_t	oldval;
+		flck_mutex_t	waiterbit	= 0;
+		int				cnt			= 0;
+		for(int spincnt = 0; 0 != fl_raw_trylock_mutex(plockval, plockcnt, lockid, waiterbit, oldval); ++spincnt){
+			if(FLCK_ROBUST_CHKCNT_NOLIMIT != max_count && max_count < cnt){
+				return EWOULDBLOCK;			// EWOULDBLOCK
+			}
+			if(spincnt < FLCK_MUTEX_SPIN_LIMIT || FLCK_MUTEX_UNLOCK == oldval || IS_FLCK_MUTEX_OWNER_DIED(oldval)){
+				sched_yield();
+				++cnt;
 			}else{
-				// try lock
-				if(FLCK_MUTEX_UNLOCK == __sync_val_compare_and_swap(plockval, FLCK_MUTEX_UNLOCK, lockid)){
-					// get lock --> count up lockcnt
-					__sync_fetch_and_add(plockcnt, 1);		// not need to check return value
-					break;
+				if(!waiterbit){
+					// the exit of owner is pushed to worker thread while parking
+					WatchThreadProcess(decompose_pid(FLCK_MUTEX_OWNER(oldval)), decompose_tid(FLCK_MUTEX_OWNER(oldval)));
 				}
+				fl_park_mutex(plockval, oldval);
+				waiterbit	= FLCK_MUTEX_WAITER;
+				cnt			+= FLCK_MUTEX_PARK_WEIGHT;
 			}
+		}
+		return 0;
+	}
 
-			struct timespec	endtime;
-			if(-1 == clock_gettime(CLOCK_MONOTONIC, &endtime)){
-				return EBUSY;
-			}
-			if(IS_OVER_TIMESPEC(&starttime, &endtime, limittime)){
+	inline int fl_trylock_mutex(flck_mutex_t* plockval, int* plockcnt, flckpid_t lockid)
+	{
+		flck_mutex_t	oldval;
+		return fl_raw_trylock_mutex(plockval, plockcnt, lockid, 0, oldval);
+	}
+
+	inline int fl_timedlock_mutex(flck_mutex_t* plockval, int* plockcnt, flckpid_t lockid, const struct timespec* pdeadline)
+	{
+		flck_mutex_t	oldval;
+		flck_mutex_t	waiterbit = 0;
+		for(int cnt = 0; 0 != fl_raw_trylock_mutex(plockval, plockcnt, lockid, waiterbit, oldval); ++cnt){
+			if(flck_check_deadline(pdeadline, cnt)){
 				return ETIMEDOUT;
 			}
-		}while(-1 <= sched_yield());
+			if(cnt < FLCK_MUTEX_SPIN_LIMIT || FLCK_MUTEX_UNLOCK == oldval || IS_FLCK_MUTEX_OWNER_DIED(oldval)){
+				sched_yield();
+			}else{
+				fl_park_mutex(plockval, oldval, pdeadline);
+				waiterbit = FLCK_MUTEX_WAITER;
+				if(flck_is_over_deadline(pdeadline)){
+					if(0 == fl_raw_trylock_mutex(plockval, plockcnt, lockid, waiterbit, oldval)){
+						break;
+					}
+					// this may get the wakeup for another waiter, so pass it.
+					flck_futex_wake(fl_mutex_futex_addr(plockval), 1);
+					return ETIMEDOUT;
+				}
+			}
+		}
 		return 0;
 	}
 
@@ -371,10 +1015,11 @@ namespace fullock
 	{
 		do{
 			// do unlock
-			if(FLCK_MUTEX_UNLOCK == *plockval){
+			flck_mutex_t	curval = *plockval;
+			if(FLCK_MUTEX_UNLOCK == curval){
 				// already unlocked
 				break;
-			}else if(lockid != *plockval){
+			}else if(lockid != FLCK_MUTEX_OWNER(curval)){
 				// another process(thread) is owner.
 				return EPERM;
 			}else{
@@ -386,13 +1031,23 @@ namespace fullock
 						__sync_val_compare_and_swap(plockcnt, oldcnt, 0);	// not check result
 					}
 					// try unlock
-					flck_mutex_t	oldval;
-					if(lockid == (oldval = __sync_val_compare_and_swap(plockval, lockid, FLCK_MUTEX_UNLOCK)) || FLCK_MUTEX_UNLOCK == oldval){
-						// succeed to unlock
+					flck_mutex_t	oldval = *plockval;
+					if(FLCK_MUTEX_UNLOCK == oldval){
+						// already unlocked
+						break;
+					}
+					if(lockid == FLCK_MUTEX_OWNER(oldval) && oldval == __sync_val_compare_and_swap(plockval, oldval, FLCK_MUTEX_UNLOCK)){
+						// succeed to unlock, and wake up one waiter if there are parking waiters
+						if(IS_FLCK_MUTEX_WAITER(oldval)){
+							flck_futex_wake(fl_mutex_futex_addr(plockval), 1);
+						}
 						break;
 					}
 					// why? but do recover
 					__sync_fetch_and_add(plockcnt, 1);						// not check result
+				}else{
+					// still locked recursively
+					break;
 				}
 			}
 		}while(-1 <= sched_yield());
@@ -406,6 +1061,10 @@ namespace fullock
 			if(0 == oldcnt || oldcnt == __sync_val_compare_and_swap(plockcnt, oldcnt, 0)){
 				flck_mutex_t	oldval = *plockval;
 				if(FLCK_MUTEX_UNLOCK == oldval || oldval == __sync_val_compare_and_swap(plockval, oldval, FLCK_MUTEX_UNLOCK)){
+					// wake up all parking waiters, because the owner is dead
+					if(IS_FLCK_MUTEX_WAITER(oldval)){
+						flck_futex_wake(fl_mutex_futex_addr(plockval), INT_MAX);
+					}
 					break;
 				}
 			}
@@ -414,43 +1073,76 @@ namespace fullock
 		return 0;
 	}
 
-	inline int fl_wait_cond(FLCKLOCKTYPE* plockstatus, FLCKLOCKTYPE waitstatus)
+	inline int fl_force_set_cond(FLCKLOCKTYPE* plockstatus, FLCKLOCKTYPE newstatus)
 	{
-		while(waitstatus != __sync_val_compare_and_swap(plockstatus, waitstatus, waitstatus)){
+		FLCKLOCKTYPE	oldstatus1;
+		FLCKLOCKTYPE	oldstatus2;
+		for(oldstatus1 = *plockstatus; oldstatus1 != (oldstatus2 = __sync_val_compare_and_swap(plockstatus, oldstatus1, newstatus)); oldstatus1 = oldstatus2){
 			sched_yield();
 		}
 		return 0;
 	}
 
-	inline int fl_timedwait_cond(FLCKLOCKTYPE* plockstatus, FLCKLOCKTYPE waitstatus, const struct timespec* limittime)
+	//
+	// Parking for named cond waiter
+	//
+	// [NOTE]
+	// The lock status in waiter is used as futex word. The waiter spins with
+	// sched_yield up to FLCK_COND_SPIN_LIMIT times, after that parks on the
+	// futex while the status is FLCK_NCOND_WAIT. The signaler always calls
+	// FUTEX_WAKE after setting FLCK_NCOND_UP, thus the waiter does not need
+	// parking timeout for waking up.
+	//
+	inline int* fl_cond_futex_addr(FLCKLOCKTYPE* plockstatus)
 	{
-		struct timespec	starttime;
-		if(-1 == clock_gettime(CLOCK_MONOTONIC, &starttime)){
-			return EBUSY;
-		}
-		while(waitstatus != __sync_val_compare_and_swap(plockstatus, waitstatus, waitstatus)){
-			struct timespec	endtime;
-			if(-1 == clock_gettime(CLOCK_MONOTONIC, &endtime)){
-				return EBUSY;
+		return reinterpret_cast<int*>(plockstatus);
+	}
+
+	inline int fl_wait_cond(FLCKLOCKTYPE* plockstatus, FLCKLOCKTYPE waitstatus)
+	{
+		for(int count = 0; waitstatus != __sync_val_compare_and_swap(plockstatus, waitstatus, waitstatus); ++count){
+			if(count < FLCK_COND_SPIN_LIMIT){
+				sched_yield();
+				continue;
 			}
-			if(IS_OVER_TIMESPEC(&starttime, &endtime, limittime)){
-				return ETIMEDOUT;
+			FLCKLOCKTYPE	beforeval = *plockstatus;
+			if(waitstatus != beforeval){
+				// not need to check result(woken up, interrupted, or value was changed)
+				flck_futex_wait(fl_cond_futex_addr(plockstatus), static_cast<int>(beforeval));
 			}
-			sched_yield();
 		}
 		return 0;
 	}
 
-	inline int fl_force_set_cond(FLCKLOCKTYPE* plockstatus, FLCKLOCKTYPE newstatus)
+	inline int fl_timedwait_cond(FLCKLOCKTYPE* plockstatus, FLCKLOCKTYPE waitstatus, const struct timespec* pdeadline)
 	{
-		FLCKLOCKTYPE	oldstatus1;
-		FLCKLOCKTYPE	oldstatus2;
-		for(oldstatus1 = *plockstatus; oldstatus1 != (oldstatus2 = __sync_val_compare_and_swap(plockstatus, oldstatus1, newstatus)); oldstatus1 = oldstatus2){
-			sched_yield();
+		for(int count = 0; waitstatus != __sync_val_compare_and_swap(plockstatus, waitstatus, waitstatus); ++count){
+			if(flck_check_deadline(pdeadline, count)){
+				return ETIMEDOUT;
+			}
+			if(count < FLCK_COND_SPIN_LIMIT){
+				sched_yield();
+				continue;
+			}
+			FLCKLOCKTYPE	beforeval = *plockstatus;
+			if(waitstatus != beforeval){
+				// not need to check result(woken up, timeouted, interrupted, or value was changed)
+				flck_futex_wait_until(fl_cond_futex_addr(plockstatus), static_cast<int>(beforeval), pdeadline);
+				if(waitstatus != *plockstatus && flck_is_over_deadline(pdeadline)){
+					return ETIMEDOUT;
+				}
+			}
 		}
 		return 0;
 	}
 
+	inline int fl_signal_cond(FLCKLOCKTYPE* plockstatus)
+	{
+		fl_force_set_cond(plockstatus, FLCK_NCOND_UP);
+		flck_futex_wake(fl_cond_futex_addr(plockstatus), INT_MAX);
+		return 0;
+	}
+
 	template<typename T> inline void flck_lock_noshared_mutex(T* plockval)
 	{
 		T	oldval;
@@ -495,6 +1187,36 @@ namespace fullock
 		return __sync_fetch_and_sub(pcounter, static_cast<T>(1));
 	}
 
+	//
+	// Utility for hash index of named mutex/cond
+	//
+	inline uint8_t fl_index_tag(flck_hash_t hash)
+	{
+		return static_cast<uint8_t>(hash >> 56);			// bucket position is made from lower bits
+	}
+
+	// [NOTE]
+	// Compare all tags in a bucket at once(SWAR), the result has top bit of
+	// each byte which is same as tag. It may have false positive(never has
+	// false negative) after a matched byte, but caller checks hash and name.
+	//
+	inline uint64_t fl_match_index_tags(const uint8_t* ptags, uint8_t tag)
+	{
+		uint64_t	word;
+		memcpy(&word, ptags, sizeof(uint64_t));
+		word ^= 0x0101010101010101ULL * static_cast<uint64_t>(tag);
+		return ((word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL);
+	}
+
+	inline bool fl_is_index_tag_matched(uint64_t matched, size_t slot)
+	{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		return (0 != (matched & (0x80ULL << (slot * 8))));
+#else
+		return (0 != (matched & (0x80ULL << ((sizeof(uint64_t) - 1 - slot) * 8))));
+#endif
+	}
+
 	//---------------------------------------------------------
 	// fl_list_base template class
 	//---------------------------------------------------------
@@ -530,10 +1252,17 @@ namespace fullock
 			inline bool to_next(void) { if(pcurrent){ pcurrent = to_abs(pcurrent->next); return true; }else{ return false; } }
 			inline bool insert_list(st_ptr_type& preltop);
 			inline bool retrieve_list(st_ptr_type& preltop);
+			inline bool insert_free(flck_free_t& freetop);
+			inline bool retrieve_free(flck_free_t& freetop);
+			inline size_t retrieve_free(flck_free_t& freetop, size_t count);
+			inline bool insert_free(flck_free_t& freetop, st_ptr_type pabstail);
+			static inline st_ptr_type rel_free_top(flck_free_t freetop) { return reinterpret_cast<st_ptr_type>(FLCK_FREE_OFFSET(freetop)); }
 			inline bool cutoff_list(st_ptr_type& preltop) const;
 
 			inline bool find(const st_ptr_type pbase, st_ptr_type& preltop);
 			inline bool rfind(const st_ptr_type pbase, st_ptr_type& preltop);
+			template<typename B> inline bool find_index(const st_ptr_type pbase, B* prelbuckets, size_t count);
+			template<typename B> inline bool insert_index(B* prelbuckets, size_t count) const;
 
 			virtual void dump(std::ostream& out, int level) const;
 	};
@@ -620,6 +1349,127 @@ namespace fullock
 		return true;
 	}
 
+	// Insert one list object to top of free list.
+	//
+	// [NOTE]
+	// Free list is shared by all processes and is not protected by any
+	// lockid. Retrieving by CAS of only pointer has ABA problem, so the top
+	// of free list is tagged by generation which is counted up at each
+	// changing. Then both inserting and retrieving do not need any lockid.
+	// Reading next of top object which is already retrieved by another is
+	// safe, because the object is always in mapped area and CAS fails.
+	//
+	template<typename T>
+	inline bool fl_list_base<T>::insert_free(flck_free_t& freetop)
+	{
+		if(!pcurrent){
+			return false;
+		}
+		// cppcheck-suppress unmatchedSuppression
+		// cppcheck-suppress knownConditionTrueFalse
+		st_ptr_type	newreltop = to_rel(pcurrent);
+		flck_free_t	oldtop;
+		flck_free_t	newtop;
+		do{
+			oldtop			= freetop;
+			pcurrent->next	= rel_free_top(oldtop);
+			newtop			= FLCK_FREE_MAKE(FLCK_FREE_GEN(oldtop) + 1, reinterpret_cast<uintptr_t>(newreltop));
+		}while(oldtop != __sync_val_compare_and_swap(&freetop, oldtop, newtop));
+
+		return true;
+	}
+
+	// Retrieve one list object from top of free list.
+	//
+	template<typename T>
+	inline bool fl_list_base<T>::retrieve_free(flck_free_t& freetop)
+	{
+		flck_free_t	oldtop;
+		flck_free_t	newtop;
+		st_ptr_type	oldreltop;
+		do{
+			oldtop		= freetop;
+			oldreltop	= rel_free_top(oldtop);
+			if(!oldreltop){
+				return false;
+			}
+			// cppcheck-suppress unmatchedSuppression
+			// cppcheck-suppress knownConditionTrueFalse
+			newtop		= FLCK_FREE_MAKE(FLCK_FREE_GEN(oldtop) + 1, reinterpret_cast<uintptr_t>(to_abs(oldreltop)->next));
+
+		}while(oldtop != __sync_val_compare_and_swap(&freetop, oldtop, newtop));
+
+		pcurrent		= to_abs(oldreltop);
+		if(!pcurrent){
+			return false;
+		}
+		pcurrent->next	= nullval;
+
+		return true;
+	}
+
+	// Retrieve some list objects from top of free list at once.
+	// Current is set top of retrieved chain, and returns count in chain.
+	//
+	template<typename T>
+	inline size_t fl_list_base<T>::retrieve_free(flck_free_t& freetop, size_t count)
+	{
+		if(0 == count){
+			return 0;
+		}
+		flck_free_t	oldtop;
+		flck_free_t	newtop;
+		st_ptr_type	oldreltop;
+		st_ptr_type	pabstail;
+		size_t		retrieved;
+		do{
+			oldtop		= freetop;
+			oldreltop	= rel_free_top(oldtop);
+			if(!oldreltop){
+				return 0;
+			}
+			// [NOTE]
+			// If the free list is changed while walking, the generation is
+			// changed too. Then CAS fails and retries.
+			//
+			// cppcheck-suppress unmatchedSuppression
+			// cppcheck-suppress knownConditionTrueFalse
+			pabstail	= to_abs(oldreltop);
+			for(retrieved = 1; retrieved < count && pabstail->next; ++retrieved){
+				pabstail = to_abs(pabstail->next);
+			}
+			newtop		= FLCK_FREE_MAKE(FLCK_FREE_GEN(oldtop) + 1, reinterpret_cast<uintptr_t>(pabstail->next));
+
+		}while(oldtop != __sync_val_compare_and_swap(&freetop, oldtop, newtop));
+
+		pcurrent		= to_abs(oldreltop);
+		pabstail->next	= nullval;
+
+		return retrieved;
+	}
+
+	// Insert the chain(from current to pabstail) to top of free list at once.
+	//
+	template<typename T>
+	inline bool fl_list_base<T>::insert_free(flck_free_t& freetop, st_ptr_type pabstail)
+	{
+		if(!pcurrent || !pabstail){
+			return false;
+		}
+		// cppcheck-suppress unmatchedSuppression
+		// cppcheck-suppress knownConditionTrueFalse
+		st_ptr_type	newreltop = to_rel(pcurrent);
+		flck_free_t	oldtop;
+		flck_free_t	newtop;
+		do{
+			oldtop			= freetop;
+			pabstail->next	= rel_free_top(oldtop);
+			newtop			= FLCK_FREE_MAKE(FLCK_FREE_GEN(oldtop) + 1, reinterpret_cast<uintptr_t>(newreltop));
+		}while(oldtop != __sync_val_compare_and_swap(&freetop, oldtop, newtop));
+
+		return true;
+	}
+
 	template<typename T>
 	inline bool fl_list_base<T>::cutoff_list(st_ptr_type& preltop) const
 	{
@@ -701,6 +1551,69 @@ namespace fullock
 		return false;
 	}
 
+	// Find object in hash index(T must have hash member).
+	//
+	template<typename T>
+	template<typename B>
+	inline bool fl_list_base<T>::find_index(const st_ptr_type pbase, B* prelbuckets, size_t count)
+	{
+		if(!pbase || !prelbuckets || 0 == count){
+			return false;
+		}
+		B*		pabsbuckets	= to_abs(prelbuckets);
+		uint8_t	tag			= fl_index_tag(pbase->hash);
+		size_t	index		= static_cast<size_t>(pbase->hash) & (count - 1);
+		for(size_t cnt = 0; cnt < count; ++cnt, index = (index + 1) & (count - 1)){
+			B*			pbucket	= &pabsbuckets[index];
+			size_t		used	= pbucket->tags[FLCK_NAME_BUCKET_SLOTS];
+			uint64_t	matched	= fl_match_index_tags(pbucket->tags, tag);
+			for(size_t slot = 0; 0 != matched && slot < used; ++slot){
+				if(!fl_is_index_tag_matched(matched, slot)){
+					continue;
+				}
+				// cppcheck-suppress unmatchedSuppression
+				// cppcheck-suppress knownConditionTrueFalse
+				st_ptr_type	pabstarget = to_abs(pbucket->entries[slot]);
+				if(pabstarget && 0 == fl_compare_list_base(pbase, pabstarget)){
+					// set current
+					pcurrent = pabstarget;
+					return true;
+				}
+			}
+			if(used < FLCK_NAME_BUCKET_SLOTS){
+				// bucket is not full, so there is no more object for this hash.
+				break;
+			}
+		}
+		return false;
+	}
+
+	// Insert current object into hash index(T must have hash member).
+	//
+	template<typename T>
+	template<typename B>
+	inline bool fl_list_base<T>::insert_index(B* prelbuckets, size_t count) const
+	{
+		if(!pcurrent || !prelbuckets || 0 == count){
+			return false;
+		}
+		B*		pabsbuckets	= to_abs(prelbuckets);
+		size_t	index		= static_cast<size_t>(pcurrent->hash) & (count - 1);
+		for(size_t cnt = 0; cnt < count; ++cnt, index = (index + 1) & (count - 1)){
+			B*		pbucket	= &pabsbuckets[index];
+			size_t	used	= pbucket->tags[FLCK_NAME_BUCKET_SLOTS];
+			if(used < FLCK_NAME_BUCKET_SLOTS){
+				// set entry and tag before count up
+				pbucket->entries[used]	= to_rel(pcurrent);
+				pbucket->tags[used]		= fl_index_tag(pcurrent->hash);
+				__sync_synchronize();
+				pbucket->tags[FLCK_NAME_BUCKET_SLOTS] = static_cast<uint8_t>(used + 1);
+				return true;
+			}
+		}
+		return false;
+	}
+
 	template<typename T>
 	void fl_list_base<T>::dump(std::ostream& out, int level) const
 	{
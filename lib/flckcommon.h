@@ -53,6 +53,7 @@ typedef pid_t						tid_t;
 typedef	uint64_t					flckpid_t;
 typedef	flckpid_t					flck_mutex_t;
 typedef	int							flck_rwlock_t;
+typedef	uint32_t					flck_ticket_t;			// counter for phase-fair ticket rwlock
 
 #define	__STDC_FORMAT_MACROS
 #include <inttypes.h>
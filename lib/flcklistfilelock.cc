@@ -46,11 +46,14 @@ void FlListFileLock::dump(std::ostream &out, int level) const
 	out << spacer2 << "ino_id            = " << pcurrent->ino_id	<< std::endl;
 	out << spacer2 << "protect           = " << (pcurrent->protect ? "true" : "false") << std::endl;
 
-	FlListOffLock	tmpobj;
-
-	out << spacer2 << "offset_lock_list={" << std::endl;
-	for(PFLOFFLOCK ptmp = to_abs(pcurrent->offset_lock_list); ptmp; ptmp = to_abs(ptmp->next)){
-		tmpobj.set(ptmp);
+	FlListOffLock			tmpobj;
+	std::vector<PFLOFFLOCK>	abslist;
+	FlListOffLock::get_tree_list(pcurrent->offset_lock_tree, abslist);
+
+	out << spacer2 << "offset_lock_tree  = " << to_hexstring(pcurrent->offset_lock_tree) << std::endl;
+	out << spacer2 << "offset_lock_tree={" << std::endl;
+	for(std::vector<PFLOFFLOCK>::const_iterator iter = abslist.begin(); iter != abslist.end(); ++iter){
+		tmpobj.set(*iter);
 		tmpobj.dump(out, level + 2);
 	}
 	out << spacer2 << "}" << std::endl;
@@ -68,11 +71,12 @@ int FlListFileLock::rawlock(FLCKLOCKTYPE LockType, flckpid_t flckpid, int fd, of
 		flckpid = get_flckpid();
 	}
 
-	int	result	= 0;
+	PFLFILEBUCKET	pbucket	= fl_get_filelock_bucket(pcurrent->dev_id, pcurrent->ino_id);		// bucket lockid is locked now
+	int				result	= 0;
 	if(FLCK_UNLOCK == LockType){
 		// UNLOCK
 		FlListOffLock	tglistobj;
-		if(!tglistobj.find(offset, length, pcurrent->offset_lock_list)){
+		if(!tglistobj.find(offset, length, pcurrent->offset_lock_tree)){
 			// not found target.
 			ERR_FLCKPRN("Could not find locking offset object for pid(%d), tid(%d), fd(%d), offset(%zd), length(%zu).", decompose_pid(flckpid), decompose_tid(flckpid), fd, offset, length);
 			return EINVAL;						// EINVAL
@@ -87,10 +91,10 @@ int FlListFileLock::rawlock(FLCKLOCKTYPE LockType, flckpid_t flckpid, int fd, of
 		// check free
 		if(FlShm::IsFreeUnitOffset()){
 			if(!tglistobj.is_locked()){
-				// retrieve target list
-				if(tglistobj.cutoff_list(pcurrent->offset_lock_list)){
+				// retrieve target tree
+				if(tglistobj.cutoff_tree(pcurrent->offset_lock_tree)){
 					// return object to free list
-					if(!tglistobj.insert_list(FlShm::pFlHead->offset_lock_free)){
+					if(!tglistobj.insert_free(FlShm::pFlHead->offset_lock_free)){
 						ERR_FLCKPRN("Failed to insert offset lock to free list, but continue...");
 					}
 				}
@@ -100,30 +104,30 @@ int FlListFileLock::rawlock(FLCKLOCKTYPE LockType, flckpid_t flckpid, int fd, of
 	}else{
 		// LOCK
 		FlListOffLock	tglistobj;
-		if(!tglistobj.find(offset, length, pcurrent->offset_lock_list)){
+		if(!tglistobj.find(offset, length, pcurrent->offset_lock_tree)){
 			// Not found, so get new offset lock and insert it.
-			if(!tglistobj.retrieve_list(FlShm::pFlHead->offset_lock_free)){
+			if(!tglistobj.retrieve_free(FlShm::pFlHead->offset_lock_free) && (!FlShm::GrowArea(FlShm::pFlHead->offset_lock_free) || !tglistobj.retrieve_free(FlShm::pFlHead->offset_lock_free))){
 				ERR_FLCKPRN("Could not get free offset lock structure.");
-				fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// unlock lockid
+				fl_unlock_lockid(&(pbucket->lockid), flckpid);		// unlock lockid
 				return ENOLCK;					// ENOLCK
 			}
 			// initialize
 			tglistobj.initialize(offset, length, true, true);
 
-			// insert offset lock into list
-			if(!tglistobj.insert_list(pcurrent->offset_lock_list)){
-				ERR_FLCKPRN("Failed to insert offset lock to top list.");
+			// insert offset lock into tree
+			if(!tglistobj.insert_tree(pcurrent->offset_lock_tree)){
+				ERR_FLCKPRN("Failed to insert offset lock to tree.");
 				// for recover
-				if(!tglistobj.insert_list(FlShm::pFlHead->offset_lock_free)){
+				if(!tglistobj.insert_free(FlShm::pFlHead->offset_lock_free)){
 					ERR_FLCKPRN("Failed to insert offset lock to free list, but continue...");
 				}
-				fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// unlock lockid
+				fl_unlock_lockid(&(pbucket->lockid), flckpid);		// unlock lockid
 				return ENOLCK;					// ENOLCK
 			}
 		}else{
 			tglistobj.set_protect();
 		}
-		// clear protect flag(because offset lock list is existed now)
+		// clear protect flag(because offset lock tree is existed now)
 		pcurrent->protect = false;
 
 		// do lock(unlocked lockid after this )
@@ -133,20 +137,20 @@ int FlListFileLock::rawlock(FLCKLOCKTYPE LockType, flckpid_t flckpid, int fd, of
 			// check remove offset lock for recover...
 			//
 			if(FlShm::IsFreeUnitOffset()){
-				fl_lock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);	// lock lockid
+				fl_lock_lockid(&(pbucket->lockid), flckpid);	// lock lockid
 
-				if(tglistobj.find(offset, length, pcurrent->offset_lock_list)){
+				if(tglistobj.find(offset, length, pcurrent->offset_lock_tree)){
 					if(!tglistobj.is_locked()){
-						// retrieve target list
-						if(tglistobj.cutoff_list(pcurrent->offset_lock_list)){
+						// retrieve target tree
+						if(tglistobj.cutoff_tree(pcurrent->offset_lock_tree)){
 							// return object to free list
-							if(!tglistobj.insert_list(FlShm::pFlHead->offset_lock_free)){
+							if(!tglistobj.insert_free(FlShm::pFlHead->offset_lock_free)){
 								ERR_FLCKPRN("Failed to insert offset lock to free list, but continue...");
 							}
 						}
 					}
 				}
-				fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);	// unlock lockid
+				fl_unlock_lockid(&(pbucket->lockid), flckpid);	// unlock lockid
 			}
 			return result;
 		}
@@ -163,29 +167,25 @@ bool FlListFileLock::check_dead_lock(fl_pid_cache_map_t* pcache, flckpid_t excep
 		ERR_FLCKPRN("Object is not initialized.");
 		return false;
 	}
-	FlListOffLock	tmpobj;
+	FlListOffLock			tmpobj;
+	std::vector<PFLOFFLOCK>	abslist;
+
+	// [NOTE]
+	// Removing node changes the tree, so we get all nodes before checking.
+	//
+	FlListOffLock::get_tree_list(pcurrent->offset_lock_tree, abslist);
 
-	// check offset list
-	for(PFLOFFLOCK pabsparent = NULL, pabscur = to_abs(pcurrent->offset_lock_list); pabscur; ){
-		tmpobj.set(pabscur);
+	// check offset tree
+	for(std::vector<PFLOFFLOCK>::const_iterator iter = abslist.begin(); iter != abslist.end(); ++iter){
+		tmpobj.set(*iter);
 		if(tmpobj.check_dead_lock(pcurrent->dev_id, pcurrent->ino_id, pcache, except_flckpid, except_fd)){
-			// retrieve target list
-			if(tmpobj.cutoff_list(pcurrent->offset_lock_list)){
+			// retrieve target tree
+			if(tmpobj.cutoff_tree(pcurrent->offset_lock_tree)){
 				// return object to free list
-				if(!tmpobj.insert_list(FlShm::pFlHead->offset_lock_free)){
+				if(!tmpobj.insert_free(FlShm::pFlHead->offset_lock_free)){
 					ERR_FLCKPRN("Failed to insert offset lock to free list, but continue...");
 				}
 			}
-			// set next
-			if(pabsparent){
-				pabscur	= to_abs(pabsparent->next);
-			}else{
-				pabscur = to_abs(pcurrent->offset_lock_list);
-			}
-		}else{
-			// set next
-			pabsparent	= pabscur;
-			pabscur		= to_abs(pabscur->next);
 		}
 	}
 	return !is_locked();
@@ -202,39 +202,45 @@ bool FlListFileLock::is_locked(void) const
 	if(pcurrent->protect){
 		return true;
 	}
-	// check offset list
-	FlListOffLock	tmpobj;
-	for(PFLOFFLOCK pabscur = to_abs(pcurrent->offset_lock_list); pabscur; pabscur = to_abs(pabscur->next)){
-		tmpobj.set(pabscur);
-		if(tmpobj.is_locked()){
-			return true;
-		}
+	// check offset tree
+	return FlListOffLock::is_locked_tree(pcurrent->offset_lock_tree);
+}
+
+//
+// Returns true only when some offset lock is locked by lockers now,
+// protected or pinned by handle is not locking.
+// Need to lock list before calling this.
+//
+bool FlListFileLock::has_locker(void) const
+{
+	if(!pcurrent){
+		return false;
 	}
-	return false;
+	return FlListOffLock::has_locker_tree(pcurrent->offset_lock_tree);
 }
 
-bool FlListFileLock::free_offset_lock_list(void)
+bool FlListFileLock::free_offset_lock_tree(void)
 {
 	if(!pcurrent){
 		ERR_FLCKPRN("Object is not initialized.");
 		return false;
 	}
-	FlListOffLock	tmpobj;
+	FlListOffLock			tmpobj;
+	std::vector<PFLOFFLOCK>	abslist;
 
-	// check offset list
-	for(PFLOFFLOCK pabsnext = NULL, pabscur = to_abs(pcurrent->offset_lock_list); pabscur; pabscur = pabsnext){
-		pabsnext = to_abs(pabscur->next);
+	FlListOffLock::get_tree_list(pcurrent->offset_lock_tree, abslist);
+	pcurrent->offset_lock_tree = NULL;
 
-		tmpobj.set(pabscur);
+	// check offset tree
+	for(std::vector<PFLOFFLOCK>::const_iterator iter = abslist.begin(); iter != abslist.end(); ++iter){
+		tmpobj.set(*iter);
 		tmpobj.free_locker_list();
 
 		// return object to free list
-		if(!tmpobj.insert_list(FlShm::pFlHead->offset_lock_free)){
+		if(!tmpobj.insert_free(FlShm::pFlHead->offset_lock_free)){
 			ERR_FLCKPRN("Failed to insert offset lock to free list, but continue...");
 		}
 	}
-	pcurrent->offset_lock_list = NULL;
-
 	return true;
 }
 
@@ -53,7 +53,7 @@ class FlListFileLock : public fllistbasefilelock
 				}
 				pcurrent->dev_id			= dev_id;
 				pcurrent->ino_id			= ino_id;
-				pcurrent->offset_lock_list	= NULL;
+				pcurrent->offset_lock_tree	= NULL;
 				pcurrent->protect			= protect;
 			}
 		}
@@ -69,8 +69,9 @@ class FlListFileLock : public fllistbasefilelock
 		}
 
 		bool is_locked(void) const;
+		bool has_locker(void) const;
 		inline void set_protect(void) { if(pcurrent){ pcurrent->protect = true; } }
-		bool free_offset_lock_list(void);
+		bool free_offset_lock_tree(void);
 
 		inline int lock(FLCKLOCKTYPE LockType, flckpid_t flckpid, int fd, off_t offset, size_t length, time_t timeout_usec = FLCK_NO_TIMEOUT) { return rawlock(LockType, flckpid, fd, offset, length, timeout_usec); }
 		inline int unlock(flckpid_t flckpid, int fd, off_t offset, size_t length) { return rawlock(FLCK_UNLOCK, flckpid, fd, offset, length, FLCK_NO_TIMEOUT); }
@@ -40,6 +40,8 @@ void FlListLocker::dump(std::ostream &out, int level) const
 	out << spacer2 << "flckpid           = " << pcurrent->flckpid	<< std::endl;
 	out << spacer2 << "fd                = " << pcurrent->fd		<< std::endl;
 	out << spacer2 << "locked            = " << (pcurrent->locked ? "locked" : "not locked")	<< std::endl;
+	out << spacer2 << "upgrading         = " << (pcurrent->upgrading ? "true" : "false")	<< std::endl;
+	out << spacer2 << "pfticket          = {type=" << pcurrent->pfticket.type << ", ticket=" << pcurrent->pfticket.ticket << ", rticket=" << pcurrent->pfticket.rticket << ", dead=" << (pcurrent->pfticket.dead ? "true" : "false") << "}" << std::endl;
 	out << spacer1 << "}" << std::endl;
 }
 
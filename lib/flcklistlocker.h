@@ -52,6 +52,11 @@ class FlListLocker : public fllistbaselocker
 				pcurrent->flckpid		= flckpid;
 				pcurrent->fd			= fd;
 				pcurrent->locked		= locked;
+				pcurrent->upgrading		= false;
+				pcurrent->pfticket.type	= FLCK_PFTICKET_NONE;
+				pcurrent->pfticket.ticket	= 0;
+				pcurrent->pfticket.rticket	= 0;
+				pcurrent->pfticket.dead	= false;
 			}
 		}
 		virtual bool initialize(PFLLOCKER ptr, size_t count) { return fllistbaselocker::initialize(ptr, count); }
@@ -62,10 +67,16 @@ class FlListLocker : public fllistbaselocker
 		inline bool is_locked(void) const { return (pcurrent && pcurrent->locked); }
 		inline void set_lock(void) { if(pcurrent){ pcurrent->locked = true; } }
 		inline void set_unlock(void) { if(pcurrent){ pcurrent->locked = false; } }
+		inline bool is_upgrading(void) const { return (pcurrent && pcurrent->upgrading); }
+		inline void set_upgrading(bool upgrading) { if(pcurrent){ pcurrent->upgrading = upgrading; } }
+		inline PFLPFTICKET get_pfticket(void) const { return (pcurrent ? &(pcurrent->pfticket) : NULL); }
+		inline bool has_pfticket(void) const { return (pcurrent && FLCK_PFTICKET_NONE != pcurrent->pfticket.type); }
+		inline bool is_pfticket_dead(void) const { return (pcurrent && pcurrent->pfticket.dead); }
+		inline void set_pfticket_dead(void) { if(pcurrent){ pcurrent->pfticket.dead = true; } }
 
 		inline bool find(flckpid_t flckpid, int fd, bool locked, PFLLOCKER& preltop)
 		{
-			FLLOCKER tmp = {NULL, flckpid, fd, locked};
+			FLLOCKER tmp = {NULL, flckpid, fd, locked, false, {FLCK_PFTICKET_NONE, 0, 0, false}};
 			return fllistbaselocker::find(&tmp, preltop);
 		}
 
@@ -53,6 +53,15 @@ void FlListNCond::dump(std::ostream &out, int level) const
 	}
 	out << spacer2 << "}" << std::endl;
 
+	out << spacer2 << "waiter_tail       = "	<< to_hexstring(pcurrent->waiter_tail)	<< std::endl;
+
+	out << spacer2 << "signaled_list={" << std::endl;
+	for(PFLWAITER ptmp = to_abs(pcurrent->signaled_list); ptmp; ptmp = to_abs(ptmp->next)){
+		tmpobj.set(ptmp);
+		tmpobj.dump(out, level + 2);
+	}
+	out << spacer2 << "}" << std::endl;
+
 	out << spacer1 << "}" << std::endl;
 }
 
@@ -70,26 +79,46 @@ int FlListNCond::rawlock(FLCKLOCKTYPE LockType, bool is_broadcast, PFLNAMEDMUTEX
 
 		if(is_broadcast){
 			// BROADCAST
+			//
+			// [NOTE]
+			// Only the oldest waiter is woken up, and other waiters for the
+			// same named mutex are moved to requeue list in that mutex. They
+			// are woken up one by one at unlocking the mutex, so that they do
+			// not rush to the mutex at once. The waiters for other mutex are
+			// woken up here.
+			// Requeuing must be done before waking up the oldest waiter,
+			// because the waiter unlocks the mutex after this.
+			//
+			FlListWaiter	topobj;
+			if(!topobj.pop_queue(pcurrent->waiter_list, pcurrent->waiter_tail)){
+				MSG_FLCKPRN("There is no waiter for broadcast.");
+				return 0;					// Success
+			}
 			FlListWaiter	tmpobj;
-			for(PFLWAITER ptmp = to_abs(pcurrent->waiter_list); ptmp; ptmp = to_abs(ptmp->next)){
-				tmpobj.set(ptmp);
-				if(tmpobj.is_wait()){
-					// wake up waiter
-					int	subresult;
-					if(0 != (subresult = tmpobj.signal())){
-						ERR_FLCKPRN("Failed to send signal to waiter(error code=%d).", subresult);
-						if(0 == result){
-							result = subresult;
-						}
+			while(tmpobj.pop_queue(pcurrent->waiter_list, pcurrent->waiter_tail)){
+				tmpobj.insert_list(pcurrent->signaled_list);
+				if(tmpobj.is_same_mutex(topobj) && tmpobj.requeue()){
+					continue;
+				}
+				// wake up waiter
+				int	subresult;
+				if(0 != (subresult = tmpobj.signal())){
+					ERR_FLCKPRN("Failed to send signal to waiter(error code=%d).", subresult);
+					if(0 == result){
+						result = subresult;
 					}
 				}
 			}
+			topobj.insert_list(pcurrent->signaled_list);
+			if(0 != (result = topobj.signal())){
+				ERR_FLCKPRN("Failed to send signal to waiter.");
+			}
 
 		}else{	// SIGNAL
-			// get end of waiter list
+			// get the oldest waiter
 			FlListWaiter	tglistobj;
-			if(!tglistobj.rfind(FLCK_NCOND_WAIT, pcurrent->waiter_list)){
-				WAN_FLCKPRN("Could not get end of waiter list, maybe no waiter.");
+			if(!tglistobj.pop_queue(pcurrent->waiter_list, pcurrent->waiter_tail)){
+				WAN_FLCKPRN("Could not get top of waiter list, maybe no waiter.");
 				return 0;					// Success
 			}
 
@@ -97,6 +126,7 @@ int FlListNCond::rawlock(FLCKLOCKTYPE LockType, bool is_broadcast, PFLNAMEDMUTEX
 			if(0 != (result = tglistobj.signal())){
 				ERR_FLCKPRN("Failed to send signal to waiter.");
 			}
+			tglistobj.insert_list(pcurrent->signaled_list);
 		}
 
 	}else{
@@ -109,7 +139,8 @@ int FlListNCond::rawlock(FLCKLOCKTYPE LockType, bool is_broadcast, PFLNAMEDMUTEX
 
 		// Always get new waiter object.
 		FlListWaiter	tglistobj;
-		if(!tglistobj.retrieve_list(FlShm::pFlHead->waiter_free)){
+		tglistobj.set(FlShm::RetrieveWaiter());
+		if(!tglistobj.get()){
 			ERR_FLCKPRN("Could not get waiter structure.");
 			fl_unlock_lockid(&FlShm::pFlHead->named_cond_lockid, flckpid);			// unlock lockid
 			return ENOLCK;					// ENOLCK
@@ -117,12 +148,12 @@ int FlListNCond::rawlock(FLCKLOCKTYPE LockType, bool is_broadcast, PFLNAMEDMUTEX
 		// initialize
 		tglistobj.initialize(flckpid, FLCK_NCOND_WAIT, abs_nmtx, false);
 
-		// insert waiter into list
-		if(!tglistobj.insert_list(pcurrent->waiter_list)){
+		// insert waiter into the end of queue
+		if(!tglistobj.push_queue(pcurrent->waiter_list, pcurrent->waiter_tail)){
 			ERR_FLCKPRN("Failed to insert waiter to top list.");
 
 			// for recover
-			if(!tglistobj.insert_list(FlShm::pFlHead->waiter_free)){
+			if(!FlShm::InsertFreeWaiter(tglistobj.get())){
 				ERR_FLCKPRN("Failed to insert waiter to free list, but continue...");
 			}
 			fl_unlock_lockid(&FlShm::pFlHead->named_cond_lockid, flckpid);			// unlock lockid
@@ -134,10 +165,24 @@ int FlListNCond::rawlock(FLCKLOCKTYPE LockType, bool is_broadcast, PFLNAMEDMUTEX
 		result = tglistobj.wait(timeout_usec);
 
 		// retrieve waiter from list
+		//
+		// [NOTE]
+		// The waiter which is still waiting(timeouted or failed) is in the
+		// waiting queue, otherwise it is moved into signaled list.
+		//
+		// If the waiter which is woken up could not get the mutex, it never
+		// unlocks the mutex. Thus the next requeued waiter is woken up here.
+		//
 		fl_lock_lockid(&FlShm::pFlHead->named_cond_lockid, flckpid);				// relock lockid
-		if(tglistobj.cutoff_list(pcurrent->waiter_list)){
+		if(!tglistobj.is_wait() && !tglistobj.is_requeue() && abs_nmtx->requeue_list && flckpid != FLCK_MUTEX_OWNER(abs_nmtx->lockval)){
+			FlListWaiter::wake_requeue(abs_nmtx);
+		}
+		if(tglistobj.is_requeue() && !tglistobj.cutoff_requeue()){
+			ERR_FLCKPRN("Could not retrieve waiter from requeue list, but continue...");
+		}
+		if(tglistobj.is_wait() ? tglistobj.cutoff_queue(pcurrent->waiter_list, pcurrent->waiter_tail) : tglistobj.cutoff_list(pcurrent->signaled_list)){
 			// put back waiter to free
-			if(!tglistobj.insert_list(FlShm::pFlHead->waiter_free)){
+			if(!FlShm::InsertFreeWaiter(tglistobj.get())){
 				ERR_FLCKPRN("Failed to insert waiter to free list, but continue...");
 			}
 		}else{
@@ -163,10 +208,10 @@ bool FlListNCond::check_dead_lock(fl_pid_cache_map_t* pcache, flckpid_t except_f
 	for(PFLWAITER pabsparent = NULL, pabscur = to_abs(pcurrent->waiter_list); pabscur; ){
 		tmpobj.set(pabscur);
 		if(tmpobj.check_dead_lock(pcache, except_flckpid)){
-			// retrieve target list
-			if(tmpobj.cutoff_list(pcurrent->waiter_list)){
+			// retrieve target from queue
+			if(tmpobj.cutoff_queue(pcurrent->waiter_list, pcurrent->waiter_tail)){
 				// return object to free list
-				if(!tmpobj.insert_list(FlShm::pFlHead->waiter_free)){
+				if(!FlShm::InsertFreeWaiter(tmpobj.get())){
 					ERR_FLCKPRN("Failed to insert waiter to free list, but continue...");
 				}
 			}
@@ -184,6 +229,38 @@ bool FlListNCond::check_dead_lock(fl_pid_cache_map_t* pcache, flckpid_t except_f
 			pabscur		= to_abs(pabscur->next);
 		}
 	}
+	for(PFLWAITER pabsparent = NULL, pabscur = to_abs(pcurrent->signaled_list); pabscur; ){
+		tmpobj.set(pabscur);
+		if(tmpobj.check_dead_lock(pcache, except_flckpid)){
+			// retrieve target from requeue list, or pass the turn of waking
+			// up to next requeued waiter when the dead waiter is woken up.
+			if(tmpobj.is_requeue()){
+				tmpobj.cutoff_requeue();
+			}else if(pabscur->named_mutex){
+				FlListWaiter::wake_requeue(to_abs(pabscur->named_mutex));
+			}
+
+			// retrieve target list
+			if(tmpobj.cutoff_list(pcurrent->signaled_list)){
+				// return object to free list
+				if(!FlShm::InsertFreeWaiter(tmpobj.get())){
+					ERR_FLCKPRN("Failed to insert waiter to free list, but continue...");
+				}
+			}
+
+			// set next
+			if(pabsparent){
+				pabscur	= to_abs(pabsparent->next);
+			}else{
+				pabscur = to_abs(pcurrent->signaled_list);
+			}
+			is_deadlock_found = true;
+		}else{
+			// set next
+			pabsparent	= pabscur;
+			pabscur		= to_abs(pabscur->next);
+		}
+	}
 	return is_deadlock_found;
 }
 
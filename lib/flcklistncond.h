@@ -63,6 +63,8 @@ class FlListNCond : public fllistbasencond
 				// initialize cond
 				if(is_all){
 					pcurrent->waiter_list	= NULL;
+					pcurrent->waiter_tail	= NULL;
+					pcurrent->signaled_list	= NULL;
 				}
 			}
 		}
@@ -71,7 +73,9 @@ class FlListNCond : public fllistbasencond
 		virtual void initialize(void) { initialize(NULL, true); }
 		virtual void dump(std::ostream& out, int level) const;
 
-		inline bool find(const char* pname, PFLNAMEDCOND& preltop)
+		// Methods for hash index(need to lock list before calling these)
+		//
+		inline bool find(const char* pname)
 		{
 			FLNAMEDCOND 	tmp;
 			if(!FLCKEMPTYSTR(pname)){
@@ -82,8 +86,13 @@ class FlListNCond : public fllistbasencond
 				tmp.name[0]	= '\0';
 				tmp.hash	= 0;
 			}
-			return fllistbasencond::find(&tmp, preltop);
+			if(fllistbasencond::find_index(&tmp, FlShm::pFlHead->named_cond_hash, FlShm::pFlHead->named_cond_hash_cnt)){
+				return true;
+			}
+			// some objects are only in list when hash index is full
+			return (0 < FlShm::pFlHead->named_cond_overflow && fllistbasencond::find(&tmp, FlShm::pFlHead->named_cond_list));
 		}
+		inline bool insert_index(void) const { return fllistbasencond::insert_index(FlShm::pFlHead->named_cond_hash, FlShm::pFlHead->named_cond_hash_cnt); }
 
 		inline int wait(PFLNAMEDMUTEX abs_nmtx, time_t timeout_usec = FLCK_NO_TIMEOUT) { return rawlock(FLCK_NCOND_WAIT, false, abs_nmtx, timeout_usec); }
 		inline int signal(void) { return rawlock(FLCK_NCOND_UP, false, NULL, FLCK_NO_TIMEOUT); }
@@ -19,6 +19,8 @@
 #include <time.h>
 
 #include "flcklistnmtx.h"
+#include "flcklistwaiter.h"
+#include "flckrobustlist.h"
 #include "flckutil.h"
 #include "flckdbg.h"
 
@@ -42,6 +44,8 @@ void FlListNMtx::dump(std::ostream &out, int level) const
 
 	out << spacer2 << "hash              = "	<< to_hexstring(pcurrent->hash)	<< std::endl;
 	out << spacer2 << "name              = \""	<< pcurrent->name				<< "\""<< std::endl;
+	out << spacer2 << "requeue_list      = "	<< to_hexstring(pcurrent->requeue_list)	<< std::endl;
+	out << spacer2 << "requeue_tail      = "	<< to_hexstring(pcurrent->requeue_tail)	<< std::endl;
 
 	out << spacer1 << "}" << std::endl;
 }
@@ -57,20 +61,51 @@ int FlListNMtx::rawlock(FLCKLOCKTYPE LockType, time_t timeout_usec)
 	int			result	= 0;
 	if(FLCK_UNLOCK == LockType){
 		// UNLOCK
+		//
+		// [NOTE]
+		// The entry is unlinked from robust list before releasing, because
+		// the next owner overwrites it. This is decided by the entry, not by
+		// the mode, because the mode may be changed while locking.
+		//
+		bool	is_robust_list = (1 == pcurrent->lockcnt && flckpid == FLCK_MUTEX_OWNER(pcurrent->lockval) && FlckRobustList::IsQueued(pcurrent));
+		if(is_robust_list){
+			FlckRobustList::SetPending(pcurrent);
+			FlckRobustList::Dequeue(pcurrent);
+		}
 		if(0 != (result = fl_unlock_mutex(&(pcurrent->lockval), &(pcurrent->lockcnt), flckpid))){
 			ERR_FLCKPRN("Could not unlock mutex(error code=%d), but continue...", result);
+		}else if(has_requeue() && flckpid != FLCK_MUTEX_OWNER(pcurrent->lockval)){
+			// released mutex, then wake up one of cond waiters requeued by broadcast
+			wake_requeue(flckpid);
+		}
+		if(is_robust_list){
+			FlckRobustList::ClearPending();
 		}
 
 	}else{
 		// LOCK
+		//
+		// [NOTE]
+		// On robust list mode, the mutex is set as pending entry while locking,
+		// and linked to robust list after getting it. The entry which is left
+		// by the previous owner is always cleared at getting it.
+		//
+		bool	is_robust_list = (FlShm::IsRobustList() && FlckRobustList::IsSupported());
+		if(is_robust_list){
+			FlckRobustList::SetPending(pcurrent);
+		}
 		do{
 			if(FLCK_NO_TIMEOUT == timeout_usec){
 				result = fl_lock_mutex(&(pcurrent->lockval), &(pcurrent->lockcnt), flckpid, (FlShm::IsHighRobust() ? FlShm::GetRobustLoopCnt() : FLCK_ROBUST_CHKCNT_NOLIMIT));
 			}else if(FLCK_TRY_TIMEOUT == timeout_usec){
 				result = fl_trylock_mutex(&(pcurrent->lockval), &(pcurrent->lockcnt), flckpid);
 			}else{
-				struct timespec	timeout = {(timeout_usec / (1000 * 1000)), ((timeout_usec % (1000 * 1000)) * 1000)};
-				result = fl_timedlock_mutex(&(pcurrent->lockval), &(pcurrent->lockcnt), flckpid, &timeout);
+				struct timespec	deadline;
+				if(!flck_set_deadline(&deadline, timeout_usec)){
+					result = EBUSY;
+				}else{
+					result = fl_timedlock_mutex(&(pcurrent->lockval), &(pcurrent->lockcnt), flckpid, &deadline);
+				}
 			}
 			if(0 != result){
 				if(EBUSY == result){
@@ -87,10 +122,38 @@ int FlListNMtx::rawlock(FLCKLOCKTYPE LockType, time_t timeout_usec)
 				}
 			}
 		}while(EWOULDBLOCK == result);
+
+		if(0 == result && 1 == pcurrent->lockcnt){
+			if(is_robust_list){
+				FlckRobustList::Enqueue(pcurrent);
+			}else if(FlckRobustList::IsSupported()){
+				FlckRobustList::Clear(pcurrent);
+			}
+		}
+		if(is_robust_list){
+			FlckRobustList::ClearPending();
+		}
 	}
 	return result;
 }
 
+// Wake up the top waiter in requeue list.
+//
+// [NOTE]
+// The requeue list is protected by named cond lockid, and this method
+// locks it. Named mutex lockid may be locked before calling this, but
+// named cond lockid is never locked before locking named mutex lockid.
+//
+void FlListNMtx::wake_requeue(flckpid_t flckpid)
+{
+	if(!pcurrent){
+		return;
+	}
+	fl_lock_lockid(&FlShm::pFlHead->named_cond_lockid, flckpid);				// lock lockid
+	FlListWaiter::wake_requeue(pcurrent);
+	fl_unlock_lockid(&FlShm::pFlHead->named_cond_lockid, flckpid);				// unlock lockid
+}
+
 // Returns	false	: does not dead lock
 //			true	: this object is dead lock and force unlock this.
 //
@@ -101,22 +164,29 @@ bool FlListNMtx::check_dead_lock(fl_pid_cache_map_t* pcache, flckpid_t except_fl
 		return false;
 	}
 
-	flck_mutex_t	lockval = pcurrent->lockval;
+	flck_mutex_t	rawval	= pcurrent->lockval;
+	flck_mutex_t	lockval = FLCK_MUTEX_OWNER(rawval);
 	if(lockval == except_flckpid || FLCK_MUTEX_UNLOCK == lockval){
 		return false;
 	}
 
-	// check thread(process) dead.
-	pid_t	pid = decompose_pid(lockval);
-	tid_t	tid = decompose_tid(lockval);
-	if(FindThreadProcess(pid, tid, pcache)){
-		return false;
+	// check thread(process) dead, the kernel already marked it when the owner was on robust list.
+	if(!IS_FLCK_MUTEX_OWNER_DIED(rawval)){
+		pid_t	pid = decompose_pid(lockval);
+		tid_t	tid = decompose_tid(lockval);
+		if(FindThreadProcess(pid, tid, pcache)){
+			return false;
+		}
 	}
 
 	// thread(process) does not run, so mutex is dead lock
 	// do force unlock
 	fl_force_unlock_mutex(&(pcurrent->lockval), &(pcurrent->lockcnt));
 
+	// the dead owner does not wake up requeued waiter
+	if(has_requeue()){
+		wake_requeue(get_flckpid());
+	}
 	return true;
 }
 
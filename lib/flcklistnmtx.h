@@ -63,8 +63,11 @@ class FlListNMtx : public fllistbasenmtx
 				}
 				// initialize mutex
 				if(is_all){
-					pcurrent->lockval	= FLCK_INVALID_ID;
-					pcurrent->lockcnt	= 0;
+					pcurrent->lockval		= FLCK_INVALID_ID;
+					pcurrent->lockcnt		= 0;
+					memset(pcurrent->robust_area, 0, sizeof(pcurrent->robust_area));
+					pcurrent->requeue_list	= NULL;
+					pcurrent->requeue_tail	= NULL;
 				}
 			}
 		}
@@ -73,7 +76,9 @@ class FlListNMtx : public fllistbasenmtx
 		virtual void initialize(void) { initialize(NULL, true); }
 		virtual void dump(std::ostream& out, int level) const;
 
-		inline bool find(const char* pname, PFLNAMEDMUTEX& preltop)
+		// Methods for hash index(need to lock list before calling these)
+		//
+		inline bool find(const char* pname)
 		{
 			FLNAMEDMUTEX 	tmp;
 			if(!FLCKEMPTYSTR(pname)){
@@ -84,11 +89,18 @@ class FlListNMtx : public fllistbasenmtx
 				tmp.name[0]	= '\0';
 				tmp.hash	= 0;
 			}
-			return fllistbasenmtx::find(&tmp, preltop);
+			if(fllistbasenmtx::find_index(&tmp, FlShm::pFlHead->named_mutex_hash, FlShm::pFlHead->named_mutex_hash_cnt)){
+				return true;
+			}
+			// some objects are only in list when hash index is full
+			return (0 < FlShm::pFlHead->named_mutex_overflow && fllistbasenmtx::find(&tmp, FlShm::pFlHead->named_mutex_list));
 		}
+		inline bool insert_index(void) const { return fllistbasenmtx::insert_index(FlShm::pFlHead->named_mutex_hash, FlShm::pFlHead->named_mutex_hash_cnt); }
 
 		inline int lock(time_t timeout_usec = FLCK_NO_TIMEOUT) { return rawlock(FLCK_NMTX_LOCK, timeout_usec); }
 		inline int unlock(void) { return rawlock(FLCK_UNLOCK, FLCK_NO_TIMEOUT); }
+		inline bool has_requeue(void) const { return (pcurrent && pcurrent->requeue_list); }
+		void wake_requeue(flckpid_t flckpid);
 
 		bool check_dead_lock(fl_pid_cache_map_t* pcache = NULL, flckpid_t except_flckpid = FLCK_INVALID_ID);
 };
@@ -42,7 +42,14 @@ void FlListOffLock::dump(std::ostream &out, int level) const
 
 	out << spacer2 << "offset            = " << pcurrent->offset	<< std::endl;
 	out << spacer2 << "length            = " << pcurrent->length	<< std::endl;
+	out << spacer2 << "left              = " << to_hexstring(pcurrent->left)	<< std::endl;
+	out << spacer2 << "right             = " << to_hexstring(pcurrent->right)	<< std::endl;
+	out << spacer2 << "max_end           = " << pcurrent->max_end	<< std::endl;
 	out << spacer2 << "lockval           = " << pcurrent->lockval	<< std::endl;
+	out << spacer2 << "prefer_writer     = " << (pcurrent->prefer_writer ? "true" : "false") << std::endl;
+	out << spacer2 << "phase_fair        = " << (pcurrent->phase_fair ? "true" : "false") << std::endl;
+	out << spacer2 << "pflockval         = {rin=" << pcurrent->pflockval.rin << ", rout=" << pcurrent->pflockval.rout << ", win=" << pcurrent->pflockval.win << ", wout=" << pcurrent->pflockval.wout << ", parked=" << pcurrent->pflockval.parked << "}" << std::endl;
+	out << spacer2 << "pfdead_cnt        = " << pcurrent->pfdead_cnt	<< std::endl;
 	out << spacer2 << "protect           = " << (pcurrent->protect ? "true" : "false") << std::endl;
 
 	FlListLocker	tmpobj;
@@ -61,9 +68,281 @@ void FlListOffLock::dump(std::ostream &out, int level) const
 	}
 	out << spacer2 << "}" << std::endl;
 
+	out << spacer2 << "pin_list={" << std::endl;
+	for(PFLLOCKER ptmp = to_abs(pcurrent->pin_list); ptmp; ptmp = to_abs(ptmp->next)){
+		tmpobj.set(ptmp);
+		tmpobj.dump(out, level + 2);
+	}
+	out << spacer2 << "}" << std::endl;
+
 	out << spacer1 << "}" << std::endl;
 }
 
+//---------------------------------------------------------
+// Utility for offset lock tree
+//---------------------------------------------------------
+static inline size_t fl_offlock_end(const FLOFFLOCK* pabs)
+{
+	return (static_cast<size_t>(pabs->offset) + pabs->length);
+}
+
+// [NOTE]
+// The priority of treap is made from the relative address of node, it is
+// same in all processes and does not need any area in shared memory.
+//
+static inline flck_hash_t fl_offlock_priority(PFLOFFLOCK pabs)
+{
+	PFLOFFLOCK	prel = to_rel(pabs);
+	return flck_fnv_hash(&prel, sizeof(PFLOFFLOCK));
+}
+
+static inline void fl_offlock_update_max_end(PFLOFFLOCK pabs)
+{
+	size_t	max_end = fl_offlock_end(pabs);
+	if(pabs->left && max_end < to_abs(pabs->left)->max_end){
+		max_end = to_abs(pabs->left)->max_end;
+	}
+	if(pabs->right && max_end < to_abs(pabs->right)->max_end){
+		max_end = to_abs(pabs->right)->max_end;
+	}
+	pabs->max_end = max_end;
+}
+
+static void fl_offlock_rotate_right(PFLOFFLOCK& prelroot)
+{
+	PFLOFFLOCK	pabsroot	= to_abs(prelroot);
+	PFLOFFLOCK	prelleft	= pabsroot->left;
+	PFLOFFLOCK	pabsleft	= to_abs(prelleft);
+
+	pabsroot->left	= pabsleft->right;
+	pabsleft->right	= prelroot;
+	fl_offlock_update_max_end(pabsroot);
+	fl_offlock_update_max_end(pabsleft);
+	prelroot		= prelleft;
+}
+
+static void fl_offlock_rotate_left(PFLOFFLOCK& prelroot)
+{
+	PFLOFFLOCK	pabsroot	= to_abs(prelroot);
+	PFLOFFLOCK	prelright	= pabsroot->right;
+	PFLOFFLOCK	pabsright	= to_abs(prelright);
+
+	pabsroot->right	= pabsright->left;
+	pabsright->left	= prelroot;
+	fl_offlock_update_max_end(pabsroot);
+	fl_offlock_update_max_end(pabsright);
+	prelroot		= prelright;
+}
+
+static void fl_offlock_insert_tree(PFLOFFLOCK& prelroot, PFLOFFLOCK pabsnode)
+{
+	if(!prelroot){
+		pabsnode->left		= NULL;
+		pabsnode->right		= NULL;
+		pabsnode->max_end	= fl_offlock_end(pabsnode);
+		prelroot			= to_rel(pabsnode);
+		return;
+	}
+	PFLOFFLOCK	pabsroot = to_abs(prelroot);
+	if(pabsnode->offset < pabsroot->offset){
+		fl_offlock_insert_tree(pabsroot->left, pabsnode);
+		if(fl_offlock_priority(pabsroot) < fl_offlock_priority(to_abs(pabsroot->left))){
+			fl_offlock_rotate_right(prelroot);
+		}else{
+			fl_offlock_update_max_end(pabsroot);
+		}
+	}else{
+		fl_offlock_insert_tree(pabsroot->right, pabsnode);
+		if(fl_offlock_priority(pabsroot) < fl_offlock_priority(to_abs(pabsroot->right))){
+			fl_offlock_rotate_left(prelroot);
+		}else{
+			fl_offlock_update_max_end(pabsroot);
+		}
+	}
+}
+
+static bool fl_offlock_cutoff_tree(PFLOFFLOCK& prelroot, PFLOFFLOCK pabsnode)
+{
+	if(!prelroot){
+		return false;
+	}
+	PFLOFFLOCK	pabsroot = to_abs(prelroot);
+	if(pabsroot == pabsnode){
+		// rotate target node down until it has one child at most
+		if(!pabsroot->left){
+			prelroot = pabsroot->right;
+		}else if(!pabsroot->right){
+			prelroot = pabsroot->left;
+		}else if(fl_offlock_priority(to_abs(pabsroot->right)) < fl_offlock_priority(to_abs(pabsroot->left))){
+			fl_offlock_rotate_right(prelroot);
+			PFLOFFLOCK	pabsnewroot = to_abs(prelroot);
+			fl_offlock_cutoff_tree(pabsnewroot->right, pabsnode);
+			fl_offlock_update_max_end(pabsnewroot);
+			return true;
+		}else{
+			fl_offlock_rotate_left(prelroot);
+			PFLOFFLOCK	pabsnewroot = to_abs(prelroot);
+			fl_offlock_cutoff_tree(pabsnewroot->left, pabsnode);
+			fl_offlock_update_max_end(pabsnewroot);
+			return true;
+		}
+		pabsnode->left	= NULL;
+		pabsnode->right	= NULL;
+		return true;
+	}
+
+	bool	result;
+	if(pabsnode->offset < pabsroot->offset){
+		result = fl_offlock_cutoff_tree(pabsroot->left, pabsnode);
+	}else if(pabsroot->offset < pabsnode->offset){
+		result = fl_offlock_cutoff_tree(pabsroot->right, pabsnode);
+	}else{
+		// same offset node can be in both side after rotating
+		result = (fl_offlock_cutoff_tree(pabsroot->left, pabsnode) || fl_offlock_cutoff_tree(pabsroot->right, pabsnode));
+	}
+	if(result){
+		fl_offlock_update_max_end(pabsroot);
+	}
+	return result;
+}
+
+// Returns the node which has the smallest offset in overlapping nodes.
+//
+// [NOTE]
+// The node which overlaps pquery by fl_compare_list_base() always has
+// "end >= pquery->offset" and "offset <= end of pquery", so we can skip
+// subtrees by max_end and offset.
+//
+static PFLOFFLOCK fl_offlock_search_tree(PFLOFFLOCK prelroot, const PFLOFFLOCK pquery)
+{
+	PFLOFFLOCK	pabsroot = to_abs(prelroot);
+	if(!pabsroot || pabsroot->max_end < static_cast<size_t>(pquery->offset)){
+		return NULL;
+	}
+	PFLOFFLOCK	pabsfound;
+	if(NULL != (pabsfound = fl_offlock_search_tree(pabsroot->left, pquery))){
+		return pabsfound;
+	}
+	if(0 == fl_compare_list_base(pquery, pabsroot)){
+		return pabsroot;
+	}
+	if(fl_offlock_end(pquery) < static_cast<size_t>(pabsroot->offset)){
+		return NULL;
+	}
+	return fl_offlock_search_tree(pabsroot->right, pquery);
+}
+
+//---------------------------------------------------------
+// FlListOffLock class : Methods for offset lock tree
+//---------------------------------------------------------
+bool FlListOffLock::find(off_t offset, size_t length, PFLOFFLOCK prelroot)
+{
+	FLOFFLOCK	tmp;
+	tmp.next		= NULL;
+	tmp.left		= NULL;
+	tmp.right		= NULL;
+	tmp.offset		= offset;
+	tmp.length		= length;
+	tmp.max_end		= fl_offlock_end(&tmp);
+	tmp.reader_list	= NULL;
+	tmp.writer_list	= NULL;
+	tmp.pin_list	= NULL;
+	tmp.prefer_writer= false;
+	tmp.phase_fair	= false;
+	tmp.pfdead_cnt	= 0;
+	tmp.protect		= false;
+
+	PFLOFFLOCK	pabsfound;
+	if(NULL == (pabsfound = fl_offlock_search_tree(prelroot, &tmp))){
+		return false;
+	}
+	pcurrent = pabsfound;
+	return true;
+}
+
+bool FlListOffLock::insert_tree(PFLOFFLOCK& prelroot)
+{
+	if(!pcurrent){
+		return false;
+	}
+	fl_offlock_insert_tree(prelroot, pcurrent);
+	return true;
+}
+
+bool FlListOffLock::cutoff_tree(PFLOFFLOCK& prelroot)
+{
+	if(!pcurrent){
+		return false;
+	}
+	return fl_offlock_cutoff_tree(prelroot, pcurrent);
+}
+
+bool FlListOffLock::is_locked_tree(PFLOFFLOCK prelroot)
+{
+	PFLOFFLOCK	pabsroot = to_abs(prelroot);
+	if(!pabsroot){
+		return false;
+	}
+	FlListOffLock	tmpobj(pabsroot);
+	if(tmpobj.is_locked()){
+		return true;
+	}
+	return (is_locked_tree(pabsroot->left) || is_locked_tree(pabsroot->right));
+}
+
+bool FlListOffLock::has_locker_tree(PFLOFFLOCK prelroot)
+{
+	PFLOFFLOCK	pabsroot = to_abs(prelroot);
+	if(!pabsroot){
+		return false;
+	}
+	FlListOffLock	tmpobj(pabsroot);
+	if(tmpobj.has_locker()){
+		return true;
+	}
+	return (has_locker_tree(pabsroot->left) || has_locker_tree(pabsroot->right));
+}
+
+// Get all nodes in tree by offset order.
+//
+void FlListOffLock::get_tree_list(PFLOFFLOCK prelroot, std::vector<PFLOFFLOCK>& abslist)
+{
+	PFLOFFLOCK	pabsroot = to_abs(prelroot);
+	if(!pabsroot){
+		return;
+	}
+	get_tree_list(pabsroot->left, abslist);
+	abslist.push_back(pabsroot);
+	get_tree_list(pabsroot->right, abslist);
+}
+
+//---------------------------------------------------------
+// Utility for phase-fair rwlock
+//---------------------------------------------------------
+// Release the ticket of dead locker.
+//
+// Returns	true	: released(or does not have ticket), the locker can be removed.
+//			false	: the locker is waiting for its turn, so it is marked dead and
+//					  is released by release_dead_tickets() at its turn.
+//
+static bool fl_release_dead_pfticket(PFLOFFLOCK pabsofflock, FlListLocker& lockerobj)
+{
+	if(!fl_release_pfrwlock(&(pabsofflock->pflockval), lockerobj.get_pfticket())){
+		if(!lockerobj.is_pfticket_dead()){
+			lockerobj.set_pfticket_dead();
+			++(pabsofflock->pfdead_cnt);
+		}
+		return false;
+	}
+	if(lockerobj.is_pfticket_dead() && 0 < pabsofflock->pfdead_cnt){
+		--(pabsofflock->pfdead_cnt);
+	}
+	return true;
+}
+
+//---------------------------------------------------------
+// FlListOffLock class : Lock/Unlock
+//---------------------------------------------------------
 int FlListOffLock::rawlock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckpid_t flckpid, int fd, time_t timeout_usec)
 {
 	if(!pcurrent){
@@ -92,9 +371,15 @@ int FlListOffLock::rawlock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flck
 		}
 
 		// do unlock
+		bool	has_pfticket = tglistobj.has_pfticket();
+		if(has_pfticket){
+			result = fl_unlock_pfrwlock(&(pcurrent->pflockval), tglistobj.get_pfticket());
+		}else{
+			result = fl_unlock_rwlock(&(pcurrent->lockval));
+		}
 		// cppcheck-suppress unmatchedSuppression
 		// cppcheck-suppress knownConditionTrueFalse
-		if(0 != (result = fl_unlock_rwlock(&(pcurrent->lockval)))){
+		if(0 != result){
 			ERR_FLCKPRN("Could not unlock rwlock object(error code=%d) for pid(%d), tid(%d), fd(%d).", result, decompose_pid(flckpid), decompose_tid(flckpid), fd);
 			return result;
 		}
@@ -105,89 +390,164 @@ int FlListOffLock::rawlock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flck
 		// retrieve target list
 		if(tglistobj.cutoff_list((is_writer ? pcurrent->writer_list : pcurrent->reader_list))){
 			// return object to free list
-			if(!tglistobj.insert_list(FlShm::pFlHead->locker_free)){
+			if(!FlShm::InsertFreeLocker(tglistobj.get())){
 				ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
 			}
 		}
 
+		// writer phase is over, so it may be the turn of dead lockers
+		if(has_pfticket && is_writer){
+			release_dead_tickets();
+		}
+
 	}else{
 		// LOCK
-		FlListLocker	tglistobj;
+		PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(devid, inoid);		// bucket lockid is locked now
+		PFLLOCKER		plocker;
 
-		// Always get new locker object.
-		if(!tglistobj.retrieve_list(FlShm::pFlHead->locker_free)){
-			ERR_FLCKPRN("Could not get free locker structure.");
-			fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// unlock lockid
-			return ENOLCK;					// ENOLCK
-		}
-		// initialize
-		tglistobj.initialize(flckpid, fd, false);
-
-		// insert locker into list
-		if(!tglistobj.insert_list((FLCK_READ_LOCK == LockType ? pcurrent->reader_list : pcurrent->writer_list))){
-			ERR_FLCKPRN("Failed to insert locker to top list.");
-			// for recover
-			if(!tglistobj.insert_list(FlShm::pFlHead->locker_free)){
-				ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
-			}
-			fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// unlock lockid
+		if(NULL == (plocker = prelock(LockType, flckpid, fd))){
+			fl_unlock_lockid(&(pbucket->lockid), flckpid);		// unlock lockid
 			return ENOLCK;					// ENOLCK
 		}
-
-		// clear protect flag(because locker list is existed now)
-		pcurrent->protect = false;
-
-		fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);			// unlock lockid
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);			// unlock lockid
 
 		// lock
-		if(0 != (result = dolock(LockType, devid, inoid, flckpid, fd, timeout_usec))){
-			ERR_FLCKPRN("Could not lock rwlock object(error code=%d) for pid(%d), tid(%d), fd(%d), devid(%lu), inode(%lu).", result, decompose_pid(flckpid), decompose_tid(flckpid), fd, devid, inoid);
-
+		if(0 != (result = postlock(LockType, devid, inoid, flckpid, fd, timeout_usec, plocker))){
 			// check remove file lock for recover...
 			//
-			fl_lock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// relock lockid
+			fl_lock_lockid(&(pbucket->lockid), flckpid);		// relock lockid
+			cancel_prelock(LockType, flckpid, fd);
+			fl_unlock_lockid(&(pbucket->lockid), flckpid);		// unlock lockid
+		}
+	}
+	return result;
+}
 
-			if(tglistobj.find(flckpid, fd, false, (FLCK_READ_LOCK == LockType ? pcurrent->reader_list : pcurrent->writer_list))){
-				if(tglistobj.cutoff_list((FLCK_READ_LOCK == LockType ? pcurrent->reader_list : pcurrent->writer_list))){
-					// return object to free list
-					if(!tglistobj.insert_list(FlShm::pFlHead->locker_free)){
-						ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
-					}
-				}
-			}
-			fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// unlock lockid
+// [NOTE]
+// Locking is split into prelock, postlock and cancel_prelock, so that the
+// caller which locks many offset locks in one file can insert all lockers
+// under one bucket lockid, and blocks for each lock after unlocking it.
+//
+// prelock inserts new locker into reader or writer list. Need to lock
+// bucket lockid before calling this, and it is kept locked.
+//
+PFLLOCKER FlListOffLock::prelock(FLCKLOCKTYPE LockType, flckpid_t flckpid, int fd)
+{
+	if(!pcurrent){
+		ERR_FLCKPRN("Object is not initialized.");
+		return NULL;
+	}
+	FlListLocker	tglistobj;
 
-			return result;
+	// Always get new locker object.
+	tglistobj.set(FlShm::RetrieveLocker());
+	if(!tglistobj.get()){
+		ERR_FLCKPRN("Could not get free locker structure.");
+		return NULL;
+	}
+	// initialize
+	tglistobj.initialize(flckpid, fd, false);
+
+	// insert locker into list
+	if(!tglistobj.insert_list((FLCK_READ_LOCK == LockType ? pcurrent->reader_list : pcurrent->writer_list))){
+		ERR_FLCKPRN("Failed to insert locker to top list.");
+		// for recover
+		if(!FlShm::InsertFreeLocker(tglistobj.get())){
+			ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
 		}
+		return NULL;
+	}
+
+	// clear protect flag(because locker list is existed now)
+	pcurrent->protect = false;
+
+	return tglistobj.get();
+}
 
-		// set lock flag
-		tglistobj.set_lock();
+// postlock locks the rwlock for the locker which is inserted by prelock.
+// Bucket lockid must not be locked, because this blocks.
+//
+int FlListOffLock::postlock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckpid_t flckpid, int fd, time_t timeout_usec, PFLLOCKER plocker)
+{
+	int	result;
+	if(0 != (result = dolock(LockType, devid, inoid, flckpid, fd, timeout_usec, plocker))){
+		ERR_FLCKPRN("Could not lock rwlock object(error code=%d) for pid(%d), tid(%d), fd(%d), devid(%lu), inode(%lu).", result, decompose_pid(flckpid), decompose_tid(flckpid), fd, devid, inoid);
+		return result;
 	}
+	// set lock flag
+	FlListLocker	tglistobj(plocker);
+	tglistobj.set_lock();
+
 	return result;
 }
 
-int FlListOffLock::dolock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckpid_t flckpid, int fd, time_t timeout_usec)
+// cancel_prelock removes the locker which is inserted by prelock and is
+// not locked. Need to lock bucket lockid before calling this.
+//
+void FlListOffLock::cancel_prelock(FLCKLOCKTYPE LockType, flckpid_t flckpid, int fd)
+{
+	if(!pcurrent){
+		return;
+	}
+	FlListLocker	tglistobj;
+	if(tglistobj.find(flckpid, fd, false, (FLCK_READ_LOCK == LockType ? pcurrent->reader_list : pcurrent->writer_list))){
+		// release the ticket which try(timed) writer left in its turn
+		if(tglistobj.has_pfticket()){
+			if(!fl_release_pfrwlock(&(pcurrent->pflockval), tglistobj.get_pfticket())){
+				ERR_FLCKPRN("Could not release ticket for phase-fair rwlock, but continue...");
+			}
+			release_dead_tickets();
+		}
+		if(tglistobj.cutoff_list((FLCK_READ_LOCK == LockType ? pcurrent->reader_list : pcurrent->writer_list))){
+			// return object to free list
+			if(!FlShm::InsertFreeLocker(tglistobj.get())){
+				ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
+			}
+		}
+	}
+}
+
+// [NOTE]
+// The lock layout(phase-fair ticket rwlock or not) is decided by the offset
+// lock, and the ticket of phase-fair rwlock is kept in plocker. When the
+// blocking lock returns ETIMEDOUT for checking dead lock, the ticket is
+// kept and the lock is retried with it.
+//
+int FlListOffLock::dolock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckpid_t flckpid, int fd, time_t timeout_usec, PFLLOCKER plocker)
 {
 	// Do lock
-	int	result;
+	PFLFILEBUCKET	pbucket		= fl_get_filelock_bucket(devid, inoid);
+	bool			is_pf		= is_phase_fair();
+	PFLPFTICKET		pticket		= &(plocker->pfticket);
+	int				result;
 	for(result = 0; 0 == result; ){
 		if(FLCK_READ_LOCK == LockType){
 			if(FLCK_TRY_TIMEOUT == timeout_usec){
-				result = fl_tryrdlock_rwlock(&(pcurrent->lockval));
+				result = (is_pf ? fl_tryrdlock_pfrwlock(&(pcurrent->pflockval), pticket) : fl_tryrdlock_rwlock(&(pcurrent->lockval)));
 			}else if(FLCK_NO_TIMEOUT == timeout_usec){
-				result = fl_rdlock_rwlock(&(pcurrent->lockval), (FlShm::IsHighRobust() ? FlShm::GetRobustLoopCnt() : FLCK_ROBUST_CHKCNT_NOLIMIT));
+				int	max_count = (FlShm::IsHighRobust() ? FlShm::GetRobustLoopCnt() : FLCK_ROBUST_CHKCNT_NOLIMIT);
+				result = (is_pf ? fl_rdlock_pfrwlock(&(pcurrent->pflockval), pticket, max_count) : fl_rdlock_rwlock(&(pcurrent->lockval), max_count));
 			}else{
-				struct timespec	timeout = {(timeout_usec / (1000 * 1000)), ((timeout_usec % (1000 * 1000)) * 1000)};
-				result = fl_timedrdlock_rwlock(&(pcurrent->lockval), &timeout);
+				struct timespec	deadline;
+				if(!flck_set_deadline(&deadline, timeout_usec)){
+					result = EBUSY;
+				}else{
+					result = (is_pf ? fl_timedrdlock_pfrwlock(&(pcurrent->pflockval), pticket, &deadline) : fl_timedrdlock_rwlock(&(pcurrent->lockval), &deadline));
+				}
 			}
 		}else{
 			if(FLCK_TRY_TIMEOUT == timeout_usec){
-				result = fl_trywrlock_rwlock(&(pcurrent->lockval));
+				result = (is_pf ? fl_trywrlock_pfrwlock(&(pcurrent->pflockval), pticket) : fl_trywrlock_rwlock(&(pcurrent->lockval)));
 			}else if(FLCK_NO_TIMEOUT == timeout_usec){
-				result = fl_wrlock_rwlock(&(pcurrent->lockval), (FlShm::IsHighRobust() ? FlShm::GetRobustLoopCnt() : FLCK_ROBUST_CHKCNT_NOLIMIT));
+				int	max_count = (FlShm::IsHighRobust() ? FlShm::GetRobustLoopCnt() : FLCK_ROBUST_CHKCNT_NOLIMIT);
+				result = (is_pf ? fl_wrlock_pfrwlock(&(pcurrent->pflockval), pticket, max_count) : fl_wrlock_rwlock(&(pcurrent->lockval), max_count, is_prefer_writer()));
 			}else{
-				struct timespec	timeout = {(timeout_usec / (1000 * 1000)), ((timeout_usec % (1000 * 1000)) * 1000)};
-				result = fl_timedwrlock_rwlock(&(pcurrent->lockval), &timeout);
+				struct timespec	deadline;
+				if(!flck_set_deadline(&deadline, timeout_usec)){
+					result = EBUSY;
+				}else{
+					result = (is_pf ? fl_timedwrlock_pfrwlock(&(pcurrent->pflockval), pticket, &deadline) : fl_timedwrlock_rwlock(&(pcurrent->lockval), &deadline, is_prefer_writer()));
+				}
 			}
 		}
 
@@ -211,7 +571,7 @@ int FlListOffLock::dolock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckp
 			if(FLCK_NO_TIMEOUT == timeout_usec){
 				// recover
 				if(FlShm::IsHighRobust()){
-					fl_lock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);	// lock lockid for top manually.(keep to lock)
+					fl_lock_lockid(&(pbucket->lockid), flckpid);	// lock lockid for top manually.(keep to lock)
 					// set protect flag (for not removing pcurrent)
 					set_protect();
 
@@ -220,7 +580,7 @@ int FlListOffLock::dolock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckp
 					check_dead_lock(devid, inoid, &cache_map, flckpid, fd);		// always success.
 
 					pcurrent->protect = false;
-					fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);	// unlock lockid
+					fl_unlock_lockid(&(pbucket->lockid), flckpid);	// unlock lockid
 
 					result = 0;					// retry to lock
 				}else{
@@ -234,6 +594,103 @@ int FlListOffLock::dolock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckp
 	return result;
 }
 
+//---------------------------------------------------------
+// FlListOffLock class : Upgrade/Downgrade
+//---------------------------------------------------------
+// [NOTE]
+// Need to lock bucket lockid before calling these, and it is unlocked in
+// these. The locker is not freed, it is moved between reader list and
+// writer list after changing lock value.
+// While waiting for upgrading, the locker stays in reader list with the
+// upgrading flag, so that the flag is cleared if the process is dead.
+//
+int FlListOffLock::upgrade(dev_t devid, ino_t inoid, flckpid_t flckpid, int fd)
+{
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(devid, inoid);		// bucket lockid is locked now
+	if(!pcurrent){
+		ERR_FLCKPRN("Object is not initialized.");
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+		return EINVAL;						// EINVAL
+	}
+	if(is_phase_fair()){
+		ERR_FLCKPRN("Phase-fair rwlock does not support upgrading.");
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+		return EINVAL;						// EINVAL
+	}
+	FlListLocker	tglistobj;
+	if(!tglistobj.find(flckpid, fd, true, pcurrent->reader_list)){
+		ERR_FLCKPRN("Could not find reader for pid(%d), tid(%d), fd(%d).", decompose_pid(flckpid), decompose_tid(flckpid), fd);
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+		return EINVAL;						// EINVAL
+	}
+	int	result;
+	if(0 != (result = fl_request_upgrade_rwlock(&(pcurrent->lockval)))){
+		MSG_FLCKPRN("Could not request upgrading(error code=%d) for pid(%d), tid(%d), fd(%d).", result, decompose_pid(flckpid), decompose_tid(flckpid), fd);
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+		return result;
+	}
+	tglistobj.set_upgrading(true);
+	fl_unlock_lockid(&(pbucket->lockid), flckpid);					// unlock lockid
+
+	// wait for other readers
+	while(0 != (result = fl_wait_upgrade_rwlock(&(pcurrent->lockval), (FlShm::IsHighRobust() ? FlShm::GetRobustLoopCnt() : FLCK_ROBUST_CHKCNT_NOLIMIT)))){
+		// timeouted, check dead readers and retry
+		fl_lock_lockid(&(pbucket->lockid), flckpid);				// lock lockid
+		set_protect();
+
+		fl_pid_cache_map_t	cache_map;
+		check_dead_lock(devid, inoid, &cache_map, flckpid, fd);		// always success.
+
+		pcurrent->protect = false;
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+	}
+
+	// move locker to writer list
+	fl_lock_lockid(&(pbucket->lockid), flckpid);					// lock lockid
+	tglistobj.set_upgrading(false);
+	if(!tglistobj.cutoff_list(pcurrent->reader_list) || !tglistobj.insert_list(pcurrent->writer_list)){
+		ERR_FLCKPRN("Failed to move locker to writer list, but continue...");
+	}
+	fl_unlock_lockid(&(pbucket->lockid), flckpid);					// unlock lockid
+
+	return 0;
+}
+
+int FlListOffLock::downgrade(dev_t devid, ino_t inoid, flckpid_t flckpid, int fd)
+{
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(devid, inoid);		// bucket lockid is locked now
+	if(!pcurrent){
+		ERR_FLCKPRN("Object is not initialized.");
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+		return EINVAL;						// EINVAL
+	}
+	if(is_phase_fair()){
+		ERR_FLCKPRN("Phase-fair rwlock does not support downgrading.");
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+		return EINVAL;						// EINVAL
+	}
+	FlListLocker	tglistobj;
+	if(!tglistobj.find(flckpid, fd, true, pcurrent->writer_list)){
+		ERR_FLCKPRN("Could not find writer for pid(%d), tid(%d), fd(%d).", decompose_pid(flckpid), decompose_tid(flckpid), fd);
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+		return EINVAL;						// EINVAL
+	}
+	int	result;
+	if(0 != (result = fl_downgrade_rwlock(&(pcurrent->lockval)))){
+		ERR_FLCKPRN("Could not downgrade rwlock(error code=%d) for pid(%d), tid(%d), fd(%d).", result, decompose_pid(flckpid), decompose_tid(flckpid), fd);
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+		return result;
+	}
+
+	// move locker to reader list
+	if(!tglistobj.cutoff_list(pcurrent->writer_list) || !tglistobj.insert_list(pcurrent->reader_list)){
+		ERR_FLCKPRN("Failed to move locker to reader list, but continue...");
+	}
+	fl_unlock_lockid(&(pbucket->lockid), flckpid);					// unlock lockid
+
+	return 0;
+}
+
 // Returns	false	: does not need to remove this object, it means locking now or null.
 //			true	: should remove this object, because this object does not lock any now.
 //
@@ -249,10 +706,14 @@ bool FlListOffLock::check_dead_lock(dev_t devid, ino_t inoid, fl_pid_cache_map_t
 	// check reader list
 	for(PFLLOCKER pabsparent = NULL, pabscur = to_abs(pcurrent->reader_list); pabscur; ){
 		tmpobj.set(pabscur);
-		if(tmpobj.check_dead_lock(devid, inoid, pcache, except_flckpid, except_fd)){
+		if((tmpobj.is_pfticket_dead() || tmpobj.check_dead_lock(devid, inoid, pcache, except_flckpid, except_fd)) && fl_release_dead_pfticket(pcurrent, tmpobj)){
 
 			// retrieve target list
 			if(tmpobj.cutoff_list(pcurrent->reader_list)){
+				if(tmpobj.is_upgrading()){
+					// dead reader was waiting for upgrading
+					fl_cancel_upgrade_rwlock(&(pcurrent->lockval));
+				}
 				if(tmpobj.is_locked()){
 					// do unlock
 					int	result;
@@ -264,7 +725,7 @@ bool FlListOffLock::check_dead_lock(dev_t devid, ino_t inoid, fl_pid_cache_map_t
 					}
 				}
 				// return object to free list
-				if(!tmpobj.insert_list(FlShm::pFlHead->locker_free)){
+				if(!FlShm::InsertFreeLocker(tmpobj.get())){
 					ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
 				}
 			}
@@ -284,10 +745,14 @@ bool FlListOffLock::check_dead_lock(dev_t devid, ino_t inoid, fl_pid_cache_map_t
 	// check writer list
 	for(PFLLOCKER pabsparent = NULL, pabscur = to_abs(pcurrent->writer_list); pabscur; ){
 		tmpobj.set(pabscur);
-		if(tmpobj.check_dead_lock(devid, inoid, pcache, except_flckpid, except_fd)){
+		if((tmpobj.is_pfticket_dead() || tmpobj.check_dead_lock(devid, inoid, pcache, except_flckpid, except_fd)) && fl_release_dead_pfticket(pcurrent, tmpobj)){
 
 			// retrieve target list
 			if(tmpobj.cutoff_list(pcurrent->writer_list)){
+				if(!tmpobj.is_locked()){
+					// dead writer may be pending with writer preference
+					fl_cancel_pending_rwlock(&(pcurrent->lockval));
+				}
 				if(tmpobj.is_locked()){
 					// do unlock
 					int	result;
@@ -299,7 +764,7 @@ bool FlListOffLock::check_dead_lock(dev_t devid, ino_t inoid, fl_pid_cache_map_t
 					}
 				}
 				// return object to free list
-				if(!tmpobj.insert_list(FlShm::pFlHead->locker_free)){
+				if(!FlShm::InsertFreeLocker(tmpobj.get())){
 					ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
 				}
 			}
@@ -315,9 +780,95 @@ bool FlListOffLock::check_dead_lock(dev_t devid, ino_t inoid, fl_pid_cache_map_t
 			pabscur		= to_abs(pabscur->next);
 		}
 	}
+	release_dead_tickets();
+
+	// check pin list
+	for(PFLLOCKER pabsparent = NULL, pabscur = to_abs(pcurrent->pin_list); pabscur; ){
+		tmpobj.set(pabscur);
+		if(tmpobj.check_dead_lock(devid, inoid, pcache, except_flckpid, except_fd) && tmpobj.cutoff_list(pcurrent->pin_list)){
+			// return object to free list
+			if(!FlShm::InsertFreeLocker(tmpobj.get())){
+				ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
+			}
+			// set next
+			if(pabsparent){
+				pabscur	= to_abs(pabsparent->next);
+			}else{
+				pabscur = to_abs(pcurrent->pin_list);
+			}
+		}else{
+			// set next
+			pabsparent	= pabscur;
+			pabscur		= to_abs(pabscur->next);
+		}
+	}
+
 	return !is_locked();
 }
 
+// [NOTE]
+// The lock layout can be changed only when there is no locker, because
+// lockers in both layouts can not exclude each other.
+// Need to lock list before calling this.
+//
+bool FlListOffLock::set_phase_fair(bool phase_fair)
+{
+	if(!pcurrent){
+		ERR_FLCKPRN("Object is not initialized.");
+		return false;
+	}
+	if(has_locker()){
+		MSG_FLCKPRN("Could not change rwlock layout, because it has lockers now.");
+		return false;
+	}
+	pcurrent->phase_fair = phase_fair;
+	return true;
+}
+
+// Release dead lockers which were waiting for their turn of phase-fair
+// rwlock. Releasing a writer ticket may be the turn of next dead locker,
+// so this repeats until nothing is released.
+// Need to lock list before calling this.
+//
+void FlListOffLock::release_dead_tickets(void)
+{
+	if(!pcurrent){
+		return;
+	}
+	FlListLocker	tmpobj;
+	for(bool is_released = true; is_released && 0 < pcurrent->pfdead_cnt; ){
+		is_released = false;
+
+		PFLLOCKER*	plists[] = {&(pcurrent->reader_list), &(pcurrent->writer_list)};
+		for(size_t pos = 0; pos < sizeof(plists) / sizeof(PFLLOCKER*); ++pos){
+			for(PFLLOCKER pabsparent = NULL, pabscur = to_abs(*(plists[pos])); pabscur; ){
+				tmpobj.set(pabscur);
+				if(tmpobj.is_pfticket_dead() && fl_release_dead_pfticket(pcurrent, tmpobj)){
+					// retrieve target list
+					if(tmpobj.cutoff_list(*(plists[pos]))){
+						// return object to free list
+						if(!FlShm::InsertFreeLocker(tmpobj.get())){
+							ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
+						}
+					}
+					is_released = true;
+
+					// set next
+					if(pabsparent){
+						pabscur	= to_abs(pabsparent->next);
+					}else{
+						pabscur = to_abs(*(plists[pos]));
+					}
+				}else{
+					// set next
+					pabsparent	= pabscur;
+					pabscur		= to_abs(pabscur->next);
+				}
+			}
+		}
+	}
+}
+
 bool FlListOffLock::free_locker_list(void)
 {
 	if(!pcurrent){
@@ -333,7 +884,7 @@ bool FlListOffLock::free_locker_list(void)
 
 		// return object to free list
 		tmpobj.set(pabscur);
-		if(!tmpobj.insert_list(FlShm::pFlHead->locker_free)){
+		if(!FlShm::InsertFreeLocker(tmpobj.get())){
 			ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
 		}
 	}
@@ -345,12 +896,77 @@ bool FlListOffLock::free_locker_list(void)
 
 		// return object to free list
 		tmpobj.set(pabscur);
-		if(!tmpobj.insert_list(FlShm::pFlHead->locker_free)){
+		if(!FlShm::InsertFreeLocker(tmpobj.get())){
 			ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
 		}
 	}
 	pcurrent->writer_list = NULL;
 
+	// check pin list
+	for(PFLLOCKER pabsnext = NULL, pabscur = to_abs(pcurrent->pin_list); pabscur; pabscur = pabsnext){
+		pabsnext = to_abs(pabscur->next);
+
+		// return object to free list
+		tmpobj.set(pabscur);
+		if(!FlShm::InsertFreeLocker(tmpobj.get())){
+			ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
+		}
+	}
+	pcurrent->pin_list = NULL;
+
+	return true;
+}
+
+// Returns the pin(locker) which is inserted into pin list, or NULL.
+//
+// [NOTE]
+// The handle belongs to the process, so the pin is made for the process
+// (tid is same as pid) without owner slot, and it has no-fd. Then the dead
+// process's pin is found by check_dead_lock and released.
+// Need to lock list before calling this.
+//
+PFLLOCKER FlListOffLock::pin(flckpid_t flckpid, int fd)
+{
+	if(!pcurrent){
+		ERR_FLCKPRN("Object is not initialized.");
+		return NULL;
+	}
+	pid_t			pid = decompose_pid(flckpid);
+	FlListLocker	tglistobj(FlShm::RetrieveLocker());
+	if(!tglistobj.get()){
+		ERR_FLCKPRN("Could not get free locker structure.");
+		return NULL;
+	}
+	tglistobj.initialize(compose_flckpid(pid, static_cast<tid_t>(pid)), FLCK_RWLOCK_NO_FD(fd), false);
+
+	if(!tglistobj.insert_list(pcurrent->pin_list)){
+		ERR_FLCKPRN("Failed to insert locker to pin list.");
+		if(!FlShm::InsertFreeLocker(tglistobj.get())){
+			ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
+		}
+		return NULL;
+	}
+	return tglistobj.get();
+}
+
+// Returns	false	: the pin is not found(it was released as dead)
+//			true	: the pin is released
+//
+// Need to lock list before calling this.
+//
+bool FlListOffLock::unpin(PFLLOCKER pabspin)
+{
+	if(!pcurrent || !pabspin){
+		ERR_FLCKPRN("Object is not initialized or parameter is wrong.");
+		return false;
+	}
+	FlListLocker	tglistobj(pabspin);
+	if(!tglistobj.cutoff_list(pcurrent->pin_list)){
+		return false;
+	}
+	if(!FlShm::InsertFreeLocker(tglistobj.get())){
+		ERR_FLCKPRN("Failed to insert locker to free list, but continue...");
+	}
 	return true;
 }
 
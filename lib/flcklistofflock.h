@@ -40,7 +40,7 @@ class FlListOffLock : public fllistbaseofflock
 {
 	protected:
 		int rawlock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckpid_t flckpid, int fd, time_t timeout_usec);
-		int dolock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckpid_t flckpid, int fd, time_t timeout_usec);
+		int dolock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckpid_t flckpid, int fd, time_t timeout_usec, PFLLOCKER plocker);
 
 	public:
 		explicit FlListOffLock(PFLOFFLOCK ptr = NULL) : fllistbaseofflock(ptr) {}
@@ -53,15 +53,27 @@ class FlListOffLock : public fllistbaseofflock
 				if(is_all){
 					pcurrent->next		= NULL;
 				}
+				pcurrent->left			= NULL;
+				pcurrent->right			= NULL;
+				pcurrent->max_end		= static_cast<size_t>(offset) + length;
 				pcurrent->offset		= offset;
 				pcurrent->length		= length;
 				pcurrent->reader_list	= NULL;
 				pcurrent->writer_list	= NULL;
+				pcurrent->pin_list		= NULL;
+				pcurrent->prefer_writer	= false;
 				pcurrent->protect		= protect;
 
 				// initialize lock variable
 				if(is_all){
-					pcurrent->lockval	= FLCK_RWLOCK_UNLOCK;
+					pcurrent->lockval			= FLCK_RWLOCK_UNLOCK;
+					pcurrent->phase_fair		= FlShm::IsPhaseFairRwlock();
+					pcurrent->pflockval.rin		= 0;
+					pcurrent->pflockval.rout	= 0;
+					pcurrent->pflockval.win		= 0;
+					pcurrent->pflockval.wout	= 0;
+					pcurrent->pflockval.parked	= 0;
+					pcurrent->pfdead_cnt		= 0;
 				}
 			}
 		}
@@ -70,27 +82,39 @@ class FlListOffLock : public fllistbaseofflock
 		virtual void initialize(void) { initialize(static_cast<off_t>(0), static_cast<size_t>(0), true); }
 		virtual void dump(std::ostream& out, int level) const;
 
-		inline bool find(off_t offset, size_t length, PFLOFFLOCK& preltop)
-		{
-			FLOFFLOCK tmp;
-			tmp.next		= NULL;
-			tmp.offset		= offset;
-			tmp.length		= length;
-			tmp.reader_list	= NULL;
-			tmp.writer_list	= NULL;
-			tmp.protect		= false;
-			return fllistbaseofflock::find(&tmp, preltop);
-		}
+		// Methods for offset lock tree(need to lock list before calling these)
+		//
+		bool find(off_t offset, size_t length, PFLOFFLOCK prelroot);
+		bool insert_tree(PFLOFFLOCK& prelroot);
+		bool cutoff_tree(PFLOFFLOCK& prelroot);
+		static bool is_locked_tree(PFLOFFLOCK prelroot);
+		static bool has_locker_tree(PFLOFFLOCK prelroot);
+		static void get_tree_list(PFLOFFLOCK prelroot, std::vector<PFLOFFLOCK>& abslist);
 
 		// If pcurrent has reader/writer list, it means locking now.
-		// Need to lock list before calling this.
+		// is_locked() also returns true while pcurrent is protected or pinned
+		// by handle, it means that pcurrent can not be released.
+		// Need to lock list before calling these.
 		//
-		inline bool is_locked(void) const { return (pcurrent && (pcurrent->protect || pcurrent->reader_list || pcurrent->writer_list)); }
+		inline bool has_locker(void) const { return (pcurrent && (pcurrent->reader_list || pcurrent->writer_list)); }
+		inline bool is_locked(void) const { return (pcurrent && (pcurrent->protect || pcurrent->pin_list || has_locker())); }
 		inline void set_protect(void) { if(pcurrent){ pcurrent->protect = true; } }
+		inline bool is_prefer_writer(void) const { return (FlShm::IsPreferWriter() || (pcurrent && pcurrent->prefer_writer)); }
+		inline void set_prefer_writer(bool prefer_writer) { if(pcurrent){ pcurrent->prefer_writer = prefer_writer; } }
+		inline bool is_phase_fair(void) const { return (pcurrent && pcurrent->phase_fair); }
+		bool set_phase_fair(bool phase_fair);
 		bool free_locker_list(void);
+		PFLLOCKER pin(flckpid_t flckpid, int fd);
+		bool unpin(PFLLOCKER pabspin);
+		void release_dead_tickets(void);
 
 		inline int lock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckpid_t flckpid, int fd, time_t timeout_usec = FLCK_NO_TIMEOUT) { return rawlock(LockType, devid, inoid, flckpid, fd, timeout_usec); }
 		inline int unlock(flckpid_t flckpid, int fd) { return rawlock(FLCK_UNLOCK, FLCK_INVALID_ID, FLCK_INVALID_ID, flckpid, fd, FLCK_NO_TIMEOUT); }
+		PFLLOCKER prelock(FLCKLOCKTYPE LockType, flckpid_t flckpid, int fd);
+		int postlock(FLCKLOCKTYPE LockType, dev_t devid, ino_t inoid, flckpid_t flckpid, int fd, time_t timeout_usec, PFLLOCKER plocker);
+		void cancel_prelock(FLCKLOCKTYPE LockType, flckpid_t flckpid, int fd);
+		int upgrade(dev_t devid, ino_t inoid, flckpid_t flckpid, int fd);
+		int downgrade(dev_t devid, ino_t inoid, flckpid_t flckpid, int fd);
 
 		bool check_dead_lock(dev_t devid, ino_t inoid, fl_pid_cache_map_t* pcache = NULL, flckpid_t except_flckpid = FLCK_INVALID_ID, int except_fd = FLCK_INVALID_HANDLE);
 };
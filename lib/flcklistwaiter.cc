@@ -40,6 +40,7 @@ void FlListWaiter::dump(std::ostream &out, int level) const
 
 	out << spacer2 << "flckpid           = " << pcurrent->flckpid	<< std::endl;
 	out << spacer2 << "lockstatus        = " << STR_FLCKCONDTYPE(pcurrent->lockstatus) << std::endl;
+	out << spacer2 << "requeue_next      = " << to_hexstring(pcurrent->requeue_next) << std::endl;
 
 	out << spacer2 << "named_mutex={" << std::endl;
 	FlListNMtx	tmpobj(to_abs(pcurrent->named_mutex));
@@ -59,7 +60,7 @@ int FlListWaiter::rawlock(FLCKLOCKTYPE LockType, time_t timeout_usec)
 	int	result = 0;
 	if(FLCK_NCOND_UP == LockType){
 		// SIGNAL
-		result = fl_force_set_cond(&(pcurrent->lockstatus), FLCK_NCOND_UP);
+		result = fl_signal_cond(&(pcurrent->lockstatus));
 
 	}else{
 		// FLCK_NCOND_WAIT
@@ -71,15 +72,19 @@ int FlListWaiter::rawlock(FLCKLOCKTYPE LockType, time_t timeout_usec)
 		}
 		FlListNMtx	tgnmtxobj(to_abs(pcurrent->named_mutex));
 
-		// set lock status to wait
-		fl_force_set_cond(&(pcurrent->lockstatus), FLCK_NCOND_WAIT);					// always returns 0
+		// [NOTE]
+		// The lock status is already set to wait when this waiter is pushed
+		// into waiting queue under lockid. Do not set it here, because the
+		// signal may already have popped this waiter and set it up.
+		//
 
 		// do unlock named mutex
 		if(0 != (result = tgnmtxobj.unlock())){
 			ERR_FLCKPRN("Could not unlock named mutex(error code=%d) for cond.", result);
 
-			// for recover
-			fl_force_set_cond(&(pcurrent->lockstatus), FLCK_NCOND_UP);
+			// [NOTE]
+			// Do not change the lock status here, it means that this waiter
+			// is still in waiting queue of cond. The caller removes it.
 			return result;
 		}
 
@@ -87,8 +92,12 @@ int FlListWaiter::rawlock(FLCKLOCKTYPE LockType, time_t timeout_usec)
 		if(FLCK_NO_TIMEOUT == timeout_usec){
 			result = fl_wait_cond(&(pcurrent->lockstatus), FLCK_NCOND_UP);
 		}else{
-			struct timespec	timeout = {(timeout_usec / (1000 * 1000)), ((timeout_usec % (1000 * 1000)) * 1000)};
-			result = fl_timedwait_cond(&(pcurrent->lockstatus), FLCK_NCOND_UP, &timeout);
+			struct timespec	deadline;
+			if(!flck_set_deadline(&deadline, timeout_usec)){
+				result = EBUSY;
+			}else{
+				result = fl_timedwait_cond(&(pcurrent->lockstatus), FLCK_NCOND_UP, &deadline);
+			}
 		}
 
 		// do lock named mutex
@@ -105,6 +114,136 @@ int FlListWaiter::rawlock(FLCKLOCKTYPE LockType, time_t timeout_usec)
 	return result;
 }
 
+// Insert current object to the end of queue.
+//
+bool FlListWaiter::push_queue(PFLWAITER& preltop, PFLWAITER& preltail)
+{
+	if(!pcurrent){
+		return false;
+	}
+	pcurrent->next = NULL;
+	if(preltail){
+		to_abs(preltail)->next	= to_rel(pcurrent);
+	}else{
+		preltop					= to_rel(pcurrent);
+	}
+	preltail = to_rel(pcurrent);
+	return true;
+}
+
+// Retrieve the top(oldest) object from queue and set it to current.
+//
+bool FlListWaiter::pop_queue(PFLWAITER& preltop, PFLWAITER& preltail)
+{
+	if(!preltop){
+		return false;
+	}
+	pcurrent	= to_abs(preltop);
+	preltop		= pcurrent->next;
+	if(!preltop){
+		preltail = NULL;
+	}
+	pcurrent->next = NULL;
+	return true;
+}
+
+// Cut current object from queue, and fix the tail if current is the end.
+//
+bool FlListWaiter::cutoff_queue(PFLWAITER& preltop, PFLWAITER& preltail)
+{
+	if(!pcurrent || !preltop){
+		return false;
+	}
+	for(PFLWAITER pabsparent = NULL, pabstarget = to_abs(preltop); pabstarget; pabsparent = pabstarget, pabstarget = to_abs(pabstarget->next)){
+		if(pabstarget != pcurrent){
+			continue;
+		}
+		if(pabsparent){
+			pabsparent->next	= pcurrent->next;
+		}else{
+			preltop				= pcurrent->next;
+		}
+		if(preltail == to_rel(pcurrent)){
+			preltail = to_rel(pabsparent);
+		}
+		pcurrent->next = NULL;
+		return true;
+	}
+	return false;
+}
+
+// Move current waiter to the end of requeue list in named mutex, and
+// current waiter keeps parking until it is woken up by unlocking mutex.
+//
+bool FlListWaiter::requeue(void)
+{
+	if(!pcurrent || !pcurrent->named_mutex){
+		return false;
+	}
+	PFLNAMEDMUTEX	abs_nmtx = to_abs(pcurrent->named_mutex);
+
+	fl_force_set_cond(&(pcurrent->lockstatus), FLCK_NCOND_REQUEUE);
+	pcurrent->requeue_next = NULL;
+	if(abs_nmtx->requeue_tail){
+		to_abs(abs_nmtx->requeue_tail)->requeue_next	= to_rel(pcurrent);
+	}else{
+		abs_nmtx->requeue_list							= to_rel(pcurrent);
+	}
+	abs_nmtx->requeue_tail = to_rel(pcurrent);
+	return true;
+}
+
+bool FlListWaiter::cutoff_requeue(void)
+{
+	if(!pcurrent || !pcurrent->named_mutex){
+		return false;
+	}
+	PFLNAMEDMUTEX	abs_nmtx = to_abs(pcurrent->named_mutex);
+
+	for(PFLWAITER pabsparent = NULL, pabstarget = to_abs(abs_nmtx->requeue_list); pabstarget; pabsparent = pabstarget, pabstarget = to_abs(pabstarget->requeue_next)){
+		if(pabstarget != pcurrent){
+			continue;
+		}
+		if(pabsparent){
+			pabsparent->requeue_next	= pcurrent->requeue_next;
+		}else{
+			abs_nmtx->requeue_list		= pcurrent->requeue_next;
+		}
+		if(abs_nmtx->requeue_tail == to_rel(pcurrent)){
+			abs_nmtx->requeue_tail = to_rel(pabsparent);
+		}
+		pcurrent->requeue_next = NULL;
+		return true;
+	}
+	return false;
+}
+
+// Wake up the top waiter in requeue list of named mutex.
+//
+// [NOTE]
+// The woken waiter stays in signaled list of cond, it is removed by itself.
+//
+bool FlListWaiter::wake_requeue(PFLNAMEDMUTEX abs_nmtx)
+{
+	if(!abs_nmtx || !abs_nmtx->requeue_list){
+		return false;
+	}
+	PFLWAITER	pabswaiter	= to_abs(abs_nmtx->requeue_list);
+	abs_nmtx->requeue_list	= pabswaiter->requeue_next;
+	if(!abs_nmtx->requeue_list){
+		abs_nmtx->requeue_tail = NULL;
+	}
+	pabswaiter->requeue_next = NULL;
+
+	FlListWaiter	tmpobj(pabswaiter);
+	int				result;
+	if(0 != (result = tmpobj.signal())){
+		ERR_FLCKPRN("Failed to send signal to requeued waiter(error code=%d).", result);
+		return false;
+	}
+	return true;
+}
+
 bool FlListWaiter::check_dead_lock(fl_pid_cache_map_t* pcache, flckpid_t except_flckpid)
 {
 	if(!pcurrent){
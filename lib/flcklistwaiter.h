@@ -54,6 +54,7 @@ class FlListWaiter : public fllistbasewaiter
 				pcurrent->flckpid		= flckpid;
 				pcurrent->lockstatus	= lockstatus;
 				pcurrent->named_mutex	= to_rel(abs_nmtx);
+				pcurrent->requeue_next	= NULL;
 			}
 		}
 		virtual bool initialize(PFLWAITER ptr, size_t count) { return fllistbasewaiter::initialize(ptr, count); }
@@ -62,13 +63,20 @@ class FlListWaiter : public fllistbasewaiter
 		virtual void dump(std::ostream& out, int level) const;
 
 		inline bool is_wait(void) const { return (pcurrent && FLCK_NCOND_WAIT == pcurrent->lockstatus); }
-
-		// search in waiter list, only check lockstatus and return lastest value.
-		inline bool rfind(FLCKLOCKTYPE lockstatus, PFLWAITER& preltop)
-		{
-			FLWAITER tmp = {NULL, FLCK_INVALID_ID, lockstatus, NULL};
-			return fllistbasewaiter::rfind(&tmp, preltop);
-		}
+		inline bool is_requeue(void) const { return (pcurrent && FLCK_NCOND_REQUEUE == pcurrent->lockstatus); }
+		inline bool is_same_mutex(const FlListWaiter& other) const { return (pcurrent && other.pcurrent && pcurrent->named_mutex == other.pcurrent->named_mutex); }
+
+		// Methods for FIFO waiter queue(need to lock list before calling these)
+		//
+		bool push_queue(PFLWAITER& preltop, PFLWAITER& preltail);
+		bool pop_queue(PFLWAITER& preltop, PFLWAITER& preltail);
+		bool cutoff_queue(PFLWAITER& preltop, PFLWAITER& preltail);
+
+		// Methods for requeue list in named mutex(need to lock named cond list before calling these)
+		//
+		bool requeue(void);
+		bool cutoff_requeue(void);
+		static bool wake_requeue(PFLNAMEDMUTEX abs_nmtx);
 
 		inline int wait(time_t timeout_usec = FLCK_NO_TIMEOUT) { return rawlock(FLCK_NCOND_WAIT, timeout_usec); }
 		inline int signal(void) { return rawlock(FLCK_NCOND_UP, FLCK_NO_TIMEOUT); }
@@ -33,7 +33,8 @@ typedef enum flck_lock_type{
 	FLCK_WRITE_LOCK,
 	FLCK_NMTX_LOCK	= FLCK_WRITE_LOCK,
 	FLCK_NCOND_WAIT	= FLCK_WRITE_LOCK,
-	FLCK_NCOND_UP	= FLCK_UNLOCK
+	FLCK_NCOND_UP	= FLCK_UNLOCK,
+	FLCK_NCOND_REQUEUE	= 3					// waiting for named mutex after broadcast(must not be same as others)
 }FLCKLOCKTYPE;
 
 //---------------------------------------------------------
@@ -42,7 +43,7 @@ typedef enum flck_lock_type{
 #define STR_FLCKLOCKTYPE(LockType)			(FLCK_READ_LOCK == LockType ? "reader lock" : FLCK_WRITE_LOCK == LockType ? "writer lock" : FLCK_UNLOCK == LockType ? "unlock" : "unknown type")
 #define STR_FLCKFILELOCKTYPE(LockType)		STR_FLCKLOCKTYPE(LockType)
 #define STR_FLCKMUTEXTYPE(LockType)			(FLCK_NMTX_LOCK == LockType ? "mutex locked" : FLCK_UNLOCK == LockType ? "mutex unlocked" : "unknown type")
-#define STR_FLCKCONDTYPE(LockType)			(FLCK_NCOND_WAIT == LockType ? "waiting cond" : FLCK_NCOND_UP == LockType ? "signaled cond" : "unknown type")
+#define STR_FLCKCONDTYPE(LockType)			(FLCK_NCOND_WAIT == LockType ? "waiting cond" : FLCK_NCOND_UP == LockType ? "signaled cond" : FLCK_NCOND_REQUEUE == LockType ? "requeued to mutex" : "unknown type")
 
 #endif	// FLCKLOCKTYPE_H
 
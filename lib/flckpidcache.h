@@ -18,98 +18,169 @@
 #ifndef	FLCKPIDCACHE_H
 #define	FLCKPIDCACHE_H
 
-#include <map>
+#include <stdint.h>
+#include <string.h>
 
 //---------------------------------------------------------
-// Structure
+// Symbols
 //---------------------------------------------------------
-// Key structure
+#define	FLCK_PID_CACHE_SLOTS		128						// slot count in cache(power of 2)
+#define	FLCK_PID_CACHE_PROBE		8						// max probing count for one key
+#define	FLCK_PID_CACHE_WATCH_GEN	64						// max generation count for keeping watched answer
+
+//---------------------------------------------------------
+// FlPidCache Class
+//---------------------------------------------------------
+// Cache for the liveness of thread(process) and device/inode of fd, which
+// is used while checking dead locks. This is an open addressed table in
+// fixed array, then it does not allocate any memory.
 //
-typedef struct fl_pid_cache_key{
-	pid_t	pid;
-	tid_t	tid;
-	int		fd;
-
-	explicit fl_pid_cache_key(pid_t in_pid = FLCK_INVALID_ID, tid_t in_tid = FLCK_INVALID_ID, int in_fd = FLCK_INVALID_HANDLE) : pid(in_pid), tid(in_tid), fd(in_fd) {}
-	fl_pid_cache_key(const fl_pid_cache_key& other) : pid(other.pid), tid(other.tid), fd(other.fd) {}
-
-	fl_pid_cache_key& operator=(const fl_pid_cache_key& other)
-	{
-		pid	= other.pid;
-		tid	= other.tid;
-		fd	= other.fd;
-		return *this;
-	}
+// [NOTE]
+// Each entry has the generation when it is set, and the generation is
+// counted up at starting each checking(Refresh). The entry is valid only
+// in same generation, because the owner may exit and the fd may be
+// closed after that.
+// Only on the cache which is kept by the worker thread(is_watch), the
+// running answer by pidfd is kept over generations up to
+// FLCK_PID_CACHE_WATCH_GEN. The worker removes the entries for owner
+// by Remove() when it catches the exit event of that pidfd.
+//
+class FlPidCache
+{
+	protected:
+		typedef struct fl_pid_cache_entry{
+			pid_t		pid;
+			tid_t		tid;
+			int			fd;							// FLCK_INVALID_HANDLE for execution cache
+			uint32_t	gen;						// 0 means empty
+			bool		is_run;
+			bool		is_watched;					// is_run is answered by pidfd
+			dev_t		devid;
+			ino_t		inodeid;
+		}FLPIDCACHEENT, *PFLPIDCACHEENT;
+
+		bool			IsWatch;					// exit events are applied to this cache
+		uint32_t		Generation;
+		FLPIDCACHEENT	Entries[FLCK_PID_CACHE_SLOTS];
+
+	protected:
+		static size_t Hash(pid_t pid, tid_t tid, int fd)
+		{
+			uint32_t	val = static_cast<uint32_t>(pid) * 0x9E3779B1U;
+			val			^= static_cast<uint32_t>(tid) + 0x7F4A7C15U + (val << 6) + (val >> 2);
+			val			^= static_cast<uint32_t>(fd) + 0x7F4A7C15U + (val << 6) + (val >> 2);
+			return static_cast<size_t>(val);
+		}
 
-	bool operator<(const fl_pid_cache_key& other) const
-	{
-		if(pid < other.pid){
-			return true;
-		}else if(pid > other.pid){
-			return false;
+		bool IsValid(const FLPIDCACHEENT& entry) const
+		{
+			if(0 == entry.gen){
+				return false;
+			}
+			if(Generation == entry.gen){
+				return true;
+			}
+			return (IsWatch && entry.is_watched && entry.is_run && (Generation - entry.gen) < FLCK_PID_CACHE_WATCH_GEN);
 		}
-		// pid == other.pid
 
-		if(tid < other.tid){
-			return true;
-		}else if(tid > other.tid){
-			return false;
+		const FLPIDCACHEENT* Find(pid_t pid, tid_t tid, int fd) const
+		{
+			for(size_t cnt = 0, pos = Hash(pid, tid, fd); cnt < FLCK_PID_CACHE_PROBE; ++cnt, ++pos){
+				const FLPIDCACHEENT&	entry = Entries[pos & (FLCK_PID_CACHE_SLOTS - 1)];
+				if(entry.pid == pid && entry.tid == tid && entry.fd == fd && IsValid(entry)){
+					return &entry;
+				}
+			}
+			return NULL;
 		}
-		// tid == other.tid
 
-		if(fd < other.fd){
-			return true;
-		}else if(fd > other.fd){
-			return false;
-		}else if(FLCK_INVALID_HANDLE == fd){
-			return false;
+		// Returns the slot for the key, or invalid(oldest) slot in probing range.
+		//
+		PFLPIDCACHEENT Slot(pid_t pid, tid_t tid, int fd)
+		{
+			PFLPIDCACHEENT	pfree = NULL;
+			for(size_t cnt = 0, pos = Hash(pid, tid, fd); cnt < FLCK_PID_CACHE_PROBE; ++cnt, ++pos){
+				PFLPIDCACHEENT	pentry = &Entries[pos & (FLCK_PID_CACHE_SLOTS - 1)];
+				if(pentry->pid == pid && pentry->tid == tid && pentry->fd == fd && 0 != pentry->gen){
+					return pentry;
+				}
+				if(!IsValid(*pentry)){
+					if(!pfree || IsValid(*pfree)){
+						pfree = pentry;
+					}
+				}else if(!pfree || (IsValid(*pfree) && (Generation - pentry->gen) > (Generation - pfree->gen))){
+					pfree = pentry;
+				}
+			}
+			return pfree;
 		}
-		// fd != FLCK_INVALID_HANDLE && fd == other.fd
-		return false;
-	}
-}FLPIDCACHEKEY, *PFLPIDCACHEKEY;
 
-//
-// Value structure
-//
-typedef struct fl_pid_cache_value{
-	dev_t	devid;
-	ino_t	inodeid;
-	bool	is_run;
+	public:
+		explicit FlPidCache(bool is_watch = false) : IsWatch(is_watch), Generation(1)
+		{
+			memset(Entries, 0, sizeof(Entries));
+		}
 
-	explicit fl_pid_cache_value(dev_t in_devid = FLCK_INVALID_ID, ino_t in_inodeid = FLCK_INVALID_ID, bool in_is_run = true) : devid(in_devid), inodeid(in_inodeid), is_run(in_is_run) {}
-	fl_pid_cache_value(const fl_pid_cache_value& other) : devid(other.devid), inodeid(other.inodeid), is_run(other.is_run) {}
+		// Start new checking, entries in previous generation become invalid.
+		//
+		void Refresh(void)
+		{
+			if(0 == ++Generation){
+				// wrap around, 0 is for empty entry
+				memset(Entries, 0, sizeof(Entries));
+				Generation = 1;
+			}
+		}
 
-	fl_pid_cache_value& operator=(const fl_pid_cache_value& other)
-	{
-		devid	= other.devid;
-		inodeid	= other.inodeid;
-		is_run	= other.is_run;
-		return *this;
-	}
-}FLPIDCACHEVAL, *PFLPIDCACHEVAL;
+		// Remove all entries for the process.
+		//
+		void Remove(pid_t pid)
+		{
+			for(size_t pos = 0; pos < FLCK_PID_CACHE_SLOTS; ++pos){
+				if(Entries[pos].pid == pid){
+					Entries[pos].gen = 0;
+				}
+			}
+		}
+
+		bool Get(pid_t pid, tid_t tid, int fd, dev_t& devid, ino_t& inodeid, bool& is_run) const
+		{
+			const FLPIDCACHEENT*	pentry = Find(pid, tid, fd);
+			if(!pentry){
+				return false;
+			}
+			devid	= pentry->devid;
+			inodeid	= pentry->inodeid;
+			is_run	= pentry->is_run;
+			return true;
+		}
+
+		void Set(pid_t pid, tid_t tid, int fd, dev_t devid, ino_t inodeid, bool is_run, bool is_watched = false)
+		{
+			PFLPIDCACHEENT	pentry = Slot(pid, tid, fd);
+			pentry->pid			= pid;
+			pentry->tid			= tid;
+			pentry->fd			= fd;
+			pentry->gen			= Generation;
+			pentry->is_run		= is_run;
+			pentry->is_watched	= is_watched;
+			pentry->devid		= devid;
+			pentry->inodeid		= inodeid;
+		}
+};
 
 //---------------------------------------------------------
 // Typedef
 //---------------------------------------------------------
-typedef std::map<FLPIDCACHEKEY, FLPIDCACHEVAL>	fl_pid_cache_map_t;
+typedef FlPidCache	fl_pid_cache_map_t;
 
 //---------------------------------------------------------
 // Utility inline functions
 //---------------------------------------------------------
 inline bool get_device_cache(fl_pid_cache_map_t* pcache, pid_t pid, tid_t tid, int fd, dev_t& devid, ino_t& inodeid)
 {
-	if(!pcache){
-		return false;
-	}
-	FLPIDCACHEKEY						key(pid, tid, fd);
-	fl_pid_cache_map_t::const_iterator	iter = pcache->find(key);
-	if(pcache->end() == iter){
-		return false;
-	}
-	devid	= iter->second.devid;
-	inodeid	= iter->second.inodeid;
-	return true;
+	bool	is_run;
+	return (pcache && pcache->Get(pid, tid, fd, devid, inodeid, is_run));
 }
 
 inline bool set_device_cache(fl_pid_cache_map_t* pcache, pid_t pid, tid_t tid, int fd, dev_t devid, ino_t inodeid)
@@ -117,9 +188,7 @@ inline bool set_device_cache(fl_pid_cache_map_t* pcache, pid_t pid, tid_t tid, i
 	if(!pcache){
 		return false;
 	}
-	FLPIDCACHEKEY	key(pid, tid, fd);
-	FLPIDCACHEVAL	val(devid, inodeid);
-	(*pcache)[key] = val;
+	pcache->Set(pid, tid, fd, devid, inodeid, true);
 	return true;
 }
 
@@ -128,34 +197,23 @@ inline bool set_no_device_cache(fl_pid_cache_map_t* pcache, pid_t pid, tid_t tid
 	if(!pcache){
 		return false;
 	}
-	FLPIDCACHEKEY	key(pid, tid, fd);
-	FLPIDCACHEVAL	val;				// empty
-	(*pcache)[key] = val;
+	pcache->Set(pid, tid, fd, FLCK_INVALID_ID, FLCK_INVALID_ID, true);		// empty
 	return true;
 }
 
 inline bool get_execution_cache(fl_pid_cache_map_t* pcache, pid_t pid, tid_t tid, bool& is_run)
 {
-	if(!pcache){
-		return false;
-	}
-	FLPIDCACHEKEY						key(pid, tid);
-	fl_pid_cache_map_t::const_iterator	iter = pcache->find(key);
-	if(pcache->end() == iter){
-		return false;
-	}
-	is_run = iter->second.is_run;
-	return true;
+	dev_t	devid;
+	ino_t	inodeid;
+	return (pcache && pcache->Get(pid, tid, FLCK_INVALID_HANDLE, devid, inodeid, is_run));
 }
 
-inline bool set_execution_cache(fl_pid_cache_map_t* pcache, pid_t pid, tid_t tid, bool is_run)
+inline bool set_execution_cache(fl_pid_cache_map_t* pcache, pid_t pid, tid_t tid, bool is_run, bool is_watched = false)
 {
 	if(!pcache){
 		return false;
 	}
-	FLPIDCACHEKEY	key(pid, tid);
-	FLPIDCACHEVAL	val(FLCK_INVALID_ID, FLCK_INVALID_ID, is_run);
-	(*pcache)[key] = val;
+	pcache->Set(pid, tid, FLCK_INVALID_HANDLE, FLCK_INVALID_ID, FLCK_INVALID_ID, is_run, is_watched);
 	return true;
 }
 
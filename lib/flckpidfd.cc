@@ -0,0 +1,388 @@
+/*
+ * FULLOCK - Fast User Level LOCK library
+ *
+ * Copyright 2015 Yahoo Japan Corporation.
+ *
+ * FULLOCK is fast locking library on user level by Yahoo! JAPAN.
+ * FULLOCK is following specifications.
+ *
+ * For the full copyright and license information, please view
+ * the license file that was distributed with this source code.
+ *
+ * AUTHOR:   agent
+ * CREATE:   Sat 17 Oct 2026
+ * REVISION:
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "flckcommon.h"
+#include "flckstructure.h"
+#include "flckpidfd.h"
+#include "flckutil.h"
+#include "flckdbg.h"
+#include "flckbaselist.tcc"
+
+using namespace std;
+using namespace fullock;
+
+//---------------------------------------------------------
+// Symbols
+//---------------------------------------------------------
+#ifndef	PIDFD_THREAD
+#define	PIDFD_THREAD						O_EXCL					// since linux 6.9
+#endif
+#define	FLCK_PIDFD_PROC_PATH_FORM			"/proc/%d/task/%d"
+
+// [NOTE]
+// The worker's cache keeps the running answer by pidfd up to
+// FLCK_PID_CACHE_WATCH_GEN sweeps without calling Check, thus the pidfd
+// which is not checked is kept in same sweeps.
+//
+#define	FLCK_PIDFD_KEEP_GEN					FLCK_PID_CACHE_WATCH_GEN
+
+//---------------------------------------------------------
+// Class variable
+//---------------------------------------------------------
+const size_t	FlckPidfd::FLCK_PIDFD_MAX;
+const rlim_t	FlckPidfd::FLCK_PIDFD_NOFILE_DIV;
+int				FlckPidfd::LockVal			= FLCK_NOSHARED_MUTEX_VAL_UNLOCKED;
+size_t			FlckPidfd::MaxCount			= FlckPidfd::FLCK_PIDFD_MAX;
+uint32_t		FlckPidfd::SweepGen			= 0;
+int				FlckPidfd::EventFd			= FLCK_INVALID_HANDLE;
+volatile bool	FlckPidfd::IsNoSupport		= false;
+volatile bool	FlckPidfd::IsNoThreadSupport= false;
+bool			FlckPidfd::IsSetForkHandler	= false;
+
+//---------------------------------------------------------
+// Class Methods
+//---------------------------------------------------------
+// [NOTE]
+// To avoid static object initialization order problem(SIOF)
+// The table is never destructed, because the worker thread clears it
+// in its cleanup handler which is called after static objects are
+// destructed at exiting process.
+//
+FlckPidfd::fl_pidfd_map_t& FlckPidfd::GetMap(void)
+{
+	static fl_pidfd_map_t*	ppidfdmap = new fl_pidfd_map_t;		// singleton(never deleted)
+	return *ppidfdmap;
+}
+
+// [NOTE]
+// The pidfd for a thread which is not the thread group leader needs
+// PIDFD_THREAD flag, and it does not check that the thread belongs to
+// the process. Thus this checks /proc only once after opening pidfd,
+// the pidfd holds the thread so that the result of it does not change.
+//
+int FlckPidfd::OpenPidfd(pid_t pid, tid_t tid)
+{
+#ifdef	SYS_pidfd_open
+	int	pidfd;
+	if(pid == tid){
+		pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+	}else{
+		if(FlckPidfd::IsNoThreadSupport){
+			errno = EINVAL;
+			return FLCK_INVALID_HANDLE;
+		}
+		pidfd = static_cast<int>(syscall(SYS_pidfd_open, tid, PIDFD_THREAD));
+	}
+	if(FLCK_INVALID_HANDLE == pidfd){
+		if(ENOSYS == errno){
+			MSG_FLCKPRN("pidfd_open is not supported, thus checks process by /proc.");
+			FlckPidfd::IsNoSupport = true;
+		}else if(EINVAL == errno && pid != tid){
+			MSG_FLCKPRN("pidfd_open does not support PIDFD_THREAD, thus checks thread by /proc.");
+			FlckPidfd::IsNoThreadSupport = true;
+		}
+		return FLCK_INVALID_HANDLE;
+	}
+	// set close on exec(pidfd_open sets it, but for safety)
+	fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+
+	if(pid != tid){
+		char		szPath[PATH_MAX];
+		struct stat	st;
+		sprintf(szPath, FLCK_PIDFD_PROC_PATH_FORM, pid, tid);
+		if(-1 == stat(szPath, &st)){
+			close(pidfd);
+			errno = ESRCH;
+			return FLCK_INVALID_HANDLE;
+		}
+	}
+	return pidfd;
+#else
+	(void)pid;
+	(void)tid;
+	FlckPidfd::IsNoSupport	= true;
+	errno					= ENOSYS;
+	return FLCK_INVALID_HANDLE;
+#endif
+}
+
+// [NOTE]
+// The event data is the owner(flckpid), it always has pid in the upper
+// 32bit, so that it is not same as the data of inotify event(fd).
+//
+bool FlckPidfd::AddEvent(int pidfd, flckpid_t owner)
+{
+	if(FLCK_INVALID_HANDLE == FlckPidfd::EventFd){
+		return false;
+	}
+	struct epoll_event	epoolev;
+	memset(&epoolev, 0, sizeof(struct epoll_event));
+	epoolev.data.u64= static_cast<uint64_t>(owner);
+	epoolev.events	= EPOLLIN;
+	if(-1 == epoll_ctl(FlckPidfd::EventFd, EPOLL_CTL_ADD, pidfd, &epoolev)){
+		WAN_FLCKPRN("Failed to add pidfd(%d) to event fd(%d), error=%d", pidfd, FlckPidfd::EventFd, errno);
+		return false;
+	}
+	return true;
+}
+
+void FlckPidfd::DelEvent(int pidfd)
+{
+	if(FLCK_INVALID_HANDLE == FlckPidfd::EventFd){
+		return;
+	}
+	epoll_ctl(FlckPidfd::EventFd, EPOLL_CTL_DEL, pidfd, NULL);
+}
+
+// [NOTE]
+// pidfd is used only while the worker thread is running, because only
+// the worker can catch the event of pidfd and clears the table at exiting.
+// Without the worker, the caller checks /proc as before.
+// This method blocks thread cancel while locking the table, because
+// poll and close are cancellation points.
+//
+FlckPidfd::PIDFDSTATE FlckPidfd::Check(pid_t pid, tid_t tid)
+{
+	if(FlckPidfd::IsNoSupport || FLCK_INVALID_HANDLE == FlckPidfd::EventFd){
+		return FLCK_PIDFD_UNKNOWN;
+	}
+	int	old_cancel_state = PTHREAD_CANCEL_ENABLE;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancel_state);
+	flck_lock_noshared_mutex(&FlckPidfd::LockVal);
+
+	PIDFDSTATE					result	= FLCK_PIDFD_UNKNOWN;
+	flckpid_t					flckpid	= compose_flckpid(pid, tid);
+	fl_pidfd_map_t&				pidfdmap= FlckPidfd::GetMap();
+	fl_pidfd_map_t::iterator	iter	= pidfdmap.find(flckpid);
+	int							pidfd	= FLCK_INVALID_HANDLE;
+
+	if(FLCK_INVALID_HANDLE == FlckPidfd::EventFd){
+		// worker exited after checking above
+		pidfd = FLCK_INVALID_HANDLE;
+	}else if(pidfdmap.end() != iter){
+		pidfd			= iter->second.pidfd;
+		iter->second.gen= FlckPidfd::SweepGen;
+	}else if(FlckPidfd::MaxCount <= pidfdmap.size()){
+		// table is full
+		pidfd = FLCK_INVALID_HANDLE;
+	}else if(FLCK_INVALID_HANDLE == (pidfd = FlckPidfd::OpenPidfd(pid, tid))){
+		if(ESRCH == errno){
+			result = FLCK_PIDFD_DEAD;
+		}
+	}else if(!FlckPidfd::AddEvent(pidfd, flckpid)){
+		// the exit can not be caught by the worker, so check /proc
+		close(pidfd);
+		pidfd = FLCK_INVALID_HANDLE;
+	}else{
+		FLPIDFDENT	entry;
+		entry.pidfd			= pidfd;
+		entry.gen			= FlckPidfd::SweepGen;
+		pidfdmap[flckpid]	= entry;
+	}
+
+	if(FLCK_INVALID_HANDLE != pidfd){
+		// pidfd is readable when the process(thread) exits
+		struct pollfd	pfd;
+		pfd.fd		= pidfd;
+		pfd.events	= POLLIN;
+		pfd.revents	= 0;
+		int	pollres	= poll(&pfd, 1, 0);
+		if(0 == pollres){
+			result = FLCK_PIDFD_RUN;
+		}else if(0 < pollres){
+			// [NOTE]
+			// The pidfd is left in table, and it is released by the worker
+			// with the event. Then the worker always knows the owner's exit.
+			//
+			result = FLCK_PIDFD_DEAD;
+		}
+	}
+
+	flck_unlock_noshared_mutex(&FlckPidfd::LockVal);
+	pthread_setcancelstate(old_cancel_state, NULL);
+
+	return result;
+}
+
+// [NOTE]
+// Called by the worker thread after creating epoll, and registers all
+// pidfds which are kept in table(ex. inherited from parent process).
+//
+bool FlckPidfd::SetEventFd(int epollfd)
+{
+	if(FLCK_INVALID_HANDLE == epollfd){
+		ERR_FLCKPRN("Parameter is wrong.");
+		return false;
+	}
+	int	old_cancel_state = PTHREAD_CANCEL_ENABLE;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancel_state);
+	flck_lock_noshared_mutex(&FlckPidfd::LockVal);
+
+	// [NOTE]
+	// The table must not be copied to child process while other thread
+	// is modifying it, thus the fork handlers keep locking the table
+	// during forking. These are set only once, because the prepare
+	// handler locks the table.
+	//
+	if(!FlckPidfd::IsSetForkHandler){
+		int	result = pthread_atfork(FlckPidfd::PrepareForkHandler, FlckPidfd::ParentForkHandler, NULL);
+		if(0 != result){
+			ERR_FLCKPRN("Failed to set handler for forking(errno=%d), thus does not use pidfd.", result);
+			flck_unlock_noshared_mutex(&FlckPidfd::LockVal);
+			pthread_setcancelstate(old_cancel_state, NULL);
+			return false;
+		}
+		FlckPidfd::IsSetForkHandler = true;
+	}
+
+	// [NOTE]
+	// Each pidfd uses one fd in this process, thus the table size is
+	// limited by a small part of RLIMIT_NOFILE for leaving fds to caller.
+	//
+	struct rlimit	rlim;
+	if(0 == getrlimit(RLIMIT_NOFILE, &rlim) && RLIM_INFINITY != rlim.rlim_cur && (rlim.rlim_cur / FlckPidfd::FLCK_PIDFD_NOFILE_DIV) < static_cast<rlim_t>(FlckPidfd::FLCK_PIDFD_MAX)){
+		FlckPidfd::MaxCount = static_cast<size_t>(rlim.rlim_cur / FlckPidfd::FLCK_PIDFD_NOFILE_DIV);
+	}else{
+		FlckPidfd::MaxCount = FlckPidfd::FLCK_PIDFD_MAX;
+	}
+
+	FlckPidfd::EventFd		= epollfd;
+	fl_pidfd_map_t&	pidfdmap= FlckPidfd::GetMap();
+	for(fl_pidfd_map_t::const_iterator iter = pidfdmap.begin(); pidfdmap.end() != iter; ++iter){
+		FlckPidfd::AddEvent(iter->second.pidfd, iter->first);
+	}
+
+	flck_unlock_noshared_mutex(&FlckPidfd::LockVal);
+	pthread_setcancelstate(old_cancel_state, NULL);
+	return true;
+}
+
+void FlckPidfd::ResetEventFd(void)
+{
+	int	old_cancel_state = PTHREAD_CANCEL_ENABLE;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancel_state);
+	flck_lock_noshared_mutex(&FlckPidfd::LockVal);
+
+	fl_pidfd_map_t&	pidfdmap= FlckPidfd::GetMap();
+	for(fl_pidfd_map_t::const_iterator iter = pidfdmap.begin(); pidfdmap.end() != iter; ++iter){
+		FlckPidfd::DelEvent(iter->second.pidfd);
+		close(iter->second.pidfd);
+	}
+	pidfdmap.clear();
+	FlckPidfd::EventFd = FLCK_INVALID_HANDLE;
+
+	flck_unlock_noshared_mutex(&FlckPidfd::LockVal);
+	pthread_setcancelstate(old_cancel_state, NULL);
+}
+
+// [NOTE]
+// Called by the worker thread when pidfd event occurred with the owner
+// in its data. The pidfd may be already released by other event, thus
+// this releases only pidfd in table.
+//
+bool FlckPidfd::Release(flckpid_t owner)
+{
+	int	old_cancel_state = PTHREAD_CANCEL_ENABLE;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancel_state);
+	flck_lock_noshared_mutex(&FlckPidfd::LockVal);
+
+	bool						result	= false;
+	fl_pidfd_map_t&				pidfdmap= FlckPidfd::GetMap();
+	fl_pidfd_map_t::iterator	iter	= pidfdmap.find(owner);
+	if(pidfdmap.end() != iter){
+		FlckPidfd::DelEvent(iter->second.pidfd);
+		close(iter->second.pidfd);
+		pidfdmap.erase(iter);
+		result = true;
+	}
+
+	flck_unlock_noshared_mutex(&FlckPidfd::LockVal);
+	pthread_setcancelstate(old_cancel_state, NULL);
+	return result;
+}
+
+// [NOTE]
+// Called by the worker thread at end of each sweep(CheckProcessDead), and
+// closes pidfds which are not checked in last FLCK_PIDFD_KEEP_GEN sweeps.
+// Each sweep checks all owners of records, so the pid of those pidfds
+// does not own any record. Returns the count of closed pidfds.
+//
+size_t FlckPidfd::Sweep(void)
+{
+	int	old_cancel_state = PTHREAD_CANCEL_ENABLE;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancel_state);
+	flck_lock_noshared_mutex(&FlckPidfd::LockVal);
+
+	size_t			count	= 0;
+	fl_pidfd_map_t&	pidfdmap= FlckPidfd::GetMap();
+	++FlckPidfd::SweepGen;
+	for(fl_pidfd_map_t::iterator iter = pidfdmap.begin(); pidfdmap.end() != iter; ){
+		if(FLCK_PIDFD_KEEP_GEN < (FlckPidfd::SweepGen - iter->second.gen)){
+			FlckPidfd::DelEvent(iter->second.pidfd);
+			close(iter->second.pidfd);
+			pidfdmap.erase(iter++);
+			++count;
+		}else{
+			++iter;
+		}
+	}
+
+	flck_unlock_noshared_mutex(&FlckPidfd::LockVal);
+	pthread_setcancelstate(old_cancel_state, NULL);
+	return count;
+}
+
+void FlckPidfd::PrepareForkHandler(void)
+{
+	flck_lock_noshared_mutex(&FlckPidfd::LockVal);
+}
+
+void FlckPidfd::ParentForkHandler(void)
+{
+	flck_unlock_noshared_mutex(&FlckPidfd::LockVal);
+}
+
+// [NOTE]
+// The table is locked by prepare handler at forking. The child process
+// keeps inherited pidfds, and registers them to new worker's epoll.
+//
+void FlckPidfd::ChildForkHandler(void)
+{
+	FlckPidfd::LockVal	= FLCK_NOSHARED_MUTEX_VAL_UNLOCKED;
+	FlckPidfd::EventFd	= FLCK_INVALID_HANDLE;
+}
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noexpandtab sw=4 ts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4
+ */
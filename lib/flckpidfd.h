@@ -0,0 +1,102 @@
+/*
+ * FULLOCK - Fast User Level LOCK library
+ *
+ * Copyright 2015 Yahoo Japan Corporation.
+ *
+ * FULLOCK is fast locking library on user level by Yahoo! JAPAN.
+ * FULLOCK is following specifications.
+ *
+ * For the full copyright and license information, please view
+ * the license file that was distributed with this source code.
+ *
+ * AUTHOR:   agent
+ * CREATE:   Sat 17 Oct 2026
+ * REVISION:
+ *
+ */
+
+#ifndef	FLCKPIDFD_H
+#define	FLCKPIDFD_H
+
+#include <map>
+#include <sys/resource.h>
+
+#include "flckcommon.h"
+
+//---------------------------------------------------------
+// FlckPidfd Class
+//---------------------------------------------------------
+// This class keeps one pidfd for each owner(pid/tid) which is found
+// running, and answers liveness of the owner by polling its pidfd.
+// A pidfd only tells the exit of the process(thread) which it was opened
+// for. If the owner had exited before its pidfd is opened, the pidfd is
+// opened for another process which reuses the pid. Thus pidfd does not
+// detect pid reuse, as same as stat for /proc.
+//
+// All pidfds are registered to the epoll of FlckThread worker, so
+// that the owner's exit is pushed to the worker and it starts
+// checking dead locks without waiting the inotify(CLOSE) event.
+// The event has the owner(flckpid) as its data, then the worker
+// releases the pidfd by the key of table.
+//
+// If the kernel does not support pidfd(or pidfd for a thread), or
+// the table is full, the caller falls back to stat for /proc.
+// The table size is limited by a small part of RLIMIT_NOFILE, and the
+// pidfds which are not checked in recent sweeps(the pid does not own
+// any record) are closed by the worker at end of each sweep.
+//
+class FlckPidfd
+{
+	public:
+		typedef enum pidfd_state{
+			FLCK_PIDFD_UNKNOWN	= 0,						// could not check by pidfd, need to check by /proc
+			FLCK_PIDFD_RUN,									// owner is running
+			FLCK_PIDFD_DEAD									// owner is exited
+		}PIDFDSTATE;
+
+		static const size_t	FLCK_PIDFD_MAX		= 1024;		// maximum pidfd count in table
+		static const rlim_t	FLCK_PIDFD_NOFILE_DIV= 16;		// table size is up to RLIMIT_NOFILE / this value
+
+	protected:
+		typedef struct fl_pidfd_entry{
+			int			pidfd;
+			uint32_t	gen;								// sweep generation when it is checked at last
+		}FLPIDFDENT;
+
+		typedef std::map<flckpid_t, FLPIDFDENT>	fl_pidfd_map_t;	// flckpid -> pidfd
+
+		static int				LockVal;					// like mutex(no shared)
+		static size_t			MaxCount;					// maximum pidfd count in table decided by RLIMIT_NOFILE
+		static uint32_t			SweepGen;					// counted up at end of each sweep by worker
+		static int				EventFd;					// epoll fd in worker thread
+		static volatile bool	IsNoSupport;				// pidfd_open is not supported
+		static volatile bool	IsNoThreadSupport;			// pidfd_open does not support PIDFD_THREAD
+		static bool				IsSetForkHandler;			// fork handlers are set
+
+	protected:
+		static fl_pidfd_map_t& GetMap(void);
+		static int OpenPidfd(pid_t pid, tid_t tid);
+		static bool AddEvent(int pidfd, flckpid_t owner);
+		static void DelEvent(int pidfd);
+		static void PrepareForkHandler(void);
+		static void ParentForkHandler(void);
+
+	public:
+		static PIDFDSTATE Check(pid_t pid, tid_t tid);
+		static bool SetEventFd(int epollfd);
+		static void ResetEventFd(void);
+		static bool Release(flckpid_t owner);
+		static size_t Sweep(void);
+		static void ChildForkHandler(void);
+};
+
+#endif	// FLCKPIDFD_H
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noexpandtab sw=4 ts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4
+ */
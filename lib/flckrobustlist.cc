@@ -0,0 +1,385 @@
+/*
+ * FULLOCK - Fast User Level LOCK library
+ *
+ * Copyright 2015 Yahoo Japan Corporation.
+ *
+ * FULLOCK is fast locking library on user level by Yahoo! JAPAN.
+ * FULLOCK is following specifications.
+ *
+ * For the full copyright and license information, please view
+ * the license file that was distributed with this source code.
+ *
+ * AUTHOR:   agent
+ * CREATE:   Sat 17 Oct 2026
+ * REVISION:
+ *
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#ifdef	__GLIBC__
+#include <gnu/libc-version.h>
+#endif
+
+#include "flckcommon.h"
+#include "flckstructure.h"
+#include "flckrobustlist.h"
+#include "flckdbg.h"
+#include "flckbaselist.tcc"
+
+using namespace std;
+using namespace fullock;
+
+//---------------------------------------------------------
+// Symbols & Macros
+//---------------------------------------------------------
+#if defined(__GLIBC__) && defined(__PTHREAD_MUTEX_HAVE_PREV) && defined(SYS_get_robust_list)
+#if 2 == __GLIBC__ && 1 == __PTHREAD_MUTEX_HAVE_PREV
+#define	FLCK_HAVE_ROBUST_LIST
+#endif
+#endif
+
+#define	FLCK_ROBUST_GLIBC_VERSION_PREFIX	"2."
+#define	FLCK_ROBUST_LIST_LIMIT				2048				// same as ROBUST_LIST_LIMIT in kernel
+
+// [NOTE]
+// Entry in robust list which has the same layout as __pthread_list_t of
+// glibc. The node for kernel(struct robust_list) is next member, and each
+// pointer in the list points the node of another entry(or list head).
+// The lowest bit of the pointer is PI flag for the kernel.
+//
+typedef struct fl_robust_entry{
+	void*	prev;
+	void*	next;
+}FLROBUSTENTRY, *PFLROBUSTENTRY;
+
+#define	FLCK_ROBUST_ENTRY(pnode)	reinterpret_cast<PFLROBUSTENTRY>((reinterpret_cast<uintptr_t>(pnode) & ~static_cast<uintptr_t>(1)) - offsetof(FLROBUSTENTRY, next))
+#define	FLCK_ROBUST_BARRIER()		__asm__ __volatile__("" ::: "memory")
+
+//---------------------------------------------------------
+// Utility
+//---------------------------------------------------------
+// Unlink the entry from list(as same as glibc).
+//
+static inline void fl_robust_unlink(PFLROBUSTENTRY pentry)
+{
+	FLCK_ROBUST_ENTRY(pentry->next)->prev	= pentry->prev;
+	FLCK_ROBUST_ENTRY(pentry->prev)->next	= pentry->next;
+	FLCK_ROBUST_BARRIER();
+	pentry->prev							= NULL;
+	pentry->next							= NULL;
+}
+
+//---------------------------------------------------------
+// Class Methods
+//---------------------------------------------------------
+FlckRobustList::FlckRobustList(void) : Initialized(false), Supported(false), QueuedCount(0)
+{
+	int	result = pthread_key_create(&HeadKey, NULL);
+	if(0 != result){
+		ERR_FLCKPRN("Could not create key for each thread, error code=%d.", result);
+		return;
+	}
+	if(0 != (result = pthread_key_create(&CountKey, FlckRobustList::ExitThreadHandler))){
+		ERR_FLCKPRN("Could not create key for each thread, error code=%d.", result);
+		pthread_key_delete(HeadKey);
+		return;
+	}
+	Initialized = true;
+
+#ifdef	FLCK_HAVE_ROBUST_LIST
+	// check glibc version at running
+	const char*	pversion = gnu_get_libc_version();
+	if(!pversion || 0 != strncmp(pversion, FLCK_ROBUST_GLIBC_VERSION_PREFIX, strlen(FLCK_ROBUST_GLIBC_VERSION_PREFIX))){
+		MSG_FLCKPRN("Running glibc version(%s) is not 2.x, so robust list is not supported.", pversion ? pversion : "unknown");
+		return;
+	}
+	// check the entry position for the futex offset of glibc's list head
+	struct robust_list_head*	phead	= NULL;
+	size_t						len		= 0;
+	if(0 != syscall(SYS_get_robust_list, 0, &phead, &len)){
+		MSG_FLCKPRN("Could not get robust list head(errno=%d), so robust list is not supported.", errno);
+		return;
+	}
+	if(!phead || sizeof(struct robust_list_head) != len){
+		MSG_FLCKPRN("Robust list head is not registered or unknown size(%zu), so robust list is not supported.", len);
+		return;
+	}
+	FLNAMEDMUTEX	tmp;
+	uintptr_t		node	= reinterpret_cast<uintptr_t>(fl_mutex_futex_addr(&tmp.lockval)) - phead->futex_offset;
+	uintptr_t		start	= reinterpret_cast<uintptr_t>(&tmp.robust_area[0]);
+	uintptr_t		end		= reinterpret_cast<uintptr_t>(&tmp.robust_area[FLCK_MUTEX_ROBUST_AREA]);
+	if(0 != (node % sizeof(void*)) || (node - offsetof(FLROBUSTENTRY, next)) < start || end < (node - offsetof(FLROBUSTENTRY, next) + sizeof(FLROBUSTENTRY))){
+		MSG_FLCKPRN("Robust list entry for futex offset(%ld) is out of area in named mutex, so robust list is not supported.", phead->futex_offset);
+		return;
+	}
+	if(!FlckRobustList::ProbeLayout(phead)){
+		MSG_FLCKPRN("Robust list of glibc does not have expected layout, so robust list is not supported.");
+		return;
+	}
+
+	// [NOTE]
+	// glibc empties the list of child process, then the counts which are
+	// inherited from parent are cleared.
+	//
+	if(0 != (result = pthread_atfork(NULL, NULL, FlckRobustList::ChildForkHandler))){
+		ERR_FLCKPRN("Failed to set handler for forking(errno=%d), so robust list is not supported.", result);
+		return;
+	}
+	Supported = true;
+#else
+	MSG_FLCKPRN("This platform does not have doubly linked robust list, so robust list is not supported.");
+#endif
+}
+
+FlckRobustList::~FlckRobustList(void)
+{
+	if(Initialized){
+		int	result = pthread_key_delete(HeadKey);
+		if(0 != result){
+			ERR_FLCKPRN("Could not delete key for each thread, error code=%d.", result);
+		}
+		if(0 != (result = pthread_key_delete(CountKey))){
+			ERR_FLCKPRN("Could not delete key for each thread, error code=%d.", result);
+		}
+	}
+	// [NOTE]
+	// This may be called before destroying FlShm at exiting process.
+	//
+	Initialized	= false;
+	Supported	= false;
+}
+
+//
+// Access function to avoid static object initialization order problem
+//
+FlckRobustList& FlckRobustList::GetObject(void)
+{
+	static FlckRobustList	RobustList;				// singleton
+	return RobustList;
+}
+
+// [NOTE]
+// The list head is in the thread descriptor of glibc, so it is cached for
+// each thread. The forked child has the same descriptor address, and glibc
+// registers the same head(with empty list) for it.
+//
+struct robust_list_head* FlckRobustList::GetHead(void)
+{
+	if(!IsSupported()){
+		return NULL;
+	}
+	struct robust_list_head*	phead;
+	if(NULL == (phead = reinterpret_cast<struct robust_list_head*>(pthread_getspecific(GetObject().HeadKey)))){
+#ifdef	FLCK_HAVE_ROBUST_LIST
+		size_t	len = 0;
+		if(0 != syscall(SYS_get_robust_list, 0, &phead, &len) || !phead || sizeof(struct robust_list_head) != len){
+			ERR_FLCKPRN("Could not get robust list head for this thread(errno=%d).", errno);
+			return NULL;
+		}
+		int	result = pthread_setspecific(GetObject().HeadKey, phead);
+		if(0 != result){
+			ERR_FLCKPRN("Could not set key and value(robust list head), error code=%d.", result);
+		}
+#endif
+	}
+	return phead;
+}
+
+struct robust_list* FlckRobustList::GetEntry(struct robust_list_head* phead, PFLNAMEDMUTEX pmutex)
+{
+	return reinterpret_cast<struct robust_list*>(reinterpret_cast<uintptr_t>(fl_mutex_futex_addr(&(pmutex->lockval))) - phead->futex_offset);
+}
+
+// [NOTE]
+// The layout of glibc's list is checked by locking a robust pthread mutex,
+// glibc links its __list member to the head of calling thread. The futex
+// offset must be the same as pthread_mutex_t, and the links must be the
+// same as which Enqueue makes. After unlocking, the list must be back.
+//
+bool FlckRobustList::ProbeLayout(struct robust_list_head* phead)
+{
+#ifdef	FLCK_HAVE_ROBUST_LIST
+	long	futex_offset = static_cast<long>(offsetof(pthread_mutex_t, __data.__lock)) - static_cast<long>(offsetof(pthread_mutex_t, __data.__list.__next));
+	if(!phead || futex_offset != phead->futex_offset){
+		MSG_FLCKPRN("Futex offset(%ld) of robust list head is not same as pthread_mutex_t(%ld).", phead ? phead->futex_offset : 0L, futex_offset);
+		return false;
+	}
+
+	pthread_mutexattr_t	attr;
+	pthread_mutex_t		probe;
+	if(0 != pthread_mutexattr_init(&attr)){
+		return false;
+	}
+	if(0 != pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) || 0 != pthread_mutex_init(&probe, &attr)){
+		pthread_mutexattr_destroy(&attr);
+		return false;
+	}
+	pthread_mutexattr_destroy(&attr);
+
+	bool	result	= false;
+	void*	ptop	= phead->list.next;
+	if(0 == pthread_mutex_lock(&probe)){
+		void*	pnode	= &(probe.__data.__list.__next);
+		result			= (pnode == phead->list.next && ptop == probe.__data.__list.__next && reinterpret_cast<void*>(phead) == probe.__data.__list.__prev && pnode == FLCK_ROBUST_ENTRY(ptop)->prev);
+		pthread_mutex_unlock(&probe);
+		result			= (result && ptop == phead->list.next && NULL == probe.__data.__list.__next);
+	}
+	pthread_mutex_destroy(&probe);
+	return result;
+#else
+	(void)phead;
+	return false;
+#endif
+}
+
+// Count up(down) queued entries of calling thread and process.
+//
+void FlckRobustList::AddCount(int count)
+{
+	int	thcount = static_cast<int>(reinterpret_cast<intptr_t>(pthread_getspecific(GetObject().CountKey))) + count;
+	int	result	= pthread_setspecific(GetObject().CountKey, reinterpret_cast<const void*>(static_cast<intptr_t>(thcount)));
+	if(0 != result){
+		ERR_FLCKPRN("Could not set key and value(queued count=%d), error code=%d.", thcount, result);
+		return;
+	}
+	__sync_add_and_fetch(&(GetObject().QueuedCount), count);
+}
+
+// [NOTE]
+// Called at exiting thread which has queued entries, the kernel handles
+// them and they are not in any list of this process after that.
+//
+void FlckRobustList::ExitThreadHandler(void* pcount)
+{
+	__sync_sub_and_fetch(&(GetObject().QueuedCount), static_cast<int>(reinterpret_cast<intptr_t>(pcount)));
+}
+
+void FlckRobustList::ChildForkHandler(void)
+{
+	GetObject().QueuedCount = 0;
+	pthread_setspecific(GetObject().CountKey, NULL);
+}
+
+// [NOTE]
+// The pending entry is checked by the kernel even if it is not linked yet,
+// so it is set while locking and unlocking the mutex.
+//
+void FlckRobustList::SetPending(PFLNAMEDMUTEX pmutex)
+{
+	struct robust_list_head*	phead;
+	if(!pmutex || NULL == (phead = GetHead())){
+		return;
+	}
+	phead->list_op_pending = GetEntry(phead, pmutex);
+	FLCK_ROBUST_BARRIER();
+}
+
+void FlckRobustList::ClearPending(void)
+{
+	struct robust_list_head*	phead;
+	if(NULL == (phead = GetHead())){
+		return;
+	}
+	FLCK_ROBUST_BARRIER();
+	phead->list_op_pending = NULL;
+}
+
+// Link the entry of the mutex to the top of list(as same as glibc).
+//
+void FlckRobustList::Enqueue(PFLNAMEDMUTEX pmutex)
+{
+	struct robust_list_head*	phead;
+	if(!pmutex || NULL == (phead = GetHead())){
+		return;
+	}
+	struct robust_list*	pnode	= GetEntry(phead, pmutex);
+	PFLROBUSTENTRY		pentry	= FLCK_ROBUST_ENTRY(pnode);
+	void*				ptop	= phead->list.next;
+
+	FLCK_ROBUST_ENTRY(ptop)->prev	= pnode;
+	pentry->next					= ptop;
+	pentry->prev					= phead;
+	FLCK_ROBUST_BARRIER();
+	phead->list.next				= pnode;
+
+	AddCount(1);
+}
+
+// Unlink the entry of the mutex from list(as same as glibc).
+//
+void FlckRobustList::Dequeue(PFLNAMEDMUTEX pmutex)
+{
+	struct robust_list_head*	phead;
+	if(!pmutex || NULL == (phead = GetHead())){
+		return;
+	}
+	PFLROBUSTENTRY	pentry = FLCK_ROBUST_ENTRY(GetEntry(phead, pmutex));
+	if(!pentry->next || !pentry->prev){
+		return;
+	}
+	fl_robust_unlink(pentry);
+	AddCount(-1);
+}
+
+// Clear the entry which is left by the dead(or another) owner.
+//
+void FlckRobustList::Clear(PFLNAMEDMUTEX pmutex)
+{
+	struct robust_list_head*	phead;
+	if(!pmutex || NULL == (phead = GetHead())){
+		return;
+	}
+	PFLROBUSTENTRY	pentry	= FLCK_ROBUST_ENTRY(GetEntry(phead, pmutex));
+	pentry->prev			= NULL;
+	pentry->next			= NULL;
+}
+
+bool FlckRobustList::IsQueued(PFLNAMEDMUTEX pmutex)
+{
+	struct robust_list_head*	phead;
+	if(!pmutex || NULL == (phead = GetHead())){
+		return false;
+	}
+	return (NULL != FLCK_ROBUST_ENTRY(GetEntry(phead, pmutex))->next);
+}
+
+// Unlink all entries in the area(shared memory) from the list of calling
+// thread, the mutexes are kept locked without robust list.
+//
+// Returns	false	: other threads in this process have queued entries
+//			true	: no entry is queued
+//
+bool FlckRobustList::DequeueAll(const void* pbase, size_t length)
+{
+	struct robust_list_head*	phead;
+	if(!pbase || NULL == (phead = GetHead())){
+		return true;
+	}
+	uintptr_t	start	= reinterpret_cast<uintptr_t>(pbase);
+	uintptr_t	end		= start + length;
+	void*		pnode	= phead->list.next;
+	for(int cnt = 0; pnode && FLCK_ROBUST_ENTRY(pnode) != FLCK_ROBUST_ENTRY(phead) && cnt < FLCK_ROBUST_LIST_LIMIT; ++cnt){
+		PFLROBUSTENTRY	pentry	= FLCK_ROBUST_ENTRY(pnode);
+		pnode					= pentry->next;
+		if(start <= reinterpret_cast<uintptr_t>(pentry) && reinterpret_cast<uintptr_t>(pentry) < end){
+			fl_robust_unlink(pentry);
+			AddCount(-1);
+		}
+	}
+	return (0 >= GetObject().QueuedCount);
+}
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noexpandtab sw=4 ts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4
+ */
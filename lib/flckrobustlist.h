@@ -0,0 +1,97 @@
+/*
+ * FULLOCK - Fast User Level LOCK library
+ *
+ * Copyright 2015 Yahoo Japan Corporation.
+ *
+ * FULLOCK is fast locking library on user level by Yahoo! JAPAN.
+ * FULLOCK is following specifications.
+ *
+ * For the full copyright and license information, please view
+ * the license file that was distributed with this source code.
+ *
+ * AUTHOR:   agent
+ * CREATE:   Sat 17 Oct 2026
+ * REVISION:
+ *
+ */
+
+#ifndef	FLCKROBUSTLIST_H
+#define	FLCKROBUSTLIST_H
+
+#include <pthread.h>
+#include <linux/futex.h>
+
+#include "flckcommon.h"
+#include "flckstructure.h"
+
+//---------------------------------------------------------
+// FlckRobustList Class
+//---------------------------------------------------------
+// This class registers the held named mutex to the kernel robust list of
+// the calling thread. When the thread exits with holding it, the kernel
+// sets FLCK_MUTEX_OWNER_DIED to the lock value and wakes up one waiter,
+// then the next locker takes over the mutex without checking dead lock.
+//
+// [NOTE]
+// The kernel accepts only one robust list for each thread, and glibc has
+// already registered its list for robust pthread mutex. So this class does
+// not replace it, but links entries into glibc's list by the same way as
+// glibc. The list head is private data in glibc's thread descriptor, thus
+// this class is supported only when all of followings are true:
+//	- built with glibc 2.x which has doubly linked list(__PTHREAD_MUTEX_HAVE_PREV)
+//	- running with glibc 2.x
+//	- locking a robust pthread mutex in probe links it to the head as expected,
+//	  and the futex offset is the same as pthread_mutex_t
+//	- the entry position by the futex offset is in robust_area of FLNAMEDMUTEX
+// Otherwise the dead owner is found by checking dead lock.
+// The list is changed only by its own thread(same as glibc), so it does not
+// race with glibc except signal handler which locks robust pthread mutex.
+//
+// The entry has pointers in the owner process, so the entries in shared
+// memory must be unlinked before detaching it(DequeueAll). The entries of
+// other threads can not be unlinked, then detaching is refused while they
+// are queued. Each thread counts own entries, and the count is taken off
+// from the total of process when the thread exits.
+//
+class FlckRobustList
+{
+	protected:
+		bool			Initialized;
+		bool			Supported;
+		pthread_key_t	HeadKey;					// == unsigned int
+		pthread_key_t	CountKey;					// == unsigned int(queued entry count of each thread)
+		volatile int	QueuedCount;				// queued entry count in this process
+
+	protected:
+		FlckRobustList(void);
+		virtual ~FlckRobustList(void);
+
+		static FlckRobustList& GetObject(void);
+		static struct robust_list_head* GetHead(void);
+		static struct robust_list* GetEntry(struct robust_list_head* phead, PFLNAMEDMUTEX pmutex);
+		static bool ProbeLayout(struct robust_list_head* phead);
+		static void AddCount(int count);
+		static void ExitThreadHandler(void* pcount);
+		static void ChildForkHandler(void);
+
+	public:
+		static bool IsSupported(void) { return GetObject().Supported; }
+		static void SetPending(PFLNAMEDMUTEX pmutex);
+		static void ClearPending(void);
+		static void Enqueue(PFLNAMEDMUTEX pmutex);
+		static void Dequeue(PFLNAMEDMUTEX pmutex);
+		static void Clear(PFLNAMEDMUTEX pmutex);
+		static bool IsQueued(PFLNAMEDMUTEX pmutex);
+		static bool DequeueAll(const void* pbase, size_t length);
+};
+
+#endif	// FLCKROBUSTLIST_H
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noexpandtab sw=4 ts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4
+ */
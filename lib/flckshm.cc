@@ -26,6 +26,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
 
 #include "flckcommon.h"
 #include "flckshm.h"
@@ -34,6 +37,7 @@
 #include "flcklistfilelock.h"
 #include "flcklistnmtx.h"
 #include "flcklistncond.h"
+#include "flckpidfd.h"
 #include "flckutil.h"
 #include "flckdbg.h"
 
@@ -69,6 +73,15 @@ using namespace fullock;
 #define	FLCK_FREEUNITMODE_OFFSET_STR			"OFFSET"
 #define	FLCK_FREEUNITMODE_ALWAYS_STR			"ALWAYS"
 
+#define	FLCK_PREFERMODE_READER_STR				"READER"
+#define	FLCK_PREFERMODE_WRITER_STR				"WRITER"
+
+#define	FLCK_RWLOCKTYPE_CAS_STR					"CAS"
+#define	FLCK_RWLOCKTYPE_PHASEFAIR_STR			"PHASEFAIR"
+
+#define	FLCK_ROBUSTLIST_YES_STR					"YES"
+#define	FLCK_ROBUSTLIST_NO_STR					"NO"
+
 #define	FLCK_FLCKFILECNT_DEFAULT				128					// default area count for file lock structure
 #define	FLCK_FLCKFILECNT_MIN					1
 #define	FLCK_FLCKFILECNT_MAX					2048
@@ -88,6 +101,11 @@ using namespace fullock;
 #define	FLCK_FLCKWAITERCNT_MIN					4
 #define	FLCK_FLCKWAITERCNT_MAX					16384
 
+#define	FLCK_SWEEP_STEP_FILES					16					// max file count checked in one step of sweeping
+#define	FLCK_SWEEP_STEP_USEC					200					// max time(us) for one step of sweeping
+#define	FLCK_SWEEP_STEP_RESTART					4					// max restart count from top of bucket in sweeping
+#define	FLCK_SWEEP_NO_BUCKET					static_cast<size_t>(-1)	// no bucket is given up in sweeping
+
 //---------------------------------------------------------
 // Helper class
 //---------------------------------------------------------
@@ -163,6 +181,9 @@ const char*			FlShm::FLCKAUTOINIT			= "FLCKAUTOINIT";
 const char*			FlShm::FLCKROBUSTMODE		= "FLCKROBUSTMODE";
 const char*			FlShm::FLCKNOMAPMODE		= "FLCKNOMAPMODE";
 const char*			FlShm::FLCKFREEUNITMODE		= "FLCKFREEUNITMODE";
+const char*			FlShm::FLCKPREFERMODE		= "FLCKPREFERMODE";
+const char*			FlShm::FLCKRWLOCKTYPE		= "FLCKRWLOCKTYPE";
+const char*			FlShm::FLCKROBUSTLIST		= "FLCKROBUSTLIST";
 const char*			FlShm::FLCKROBUSTCHKCNT		= "FLCKROBUSTCHKCNT";
 const char*			FlShm::FLCKUMASK			= "FLCKUMASK";
 const char*			FlShm::FLCKDIRPATH			= "FLCKDIRPATH";
@@ -178,6 +199,9 @@ bool				FlShm::IsAutoInitialize		= true;
 FlShm::ROBUSTMODE	FlShm::RobustMode			= FlShm::ROBUST_DEFAULT;
 FlShm::NOMAPMODE	FlShm::NomapMode			= FlShm::NOMAP_ALLOW_NORETRY;
 FlShm::FREEUNITMODE	FlShm::FreeUnitMode			= FlShm::FREE_FD;
+FlShm::PREFERMODE	FlShm::PreferMode			= FlShm::PREFER_DEFAULT;
+FlShm::RWLOCKTYPE	FlShm::RwlockType			= FlShm::RWLOCK_DEFAULT;
+FlShm::ROBUSTLISTMODE	FlShm::RobustListMode	= FlShm::ROBUSTLIST_DEFAULT;
 mode_t				FlShm::ShmFileUmask			= 0;
 int					FlShm::RobustLoopCnt		= FLCK_ROBUST_CHKCNT_DEFAULT;
 size_t				FlShm::FileLockAreaCount	= FLCK_FLCKFILECNT_DEFAULT;
@@ -188,12 +212,21 @@ size_t				FlShm::NCondAreaCount		= FLCK_FLCKNCONDCNT_DEFAULT;
 size_t				FlShm::WaiterAreaCount		= FLCK_FLCKWAITERCNT_DEFAULT;
 
 int					FlShm::ShmFd				= FLCK_INVALID_HANDLE;
+size_t				FlShm::MapLength			= 0;
 std::string*		FlShm::pShmDirPath			= NULL;
 std::string*		FlShm::pShmFileName			= NULL;
 std::string*		FlShm::pShmPath				= NULL;
 void*				FlShm::pShmBase				= NULL;
 PFLHEAD				FlShm::pFlHead				= NULL;
+unsigned int		FlShm::AttachGen			= 0;
+PFLMAGAZINE			FlShm::pMagazine			= NULL;
+pid_t				FlShm::MagazinePid			= 0;
+int					FlShm::MagazineLockVal		= FLCK_NOSHARED_MUTEX_VAL_UNLOCKED;
 FlckThread*			FlShm::pCheckPidThread		= NULL;
+size_t				FlShm::SweepBucket			= FLCK_SWEEP_NO_BUCKET;
+PFLFILELOCK			FlShm::SweepParent			= NULL;
+uint32_t			FlShm::SweepBucketGen		= 0;
+unsigned int		FlShm::SweepAttachGen		= 0;
 int					FlShm::InotifyFd			= FLCK_INVALID_HANDLE;
 int					FlShm::WatchFd				= FLCK_INVALID_HANDLE;
 int					FlShm::EventFd				= FLCK_INVALID_HANDLE;
@@ -436,6 +469,27 @@ FlShm::FREEUNITMODE FlShm::SetFreeUnitMode(FlShm::FREEUNITMODE newval)
 	return oldval;
 }
 
+FlShm::PREFERMODE FlShm::SetPreferMode(FlShm::PREFERMODE newval)
+{
+	PREFERMODE	oldval	= FlShm::PreferMode;
+	FlShm::PreferMode	= newval;
+	return oldval;
+}
+
+FlShm::RWLOCKTYPE FlShm::SetRwlockType(FlShm::RWLOCKTYPE newval)
+{
+	RWLOCKTYPE	oldval	= FlShm::RwlockType;
+	FlShm::RwlockType	= newval;
+	return oldval;
+}
+
+FlShm::ROBUSTLISTMODE FlShm::SetRobustListMode(FlShm::ROBUSTLISTMODE newval)
+{
+	ROBUSTLISTMODE	oldval	= FlShm::RobustListMode;
+	FlShm::RobustListMode	= newval;
+	return oldval;
+}
+
 int FlShm::SetRobustLoopCnt(int newval)
 {
 	if(FlShm::ROBUST_HIGH != FlShm::RobustMode){
@@ -491,29 +545,63 @@ size_t FlShm::SetWaiterAreaCount(size_t newval)
 	return oldval;
 }
 
+//---------------------------------------------------------
+// Utility for file lock bucket
+//---------------------------------------------------------
+// Cut off the file lock from the list in bucket, and count up the
+// generation of bucket(see FLFILEBUCKET). Call this with locking lockid.
+//
+inline bool fl_cutoff_filelock(FlListFileLock& listobj, PFLFILEBUCKET pbucket)
+{
+	if(!listobj.cutoff_list(pbucket->file_lock_list)){
+		return false;
+	}
+	++(pbucket->gen);
+	return true;
+}
+
 //---------------------------------------------------------
 // FlShm : Processes Methods
 //---------------------------------------------------------
-bool FlShm::CheckProcessDead(void)
+// [NOTE]
+// The worker thread passes its cache which is kept over checking, and
+// a new generation is started in it.
+//
+bool FlShm::CheckProcessDead(fl_pid_cache_map_t* pcache_map)
 {
 	if(FLCK_INVALID_HANDLE == FlShm::ShmFd){
 		return false;
 	}
 	flckpid_t			flckpid	= get_flckpid();
 	fl_pid_cache_map_t	cache_map;
+	if(pcache_map){
+		pcache_map->Refresh();
+	}else{
+		pcache_map = &cache_map;
+	}
 
 	// check file lock list
-	CheckFileLockDeadLock(&cache_map, flckpid);
+	CheckFileLockDeadLock(pcache_map, flckpid);
 
 	// check mutex list
-	CheckMutexDeadLock(&cache_map, flckpid);
+	CheckMutexDeadLock(pcache_map, flckpid);
 
 	// check cond list
-	CheckCondDeadLock(&cache_map, flckpid);
+	CheckCondDeadLock(pcache_map, flckpid);
+
+	// check magazines
+	CheckMagazineDead(pcache_map);
 
 	return true;
 }
 
+// Returns	true	: the last sweep gave up a bucket, and the next pass resumes it.
+//
+bool FlShm::IsSweepPending(void)
+{
+	return (FLCK_SWEEP_NO_BUCKET != FlShm::SweepBucket && FlShm::SweepAttachGen == FlShm::AttachGen);
+}
+
 // Returns	false	: does not dead lock
 //			true	: this object is dead lock and force unlock this.
 //
@@ -522,41 +610,94 @@ bool FlShm::CheckFileLockDeadLock(fl_pid_cache_map_t* pcache_map, flckpid_t flck
 	if(FLCK_INVALID_HANDLE == FlShm::ShmFd){
 		return false;
 	}
-	if(!FlShm::pFlHead->file_lock_list){
-		return false;
-	}
 
 	if(FLCK_INVALID_ID == flckpid){
 		flckpid	= get_flckpid();
 	}
-	fl_lock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// lock lockid for top manually.(keep to lock)
+	// [NOTE]
+	// Checking dead lock runs /proc(or pidfd) checks for every locker, so
+	// that it is divided into steps. One step checks files in one bucket up
+	// to FLCK_SWEEP_STEP_FILES or FLCK_SWEEP_STEP_USEC, and the bucket lockid
+	// is released between steps. The cursor is the last file which is left
+	// in the list(pParent), and the next step resumes from its next without
+	// walking the list if the generation of bucket is not changed. If other
+	// removed a file lock while unlocking, the step restarts from the top of
+	// bucket(checking again is harmless). After FLCK_SWEEP_STEP_RESTART
+	// restarts, this pass gives up the rest of bucket, and keeps the cursor
+	// for the next pass(one bucket at most). The worker runs the next pass
+	// at its interval while the cursor is kept(IsSweepPending).
+	//
+	size_t		resume_bucket	= (FlShm::SweepAttachGen == FlShm::AttachGen ? FlShm::SweepBucket : FLCK_SWEEP_NO_BUCKET);
+	PFLFILELOCK	resume_parent	= FlShm::SweepParent;
+	uint32_t	resume_gen		= FlShm::SweepBucketGen;
+	FlShm::SweepBucket			= FLCK_SWEEP_NO_BUCKET;
 
 	FlListFileLock		tmpobj;
 	bool				result = false;		// true means that found deadlock and force unlock it.
-	for(PFLFILELOCK pParent = NULL, ptmp = to_abs(FlShm::pFlHead->file_lock_list); ptmp; ){
-		tmpobj.set(ptmp);
-		if(tmpobj.check_dead_lock(pcache_map, except_flckpid)){
-			// retrieve target list
-			if(tmpobj.cutoff_list(FlShm::pFlHead->file_lock_list)){
-				// return object to free list
-				if(!tmpobj.insert_list(FlShm::pFlHead->file_lock_free)){
-					ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
+	for(size_t index = 0; index < FlShm::pFlHead->file_lock_hash_cnt; ++index){
+		PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(index);
+		if(!pbucket->file_lock_list){
+			continue;
+		}
+		bool		is_resume	= (index == resume_bucket);
+		PFLFILELOCK	pParent		= (is_resume ? resume_parent : NULL);
+		uint32_t	gen			= (is_resume ? resume_gen : 0);
+		int			restartcnt	= 0;
+		for(bool is_first = !is_resume; ; is_first = false){
+			fl_lock_lockid(&(pbucket->lockid), flckpid);	// lock lockid for bucket manually.(keep to lock)
+
+			// resume from cursor
+			if(!is_first && gen != pbucket->gen){
+				pParent = NULL;
+				++restartcnt;
+			}
+			PFLFILELOCK	ptmp		= (pParent ? to_abs(pParent->next) : to_abs(pbucket->file_lock_list));
+
+			struct timespec	deadline;
+			bool			is_deadline = flck_set_deadline(&deadline, FLCK_SWEEP_STEP_USEC);
+			for(size_t cnt = 0; ptmp && cnt < FLCK_SWEEP_STEP_FILES && (0 == cnt || !is_deadline || !flck_is_over_deadline(&deadline)); ++cnt){
+				tmpobj.set(ptmp);
+				if(tmpobj.check_dead_lock(pcache_map, except_flckpid)){
+					// retrieve target list
+					if(fl_cutoff_filelock(tmpobj, pbucket)){
+						// return object to free list
+						if(!tmpobj.insert_free(FlShm::pFlHead->file_lock_free)){
+							ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
+						}
+					}
+					// set next
+					if(pParent){
+						ptmp = to_abs(pParent->next);
+					}else{
+						ptmp = to_abs(pbucket->file_lock_list);
+					}
+					result = true;
+				}else{
+					// set next
+					pParent	= ptmp;
+					ptmp	= to_abs(ptmp->next);
 				}
 			}
-			// set next
-			if(pParent){
-				ptmp = to_abs(pParent->next);
-			}else{
-				ptmp = to_abs(FlShm::pFlHead->file_lock_list);
+			gen = pbucket->gen;
+			fl_unlock_lockid(&(pbucket->lockid), flckpid);	// unlock lockid
+
+			if(!ptmp){
+				break;
 			}
-			result = true;
-		}else{
-			// set next
-			pParent	= ptmp;
-			ptmp	= to_abs(ptmp->next);
+			if(FLCK_SWEEP_STEP_RESTART <= restartcnt){
+				// give up the rest of bucket in this pass
+				if(FLCK_SWEEP_NO_BUCKET == FlShm::SweepBucket){
+					FlShm::SweepBucket		= index;
+					FlShm::SweepParent		= pParent;
+					FlShm::SweepBucketGen	= gen;
+					FlShm::SweepAttachGen	= FlShm::AttachGen;
+				}
+				MSG_FLCKPRN("Gave up checking the rest of file lock bucket(%zu) after %d restarts.", index, restartcnt);
+				break;
+			}
+			sched_yield();									// give lockers in this bucket a chance
 		}
 	}
-	fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);	// unlock lockid
 
 	return result;
 }
@@ -630,6 +771,13 @@ bool FlShm::CheckCondDeadLock(fl_pid_cache_map_t* pcache_map, flckpid_t flckpid,
 //
 void FlShm::PreforkHandler(void)
 {
+	// [NOTE]
+	// Other thread in parent may lock magazine at forking, and the child
+	// process takes own magazine(checked by pid) later.
+	//
+	FlShm::MagazineLockVal = FLCK_NOSHARED_MUTEX_VAL_UNLOCKED;
+	FlckPidfd::ChildForkHandler();
+
 	if(FlShm::pCheckPidThread){
 		if(!FlShm::pCheckPidThread->ReInitializeThread()){
 			ERR_FLCKPRN("Call Prefork handler and try to reinitialize thread for child process(%d), but FAILED TO RUN THREAD", getpid());
@@ -678,7 +826,7 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, const char* pname, time_t timeout_usec
 	if(FLCK_UNLOCK == LockType){
 		// UNLOCK
 		FlListNMtx		tglistobj;
-		if(!tglistobj.find(pname, FlShm::pFlHead->named_mutex_list)){
+		if(!tglistobj.find(pname)){
 			// not found target.
 			ERR_FLCKPRN("Could not locking named mutex for name(%s).", pname);
 			fl_unlock_lockid(&FlShm::pFlHead->named_mutex_lockid, flckpid);		// unlock lockid
@@ -695,9 +843,9 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, const char* pname, time_t timeout_usec
 		// LOCK
 		FlListNMtx		tglistobj;
 
-		if(!tglistobj.find(pname, FlShm::pFlHead->named_mutex_list)){
+		if(!tglistobj.find(pname)){
 			// Not found, so get new file lock and insert it.
-			if(!tglistobj.retrieve_list(FlShm::pFlHead->named_mutex_free)){
+			if(!tglistobj.retrieve_free(FlShm::pFlHead->named_mutex_free) && (!FlShm::GrowArea(FlShm::pFlHead->named_mutex_free) || !tglistobj.retrieve_free(FlShm::pFlHead->named_mutex_free))){
 				ERR_FLCKPRN("Could not get free named mutex structure.");
 				fl_unlock_lockid(&FlShm::pFlHead->named_mutex_lockid, flckpid);	// unlock lockid
 				return ENOLCK;					// ENOLCK
@@ -705,11 +853,18 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, const char* pname, time_t timeout_usec
 			// initialize
 			tglistobj.initialize(pname);
 
+			// insert into hash index
+			if(!tglistobj.insert_index()){
+				// hash index is full after growing, then this object is found by list.
+				MSG_FLCKPRN("Hash index for named mutex is full, so named mutex(%s) is only in list.", pname);
+				++(FlShm::pFlHead->named_mutex_overflow);
+			}
+
 			// insert file lock into list
 			if(!tglistobj.insert_list(FlShm::pFlHead->named_mutex_list)){
 				ERR_FLCKPRN("Failed to insert named mutex to top list.");
 				// for recover
-				if(!tglistobj.insert_list(FlShm::pFlHead->named_mutex_free)){
+				if(!tglistobj.insert_free(FlShm::pFlHead->named_mutex_free)){
 					ERR_FLCKPRN("Failed to insert named mutex to free list, but continue...");
 				}
 				fl_unlock_lockid(&FlShm::pFlHead->named_mutex_lockid, flckpid);	// unlock lockid
@@ -743,25 +898,35 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, int fd, off_t offset, size_t length, t
 		ERR_FLCKPRN("Failed to get device id/inode from fd(%d) offset(%zd) length(%zu)", fd, offset, length);
 		return ((NOMAP_ALLOW_RETRY == FlShm::NomapMode || NOMAP_ALLOW_NORETRY == FlShm::NomapMode) ? 0 : ENOLCK);			// ENOLCK
 	}
+	return FlShm::RawLock(LockType, fd, devid, inodeid, offset, length, timeout_usec);
+}
+
+//
+// Need to attach shm and resolve device id/inode before calling this.
+//
+int FlShm::RawLock(FLCKLOCKTYPE LockType, int fd, dev_t devid, ino_t inodeid, off_t offset, size_t length, time_t timeout_usec)
+{
 	flckpid_t	flckpid	= get_flckpid();
 	int			result	= 0;
 
-	fl_lock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);					// lock lockid for top manually.(keep to lock)
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(devid, inodeid);			// hash bucket for this file
+
+	fl_lock_lockid(&(pbucket->lockid), flckpid);								// lock lockid for bucket manually.(keep to lock)
 
 	if(FLCK_UNLOCK == LockType){
 		// UNLOCK
 		FlListFileLock	tglistobj;
-		if(!tglistobj.find(devid, inodeid, FlShm::pFlHead->file_lock_list)){
+		if(!tglistobj.find(devid, inodeid, pbucket->file_lock_list)){
 			// not found target.
 			ERR_FLCKPRN("Could not locking file lock for fd(%d), offset(%zd), length(%zu).", fd, offset, length);
-			fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);			// unlock lockid
+			fl_unlock_lockid(&(pbucket->lockid), flckpid);			// unlock lockid
 			return EINVAL;						// EINVAL
 		}
 
 		// do unlock(unlocked lockid after this)
 		if(0 != (result = tglistobj.unlock(flckpid, fd, offset, length))){
 			ERR_FLCKPRN("Could not unlock file lock(error code=%d) for fd(%d), offset(%zd), length(%zu).", result, fd, offset, length);
-			fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);			// unlock lockid
+			fl_unlock_lockid(&(pbucket->lockid), flckpid);			// unlock lockid
 			return result;
 		}
 
@@ -769,37 +934,37 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, int fd, off_t offset, size_t length, t
 		if(FlShm::IsFreeUnitFd()){
 			if(!tglistobj.is_locked()){
 				// retrieve target list
-				if(tglistobj.cutoff_list(FlShm::pFlHead->file_lock_list)){
+				if(fl_cutoff_filelock(tglistobj, pbucket)){
 					// return object to free list
-					if(!tglistobj.insert_list(FlShm::pFlHead->file_lock_free)){
+					if(!tglistobj.insert_free(FlShm::pFlHead->file_lock_free)){
 						ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
 					}
 				}
 			}
 		}
-		fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);				// unlock lockid
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
 
 	}else{
 		// LOCK
 		FlListFileLock	tglistobj;
-		if(!tglistobj.find(devid, inodeid, FlShm::pFlHead->file_lock_list)){
+		if(!tglistobj.find(devid, inodeid, pbucket->file_lock_list)){
 			// Not found, so get new file lock and insert it.
-			if(!tglistobj.retrieve_list(FlShm::pFlHead->file_lock_free)){
+			if(!tglistobj.retrieve_free(FlShm::pFlHead->file_lock_free) && (!FlShm::GrowArea(FlShm::pFlHead->file_lock_free) || !tglistobj.retrieve_free(FlShm::pFlHead->file_lock_free))){
 				ERR_FLCKPRN("Could not get free file lock structure.");
-				fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// unlock lockid
+				fl_unlock_lockid(&(pbucket->lockid), flckpid);		// unlock lockid
 				return ENOLCK;					// ENOLCK
 			}
 			// initialize
 			tglistobj.initialize(devid, inodeid, true, true);
 
 			// insert file lock into list
-			if(!tglistobj.insert_list(FlShm::pFlHead->file_lock_list)){
+			if(!tglistobj.insert_list(pbucket->file_lock_list)){
 				ERR_FLCKPRN("Failed to insert file lock to top list.");
 				// for recover
-				if(!tglistobj.insert_list(FlShm::pFlHead->file_lock_free)){
+				if(!tglistobj.insert_free(FlShm::pFlHead->file_lock_free)){
 					ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
 				}
-				fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// unlock lockid
+				fl_unlock_lockid(&(pbucket->lockid), flckpid);		// unlock lockid
 				return ENOLCK;					// ENOLCK
 			}
 		}else{
@@ -813,23 +978,23 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, int fd, off_t offset, size_t length, t
 			// check remove file lock for recover...
 			//
 			if(FlShm::IsFreeUnitFd()){
-				fl_lock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// lock lockid
+				fl_lock_lockid(&(pbucket->lockid), flckpid);		// lock lockid
 
-				if(tglistobj.find(devid, inodeid, FlShm::pFlHead->file_lock_list)){
+				if(tglistobj.find(devid, inodeid, pbucket->file_lock_list)){
 					if(!tglistobj.is_locked()){
 						// free all
-						tglistobj.free_offset_lock_list();
+						tglistobj.free_offset_lock_tree();
 
 						// retrieve target list
-						if(tglistobj.cutoff_list(FlShm::pFlHead->file_lock_list)){
+						if(fl_cutoff_filelock(tglistobj, pbucket)){
 							// return object to free list
-							if(!tglistobj.insert_list(FlShm::pFlHead->file_lock_free)){
+							if(!tglistobj.insert_free(FlShm::pFlHead->file_lock_free)){
 								ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
 							}
 						}
 					}
 				}
-				fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// unlock lockid
+				fl_unlock_lockid(&(pbucket->lockid), flckpid);		// unlock lockid
 			}
 			return result;
 		}
@@ -837,6 +1002,458 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, int fd, off_t offset, size_t length, t
 	return result;
 }
 
+// [NOTE]
+// Upgrading(reader to writer) and downgrading(writer to reader) keep the
+// locker object, and change the lock value by one CAS, so that other
+// writer can not get the lock between. Upgrading returns EDEADLK when the
+// other reader is already waiting for upgrading.
+//
+int FlShm::RawChangeLock(bool is_upgrade, int fd, off_t offset, size_t length)
+{
+	// check mapping
+	if(!FlShm::CheckAttach()){
+		ERR_FLCKPRN("Does not attach shm.");
+		return ((NOMAP_ALLOW_RETRY == FlShm::NomapMode || NOMAP_ALLOW_NORETRY == FlShm::NomapMode) ? 0 : ENOLCK);			// ENOLCK
+	}
+
+	// device id/inode
+	dev_t	devid		= FLCK_INVALID_ID;
+	ino_t	inodeid		= FLCK_INVALID_ID;
+	if(!GetFileDevNode(fd, devid, inodeid)){
+		ERR_FLCKPRN("Failed to get device id/inode from fd(%d) offset(%zd) length(%zu)", fd, offset, length);
+		return ((NOMAP_ALLOW_RETRY == FlShm::NomapMode || NOMAP_ALLOW_NORETRY == FlShm::NomapMode) ? 0 : ENOLCK);			// ENOLCK
+	}
+	flckpid_t		flckpid	= get_flckpid();
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(devid, inodeid);			// hash bucket for this file
+
+	fl_lock_lockid(&(pbucket->lockid), flckpid);								// lock lockid for bucket manually.(keep to lock)
+
+	FlListFileLock	filelistobj;
+	FlListOffLock	offlistobj;
+	if(!filelistobj.find(devid, inodeid, pbucket->file_lock_list) || !offlistobj.find(offset, length, filelistobj.get()->offset_lock_tree)){
+		ERR_FLCKPRN("Could not find locking offset object for fd(%d), offset(%zd), length(%zu).", fd, offset, length);
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);						// unlock lockid
+		return EINVAL;						// EINVAL
+	}
+
+	// do upgrade/downgrade(unlocked lockid after this)
+	return (is_upgrade ? offlistobj.upgrade(devid, inodeid, flckpid, fd) : offlistobj.downgrade(devid, inodeid, flckpid, fd));
+}
+
+int FlShm::RawChangeLock(bool is_upgrade, PFLRWHANDLE phandle)
+{
+	if(!FlShm::CheckHandle(phandle)){
+		ERR_FLCKPRN("Handle is wrong or shm is re-attached.");
+		return EINVAL;						// EINVAL
+	}
+	flckpid_t		flckpid	= get_flckpid();
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(phandle->dev_id, phandle->ino_id);
+	FlListOffLock	offlistobj(phandle->pofflock);
+
+	fl_lock_lockid(&(pbucket->lockid), flckpid);								// lock lockid for bucket manually.(keep to lock)
+
+	// do upgrade/downgrade(unlocked lockid after this)
+	return (is_upgrade ? offlistobj.upgrade(phandle->dev_id, phandle->ino_id, flckpid, phandle->fd) : offlistobj.downgrade(phandle->dev_id, phandle->ino_id, flckpid, phandle->fd));
+}
+
+//---------------------------------------------------------
+// Utility for locking multi ranges
+//---------------------------------------------------------
+typedef struct fl_resolved_range{
+	dev_t							devid;
+	ino_t							inodeid;
+	const fullock_rwlock_range_t*	prange;
+	PFLOFFLOCK						pofflock;					// offset lock which is used by this range(absolute)
+	bool							merged;						// this range shares offset lock with former range
+	bool							is_write;					// lock mode of offset lock(writer if any range sharing it is writer)
+	PFLLOCKER						plocker;					// locker which is inserted into offset lock(absolute)
+	bool							locked;						// offset lock is locked
+}FLRESOLVEDRANGE;
+
+typedef std::vector<FLRESOLVEDRANGE>	flresolvedranges_t;
+
+// Canonical order for locking: (device id, inode, offset, length, fd)
+//
+// [NOTE]
+// Length and fd are compared too, so that locking and unlocking same ranges
+// make same order, and the locker of shared offset lock has same fd.
+//
+inline bool fl_compare_resolved_range(const FLRESOLVEDRANGE& src1, const FLRESOLVEDRANGE& src2)
+{
+	if(src1.devid != src2.devid){
+		return (src1.devid < src2.devid);
+	}
+	if(src1.inodeid != src2.inodeid){
+		return (src1.inodeid < src2.inodeid);
+	}
+	if(src1.prange->offset != src2.prange->offset){
+		return (src1.prange->offset < src2.prange->offset);
+	}
+	if(src1.prange->length != src2.prange->length){
+		return (src1.prange->length < src2.prange->length);
+	}
+	return (src1.prange->fd < src2.prange->fd);
+}
+
+// Returns the end of group which has same file as the range at start.
+//
+static size_t fl_get_resolved_group_end(const flresolvedranges_t& ranges, size_t start)
+{
+	size_t	end;
+	for(end = start + 1; end < ranges.size() && ranges[start].devid == ranges[end].devid && ranges[start].inodeid == ranges[end].inodeid; ++end);
+	return end;
+}
+
+// Set merged flag for the ranges which share offset lock with former range
+// in the group, and set lock mode of the offset lock to former range.
+//
+static void fl_merge_resolved_group(flresolvedranges_t& ranges, size_t start, size_t end)
+{
+	for(size_t cnt = start; cnt < end; ++cnt){
+		FLRESOLVEDRANGE&	range = ranges[cnt];
+		range.merged	= false;
+		range.is_write	= range.prange->is_write;
+		if(!range.pofflock){
+			continue;
+		}
+		for(size_t pos = start; pos < cnt; ++pos){
+			FLRESOLVEDRANGE&	held = ranges[pos];
+			if(!held.merged && held.pofflock == range.pofflock){
+				held.is_write	= (held.is_write || range.is_write);
+				range.merged	= true;
+				break;
+			}
+		}
+	}
+}
+
+// Release offset locks of ranges in the group.
+//
+// [NOTE]
+// Need to lock bucket lockid before calling this. The ranges which are
+// locked are unlocked, and lockers which are only inserted are removed.
+// Offset locks and the file lock which are not used are freed by the
+// free unit mode as same as unlocking one range.
+//
+static int fl_release_resolved_group(flresolvedranges_t& ranges, size_t start, size_t end, FlListFileLock& filelistobj, PFLFILEBUCKET pbucket, flckpid_t flckpid)
+{
+	int	result = 0;
+	for(size_t cnt = start; cnt < end; ++cnt){
+		FLRESOLVEDRANGE&	range = ranges[cnt];
+		if(range.merged || !range.pofflock){
+			continue;
+		}
+		FlListOffLock	offlistobj(range.pofflock);
+		if(range.locked){
+			int	tmpresult;
+			if(0 != (tmpresult = offlistobj.unlock(flckpid, range.prange->fd))){
+				ERR_FLCKPRN("Could not unlock fd(%d), offset(%zd), length(%zu), error code=%d, but continue...", range.prange->fd, range.prange->offset, range.prange->length, tmpresult);
+				if(0 == result){
+					result = tmpresult;
+				}
+			}
+		}else if(range.plocker){
+			offlistobj.cancel_prelock((range.is_write ? FLCK_WRITE_LOCK : FLCK_READ_LOCK), flckpid, range.prange->fd);
+		}
+		range.locked	= false;
+		range.plocker	= NULL;
+
+		// check free(protect flag is left when inserting locker failed)
+		range.pofflock->protect = false;
+		if(FlShm::IsFreeUnitOffset() && !offlistobj.is_locked()){
+			if(offlistobj.cutoff_tree(filelistobj.get()->offset_lock_tree)){
+				if(!offlistobj.insert_free(FlShm::pFlHead->offset_lock_free)){
+					ERR_FLCKPRN("Failed to insert offset lock to free list, but continue...");
+				}
+			}
+		}
+	}
+	// offset locks may be freed, so forget these
+	for(size_t cnt = start; cnt < end; ++cnt){
+		ranges[cnt].pofflock = NULL;
+	}
+
+	filelistobj.get()->protect = false;
+	if(FlShm::IsFreeUnitFd() && !filelistobj.is_locked()){
+		if(fl_cutoff_filelock(filelistobj, pbucket)){
+			if(!filelistobj.insert_free(FlShm::pFlHead->file_lock_free)){
+				ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
+			}
+		}
+	}
+	return result;
+}
+
+// Find(or make) offset locks of all ranges in the group, and insert lockers.
+//
+// [NOTE]
+// The bucket lockid is locked once for the group(same file), the offset
+// lock of each range is found only here and kept in the range. Lockers are
+// inserted before blocking, so offset locks are not freed until these are
+// unlocked.
+//
+static int fl_prelock_resolved_group(flresolvedranges_t& ranges, size_t start, size_t end, flckpid_t flckpid)
+{
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(ranges[start].devid, ranges[start].inodeid);
+
+	fl_lock_lockid(&(pbucket->lockid), flckpid);					// lock lockid
+
+	// file lock
+	FlListFileLock	filelistobj;
+	if(!filelistobj.find(ranges[start].devid, ranges[start].inodeid, pbucket->file_lock_list)){
+		// Not found, so get new file lock and insert it.
+		if(!filelistobj.retrieve_free(FlShm::pFlHead->file_lock_free) && (!FlShm::GrowArea(FlShm::pFlHead->file_lock_free) || !filelistobj.retrieve_free(FlShm::pFlHead->file_lock_free))){
+			ERR_FLCKPRN("Could not get free file lock structure.");
+			fl_unlock_lockid(&(pbucket->lockid), flckpid);			// unlock lockid
+			return ENOLCK;					// ENOLCK
+		}
+		filelistobj.initialize(ranges[start].devid, ranges[start].inodeid, true, true);
+
+		if(!filelistobj.insert_list(pbucket->file_lock_list)){
+			ERR_FLCKPRN("Failed to insert file lock to top list.");
+			// for recover
+			if(!filelistobj.insert_free(FlShm::pFlHead->file_lock_free)){
+				ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
+			}
+			fl_unlock_lockid(&(pbucket->lockid), flckpid);			// unlock lockid
+			return ENOLCK;					// ENOLCK
+		}
+	}else{
+		filelistobj.set_protect();
+	}
+
+	// offset locks
+	int	result = 0;
+	for(size_t cnt = start; cnt < end; ++cnt){
+		FLRESOLVEDRANGE&	range = ranges[cnt];
+		FlListOffLock		offlistobj;
+		if(!offlistobj.find(range.prange->offset, range.prange->length, filelistobj.get()->offset_lock_tree)){
+			// Not found, so get new offset lock and insert it.
+			if(!offlistobj.retrieve_free(FlShm::pFlHead->offset_lock_free) && (!FlShm::GrowArea(FlShm::pFlHead->offset_lock_free) || !offlistobj.retrieve_free(FlShm::pFlHead->offset_lock_free))){
+				ERR_FLCKPRN("Could not get free offset lock structure.");
+				result = ENOLCK;			// ENOLCK
+				break;
+			}
+			offlistobj.initialize(range.prange->offset, range.prange->length, true, true);
+
+			if(!offlistobj.insert_tree(filelistobj.get()->offset_lock_tree)){
+				ERR_FLCKPRN("Failed to insert offset lock to tree.");
+				// for recover
+				if(!offlistobj.insert_free(FlShm::pFlHead->offset_lock_free)){
+					ERR_FLCKPRN("Failed to insert offset lock to free list, but continue...");
+				}
+				result = ENOLCK;			// ENOLCK
+				break;
+			}
+		}else{
+			offlistobj.set_protect();
+		}
+		range.pofflock = offlistobj.get();
+	}
+
+	// lockers(one for each offset lock)
+	if(0 == result){
+		fl_merge_resolved_group(ranges, start, end);
+		for(size_t cnt = start; cnt < end; ++cnt){
+			FLRESOLVEDRANGE&	range = ranges[cnt];
+			if(range.merged){
+				continue;
+			}
+			FlListOffLock	offlistobj(range.pofflock);
+			if(NULL == (range.plocker = offlistobj.prelock((range.is_write ? FLCK_WRITE_LOCK : FLCK_READ_LOCK), flckpid, range.prange->fd))){
+				ERR_FLCKPRN("Could not insert locker for fd(%d), offset(%zd), length(%zu).", range.prange->fd, range.prange->offset, range.prange->length);
+				result = ENOLCK;			// ENOLCK
+				break;
+			}
+		}
+	}
+
+	if(0 != result){
+		// for recover
+		fl_merge_resolved_group(ranges, start, end);
+		fl_release_resolved_group(ranges, start, end, filelistobj, pbucket, flckpid);
+	}else{
+		// clear protect flag(because offset lock tree is existed now)
+		filelistobj.get()->protect = false;
+	}
+	fl_unlock_lockid(&(pbucket->lockid), flckpid);					// unlock lockid
+
+	return result;
+}
+
+// Unlock(or cancel) all ranges in the group.
+//
+// [NOTE]
+// When is_find is true, offset locks are found by ranges(unlocking by
+// caller), otherwise these are already set by locking.
+//
+static int fl_unlock_resolved_group(flresolvedranges_t& ranges, size_t start, size_t end, bool is_find, flckpid_t flckpid)
+{
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(ranges[start].devid, ranges[start].inodeid);
+	int				result	= 0;
+
+	fl_lock_lockid(&(pbucket->lockid), flckpid);					// lock lockid
+
+	FlListFileLock	filelistobj;
+	if(!filelistobj.find(ranges[start].devid, ranges[start].inodeid, pbucket->file_lock_list)){
+		ERR_FLCKPRN("Could not find file lock for fd(%d).", ranges[start].prange->fd);
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+		return EINVAL;						// EINVAL
+	}
+	if(is_find){
+		for(size_t cnt = start; cnt < end; ++cnt){
+			FLRESOLVEDRANGE&	range = ranges[cnt];
+			FlListOffLock		offlistobj;
+			if(offlistobj.find(range.prange->offset, range.prange->length, filelistobj.get()->offset_lock_tree)){
+				range.pofflock	= offlistobj.get();
+				range.locked	= true;
+			}else{
+				ERR_FLCKPRN("Could not find locking offset object for fd(%d), offset(%zd), length(%zu).", range.prange->fd, range.prange->offset, range.prange->length);
+				result = EINVAL;			// EINVAL
+			}
+		}
+		fl_merge_resolved_group(ranges, start, end);
+	}
+	int	tmpresult = fl_release_resolved_group(ranges, start, end, filelistobj, pbucket, flckpid);
+	if(0 == result){
+		result = tmpresult;
+	}
+	fl_unlock_lockid(&(pbucket->lockid), flckpid);					// unlock lockid
+
+	return result;
+}
+
+// Returns remaining timeout(usec) to deadline, or 0 if it is over.
+//
+static time_t fl_remaining_timeout(const struct timespec& deadline, time_t timeout_usec)
+{
+	if(FLCK_NO_TIMEOUT == timeout_usec || FLCK_TRY_TIMEOUT == timeout_usec){
+		return timeout_usec;
+	}
+	struct timespec	nowtime;
+	if(-1 == clock_gettime(CLOCK_MONOTONIC, &nowtime)){
+		return 0;
+	}
+	time_t	remain = ((deadline.tv_sec - nowtime.tv_sec) * 1000 * 1000) + ((deadline.tv_nsec - nowtime.tv_nsec) / 1000);
+	return (0 < remain ? remain : 0);
+}
+
+// [NOTE]
+// Device id/inode of each fd is resolved only once, and all ranges are
+// locked by canonical order(device id, inode, offset) for avoiding dead
+// lock between callers. If locking any range fails, all ranges locked in
+// this call are unlocked(all or nothing).
+// Ranges of one file are a group, and the bucket lockid is locked once for
+// each group. Under it, offset locks of all ranges are found and lockers
+// are inserted, then each offset lock is locked after unlocking lockid.
+// Ranges which share one offset lock(overlapped ranges always share it,
+// and ranges may be covered by one existing offset lock which is larger)
+// are locked once, as writer if any of them is writer, and unlocked once.
+//
+int FlShm::RawLockMany(const fullock_rwlock_range_t* pranges, size_t count, bool is_lock, time_t timeout_usec)
+{
+	if(!pranges || 0 == count){
+		ERR_FLCKPRN("Parameters are wrong.");
+		return EINVAL;						// EINVAL
+	}
+	// check mapping
+	if(!FlShm::CheckAttach()){
+		ERR_FLCKPRN("Does not attach shm.");
+		return ((NOMAP_ALLOW_RETRY == FlShm::NomapMode || NOMAP_ALLOW_NORETRY == FlShm::NomapMode) ? 0 : ENOLCK);			// ENOLCK
+	}
+	struct timespec	deadline = {0, 0};
+	if(FLCK_NO_TIMEOUT != timeout_usec && FLCK_TRY_TIMEOUT != timeout_usec && !flck_set_deadline(&deadline, timeout_usec)){
+		ERR_FLCKPRN("Could not get clock time.");
+		return EBUSY;						// EBUSY
+	}
+
+	// resolve device id/inode(once for each fd)
+	flresolvedranges_t	ranges;
+	ranges.reserve(count);
+	for(size_t cnt = 0; cnt < count; ++cnt){
+		FLRESOLVEDRANGE	range = {static_cast<dev_t>(FLCK_INVALID_ID), static_cast<ino_t>(FLCK_INVALID_ID), &pranges[cnt], NULL, false, pranges[cnt].is_write, NULL, false};
+		size_t			pos;
+		for(pos = 0; pos < ranges.size() && ranges[pos].prange->fd != range.prange->fd; ++pos);
+		if(pos < ranges.size()){
+			range.devid		= ranges[pos].devid;
+			range.inodeid	= ranges[pos].inodeid;
+		}else if(!GetFileDevNode(range.prange->fd, range.devid, range.inodeid)){
+			ERR_FLCKPRN("Failed to get device id/inode from fd(%d) offset(%zd) length(%zu)", range.prange->fd, range.prange->offset, range.prange->length);
+			if(NOMAP_ALLOW_RETRY == FlShm::NomapMode || NOMAP_ALLOW_NORETRY == FlShm::NomapMode){
+				continue;					// this range is allowed(same as locking one range)
+			}
+			return ENOLCK;					// ENOLCK
+		}
+		ranges.push_back(range);
+	}
+	if(ranges.empty()){
+		return 0;
+	}
+
+	// sort by canonical order
+	std::sort(ranges.begin(), ranges.end(), fl_compare_resolved_range);
+
+	flckpid_t	flckpid	= get_flckpid();
+	int			result	= 0;
+	if(!is_lock){
+		// UNLOCK(continue for all groups even if error)
+		for(size_t start = 0, end = 0; start < ranges.size(); start = end){
+			end = fl_get_resolved_group_end(ranges, start);
+
+			int	tmpresult;
+			if(0 != (tmpresult = fl_unlock_resolved_group(ranges, start, end, true, flckpid))){
+				ERR_FLCKPRN("Could not unlock ranges of fd(%d), error code=%d, but continue...", ranges[start].prange->fd, tmpresult);
+				if(0 == result){
+					result = tmpresult;
+				}
+			}
+		}
+		return result;
+	}
+
+	// LOCK
+	size_t	start;
+	size_t	end;
+	for(start = 0, end = 0; 0 == result && start < ranges.size(); start = end){
+		end = fl_get_resolved_group_end(ranges, start);
+		if(0 != (result = fl_prelock_resolved_group(ranges, start, end, flckpid))){
+			break;
+		}
+		// lock each offset lock without lockid
+		for(size_t cnt = start; cnt < end; ++cnt){
+			FLRESOLVEDRANGE&	range = ranges[cnt];
+			if(range.merged){
+				continue;
+			}
+			time_t	remain = fl_remaining_timeout(deadline, timeout_usec);
+			if(FLCK_NO_TIMEOUT != timeout_usec && FLCK_TRY_TIMEOUT != timeout_usec && 0 == remain){
+				result = ETIMEDOUT;			// ETIMEDOUT
+				break;
+			}
+			FlListOffLock	offlistobj(range.pofflock);
+			if(0 != (result = offlistobj.postlock((range.is_write ? FLCK_WRITE_LOCK : FLCK_READ_LOCK), range.devid, range.inodeid, flckpid, range.prange->fd, remain, range.plocker))){
+				break;
+			}
+			range.locked = true;
+		}
+	}
+	if(0 != result){
+		ERR_FLCKPRN("Could not lock all ranges(error code=%d), then unlock ranges which are locked.", result);
+
+		// rollback(groups which are prelocked)
+		for(size_t pos = 0, posend = 0; pos < end && pos < ranges.size(); pos = posend){
+			posend = fl_get_resolved_group_end(ranges, pos);
+			if(!ranges[pos].pofflock){
+				continue;						// not prelocked
+			}
+			if(0 != fl_unlock_resolved_group(ranges, pos, posend, false, flckpid)){
+				ERR_FLCKPRN("Could not unlock ranges of fd(%d) for recover, but continue...", ranges[pos].prange->fd);
+			}
+		}
+	}
+	return result;
+}
+
 bool FlShm::IsLocked(int fd, off_t offset, size_t length)
 {
 	// check mapping
@@ -857,19 +1474,241 @@ bool FlShm::IsLocked(int fd, off_t offset, size_t length)
 
 	FlListFileLock	tglistobj;
 	flckpid_t		flckpid = get_flckpid();
-	fl_lock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);			// lock lockid for top manually.(keep to lock)
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(devid, inodeid);	// hash bucket for this file
+	fl_lock_lockid(&(pbucket->lockid), flckpid);						// lock lockid for bucket manually.(keep to lock)
 
-	if(!tglistobj.find(devid, inodeid, FlShm::pFlHead->file_lock_list)){
-		fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);		// unlock lockid
+	if(!tglistobj.find(devid, inodeid, pbucket->file_lock_list)){
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);		// unlock lockid
 		return false;
 	}
 
-	bool	result = tglistobj.is_locked();
-	fl_unlock_lockid(&FlShm::pFlHead->file_lock_lockid, flckpid);			// unlock lockid
+	bool	result = tglistobj.has_locker();
+	fl_unlock_lockid(&(pbucket->lockid), flckpid);			// unlock lockid
 
 	return result;
 }
 
+//---------------------------------------------------------
+// Methods for rwlock handle
+//---------------------------------------------------------
+// [NOTE]
+// Opening handle finds(or makes) file lock and offset lock, and pins the
+// offset lock by a locker in its pin list. The pinned offset lock(and the
+// file lock which has it) is not released until the handle is closed, then
+// locking by the handle only needs the bucket lockid for locker bookkeeping.
+// If the process is dead without closing, the pin is released by checking
+// dead lock as same as other lockers.
+//
+PFLRWHANDLE FlShm::OpenHandle(int fd, off_t offset, size_t length)
+{
+	// check mapping
+	if(!FlShm::CheckAttach()){
+		ERR_FLCKPRN("Does not attach shm.");
+		return NULL;
+	}
+
+	// device id/inode
+	dev_t	devid		= FLCK_INVALID_ID;
+	ino_t	inodeid		= FLCK_INVALID_ID;
+	if(!GetFileDevNode(fd, devid, inodeid)){
+		ERR_FLCKPRN("Failed to get device id/inode from fd(%d) offset(%zd) length(%zu)", fd, offset, length);
+		return NULL;
+	}
+	flckpid_t		flckpid	= get_flckpid();
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(devid, inodeid);			// hash bucket for this file
+
+	fl_lock_lockid(&(pbucket->lockid), flckpid);								// lock lockid for bucket manually.(keep to lock)
+
+	// file lock
+	FlListFileLock	filelistobj;
+	bool			is_new_file = false;
+	if(!filelistobj.find(devid, inodeid, pbucket->file_lock_list)){
+		// Not found, so get new file lock and insert it.
+		if(!filelistobj.retrieve_free(FlShm::pFlHead->file_lock_free) && (!FlShm::GrowArea(FlShm::pFlHead->file_lock_free) || !filelistobj.retrieve_free(FlShm::pFlHead->file_lock_free))){
+			ERR_FLCKPRN("Could not get free file lock structure.");
+			fl_unlock_lockid(&(pbucket->lockid), flckpid);			// unlock lockid
+			return NULL;
+		}
+		filelistobj.initialize(devid, inodeid, false, true);
+
+		if(!filelistobj.insert_list(pbucket->file_lock_list)){
+			ERR_FLCKPRN("Failed to insert file lock to top list.");
+			// for recover
+			if(!filelistobj.insert_free(FlShm::pFlHead->file_lock_free)){
+				ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
+			}
+			fl_unlock_lockid(&(pbucket->lockid), flckpid);			// unlock lockid
+			return NULL;
+		}
+		is_new_file = true;
+	}
+
+	// offset lock
+	FlListOffLock	offlistobj;
+	if(!offlistobj.find(offset, length, filelistobj.get()->offset_lock_tree)){
+		// Not found, so get new offset lock and insert it.
+		bool	is_inserted = false;
+		if(!offlistobj.retrieve_free(FlShm::pFlHead->offset_lock_free) && (!FlShm::GrowArea(FlShm::pFlHead->offset_lock_free) || !offlistobj.retrieve_free(FlShm::pFlHead->offset_lock_free))){
+			ERR_FLCKPRN("Could not get free offset lock structure.");
+		}else{
+			offlistobj.initialize(offset, length, false, true);
+
+			if(!(is_inserted = offlistobj.insert_tree(filelistobj.get()->offset_lock_tree))){
+				ERR_FLCKPRN("Failed to insert offset lock to tree.");
+				// for recover
+				if(!offlistobj.insert_free(FlShm::pFlHead->offset_lock_free)){
+					ERR_FLCKPRN("Failed to insert offset lock to free list, but continue...");
+				}
+			}
+		}
+		if(!is_inserted){
+			// for recover
+			if(is_new_file && fl_cutoff_filelock(filelistobj, pbucket)){
+				if(!filelistobj.insert_free(FlShm::pFlHead->file_lock_free)){
+					ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
+				}
+			}
+			fl_unlock_lockid(&(pbucket->lockid), flckpid);			// unlock lockid
+			return NULL;
+		}
+	}
+
+	// pin
+	PFLLOCKER	ppin;
+	if(NULL == (ppin = offlistobj.pin(flckpid, fd))){
+		ERR_FLCKPRN("Could not pin offset lock for fd(%d) offset(%zd) length(%zu)", fd, offset, length);
+		// for recover
+		if(!offlistobj.is_locked() && offlistobj.cutoff_tree(filelistobj.get()->offset_lock_tree)){
+			if(!offlistobj.insert_free(FlShm::pFlHead->offset_lock_free)){
+				ERR_FLCKPRN("Failed to insert offset lock to free list, but continue...");
+			}
+		}
+		if(is_new_file && !filelistobj.is_locked() && fl_cutoff_filelock(filelistobj, pbucket)){
+			if(!filelistobj.insert_free(FlShm::pFlHead->file_lock_free)){
+				ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
+			}
+		}
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);			// unlock lockid
+		return NULL;
+	}
+	fl_unlock_lockid(&(pbucket->lockid), flckpid);					// unlock lockid
+
+	PFLRWHANDLE	phandle	= new FLRWHANDLE;
+	phandle->pshmbase	= FlShm::pShmBase;
+	phandle->attach_gen	= FlShm::AttachGen;
+	phandle->pid		= getpid();
+	phandle->fd			= fd;
+	phandle->dev_id		= devid;
+	phandle->ino_id		= inodeid;
+	phandle->offset		= offset;
+	phandle->length		= length;
+	phandle->pfilelock	= filelistobj.get();
+	phandle->pofflock	= offlistobj.get();
+	phandle->ppin		= ppin;
+
+	return phandle;
+}
+
+int FlShm::CloseHandle(PFLRWHANDLE phandle)
+{
+	if(!phandle){
+		ERR_FLCKPRN("Parameter is wrong.");
+		return EINVAL;						// EINVAL
+	}
+	if(!FlShm::CheckHandle(phandle)){
+		// shm is re-attached or this is forked child, so pinned objects
+		// do not exist now or they are not pinned by this process.
+		delete phandle;
+		return 0;
+	}
+	flckpid_t		flckpid	= get_flckpid();
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(phandle->dev_id, phandle->ino_id);
+
+	fl_lock_lockid(&(pbucket->lockid), flckpid);					// lock lockid
+
+	// unpin
+	FlListOffLock	offlistobj(phandle->pofflock);
+	if(!offlistobj.unpin(phandle->ppin)){
+		WAN_FLCKPRN("Could not find pin for fd(%d), offset(%zd), length(%zu), but continue...", phandle->fd, phandle->offset, phandle->length);
+	}
+
+	// check free
+	FlListFileLock	filelistobj(phandle->pfilelock);
+	if(FlShm::IsFreeUnitOffset() && !offlistobj.is_locked()){
+		if(offlistobj.cutoff_tree(phandle->pfilelock->offset_lock_tree)){
+			if(!offlistobj.insert_free(FlShm::pFlHead->offset_lock_free)){
+				ERR_FLCKPRN("Failed to insert offset lock to free list, but continue...");
+			}
+		}
+	}
+	if(FlShm::IsFreeUnitFd() && !filelistobj.is_locked()){
+		filelistobj.free_offset_lock_tree();
+		if(fl_cutoff_filelock(filelistobj, pbucket)){
+			if(!filelistobj.insert_free(FlShm::pFlHead->file_lock_free)){
+				ERR_FLCKPRN("Failed to insert file lock to free list, but continue...");
+			}
+		}
+	}
+	fl_unlock_lockid(&(pbucket->lockid), flckpid);					// unlock lockid
+
+	delete phandle;
+	return 0;
+}
+
+bool FlShm::CheckHandle(PFLRWHANDLE phandle)
+{
+	if(!phandle || !FlShm::CheckAttach() || phandle->pshmbase != FlShm::pShmBase || phandle->attach_gen != FlShm::AttachGen || phandle->pid != getpid()){
+		return false;
+	}
+	return true;
+}
+
+bool FlShm::IsLocked(PFLRWHANDLE phandle)
+{
+	if(!FlShm::CheckHandle(phandle)){
+		ERR_FLCKPRN("Handle is wrong or shm is re-attached.");
+		return false;
+	}
+	flckpid_t		flckpid	= get_flckpid();
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(phandle->dev_id, phandle->ino_id);
+
+	fl_lock_lockid(&(pbucket->lockid), flckpid);					// lock lockid
+	FlListOffLock	offlistobj(phandle->pofflock);
+	bool			result = offlistobj.has_locker();
+	fl_unlock_lockid(&(pbucket->lockid), flckpid);					// unlock lockid
+
+	return result;
+}
+
+int FlShm::RawLock(FLCKLOCKTYPE LockType, PFLRWHANDLE phandle, time_t timeout_usec)
+{
+	if(!FlShm::CheckHandle(phandle)){
+		ERR_FLCKPRN("Handle is wrong or shm is re-attached.");
+		return EINVAL;						// EINVAL
+	}
+	flckpid_t		flckpid	= get_flckpid();
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(phandle->dev_id, phandle->ino_id);
+	FlListOffLock	offlistobj(phandle->pofflock);
+	int				result;
+
+	fl_lock_lockid(&(pbucket->lockid), flckpid);					// lock lockid for bucket manually.(keep to lock)
+
+	if(FLCK_UNLOCK == LockType){
+		// UNLOCK(pinned offset lock is not released here)
+		if(0 != (result = offlistobj.unlock(flckpid, phandle->fd))){
+			ERR_FLCKPRN("Could not unlock offset object(error code=%d) for fd(%d), offset(%zd), length(%zu).", result, phandle->fd, phandle->offset, phandle->length);
+		}
+		fl_unlock_lockid(&(pbucket->lockid), flckpid);				// unlock lockid
+
+	}else{
+		// LOCK(unlocked lockid after this)
+		if(0 != (result = offlistobj.lock(LockType, phandle->dev_id, phandle->ino_id, flckpid, phandle->fd, timeout_usec))){
+			ERR_FLCKPRN("Could not %s lock offset object(error code=%d) for fd(%d), offset(%zd), length(%zu).", (FLCK_READ_LOCK == LockType ? "read" : "write"), result, phandle->fd, phandle->offset, phandle->length);
+		}
+	}
+	return result;
+}
+
 int FlShm::RawLock(FLCKLOCKTYPE LockType, const char* pcondname, const char* pmutexname, bool is_broadcast, time_t timeout_usec)
 {
 	if(!pcondname){
@@ -890,7 +1729,7 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, const char* pcondname, const char* pmu
 		fl_lock_lockid(&FlShm::pFlHead->named_cond_lockid, flckpid);			// lock lockid for top manually.(keep to lock)
 
 		FlListNCond		tglistobj;
-		if(!tglistobj.find(pcondname, FlShm::pFlHead->named_cond_list)){
+		if(!tglistobj.find(pcondname)){
 			// not found target.
 			ERR_FLCKPRN("Could not locking named cond for name(%s).", pcondname);
 			fl_unlock_lockid(&FlShm::pFlHead->named_cond_lockid, flckpid);		// unlock lockid
@@ -920,7 +1759,7 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, const char* pcondname, const char* pmu
 		fl_lock_lockid(&FlShm::pFlHead->named_mutex_lockid, flckpid);			// lock mutex lockid for top manually.(keep to lock)
 
 		FlListNMtx		tglistmtxobj;
-		if(!tglistmtxobj.find(pmutexname, FlShm::pFlHead->named_mutex_list)){
+		if(!tglistmtxobj.find(pmutexname)){
 			// not found target.
 			ERR_FLCKPRN("Could not locking named mutex(%s) for named cond(%s).", pmutexname, pcondname);
 			fl_unlock_lockid(&FlShm::pFlHead->named_mutex_lockid, flckpid);		// unlock mutex lockid
@@ -934,9 +1773,9 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, const char* pcondname, const char* pmu
 		fl_lock_lockid(&FlShm::pFlHead->named_cond_lockid, flckpid);			// lock lockid for top manually.(keep to lock)
 
 		FlListNCond		tglistobj;
-		if(!tglistobj.find(pcondname, FlShm::pFlHead->named_cond_list)){
+		if(!tglistobj.find(pcondname)){
 			// Not found, so get new file lock and insert it.
-			if(!tglistobj.retrieve_list(FlShm::pFlHead->named_cond_free)){
+			if(!tglistobj.retrieve_free(FlShm::pFlHead->named_cond_free) && (!FlShm::GrowArea(FlShm::pFlHead->named_cond_free) || !tglistobj.retrieve_free(FlShm::pFlHead->named_cond_free))){
 				ERR_FLCKPRN("Could not get free named cond structure.");
 				fl_unlock_lockid(&FlShm::pFlHead->named_cond_lockid, flckpid);	// unlock lockid
 				return ENOLCK;					// ENOLCK
@@ -944,11 +1783,18 @@ int FlShm::RawLock(FLCKLOCKTYPE LockType, const char* pcondname, const char* pmu
 			// initialize
 			tglistobj.initialize(pcondname);
 
+			// insert into hash index
+			if(!tglistobj.insert_index()){
+				// hash index is full after growing, then this object is found by list.
+				MSG_FLCKPRN("Hash index for named cond is full, so named cond(%s) is only in list.", pcondname);
+				++(FlShm::pFlHead->named_cond_overflow);
+			}
+
 			// insert file lock into list
 			if(!tglistobj.insert_list(FlShm::pFlHead->named_cond_list)){
 				ERR_FLCKPRN("Failed to insert named cond to top list.");
 				// for recover
-				if(!tglistobj.insert_list(FlShm::pFlHead->named_cond_free)){
+				if(!tglistobj.insert_free(FlShm::pFlHead->named_cond_free)){
 					ERR_FLCKPRN("Failed to insert named cond to free list, but continue...");
 				}
 				fl_unlock_lockid(&FlShm::pFlHead->named_cond_lockid, flckpid);	// unlock lockid
@@ -1026,6 +1872,119 @@ int FlShm::Unlock(int fd, off_t offset, size_t length)
 	return FlShm::RawLock(FLCK_UNLOCK, fd, offset, length, FLCK_NO_TIMEOUT);
 }
 
+int FlShm::Upgrade(int fd, off_t offset, size_t length)
+{
+	return FlShm::RawChangeLock(true, fd, offset, length);
+}
+
+int FlShm::Downgrade(int fd, off_t offset, size_t length)
+{
+	return FlShm::RawChangeLock(false, fd, offset, length);
+}
+
+int FlShm::TimeoutLockMany(const fullock_rwlock_range_t* pranges, size_t count, time_t timeout_usec)
+{
+	return FlShm::RawLockMany(pranges, count, true, timeout_usec);
+}
+
+int FlShm::TryLockMany(const fullock_rwlock_range_t* pranges, size_t count)
+{
+	return FlShm::RawLockMany(pranges, count, true, FLCK_TRY_TIMEOUT);
+}
+
+int FlShm::LockMany(const fullock_rwlock_range_t* pranges, size_t count)
+{
+	return FlShm::RawLockMany(pranges, count, true, FLCK_NO_TIMEOUT);
+}
+
+int FlShm::UnlockMany(const fullock_rwlock_range_t* pranges, size_t count)
+{
+	return FlShm::RawLockMany(pranges, count, false, FLCK_NO_TIMEOUT);
+}
+
+int FlShm::TimeoutReadLock(PFLRWHANDLE phandle, time_t timeout_usec)
+{
+	return FlShm::RawLock(FLCK_READ_LOCK, phandle, timeout_usec);
+}
+
+int FlShm::TryReadLock(PFLRWHANDLE phandle)
+{
+	return FlShm::RawLock(FLCK_READ_LOCK, phandle, FLCK_TRY_TIMEOUT);
+}
+
+int FlShm::ReadLock(PFLRWHANDLE phandle)
+{
+	return FlShm::RawLock(FLCK_READ_LOCK, phandle, FLCK_NO_TIMEOUT);
+}
+
+int FlShm::TimeoutWriteLock(PFLRWHANDLE phandle, time_t timeout_usec)
+{
+	return FlShm::RawLock(FLCK_WRITE_LOCK, phandle, timeout_usec);
+}
+
+int FlShm::TryWriteLock(PFLRWHANDLE phandle)
+{
+	return FlShm::RawLock(FLCK_WRITE_LOCK, phandle, FLCK_TRY_TIMEOUT);
+}
+
+int FlShm::WriteLock(PFLRWHANDLE phandle)
+{
+	return FlShm::RawLock(FLCK_WRITE_LOCK, phandle, FLCK_NO_TIMEOUT);
+}
+
+int FlShm::Unlock(PFLRWHANDLE phandle)
+{
+	return FlShm::RawLock(FLCK_UNLOCK, phandle, FLCK_NO_TIMEOUT);
+}
+
+int FlShm::Upgrade(PFLRWHANDLE phandle)
+{
+	return FlShm::RawChangeLock(true, phandle);
+}
+
+int FlShm::Downgrade(PFLRWHANDLE phandle)
+{
+	return FlShm::RawChangeLock(false, phandle);
+}
+
+// [NOTE]
+// The preference is set to the offset lock which is pinned by the handle,
+// so it affects all writers for the lock(in all processes) while the offset
+// lock exists.
+//
+bool FlShm::SetPreferWriter(PFLRWHANDLE phandle, bool prefer_writer)
+{
+	if(!FlShm::CheckHandle(phandle)){
+		ERR_FLCKPRN("Handle is wrong or shm is re-attached.");
+		return false;
+	}
+	FlListOffLock	offlistobj(phandle->pofflock);
+	offlistobj.set_prefer_writer(prefer_writer);
+	return true;
+}
+
+// [NOTE]
+// The layout of rwlock is kept in the offset lock which is pinned by the
+// handle, so all processes use same layout for the lock. It can be changed
+// only when the lock does not have any locker.
+//
+bool FlShm::SetPhaseFair(PFLRWHANDLE phandle, bool phase_fair)
+{
+	if(!FlShm::CheckHandle(phandle)){
+		ERR_FLCKPRN("Handle is wrong or shm is re-attached.");
+		return false;
+	}
+	flckpid_t		flckpid	= get_flckpid();
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(phandle->dev_id, phandle->ino_id);
+
+	fl_lock_lockid(&(pbucket->lockid), flckpid);					// lock lockid
+	FlListOffLock	offlistobj(phandle->pofflock);
+	bool			result = offlistobj.set_phase_fair(phase_fair);
+	fl_unlock_lockid(&(pbucket->lockid), flckpid);					// unlock lockid
+
+	return result;
+}
+
 int FlShm::TimeoutWait(const char* pcondname, const char* pmutexname, time_t timeout_usec)
 {
 	return FlShm::RawLock(FLCK_NCOND_WAIT, pcondname, pmutexname, false, timeout_usec);
@@ -1304,6 +2263,51 @@ bool FlShm::LoadEnv(void)
 			ERR_FLCKPRN("ENV %s value %s is unknown.", FlShm::FLCKFREEUNITMODE, pEnvVal);
 		}
 	}
+
+	// FLCKPREFERMODE
+	if(NULL == (pEnvVal = getenv(FlShm::FLCKPREFERMODE))){
+		MSG_FLCKPRN("%s ENV is not set.", FlShm::FLCKPREFERMODE);
+	}else{
+		if(0 == strcasecmp(pEnvVal, FLCK_PREFERMODE_READER_STR)){
+			MSG_FLCKPRN("ENV %s value %s, set to mode: PREFER_READER.", FlShm::FLCKPREFERMODE, pEnvVal);
+			FlShm::PreferMode = FlShm::PREFER_READER;
+		}else if(0 == strcasecmp(pEnvVal, FLCK_PREFERMODE_WRITER_STR)){
+			MSG_FLCKPRN("ENV %s value %s, set to mode: PREFER_WRITER.", FlShm::FLCKPREFERMODE, pEnvVal);
+			FlShm::PreferMode = FlShm::PREFER_WRITER;
+		}else{
+			ERR_FLCKPRN("ENV %s value %s is unknown.", FlShm::FLCKPREFERMODE, pEnvVal);
+		}
+	}
+
+	// FLCKRWLOCKTYPE
+	if(NULL == (pEnvVal = getenv(FlShm::FLCKRWLOCKTYPE))){
+		MSG_FLCKPRN("%s ENV is not set.", FlShm::FLCKRWLOCKTYPE);
+	}else{
+		if(0 == strcasecmp(pEnvVal, FLCK_RWLOCKTYPE_CAS_STR)){
+			MSG_FLCKPRN("ENV %s value %s, set to type: RWLOCK_CAS.", FlShm::FLCKRWLOCKTYPE, pEnvVal);
+			FlShm::RwlockType = FlShm::RWLOCK_CAS;
+		}else if(0 == strcasecmp(pEnvVal, FLCK_RWLOCKTYPE_PHASEFAIR_STR)){
+			MSG_FLCKPRN("ENV %s value %s, set to type: RWLOCK_PHASEFAIR.", FlShm::FLCKRWLOCKTYPE, pEnvVal);
+			FlShm::RwlockType = FlShm::RWLOCK_PHASEFAIR;
+		}else{
+			ERR_FLCKPRN("ENV %s value %s is unknown.", FlShm::FLCKRWLOCKTYPE, pEnvVal);
+		}
+	}
+
+	// FLCKROBUSTLIST
+	if(NULL == (pEnvVal = getenv(FlShm::FLCKROBUSTLIST))){
+		MSG_FLCKPRN("%s ENV is not set.", FlShm::FLCKROBUSTLIST);
+	}else{
+		if(0 == strcasecmp(pEnvVal, FLCK_ROBUSTLIST_YES_STR)){
+			MSG_FLCKPRN("ENV %s value %s, set to mode: ROBUSTLIST_YES.", FlShm::FLCKROBUSTLIST, pEnvVal);
+			FlShm::RobustListMode = FlShm::ROBUSTLIST_YES;
+		}else if(0 == strcasecmp(pEnvVal, FLCK_ROBUSTLIST_NO_STR)){
+			MSG_FLCKPRN("ENV %s value %s, set to mode: ROBUSTLIST_NO.", FlShm::FLCKROBUSTLIST, pEnvVal);
+			FlShm::RobustListMode = FlShm::ROBUSTLIST_NO;
+		}else{
+			ERR_FLCKPRN("ENV %s value %s is unknown.", FlShm::FLCKROBUSTLIST, pEnvVal);
+		}
+	}
 	return true;
 }
 
@@ -23,6 +23,30 @@
 #include "flcklocktype.h"
 #include "flckutil.h"
 
+//---------------------------------------------------------
+// Rwlock handle(process local)
+//---------------------------------------------------------
+// [NOTE]
+// The handle keeps file lock and offset lock which are resolved at opening,
+// and the offset lock is pinned by the locker in its pin list while the
+// handle is opened. pshmbase and attach_gen are for checking that shm is not
+// re-attached after opening(re-mapping may return same address), and pid is
+// for checking that the handle is not used by forked child.
+//
+typedef struct fl_rwlock_handle{
+	void*					pshmbase;						// shm base address at opening
+	unsigned int			attach_gen;						// attach generation at opening
+	pid_t					pid;							// process id at opening
+	int						fd;								// file descriptor
+	dev_t					dev_id;							// devide id
+	ino_t					ino_id;							// inode id
+	off_t					offset;							// offset at opening
+	size_t					length;							// length at opening
+	PFLFILELOCK				pfilelock;						// file lock(absolute)
+	PFLOFFLOCK				pofflock;						// offset lock(absolute)
+	PFLLOCKER				ppin;							// pin in pofflock(absolute)
+}FLRWHANDLE, *PFLRWHANDLE;
+
 //---------------------------------------------------------
 // Class FlShm
 //---------------------------------------------------------
@@ -56,11 +80,32 @@ class FlShm
 			FREE_ALWAYS			= FREE_FD						//
 		}FREEUNITMODE;
 
+		typedef enum prefer_mode{								// Preference mode for rwlock
+			PREFER_READER		= 0,							// Readers can lock while writer is waiting
+			PREFER_WRITER,										// New readers back off while writer is waiting
+			PREFER_DEFAULT		= PREFER_READER					//
+		}PREFERMODE;
+
+		typedef enum rwlock_type{								// Layout of rwlock for new offset lock
+			RWLOCK_CAS			= 0,							// One lock word which is changed by CAS
+			RWLOCK_PHASEFAIR,									// Phase-fair ticket rwlock(bounded waiting for both readers and writers)
+			RWLOCK_DEFAULT		= RWLOCK_CAS					//
+		}RWLOCKTYPE;
+
+		typedef enum robust_list_mode{							// Registering named mutex to kernel robust list
+			ROBUSTLIST_NO		= 0,							// Dead owner is found by checking dead lock
+			ROBUSTLIST_YES,										// Kernel marks the mutex when the owner thread exits
+			ROBUSTLIST_DEFAULT	= ROBUSTLIST_NO					//
+		}ROBUSTLISTMODE;
+
 	protected:
 		static const char*		FLCKAUTOINIT;					// Env name for AUTOINIT
 		static const char*		FLCKROBUSTMODE;					// Env name for ROBUSTMODE
 		static const char*		FLCKNOMAPMODE;					// Env name for NOMAPMODE
 		static const char*		FLCKFREEUNITMODE;				// Env name for FREEUNITMODE
+		static const char*		FLCKPREFERMODE;					// Env name for PREFERMODE
+		static const char*		FLCKRWLOCKTYPE;					// Env name for RWLOCKTYPE
+		static const char*		FLCKROBUSTLIST;					// Env name for ROBUSTLISTMODE
 		static const char*		FLCKROBUSTCHKCNT;				// Env name for ROBUSTCHKCNT(checking limit for robust mode)
 		static const char*		FLCKUMASK;						// Env name for FLCKUMASK
 		static const char*		FLCKDIRPATH;					// Env name for flck shmfile path
@@ -77,6 +122,9 @@ class FlShm
 		static ROBUSTMODE		RobustMode;						// ROBUST mode
 		static NOMAPMODE		NomapMode;						// mode for no mmapping
 		static FREEUNITMODE		FreeUnitMode;					// Free Unit mode
+		static PREFERMODE		PreferMode;						// Preference mode for rwlock
+		static RWLOCKTYPE		RwlockType;						// Layout of rwlock for new offset lock
+		static ROBUSTLISTMODE	RobustListMode;					// Registering named mutex to kernel robust list
 		static mode_t			ShmFileUmask;					// Umask for shm file
 		static int				RobustLoopCnt;					// limit lock loop count for checking robust mode
 		static size_t			FileLockAreaCount;				// area count for file lock structure
@@ -88,12 +136,24 @@ class FlShm
 
 		// Shared memory
 		static int				ShmFd;							// shm file descriptor
+		static size_t			MapLength;						// mapped length(reserved for growing)
 		static std::string*		pShmDirPath;					// flck shm Directory path
 		static std::string*		pShmFileName;					// flck shm file name
 		static std::string*		pShmPath;						// flck shm file path
 
+		// Magazine(process local)
+		static PFLMAGAZINE		pMagazine;						// magazine for this process
+		static pid_t			MagazinePid;					// pid which took pMagazine(for checking forked)
+		static int				MagazineLockVal;				// lock variable for pMagazine in this process
+
 		// Worker thread
 		static FlckThread*		pCheckPidThread;				// thread for checking process dead
+
+		// Cursor of file lock sweep which gave up a bucket(worker only)
+		static size_t			SweepBucket;					// bucket index(FLCK_SWEEP_NO_BUCKET means nothing)
+		static PFLFILELOCK		SweepParent;					// last file lock which was left in the bucket(relative)
+		static uint32_t			SweepBucketGen;					// generation of the bucket at the cursor
+		static unsigned int		SweepAttachGen;					// AttachGen at the cursor
 		static int				InotifyFd;						// inotify fd for other process dead
 		static int				WatchFd;						// watch fd for other process dead
 		static int				EventFd;						// epoll fd for other process dead
@@ -102,6 +162,7 @@ class FlShm
 		// Shared memory(direct access for performance)
 		static void*			pShmBase;						// shared memory base address
 		static PFLHEAD			pFlHead;						// header pointer
+		static unsigned int		AttachGen;						// generation counted up at each mapping
 
 	protected:
 		static bool InitializeSingleton(const void* phelper);	// MAIN SINGLETON OBJECT(for class variables initializing/destroying)
@@ -126,9 +187,20 @@ class FlShm
 		static PFLNAMEDCOND MakeListNCondLock(PFLNAMEDCOND ptr, size_t count);
 		static PFLWAITER MakeListWaiter(PFLWAITER ptr, size_t count);
 
+		template<typename L> static bool GrowFreeArea(flck_free_t& freetop, size_t count);
+
+		static PFLMAGAZINE GetMagazine(void);
+		static void ReleaseMagazine(void);
+
 		static int RawLock(FLCKLOCKTYPE LockType, const char* pname, time_t timeout_usec);													// named mutex
 		static int RawLock(FLCKLOCKTYPE LockType, int fd, off_t offset, size_t length, time_t timeout_usec);								// file lock(rwlock)
+		static int RawLock(FLCKLOCKTYPE LockType, int fd, dev_t devid, ino_t inodeid, off_t offset, size_t length, time_t timeout_usec);	// file lock(rwlock) with resolved file
+		static int RawChangeLock(bool is_upgrade, int fd, off_t offset, size_t length);													// upgrade/downgrade rwlock
+		static int RawChangeLock(bool is_upgrade, PFLRWHANDLE phandle);																	// upgrade/downgrade rwlock handle
+		static int RawLockMany(const fullock_rwlock_range_t* pranges, size_t count, bool is_lock, time_t timeout_usec);					// file locks(rwlock) at once
 		static int RawLock(FLCKLOCKTYPE LockType, const char* pcondname, const char* pmutexname, bool is_broadcast, time_t timeout_usec);	// named cond
+		static int RawLock(FLCKLOCKTYPE LockType, PFLRWHANDLE phandle, time_t timeout_usec);												// rwlock handle
+		static bool CheckHandle(PFLRWHANDLE phandle);
 
 	public:
 		static bool ReInitializeObject(const char* dirname = NULL, const char* filename = NULL, size_t filelockcnt = FLCK_INITCNT_DEFAULT, size_t offlockcnt = FLCK_INITCNT_DEFAULT, size_t lockercnt = FLCK_INITCNT_DEFAULT, size_t nmtxcnt = FLCK_INITCNT_DEFAULT, size_t ncondcnt = FLCK_INITCNT_DEFAULT, size_t waitercnt = FLCK_INITCNT_DEFAULT);
@@ -136,6 +208,9 @@ class FlShm
 		static ROBUSTMODE SetRobustMode(ROBUSTMODE newval);
 		static NOMAPMODE SetNomapMode(NOMAPMODE newval);
 		static FREEUNITMODE SetFreeUnitMode(FREEUNITMODE newval);
+		static PREFERMODE SetPreferMode(PREFERMODE newval);
+		static RWLOCKTYPE SetRwlockType(RWLOCKTYPE newval);
+		static ROBUSTLISTMODE SetRobustListMode(ROBUSTLISTMODE newval);
 		static int SetRobustLoopCnt(int newval);
 		static size_t SetFileLockAreaCount(size_t newval);
 		static size_t SetOffLockAreaCount(size_t newval);
@@ -150,6 +225,9 @@ class FlShm
 		static NOMAPMODE GetNomapMode(void) { return FlShm::NomapMode; }
 		static bool IsFreeUnitFd(void) { return (FREE_FD == FlShm::FreeUnitMode); }
 		static bool IsFreeUnitOffset(void) { return (FREE_FD == FlShm::FreeUnitMode || FREE_OFFSET == FlShm::FreeUnitMode); }
+		static bool IsPreferWriter(void) { return (PREFER_WRITER == FlShm::PreferMode); }
+		static bool IsPhaseFairRwlock(void) { return (RWLOCK_PHASEFAIR == FlShm::RwlockType); }
+		static bool IsRobustList(void) { return (ROBUSTLIST_YES == FlShm::RobustListMode); }
 		static int GetRobustLoopCnt(void) { return FlShm::RobustLoopCnt; }
 		static size_t GetFileLockAreaCount(void) { return FlShm::FileLockAreaCount; }
 		static size_t GetOffLockAreaCount(void) { return FlShm::OffLockAreaCount; }
@@ -159,10 +237,21 @@ class FlShm
 		static size_t GetWaiterAreaCount(void) { return FlShm::WaiterAreaCount; }
 
 		// Check
-		static bool CheckProcessDead(void);
+		static bool CheckProcessDead(fl_pid_cache_map_t* pcache_map = NULL);
+		static bool IsSweepPending(void);
 		static bool CheckFileLockDeadLock(fl_pid_cache_map_t* pcache_map = NULL, flckpid_t flckpid = FLCK_INVALID_ID, flckpid_t except_flckpid = FLCK_INVALID_ID);
 		static bool CheckMutexDeadLock(fl_pid_cache_map_t* pcache_map = NULL, flckpid_t flckpid = FLCK_INVALID_ID, flckpid_t except_flckpid = FLCK_INVALID_ID);
 		static bool CheckCondDeadLock(fl_pid_cache_map_t* pcache_map = NULL, flckpid_t flckpid = FLCK_INVALID_ID, flckpid_t except_flckpid = FLCK_INVALID_ID);
+		static bool CheckMagazineDead(fl_pid_cache_map_t* pcache_map = NULL);
+
+		// Growing shm file
+		static bool GrowArea(flck_free_t& freetop);
+
+		// Lockers and Waiters(cached by magazine)
+		static PFLLOCKER RetrieveLocker(void);
+		static bool InsertFreeLocker(PFLLOCKER pabslocker);
+		static PFLWAITER RetrieveWaiter(void);
+		static bool InsertFreeWaiter(PFLWAITER pabswaiter);
 
 	public:
 		// Constructor/Destructor
@@ -192,6 +281,36 @@ class FlShm
 
 		int Unlock(int fd, off_t offset, size_t length);
 
+		int Upgrade(int fd, off_t offset, size_t length);
+		int Downgrade(int fd, off_t offset, size_t length);
+
+		int TimeoutLockMany(const fullock_rwlock_range_t* pranges, size_t count, time_t timeout_usec);
+		int TryLockMany(const fullock_rwlock_range_t* pranges, size_t count);
+		int LockMany(const fullock_rwlock_range_t* pranges, size_t count);
+		int UnlockMany(const fullock_rwlock_range_t* pranges, size_t count);
+
+		//
+		// Lock/Unlock for rwlock handle
+		//
+		PFLRWHANDLE OpenHandle(int fd, off_t offset, size_t length);
+		int CloseHandle(PFLRWHANDLE phandle);
+		bool IsLocked(PFLRWHANDLE phandle);
+
+		int TimeoutReadLock(PFLRWHANDLE phandle, time_t timeout_usec);
+		int TryReadLock(PFLRWHANDLE phandle);
+		int ReadLock(PFLRWHANDLE phandle);
+
+		int TimeoutWriteLock(PFLRWHANDLE phandle, time_t timeout_usec);
+		int TryWriteLock(PFLRWHANDLE phandle);
+		int WriteLock(PFLRWHANDLE phandle);
+
+		int Unlock(PFLRWHANDLE phandle);
+
+		int Upgrade(PFLRWHANDLE phandle);
+		int Downgrade(PFLRWHANDLE phandle);
+		bool SetPreferWriter(PFLRWHANDLE phandle, bool prefer_writer);
+		bool SetPhaseFair(PFLRWHANDLE phandle, bool phase_fair);
+
 		//
 		// Wait/Signal for named cond
 		//
@@ -210,6 +329,25 @@ class FlShm
 #define	to_rel(abs_addr)	(abs_addr ? SUBPTR(abs_addr, reinterpret_cast<off_t>(FlShm::pShmBase)) : abs_addr)
 #define	to_abs(rel_addr)	(rel_addr ? ADDPTR(rel_addr, reinterpret_cast<off_t>(FlShm::pShmBase)) : rel_addr)
 
+//---------------------------------------------------------
+// Utility for file lock hash
+//---------------------------------------------------------
+inline flck_hash_t fl_filelock_hash(dev_t dev_id, ino_t ino_id)
+{
+	uint64_t	keys[2] = {static_cast<uint64_t>(dev_id), static_cast<uint64_t>(ino_id)};
+	return flck_fnv_hash(keys, sizeof(keys));
+}
+
+inline PFLFILEBUCKET fl_get_filelock_bucket(size_t index)
+{
+	return &(to_abs(FlShm::pFlHead->file_lock_hash)[index]);
+}
+
+inline PFLFILEBUCKET fl_get_filelock_bucket(dev_t dev_id, ino_t ino_id)
+{
+	return fl_get_filelock_bucket(fl_filelock_hash(dev_id, ino_id) & (FlShm::pFlHead->file_lock_hash_cnt - 1));
+}
+
 #endif	// FLCKSHM_H
 
 /*
@@ -49,18 +49,38 @@ bool FlShm::Dump(ostream& out, bool is_free_list)
 	out << "[SHM] version                   = "	<< to_hexstring(FlShm::pFlHead->version)			<< std::endl;
 	out << "[SHM] szver                     = "	<< FlShm::pFlHead->szver							<< std::endl;
 	out << "[SHM] flength                   = "	<< FlShm::pFlHead->flength							<< std::endl;
-	out << "[SHM] file_lock_list            = "	<< to_hexstring(FlShm::pFlHead->file_lock_list)		<< std::endl;
+	out << "[SHM] grow_gen                  = "	<< FlShm::pFlHead->grow_gen							<< std::endl;
+	out << "[SHM] file_lock_hash            = "	<< to_hexstring(FlShm::pFlHead->file_lock_hash)		<< std::endl;
+	out << "[SHM] file_lock_hash_cnt        = "	<< FlShm::pFlHead->file_lock_hash_cnt				<< std::endl;
 	out << "[SHM] named_mutex_list          = "	<< to_hexstring(FlShm::pFlHead->named_mutex_list)	<< std::endl;
+	out << "[SHM] named_mutex_hash          = "	<< to_hexstring(FlShm::pFlHead->named_mutex_hash)	<< std::endl;
+	out << "[SHM] named_mutex_hash_cnt      = "	<< FlShm::pFlHead->named_mutex_hash_cnt				<< std::endl;
+	out << "[SHM] named_mutex_overflow      = "	<< FlShm::pFlHead->named_mutex_overflow				<< std::endl;
+	out << "[SHM] named_cond_list           = "	<< to_hexstring(FlShm::pFlHead->named_cond_list)	<< std::endl;
+	out << "[SHM] named_cond_hash           = "	<< to_hexstring(FlShm::pFlHead->named_cond_hash)	<< std::endl;
+	out << "[SHM] named_cond_hash_cnt       = "	<< FlShm::pFlHead->named_cond_hash_cnt				<< std::endl;
+	out << "[SHM] named_cond_overflow       = "	<< FlShm::pFlHead->named_cond_overflow				<< std::endl;
 	out << "[SHM] file_lock_free            = "	<< to_hexstring(FlShm::pFlHead->file_lock_free)		<< std::endl;
 	out << "[SHM] offset_lock_free          = "	<< to_hexstring(FlShm::pFlHead->offset_lock_free)	<< std::endl;
 	out << "[SHM] locker_free               = "	<< to_hexstring(FlShm::pFlHead->locker_free)		<< std::endl;
 	out << "[SHM] named_mutex_free          = "	<< to_hexstring(FlShm::pFlHead->named_mutex_free)	<< std::endl;
 
-	// dump: file_lock_list
-	out << "[file_lock_list]={" << std::endl;
-	if(FlShm::pFlHead->file_lock_list){
-		FlListFileLock	list(to_abs(FlShm::pFlHead->file_lock_list));
-		list.dump(out, 1);
+	// dump: lockid backoff statistics(this process only)
+	out << "[SHM] lockid pause phase count  = "	<< fl_get_lockid_stat().pause_cnt					<< std::endl;
+	out << "[SHM] lockid yield phase count  = "	<< fl_get_lockid_stat().yield_cnt					<< std::endl;
+	out << "[SHM] lockid park phase count   = "	<< fl_get_lockid_stat().park_cnt					<< std::endl;
+
+	// dump: file_lock_hash
+	out << "[file_lock_hash]={" << std::endl;
+	for(size_t index = 0; index < FlShm::pFlHead->file_lock_hash_cnt; ++index){
+		if(fl_get_filelock_bucket(index)->file_lock_list){
+			out << " [" << index << "]={" << std::endl;
+			for(PFLFILELOCK ptmp = to_abs(fl_get_filelock_bucket(index)->file_lock_list); ptmp; ptmp = to_abs(ptmp->next)){
+				FlListFileLock	list(ptmp);
+				list.dump(out, 2);
+			}
+			out << " }" << std::endl;
+		}
 	}
 	out << "}" << std::endl;
 
@@ -83,7 +103,7 @@ bool FlShm::Dump(ostream& out, bool is_free_list)
 	if(is_free_list){
 		// dump: file_lock_free
 		out << "[file_lock_free]={" << std::endl;
-		for(PFLFILELOCK ptmp = to_abs(FlShm::pFlHead->file_lock_free); ptmp; ptmp = to_abs(ptmp->next)){
+		for(PFLFILELOCK ptmp = to_abs(FlListFileLock::rel_free_top(FlShm::pFlHead->file_lock_free)); ptmp; ptmp = to_abs(ptmp->next)){
 			FlListFileLock	list(ptmp);
 			list.dump(out, 1);
 		}
@@ -91,7 +111,7 @@ bool FlShm::Dump(ostream& out, bool is_free_list)
 
 		// dump: offset_lock_free
 		out << "[offset_lock_free]={" << std::endl;
-		for(PFLOFFLOCK ptmp = to_abs(FlShm::pFlHead->offset_lock_free); ptmp; ptmp = to_abs(ptmp->next)){
+		for(PFLOFFLOCK ptmp = to_abs(FlListOffLock::rel_free_top(FlShm::pFlHead->offset_lock_free)); ptmp; ptmp = to_abs(ptmp->next)){
 			FlListOffLock	list(ptmp);
 			list.dump(out, 1);
 		}
@@ -99,7 +119,7 @@ bool FlShm::Dump(ostream& out, bool is_free_list)
 
 		// dump: locker_free
 		out << "[locker_free]={" << std::endl;
-		for(PFLLOCKER ptmp = to_abs(FlShm::pFlHead->locker_free); ptmp; ptmp = to_abs(ptmp->next)){
+		for(PFLLOCKER ptmp = to_abs(FlListLocker::rel_free_top(FlShm::pFlHead->locker_free)); ptmp; ptmp = to_abs(ptmp->next)){
 			FlListLocker	list(ptmp);
 			list.dump(out, 1);
 		}
@@ -107,7 +127,7 @@ bool FlShm::Dump(ostream& out, bool is_free_list)
 
 		// dump: named_mutex_free
 		out << "[named_mutex_free]={" << std::endl;
-		for(PFLNAMEDMUTEX ptmp = to_abs(FlShm::pFlHead->named_mutex_free); ptmp; ptmp = to_abs(ptmp->next)){
+		for(PFLNAMEDMUTEX ptmp = to_abs(FlListNMtx::rel_free_top(FlShm::pFlHead->named_mutex_free)); ptmp; ptmp = to_abs(ptmp->next)){
 			FlListNMtx	list(ptmp);
 			list.dump(out, 1);
 		}
@@ -115,7 +135,7 @@ bool FlShm::Dump(ostream& out, bool is_free_list)
 
 		// dump: named_mutex_free
 		out << "[named_cond_free]={" << std::endl;
-		for(PFLNAMEDCOND ptmp = to_abs(FlShm::pFlHead->named_cond_free); ptmp; ptmp = to_abs(ptmp->next)){
+		for(PFLNAMEDCOND ptmp = to_abs(FlListNCond::rel_free_top(FlShm::pFlHead->named_cond_free)); ptmp; ptmp = to_abs(ptmp->next)){
 			FlListNCond	list(ptmp);
 			list.dump(out, 1);
 		}
@@ -123,7 +143,7 @@ bool FlShm::Dump(ostream& out, bool is_free_list)
 
 		// dump: waiter_free
 		out << "[waiter_free]={" << std::endl;
-		for(PFLWAITER ptmp = to_abs(FlShm::pFlHead->waiter_free); ptmp; ptmp = to_abs(ptmp->next)){
+		for(PFLWAITER ptmp = to_abs(FlListWaiter::rel_free_top(FlShm::pFlHead->waiter_free)); ptmp; ptmp = to_abs(ptmp->next)){
 			FlListWaiter	list(ptmp);
 			list.dump(out, 1);
 		}
@@ -31,6 +31,7 @@
 #include "flcklistnmtx.h"
 #include "flcklistncond.h"
 #include "flcklistwaiter.h"
+#include "flckrobustlist.h"
 #include "flckutil.h"
 #include "flckdbg.h"
 
@@ -42,6 +43,20 @@ using namespace fullock;
 //---------------------------------------------------------
 #define	FLCK_SHM_PERMS				(S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH)
 
+// [NOTE]
+// Each process maps this size(or file size if it is larger) at attaching.
+// The area over the file size can not be accessed, but it becomes usable
+// without remapping when the file is grown by any process. Then the base
+// address never moves, and absolute pointers are always valid.
+// On 32bit, 4GB can not be expressed by size_t(and can not be reserved in
+// address space), so the size is clamped.
+//
+#if	defined(__SIZEOF_SIZE_T__) && 4 < __SIZEOF_SIZE_T__
+#define	FLCK_SHM_MAP_MAXSIZE		(static_cast<size_t>(4) * 1024 * 1024 * 1024)		// 4GB
+#else
+#define	FLCK_SHM_MAP_MAXSIZE		(static_cast<size_t>(512) * 1024 * 1024)			// 512MB
+#endif
+
 //---------------------------------------------------------
 // FlShm : Initialize Methods
 //---------------------------------------------------------
@@ -64,8 +79,13 @@ bool FlShm::Attach(void)
 	}
 
 	// check
-	if(FLCK_FILE_VERSION < pTmpHead->version){
-		ERR_FLCKPRN("Fullock shm file version(%lu: %s) is newer this library(%ld: %s)", pTmpHead->version, pTmpHead->szver, FLCK_FILE_VERSION, FLCK_FILE_VERSION_STR);
+	//
+	// [NOTE]
+	// The structure layout is different for each version, then we can not
+	// attach both newer and older version file.
+	//
+	if(FLCK_FILE_VERSION != pTmpHead->version){
+		ERR_FLCKPRN("Fullock shm file version(%lu: %s) is not same as this library(%ld: %s)", pTmpHead->version, pTmpHead->szver, FLCK_FILE_VERSION, FLCK_FILE_VERSION_STR);
 		RawUnmap(pTmpHead, sizeof(FLHEAD));
 		return false;
 	}
@@ -75,18 +95,35 @@ bool FlShm::Attach(void)
 	// munmap
 	RawUnmap(pTmpHead, sizeof(FLHEAD));
 
-	// remmap
+	// remmap(with reserving area for growing)
+	length = (length < FLCK_SHM_MAP_MAXSIZE ? FLCK_SHM_MAP_MAXSIZE : length);
 	if(NULL == (FlShm::pShmBase = RawMap(FlShm::ShmFd, length, 0))){
 		ERR_FLCKPRN("Failed to mmap FlShm::ShmFd(%d), size(%zu)", FlShm::ShmFd, length);
 		return false;
 	}
+	FlShm::MapLength = length;
 	FlShm::pFlHead = reinterpret_cast<PFLHEAD>(FlShm::pShmBase);
+	++FlShm::AttachGen;
 
 	return true;
 }
 
+// [NOTE]
+// The named mutexes which are linked to robust list have pointers in the
+// shared memory. The entries of calling thread are unlinked, and detaching
+// is refused while other threads have entries, because glibc and kernel
+// access them after unmapping.
+//
 bool FlShm::Detach(void)
 {
+	if(FlShm::pShmBase && !FlckRobustList::DequeueAll(FlShm::pShmBase, FlShm::MapLength)){
+		ERR_FLCKPRN("Other threads lock named mutexes with robust list, so could not detach shm.");
+		return false;
+	}
+
+	// return objects in magazine
+	FlShm::ReleaseMagazine();
+
 	// munmap
 	if(!FlShm::pShmBase){
 		WAN_FLCKPRN("Already munmap.");
@@ -94,11 +131,12 @@ bool FlShm::Detach(void)
 		if(!FlShm::pFlHead){
 			ERR_FLCKPRN("pShmBase(%p) is not NULL, but pFlHead is NULL, but continue...", FlShm::pShmBase);
 		}else{
-			if(!RawUnmap(FlShm::pShmBase, FlShm::pFlHead->flength)){
-				ERR_FLCKPRN("Failed to munmap(%p: %zu), but continue...", FlShm::pShmBase, FlShm::pFlHead->flength);
+			if(!RawUnmap(FlShm::pShmBase, FlShm::MapLength)){
+				ERR_FLCKPRN("Failed to munmap(%p: %zu), but continue...", FlShm::pShmBase, FlShm::MapLength);
 			}else{
 				FlShm::pShmBase	= NULL;
 				FlShm::pFlHead	= NULL;
+				FlShm::MapLength= 0;
 			}
 		}
 	}
@@ -241,8 +279,33 @@ bool FlShm::InitializeShmFile(void)
 		return false;
 	}
 
+	// calc hash bucket count for file lock(power of 2, and over file lock count)
+	size_t	filehashcnt;
+	for(filehashcnt = 1; filehashcnt < FlShm::FileLockAreaCount; filehashcnt <<= 1);
+
+	// calc hash bucket count for named mutex/cond(power of 2, and under about 57% load factor)
+	size_t	nmtxhashcnt;
+	size_t	ncondhashcnt;
+	for(nmtxhashcnt = 1; (nmtxhashcnt * 4) < FlShm::NMtxAreaCount; nmtxhashcnt <<= 1);
+	for(ncondhashcnt = 1; (ncondhashcnt * 4) < FlShm::NCondAreaCount; ncondhashcnt <<= 1);
+
+	// calc magazine count
+	//
+	// [NOTE]
+	// Lockers and waiters in magazines are not used by other processes, so
+	// magazines are made only when all magazines can not eat up half of areas.
+	//
+	size_t	magazinecnt = (FlShm::LockerAreaCount < FlShm::WaiterAreaCount ? FlShm::LockerAreaCount : FlShm::WaiterAreaCount) / (FLCK_MAGAZINE_MAX * 2);
+	if(FLCK_MAGAZINE_COUNT < magazinecnt){
+		magazinecnt = FLCK_MAGAZINE_COUNT;
+	}
+
 	// calc initialize size(align 64bit)
 	size_t	sz_head		= sizeof(FLHEAD);
+	size_t	sz_filehash	= sizeof(FLFILEBUCKET)	* filehashcnt;
+	size_t	sz_nmtxhash	= sizeof(FLNMTXBUCKET)	* nmtxhashcnt;
+	size_t	sz_ncondhash= sizeof(FLNCONDBUCKET)	* ncondhashcnt;
+	size_t	sz_magazine	= sizeof(FLMAGAZINE)	* magazinecnt;
 	size_t	sz_filelock	= sizeof(FLFILELOCK)	* FlShm::FileLockAreaCount;
 	size_t	sz_offlock	= sizeof(FLOFFLOCK)		* FlShm::OffLockAreaCount;
 	size_t	sz_locker	= sizeof(FLLOCKER)		* FlShm::LockerAreaCount;
@@ -251,7 +314,11 @@ bool FlShm::InitializeShmFile(void)
 	size_t	sz_waiter	= sizeof(FLWAITER)		* FlShm::WaiterAreaCount;
 
 	off_t	off_head		= 0;
-	off_t	off_filelock	= off_head		+ ALIGNMENT(sz_head,		sizeof(uint64_t));
+	off_t	off_filehash	= off_head		+ ALIGNMENT(sz_head,		FLCK_CACHELINE_SIZE);		// align cache line for each bucket
+	off_t	off_nmtxhash	= off_filehash	+ ALIGNMENT(sz_filehash,	FLCK_CACHELINE_SIZE);		// align cache line for each bucket
+	off_t	off_ncondhash	= off_nmtxhash	+ ALIGNMENT(sz_nmtxhash,	FLCK_CACHELINE_SIZE);		// align cache line for each bucket
+	off_t	off_magazine	= off_ncondhash	+ ALIGNMENT(sz_ncondhash,	FLCK_CACHELINE_SIZE);		// align cache line for each magazine
+	off_t	off_filelock	= off_magazine	+ ALIGNMENT(sz_magazine,	sizeof(uint64_t));
 	off_t	off_offlock		= off_filelock	+ ALIGNMENT(sz_filelock,	sizeof(uint64_t));
 	off_t	off_locker		= off_offlock	+ ALIGNMENT(sz_offlock,		sizeof(uint64_t));
 	off_t	off_nmtxlock	= off_locker	+ ALIGNMENT(sz_locker,		sizeof(uint64_t));
@@ -259,6 +326,10 @@ bool FlShm::InitializeShmFile(void)
 	off_t	off_waiter		= off_ncondlock	+ ALIGNMENT(sz_ncondlock,	sizeof(uint64_t));
 	off_t	off_end			= off_waiter	+ ALIGNMENT(sz_waiter,		sizeof(uint64_t));
 	size_t	sz_total	= ALIGNMENT(off_end, GetSystemPageSize());
+	if(FLCK_FREE_OFFSET_MAX < sz_total){
+		ERR_FLCKPRN("Total shm size(%zu) is over maximum size(%llu) which can be addressed in free list.", sz_total, static_cast<unsigned long long>(FLCK_FREE_OFFSET_MAX));
+		return false;
+	}
 
 	// fill zero to hole file
 	if(!flck_fill_zero(FlShm::ShmFd, sz_total, 0)){
@@ -266,11 +337,14 @@ bool FlShm::InitializeShmFile(void)
 		return false;
 	}
 
-	// mmap
-	if(NULL == (FlShm::pShmBase = RawMap(FlShm::ShmFd, sz_total, 0))){
-		ERR_FLCKPRN("Failed to mmap FlShm::ShmFd(%d), size(%zu)", FlShm::ShmFd, sz_total);
+	// mmap(with reserving area for growing)
+	size_t	sz_map = (sz_total < FLCK_SHM_MAP_MAXSIZE ? FLCK_SHM_MAP_MAXSIZE : sz_total);
+	if(NULL == (FlShm::pShmBase = RawMap(FlShm::ShmFd, sz_map, 0))){
+		ERR_FLCKPRN("Failed to mmap FlShm::ShmFd(%d), size(%zu)", FlShm::ShmFd, sz_map);
 		return false;
 	}
+	FlShm::MapLength = sz_map;
+	++FlShm::AttachGen;
 
 	// initialize parts
 	FlShm::pFlHead = reinterpret_cast<PFLHEAD>(FlShm::pShmBase);
@@ -279,21 +353,34 @@ bool FlShm::InitializeShmFile(void)
 
 	FlShm::pFlHead->version					= FLCK_FILE_VERSION;
 	FlShm::pFlHead->flength					= sz_total;
-	FlShm::pFlHead->file_lock_lockid		= FLCK_INVALID_ID;
-	FlShm::pFlHead->file_lock_list			= NULL;
+	FlShm::pFlHead->grow_lockid				= FLCK_INVALID_ID;
+	FlShm::pFlHead->grow_gen				= 0;
+	FlShm::pFlHead->file_lock_hash			= to_rel(ADDPTR(CVT_POINTER(FlShm::pShmBase, FLFILEBUCKET), off_filehash));	// all buckets are filled zero(unlocked and empty)
+	FlShm::pFlHead->file_lock_hash_cnt		= filehashcnt;
 	FlShm::pFlHead->named_mutex_lockid		= FLCK_INVALID_ID;
 	FlShm::pFlHead->named_mutex_list		= NULL;
-	FlShm::pFlHead->file_lock_free			= FlShm::MakeListFileLock(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLFILELOCK),	off_filelock),	FlShm::FileLockAreaCount);
-	FlShm::pFlHead->offset_lock_free		= FlShm::MakeListOffLock(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLOFFLOCK),		off_offlock),	FlShm::OffLockAreaCount);
-	FlShm::pFlHead->locker_free				= FlShm::MakeListLocker(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLLOCKER),		off_locker),	FlShm::LockerAreaCount);
-	FlShm::pFlHead->named_mutex_free		= FlShm::MakeListNMtxLock(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLNAMEDMUTEX),	off_nmtxlock),	FlShm::NMtxAreaCount);
-	FlShm::pFlHead->named_cond_free			= FlShm::MakeListNCondLock(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLNAMEDCOND),	off_ncondlock),	FlShm::NCondAreaCount);
-	FlShm::pFlHead->waiter_free				= FlShm::MakeListWaiter(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLWAITER),		off_waiter),	FlShm::WaiterAreaCount);
+	FlShm::pFlHead->named_mutex_overflow	= 0;
+	FlShm::pFlHead->named_mutex_hash		= to_rel(ADDPTR(CVT_POINTER(FlShm::pShmBase, FLNMTXBUCKET), off_nmtxhash));	// all buckets are filled zero(empty)
+	FlShm::pFlHead->named_mutex_hash_cnt	= nmtxhashcnt;
+	FlShm::pFlHead->named_cond_lockid		= FLCK_INVALID_ID;
+	FlShm::pFlHead->named_cond_list			= NULL;
+	FlShm::pFlHead->named_cond_overflow		= 0;
+	FlShm::pFlHead->named_cond_hash			= to_rel(ADDPTR(CVT_POINTER(FlShm::pShmBase, FLNCONDBUCKET), off_ncondhash));	// all buckets are filled zero(empty)
+	FlShm::pFlHead->named_cond_hash_cnt		= ncondhashcnt;
+	FlShm::pFlHead->magazines				= (0 == magazinecnt ? NULL : to_rel(ADDPTR(CVT_POINTER(FlShm::pShmBase, FLMAGAZINE), off_magazine)));	// all magazines are filled zero(not used)
+	FlShm::pFlHead->magazine_cnt			= magazinecnt;
+	FlShm::pFlHead->file_lock_free			= FLCK_FREE_MAKE(0, reinterpret_cast<uintptr_t>(FlShm::MakeListFileLock(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLFILELOCK),	off_filelock),	FlShm::FileLockAreaCount)));
+	FlShm::pFlHead->offset_lock_free		= FLCK_FREE_MAKE(0, reinterpret_cast<uintptr_t>(FlShm::MakeListOffLock(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLOFFLOCK),		off_offlock),	FlShm::OffLockAreaCount)));
+	FlShm::pFlHead->locker_free				= FLCK_FREE_MAKE(0, reinterpret_cast<uintptr_t>(FlShm::MakeListLocker(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLLOCKER),		off_locker),	FlShm::LockerAreaCount)));
+	FlShm::pFlHead->named_mutex_free		= FLCK_FREE_MAKE(0, reinterpret_cast<uintptr_t>(FlShm::MakeListNMtxLock(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLNAMEDMUTEX),	off_nmtxlock),	FlShm::NMtxAreaCount)));
+	FlShm::pFlHead->named_cond_free			= FLCK_FREE_MAKE(0, reinterpret_cast<uintptr_t>(FlShm::MakeListNCondLock(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLNAMEDCOND),	off_ncondlock),	FlShm::NCondAreaCount)));
+	FlShm::pFlHead->waiter_free				= FLCK_FREE_MAKE(0, reinterpret_cast<uintptr_t>(FlShm::MakeListWaiter(	ADDPTR(CVT_POINTER(FlShm::pShmBase, FLWAITER),		off_waiter),	FlShm::WaiterAreaCount)));
 
 	// check
 	if(!FlShm::pFlHead->file_lock_free || !FlShm::pFlHead->offset_lock_free || !FlShm::pFlHead->locker_free || !FlShm::pFlHead->named_mutex_free || !FlShm::pFlHead->named_cond_free || !FlShm::pFlHead->waiter_free){
 		ERR_FLCKPRN("FATAL - Could not initialize some free leaf pointer.");
-		RawUnmap(FlShm::pShmBase, sz_total);
+		RawUnmap(FlShm::pShmBase, sz_map);
+		FlShm::MapLength= 0;
 		FlShm::pShmBase	= NULL;
 		FlShm::pFlHead	= NULL;
 		return false;
@@ -373,6 +460,83 @@ PFLWAITER FlShm::MakeListWaiter(PFLWAITER ptr, size_t count)
 	return list.rel_get();
 }
 
+//---------------------------------------------------------
+// FlShm : Growing Methods
+//---------------------------------------------------------
+// [NOTE]
+// Must lock grow_lockid before calling this.
+// New area for count objects is appended to the end of file, and all of
+// them are inserted to free list. The other processes do not need to do
+// anything, because they already map the area(see FLCK_SHM_MAP_MAXSIZE).
+//
+template<typename L>
+bool FlShm::GrowFreeArea(flck_free_t& freetop, size_t count)
+{
+	size_t	oldlength = FlShm::pFlHead->flength;
+	size_t	newlength = oldlength + ALIGNMENT(sizeof(typename L::st_type) * count, GetSystemPageSize());
+	if(0 == count || FLCK_SHM_MAP_MAXSIZE < newlength || FlShm::MapLength < newlength || FLCK_FREE_OFFSET_MAX < newlength){
+		ERR_FLCKPRN("Could not grow shm file from %zu to %zu byte, it is over maximum size.", oldlength, newlength);
+		return false;
+	}
+
+	// fill zero to new area
+	if(!flck_fill_zero(FlShm::ShmFd, newlength - oldlength, static_cast<off_t>(oldlength))){
+		ERR_FLCKPRN("Failed to grow shm file from %zu to %zu byte.", oldlength, newlength);
+		return false;
+	}
+
+	// initialize as list and insert all to free list
+	typename L::st_ptr_type	pabstop = ADDPTR(CVT_POINTER(FlShm::pShmBase, typename L::st_type), oldlength);
+	L						listobj;
+	if(!listobj.initialize(pabstop, count) || !listobj.insert_free(freetop, &pabstop[count - 1])){
+		ERR_FLCKPRN("Failed to initialize new area in shm file.");
+		return false;
+	}
+	FlShm::pFlHead->flength = newlength;
+	__sync_fetch_and_add(&(FlShm::pFlHead->grow_gen), 1);
+
+	MSG_FLCKPRN("Grew shm file from %zu to %zu byte(generation %lu).", oldlength, newlength, FlShm::pFlHead->grow_gen);
+	return true;
+}
+
+// Returns	false	: could not grow
+//			true	: grew area for freetop, or freetop is already not empty
+//
+bool FlShm::GrowArea(flck_free_t& freetop)
+{
+	if(FLCK_INVALID_HANDLE == FlShm::ShmFd || !FlShm::pFlHead){
+		return false;
+	}
+	flckpid_t	flckpid = get_flckpid();
+	bool		result;
+
+	fl_lock_lockid(&FlShm::pFlHead->grow_lockid, flckpid);			// lock lockid
+
+	if(0 != FLCK_FREE_OFFSET(freetop)){
+		// other thread(process) already grew or returned object
+		result = true;
+	}else if(&freetop == &FlShm::pFlHead->file_lock_free){
+		result = FlShm::GrowFreeArea<FlListFileLock>(freetop, FlShm::FileLockAreaCount);
+	}else if(&freetop == &FlShm::pFlHead->offset_lock_free){
+		result = FlShm::GrowFreeArea<FlListOffLock>(freetop, FlShm::OffLockAreaCount);
+	}else if(&freetop == &FlShm::pFlHead->locker_free){
+		result = FlShm::GrowFreeArea<FlListLocker>(freetop, FlShm::LockerAreaCount);
+	}else if(&freetop == &FlShm::pFlHead->named_mutex_free){
+		result = FlShm::GrowFreeArea<FlListNMtx>(freetop, FlShm::NMtxAreaCount);
+	}else if(&freetop == &FlShm::pFlHead->named_cond_free){
+		result = FlShm::GrowFreeArea<FlListNCond>(freetop, FlShm::NCondAreaCount);
+	}else if(&freetop == &FlShm::pFlHead->waiter_free){
+		result = FlShm::GrowFreeArea<FlListWaiter>(freetop, FlShm::WaiterAreaCount);
+	}else{
+		ERR_FLCKPRN("Unknown free list is specified.");
+		result = false;
+	}
+
+	fl_unlock_lockid(&FlShm::pFlHead->grow_lockid, flckpid);		// unlock lockid
+
+	return result;
+}
+
 bool FlShm::Destroy(void)
 {
 	if(FLCK_INVALID_HANDLE == FlShm::ShmFd){
@@ -380,6 +544,12 @@ bool FlShm::Destroy(void)
 		return true;
 	}
 
+	// check robust list before stopping thread(see Detach)
+	if(FlShm::pShmBase && !FlckRobustList::DequeueAll(FlShm::pShmBase, FlShm::MapLength)){
+		ERR_FLCKPRN("Other threads lock named mutexes with robust list, so could not destroy object.");
+		return false;
+	}
+
 	// stop epoll thread
 	if(FlShm::pCheckPidThread){
 		FlShm::pCheckPidThread->Exit();
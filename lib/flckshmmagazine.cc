@@ -0,0 +1,278 @@
+/*
+ * FULLOCK - Fast User Level LOCK library
+ *
+ * Copyright 2015 Yahoo Japan Corporation.
+ *
+ * FULLOCK is fast locking library on user level by Yahoo! JAPAN.
+ * FULLOCK is following specifications.
+ *
+ * For the full copyright and license information, please view
+ * the license file that was distributed with this source code.
+ *
+ * AUTHOR:   agent
+ * CREATE:   Sat 17 Oct 2026
+ * REVISION:
+ *
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "flckcommon.h"
+#include "flckshm.h"
+#include "flckstructure.h"
+#include "flcklistlocker.h"
+#include "flcklistwaiter.h"
+#include "flckutil.h"
+#include "flckdbg.h"
+
+using namespace std;
+using namespace fullock;
+
+//---------------------------------------------------------
+// Symbols
+//---------------------------------------------------------
+#define	FLCK_MAGAZINE_RECLAIMING			static_cast<pid_t>(-1)		// owner value while returning dead process's magazine
+
+//---------------------------------------------------------
+// Utility for magazine
+//---------------------------------------------------------
+// Retrieve one object from magazine list, if the list is empty, it is
+// refilled from free list by batch.
+//
+template<typename L>
+static typename L::st_ptr_type fl_magazine_retrieve(typename L::st_ptr_type& prellist, size_t& count, flck_free_t& freetop)
+{
+	typedef typename L::st_ptr_type	st_ptr_type;
+
+	if(0 == count || !prellist){
+		L	listobj;
+		if(0 == (count = listobj.retrieve_free(freetop, FLCK_MAGAZINE_BATCH))){
+			prellist = NULL;
+			return NULL;
+		}
+		prellist = listobj.rel_get();
+	}
+	st_ptr_type	pabs = to_abs(prellist);
+	prellist	= pabs->next;
+	pabs->next	= NULL;
+	--count;
+	return pabs;
+}
+
+// Insert one object to magazine list, if the list is over max count,
+// the objects in top of the list are returned to free list by batch.
+//
+template<typename L>
+static void fl_magazine_insert(typename L::st_ptr_type pabs, typename L::st_ptr_type& prellist, size_t& count, flck_free_t& freetop)
+{
+	typedef typename L::st_ptr_type	st_ptr_type;
+
+	pabs->next	= prellist;
+	prellist	= to_rel(pabs);
+	++count;
+
+	if(FLCK_MAGAZINE_MAX < count){
+		st_ptr_type	pabstop		= to_abs(prellist);
+		st_ptr_type	pabstail	= pabstop;
+		for(size_t cnt = 1; cnt < FLCK_MAGAZINE_BATCH; ++cnt){
+			pabstail = to_abs(pabstail->next);
+		}
+		prellist	= pabstail->next;
+		count		-= FLCK_MAGAZINE_BATCH;
+
+		L	listobj(pabstop);
+		listobj.insert_free(freetop, pabstail);
+	}
+}
+
+// Return all objects in magazine list to free list.
+//
+template<typename L>
+static void fl_magazine_flush(typename L::st_ptr_type& prellist, size_t& count, flck_free_t& freetop)
+{
+	typedef typename L::st_ptr_type	st_ptr_type;
+
+	if(prellist){
+		st_ptr_type	pabstail = to_abs(prellist);
+		while(pabstail->next){
+			pabstail = to_abs(pabstail->next);
+		}
+		L	listobj(to_abs(prellist));
+		listobj.insert_free(freetop, pabstail);
+	}
+	prellist	= NULL;
+	count		= 0;
+}
+
+//---------------------------------------------------------
+// FlShm : Magazine Methods
+//---------------------------------------------------------
+// [NOTE]
+// Must lock MagazineLockVal before calling this.
+// After forking, the child process can not use parent's magazine, so the
+// magazine is checked by pid at each calling.
+//
+PFLMAGAZINE FlShm::GetMagazine(void)
+{
+	pid_t	pid = getpid();
+	if(pid == FlShm::MagazinePid){
+		return FlShm::pMagazine;			// if pMagazine is NULL, it means there is no free magazine.
+	}
+	FlShm::pMagazine	= NULL;
+	FlShm::MagazinePid	= pid;
+
+	PFLMAGAZINE	pabsmagazines = to_abs(FlShm::pFlHead->magazines);
+	for(size_t cnt = 0; pabsmagazines && cnt < FlShm::pFlHead->magazine_cnt; ++cnt){
+		if(0 == pabsmagazines[cnt].owner && 0 == __sync_val_compare_and_swap(&(pabsmagazines[cnt].owner), 0, pid)){
+			FlShm::pMagazine = &pabsmagazines[cnt];
+			break;
+		}
+	}
+	if(!FlShm::pMagazine){
+		MSG_FLCKPRN("There is no free magazine for process(%d), so lockers and waiters are not cached.", pid);
+	}
+	return FlShm::pMagazine;
+}
+
+void FlShm::ReleaseMagazine(void)
+{
+	flck_lock_noshared_mutex(&FlShm::MagazineLockVal);
+
+	if(FlShm::pFlHead && FlShm::pMagazine && getpid() == FlShm::MagazinePid){
+		fl_magazine_flush<FlListLocker>(FlShm::pMagazine->locker_list, FlShm::pMagazine->locker_cnt, FlShm::pFlHead->locker_free);
+		fl_magazine_flush<FlListWaiter>(FlShm::pMagazine->waiter_list, FlShm::pMagazine->waiter_cnt, FlShm::pFlHead->waiter_free);
+		__sync_synchronize();
+		FlShm::pMagazine->owner = 0;
+	}
+	FlShm::pMagazine	= NULL;
+	FlShm::MagazinePid	= 0;
+
+	flck_unlock_noshared_mutex(&FlShm::MagazineLockVal);
+}
+
+// Returns	false	: there is no magazine of dead process
+//			true	: found magazine of dead process and returned objects in it
+//
+bool FlShm::CheckMagazineDead(fl_pid_cache_map_t* pcache_map)
+{
+	if(FLCK_INVALID_HANDLE == FlShm::ShmFd || !FlShm::pFlHead->magazines){
+		return false;
+	}
+	pid_t		pid				= getpid();
+	PFLMAGAZINE	pabsmagazines	= to_abs(FlShm::pFlHead->magazines);
+	bool		result			= false;
+	for(size_t cnt = 0; cnt < FlShm::pFlHead->magazine_cnt; ++cnt){
+		PFLMAGAZINE	pmagazine	= &pabsmagazines[cnt];
+		pid_t		owner		= pmagazine->owner;
+		if(0 == owner || FLCK_MAGAZINE_RECLAIMING == owner || pid == owner){
+			continue;
+		}
+		if(FindThreadProcess(owner, static_cast<tid_t>(owner), pcache_map)){
+			continue;
+		}
+		// owner process is dead, get this magazine for returning.
+		if(owner != __sync_val_compare_and_swap(&(pmagazine->owner), owner, FLCK_MAGAZINE_RECLAIMING)){
+			continue;
+		}
+		fl_magazine_flush<FlListLocker>(pmagazine->locker_list, pmagazine->locker_cnt, FlShm::pFlHead->locker_free);
+		fl_magazine_flush<FlListWaiter>(pmagazine->waiter_list, pmagazine->waiter_cnt, FlShm::pFlHead->waiter_free);
+		__sync_synchronize();
+		pmagazine->owner = 0;
+		result = true;
+	}
+	return result;
+}
+
+PFLLOCKER FlShm::RetrieveLocker(void)
+{
+	PFLLOCKER	pabs = NULL;
+
+	flck_lock_noshared_mutex(&FlShm::MagazineLockVal);
+	PFLMAGAZINE	pmagazine = FlShm::GetMagazine();
+	if(pmagazine){
+		pabs = fl_magazine_retrieve<FlListLocker>(pmagazine->locker_list, pmagazine->locker_cnt, FlShm::pFlHead->locker_free);
+	}
+	flck_unlock_noshared_mutex(&FlShm::MagazineLockVal);
+
+	if(!pabs){
+		// no magazine or could not refill, then try to retrieve directly(grow area if empty).
+		FlListLocker	listobj;
+		if(listobj.retrieve_free(FlShm::pFlHead->locker_free) || (FlShm::GrowArea(FlShm::pFlHead->locker_free) && listobj.retrieve_free(FlShm::pFlHead->locker_free))){
+			pabs = listobj.get();
+		}
+	}
+	return pabs;
+}
+
+// [NOTE]
+// If free list is empty, other process may wait for free object. Then the
+// object is not cached in magazine, and is returned to free list directly.
+//
+bool FlShm::InsertFreeLocker(PFLLOCKER pabslocker)
+{
+	if(!pabslocker){
+		return false;
+	}
+	if(0 != FLCK_FREE_OFFSET(FlShm::pFlHead->locker_free)){
+		flck_lock_noshared_mutex(&FlShm::MagazineLockVal);
+		PFLMAGAZINE	pmagazine = FlShm::GetMagazine();
+		if(pmagazine){
+			fl_magazine_insert<FlListLocker>(pabslocker, pmagazine->locker_list, pmagazine->locker_cnt, FlShm::pFlHead->locker_free);
+			flck_unlock_noshared_mutex(&FlShm::MagazineLockVal);
+			return true;
+		}
+		flck_unlock_noshared_mutex(&FlShm::MagazineLockVal);
+	}
+	FlListLocker	listobj(pabslocker);
+	return listobj.insert_free(FlShm::pFlHead->locker_free);
+}
+
+PFLWAITER FlShm::RetrieveWaiter(void)
+{
+	PFLWAITER	pabs = NULL;
+
+	flck_lock_noshared_mutex(&FlShm::MagazineLockVal);
+	PFLMAGAZINE	pmagazine = FlShm::GetMagazine();
+	if(pmagazine){
+		pabs = fl_magazine_retrieve<FlListWaiter>(pmagazine->waiter_list, pmagazine->waiter_cnt, FlShm::pFlHead->waiter_free);
+	}
+	flck_unlock_noshared_mutex(&FlShm::MagazineLockVal);
+
+	if(!pabs){
+		// no magazine or could not refill, then try to retrieve directly(grow area if empty).
+		FlListWaiter	listobj;
+		if(listobj.retrieve_free(FlShm::pFlHead->waiter_free) || (FlShm::GrowArea(FlShm::pFlHead->waiter_free) && listobj.retrieve_free(FlShm::pFlHead->waiter_free))){
+			pabs = listobj.get();
+		}
+	}
+	return pabs;
+}
+
+bool FlShm::InsertFreeWaiter(PFLWAITER pabswaiter)
+{
+	if(!pabswaiter){
+		return false;
+	}
+	if(0 != FLCK_FREE_OFFSET(FlShm::pFlHead->waiter_free)){
+		flck_lock_noshared_mutex(&FlShm::MagazineLockVal);
+		PFLMAGAZINE	pmagazine = FlShm::GetMagazine();
+		if(pmagazine){
+			fl_magazine_insert<FlListWaiter>(pabswaiter, pmagazine->waiter_list, pmagazine->waiter_cnt, FlShm::pFlHead->waiter_free);
+			flck_unlock_noshared_mutex(&FlShm::MagazineLockVal);
+			return true;
+		}
+		flck_unlock_noshared_mutex(&FlShm::MagazineLockVal);
+	}
+	FlListWaiter	listobj(pabswaiter);
+	return listobj.insert_free(FlShm::pFlHead->waiter_free);
+}
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noexpandtab sw=4 ts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4
+ */
@@ -19,6 +19,7 @@
 #define	FLCKSTRUCTURE_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include "flckcommon.h"
 #include "fullock.h"
@@ -28,23 +29,136 @@
 // Typedefs
 //---------------------------------------------------------
 typedef	uint64_t					flck_ver_t;				// for fullock shared memory file version
+typedef	uint64_t					flck_free_t;			// tagged top of free list(generation and relative offset)
 
 //---------------------------------------------------------
 // Symbols
 //---------------------------------------------------------
-#define	FLCK_FILE_VERSION			1L
-#define	FLCK_FILE_VERSION_STR		"FULLOCK FILEVER 1"
+// [NOTE]
+// FLCK_FILE_VERSION must be bumped by every change of the shared memory
+// layout, and also by every change of how a value in it is encoded(lock
+// word bits, waiter bits, owner fields) or how waiters are woken. Attach
+// refuses any file whose version is not same, so a process built from
+// another revision never reads the values by a different rule.
+//
+#define	FLCK_FILE_VERSION			26L
+#define	FLCK_FILE_VERSION_STR		"FULLOCK FILEVER 26"
 #define	FLCK_FILE_VERSION_BUFFSIZE	24
 
+#define	FLCK_CACHELINE_SIZE			64
+#define	FLCK_NAME_BUCKET_SLOTS		7						// slot count in one hash bucket for named mutex/cond
+#define	FLCK_NAME_BUCKET_PADDING	(FLCK_CACHELINE_SIZE - (FLCK_NAME_BUCKET_SLOTS + 1) - __SIZEOF_POINTER__ * FLCK_NAME_BUCKET_SLOTS)	// padding in hash bucket(0 on LP64)
+#define	FLCK_MAGAZINE_COUNT			256						// max magazine count(max process count which has magazine)
+#define	FLCK_MAGAZINE_BATCH			8						// object count for retrieving/returning at once
+#define	FLCK_MAGAZINE_MAX			16						// max object count in one magazine list
+
+// [NOTE]
+// Top of free list is tagged for avoiding ABA problem as following:
+//	upper 32bit	: generation(counted up at each changing)
+//	lower 32bit	: relative offset of top object / 8(0 means empty)
+// All objects in shm are aligned 64bit, so the shm file can be up to 32GB.
+//
+#define	FLCK_FREE_OFFSET_UNIT		sizeof(uint64_t)
+#define	FLCK_FREE_OFFSET_MAX		(static_cast<uint64_t>(0xFFFFFFFFULL) * FLCK_FREE_OFFSET_UNIT)
+#define	FLCK_FREE_GEN(val)			static_cast<uint32_t>((val) >> 32)
+#define	FLCK_FREE_OFFSET(val)		(((val) & 0xFFFFFFFFULL) * FLCK_FREE_OFFSET_UNIT)
+#define	FLCK_FREE_MAKE(gen, reloff)	((static_cast<flck_free_t>(static_cast<uint32_t>(gen)) << 32) | ((static_cast<flck_free_t>(reloff) / FLCK_FREE_OFFSET_UNIT) & 0xFFFFFFFFULL))
+
+// [NOTE]
+// Named mutex value is owner's flckpid, and the lower 32bit(tid) is the
+// futex word. It has the same layout as the futex word of the kernel
+// robust futex, then the kernel can set FLCK_MUTEX_OWNER_DIED when the
+// owner thread exits with holding the mutex registered to its robust
+// list(see FlckRobustList). tid does not use top 2 bits(FUTEX_TID_MASK).
+//	0x80000000	: there are waiters parked on futex(FUTEX_WAITERS)
+//	0x40000000	: owner thread is dead(FUTEX_OWNER_DIED)
+//
 #define	FLCK_MUTEX_UNLOCK			0
+#define	FLCK_MUTEX_WAITER			(static_cast<flck_mutex_t>(0x80000000U))	// there are waiters parked on futex
+#define	FLCK_MUTEX_OWNER_DIED		(static_cast<flck_mutex_t>(0x40000000U))	// owner thread is dead(set by kernel)
+#define	FLCK_MUTEX_OWNER(val)		((val) & ~(FLCK_MUTEX_WAITER | FLCK_MUTEX_OWNER_DIED))
+#define	IS_FLCK_MUTEX_WAITER(val)	(FLCK_MUTEX_WAITER == ((val) & FLCK_MUTEX_WAITER))
+#define	IS_FLCK_MUTEX_OWNER_DIED(val)	(FLCK_MUTEX_OWNER_DIED == ((val) & FLCK_MUTEX_OWNER_DIED))
+#define	FLCK_MUTEX_ROBUST_AREA		4						// pointer count of area for robust list entry
 
+// [NOTE]
+// rwlock value is bit field as following:
+//	0x07FFFFFF	: reader count(FLCK_RWLOCK_RLOCK is one reader)
+//	0x08000000	: some writer is pending with writer preference(new readers are blocked)
+//	0x10000000	: writer locked
+//	0x20000000	: one reader is waiting for upgrading to writer(new readers are blocked)
+//	0x40000000	: there are waiters parked on futex
+//
 #define	FLCK_RWLOCK_UNLOCK			0
-#define	FLCK_RWLOCK_WLOCK			-1
 #define	FLCK_RWLOCK_RLOCK			1						// over 1
+#define	FLCK_RWLOCK_RCNT_MASK		0x07FFFFFF
+#define	FLCK_RWLOCK_WPENDING		0x08000000
+#define	FLCK_RWLOCK_WLOCK			0x10000000
+#define	FLCK_RWLOCK_UPGRADE			0x20000000
+#define	FLCK_RWLOCK_WAITER			0x40000000
+
+#define	FLCK_RWLOCK_STATE(val)		((val) & ~FLCK_RWLOCK_WAITER)
+#define	IS_FLCK_RWLOCK_WLOCKED(val)	(FLCK_RWLOCK_WLOCK == ((val) & FLCK_RWLOCK_WLOCK))
+#define	IS_FLCK_RWLOCK_UPGRADE(val)	(FLCK_RWLOCK_UPGRADE == ((val) & FLCK_RWLOCK_UPGRADE))
+#define	IS_FLCK_RWLOCK_WAITER(val)	(FLCK_RWLOCK_WAITER == ((val) & FLCK_RWLOCK_WAITER))
+#define	IS_FLCK_RWLOCK_WPENDING(val)	(FLCK_RWLOCK_WPENDING == ((val) & FLCK_RWLOCK_WPENDING))
+#define	IS_FLCK_RWLOCK_RBLOCKED(val)	(0 != ((val) & (FLCK_RWLOCK_WLOCK | FLCK_RWLOCK_UPGRADE | FLCK_RWLOCK_WPENDING)))	// new reader can not lock
+#define	IS_FLCK_RWLOCK_WLOCKABLE(val)	(FLCK_RWLOCK_UNLOCK == ((val) & ~(FLCK_RWLOCK_WAITER | FLCK_RWLOCK_WPENDING)))		// writer can lock
+
+// [NOTE]
+// Phase-fair ticket rwlock is another layout of rwlock, it has four counters:
+//	rin		: count of entered readers(by FLCK_PFRW_RINC) and writer phase bits
+//	rout	: count of left readers(by FLCK_PFRW_RINC)
+//	win		: ticket for next writer
+//	wout	: ticket of writer which is served now
+// Writer phase bits in rin are as following:
+//	0x02	: writer is present(new readers wait until the phase is changed)
+//	0x01	: phase id(lowest bit of writer ticket)
+// A reader waits only while the writer phase which it saw at entering is
+// going on, and writers are served by ticket order, so that both readers
+// and writers wait bounded. Waiters compare the counters with their own
+// ticket which is kept in the locker.
+//
+#define	FLCK_PFRW_RINC				0x100
+#define	FLCK_PFRW_WBITS				0x3
+#define	FLCK_PFRW_PRES				0x2
+#define	FLCK_PFRW_PHID				0x1
+#define	FLCK_PFRW_RCNT(val)			((val) & ~static_cast<flck_ticket_t>(FLCK_PFRW_WBITS))
+
+#define	FLCK_PFTICKET_NONE			0						// locker does not have ticket
+#define	FLCK_PFTICKET_READER		1						// locker has reader ticket(entered to rin)
+#define	FLCK_PFTICKET_WRITER		2						// locker has writer ticket(waiting for wout)
+#define	FLCK_PFTICKET_WPRESENT		3						// locker has writer ticket and set phase bits(waiting for readers)
 
 //---------------------------------------------------------
 // Structure
 //---------------------------------------------------------
+//
+// Phase-fair ticket rwlock
+//
+typedef struct fl_pf_rwlock{
+	volatile flck_ticket_t	rin;							// entered readers and writer phase bits
+	volatile flck_ticket_t	rout;							// left readers
+	volatile flck_ticket_t	win;							// next writer ticket
+	volatile flck_ticket_t	wout;							// served writer ticket
+	volatile int			parked;							// count of waiters parked on futex
+}FLPFRWLOCK, *PFLPFRWLOCK;
+
+//
+// Ticket for phase-fair ticket rwlock(kept in locker)
+//
+// [NOTE]
+// The ticket is set just after taking it, then the dead locker's ticket
+// can be released by another process. When the dead locker still waits
+// for its turn, it is marked dead and released at the turn.
+//
+typedef struct fl_pf_ticket{
+	volatile int			type;							// FLCK_PFTICKET_*
+	flck_ticket_t			ticket;							// rin for reader, win for writer
+	flck_ticket_t			rticket;						// rin at setting phase bits(only writer)
+	volatile bool			dead;							// owner is dead, waiting for its turn to release
+}FLPFTICKET, *PFLPFTICKET;
+
 //
 // RWLocker by one Process/Thread/FileDescriptor
 //
@@ -54,19 +168,38 @@ typedef struct fl_locker{
 	flckpid_t				flckpid;						// pid and tid(packed)
 	int						fd;
 	volatile bool			locked;
+	volatile bool			upgrading;						// waiting for upgrading to writer(in reader list)
+	FLPFTICKET				pfticket;						// ticket for phase-fair rwlock
 }FLLOCKER, *PFLLOCKER;
 
 //
 // RWLocker by offset
 //
+// [NOTE]
+// Offset locks in one file are kept in a treap(binary search tree by offset,
+// and heap by priority which is made from hash of the relative address).
+// Each node has max end(offset + length) in its subtree, then it works as
+// interval tree for searching overlap. "next" is used only in free list.
+// pin_list has a locker for each opened handle, it is owned by the process
+// (tid is same as pid) and has no-fd, then it is released when the process
+// is dead as same as other lockers.
+//
 typedef struct fl_offset_lock{
-	struct fl_offset_lock*	next;							// next list
+	struct fl_offset_lock*	next;							// next list(only for free list)
+	struct fl_offset_lock*	left;							// left child in offset lock tree(smaller offset)
+	struct fl_offset_lock*	right;							// right child in offset lock tree(larger offset)
+	size_t					max_end;						// max end(offset + length) in this subtree
 
 	flck_rwlock_t			lockval;						// lock variable
 	off_t					offset;							// offset from file top
 	size_t					length;							// length for locking area
 	PFLLOCKER				reader_list;					// lock readers list
 	PFLLOCKER				writer_list;					// lock writers list
+	PFLLOCKER				pin_list;						// pins by opened handles(pin this and parent file lock)
+	volatile bool			prefer_writer;					// writer preference for this lock(set by handle)
+	volatile bool			phase_fair;						// use pflockval instead of lockval
+	FLPFRWLOCK				pflockval;						// lock variable for phase-fair ticket rwlock
+	size_t					pfdead_cnt;						// count of dead lockers which wait for their turn
 	volatile bool			protect;
 }FLOFFLOCK, *PFLOFFLOCK;
 
@@ -78,22 +211,70 @@ typedef struct fl_file_lock{
 
 	dev_t					dev_id;							// devide id
 	ino_t					ino_id;							// inode id
-	PFLOFFLOCK				offset_lock_list;
+	PFLOFFLOCK				offset_lock_tree;				// root of offset lock tree
 	volatile bool			protect;
 }FLFILELOCK, *PFLFILELOCK;
 
+//
+// Hash bucket for RWLocker by File
+//
+// [NOTE]
+// Each bucket has own lockid, it protects the file lock list in the bucket
+// and all offset lock/locker lists under them. This structure is padded to
+// cache line size, because each lockid is spinning by other processes.
+// gen is counted up when a file lock is removed from the list, then the
+// position in the list which is kept over unlocking lockid is still valid
+// if gen is not changed(new file lock is inserted at top of list).
+//
+typedef struct fl_file_lock_bucket{
+	flckpid_t				lockid;							// lock pid/tid variable for this bucket
+	PFLFILELOCK				file_lock_list;					// shared rwlock list by file in this bucket
+	volatile uint32_t		gen;							// generation of list(protected by lockid)
+	char					padding[FLCK_CACHELINE_SIZE - sizeof(flckpid_t) - sizeof(PFLFILELOCK) - sizeof(uint32_t)];
+}FLFILEBUCKET, *PFLFILEBUCKET;
+
 //
 // Named Mutex
 //
+// [NOTE]
+// requeue_list is FIFO queue of cond waiters which are moved by broadcast,
+// these waiters are woken up one by one at unlocking this mutex. This queue
+// is linked by requeue_next in waiter, and protected by named_cond_lockid.
+// robust_area is used only by the owner as an entry of its robust list,
+// the entry position is decided by the futex offset of the list head.
+//
 typedef struct fl_named_mutex{
 	struct fl_named_mutex*	next;							// next list
 
 	flck_mutex_t			lockval;						// lock variable(=pid/tid)
+	void*					robust_area[FLCK_MUTEX_ROBUST_AREA];	// area for robust list entry(pointers in owner process)
 	int						lockcnt;						// lock count for recursive
+	struct fl_waiter*		requeue_list;					// FIFO queue for cond waiters requeued by broadcast
+	struct fl_waiter*		requeue_tail;					// last waiter in requeue_list
 	flck_hash_t				hash;							// hash value by flck_fnv_hash()
 	char					name[FLCK_NAMED_MUTEX_MAXLENGTH + 1];	// mutex name
 }FLNAMEDMUTEX, *PFLNAMEDMUTEX;
 
+//
+// Hash bucket for Named Mutex
+//
+// [NOTE]
+// One bucket is one cache line, it has tags(top byte of hash) for slots
+// and relative pointers to named mutexes. The last byte of tags is used
+// slot count, so all tags in a bucket can be compared at once as a word.
+// When a bucket is full, next bucket is used(linear probing). Named mutex
+// is never removed, so this index does not need any tombstone.
+// Slots fill the cache line on LP64, and the bucket is padded when the
+// pointer is shorter(ILP32).
+//
+typedef struct fl_named_mutex_bucket{
+	uint8_t					tags[FLCK_NAME_BUCKET_SLOTS + 1];		// tags for each slot, and last byte is used slot count
+	struct fl_named_mutex*	entries[FLCK_NAME_BUCKET_SLOTS];		// named mutex
+#if	(0 < FLCK_NAME_BUCKET_PADDING)
+	char					padding[FLCK_NAME_BUCKET_PADDING];
+#endif
+}FLNMTXBUCKET, *PFLNMTXBUCKET;
+
 //
 // Conditional waiter by Process/Thread/NamedMutex
 //
@@ -103,51 +284,154 @@ typedef struct fl_waiter{
 	flckpid_t				flckpid;						// pid and tid(packed)
 	FLCKLOCKTYPE			lockstatus;						// lock status
 	PFLNAMEDMUTEX			named_mutex;					// named mutex pointer
+	struct fl_waiter*		requeue_next;					// next waiter in requeue_list of named mutex
 }FLWAITER, *PFLWAITER;
 
 //
 // Named Conditional
 //
+// [NOTE]
+// waiter_list is FIFO queue, the top is the oldest waiter and waiter_tail
+// points the last one. Signaling pops the top waiter and moves it into
+// signaled_list, so that waiter_list has only waiting waiters and signal
+// does not need to search the list.
+//
 typedef struct fl_named_cond{
 	struct fl_named_cond*	next;							// next list
 
-	PFLWAITER				waiter_list;					// list for waiting condition
+	PFLWAITER				waiter_list;					// FIFO queue for waiting condition
+	PFLWAITER				waiter_tail;					// last waiter in waiter_list
+	PFLWAITER				signaled_list;					// list for signaled waiters which do not leave yet
 	flck_hash_t				hash;							// hash value by flck_fnv_hash()
 	char					name[FLCK_NAMED_COND_MAXLENGTH + 1];	// cond name
 }FLNAMEDCOND, *PFLNAMEDCOND;
 
+//
+// Hash bucket for Named Conditional(same as named mutex bucket)
+//
+typedef struct fl_named_cond_bucket{
+	uint8_t					tags[FLCK_NAME_BUCKET_SLOTS + 1];		// tags for each slot, and last byte is used slot count
+	struct fl_named_cond*	entries[FLCK_NAME_BUCKET_SLOTS];		// named cond
+#if	(0 < FLCK_NAME_BUCKET_PADDING)
+	char					padding[FLCK_NAME_BUCKET_PADDING];
+#endif
+}FLNCONDBUCKET, *PFLNCONDBUCKET;
+
+//
+// Magazine(cache of lockers and waiters by process)
+//
+// [NOTE]
+// Each process takes one magazine by CAS on owner, and caches lockers and
+// waiters which are retrieved from(returned to) free lists by batch. The
+// lists in magazine are changed only by owner process, and the magazine
+// of dead process is returned to free lists by CheckProcessDead.
+//
+typedef struct fl_magazine{
+	PFLLOCKER				locker_list;					// cached lockers
+	PFLWAITER				waiter_list;					// cached waiters
+	size_t					locker_cnt;						// count of locker_list
+	size_t					waiter_cnt;						// count of waiter_list
+	volatile pid_t			owner;							// owner process id(0 is not used)
+	char					padding[FLCK_CACHELINE_SIZE - sizeof(PFLLOCKER) - sizeof(PFLWAITER) - sizeof(size_t) * 2 - sizeof(pid_t)];
+}FLMAGAZINE, *PFLMAGAZINE;
+
 //
 // Header(Main structure)
 //
+// [NOTE]
+// Each lockid and free list top is spinning(or CAS) by other processes,
+// so they are placed in own line(FLCK_HEAD_LINE_SIZE) for avoiding false
+// sharing. The line size is two cache lines, because some CPUs prefetch
+// adjacent cache line. The read mostly members are placed in first lines,
+// and the lists are placed with the lockid which protects them.
+//
+#define	FLCK_HEAD_LINE_SIZE			(FLCK_CACHELINE_SIZE * 2)
+#define	FLCK_HEAD_PADDING_SIZE(size)	(FLCK_HEAD_LINE_SIZE - ((size) % FLCK_HEAD_LINE_SIZE))
+
 typedef struct fl_header{
+	// read mostly area
 	flck_ver_t			version;							// * fullock shared memory structure version
                                                             //		this buffer is reading locked by fcntl because initializing.
 	char				szver[FLCK_FILE_VERSION_BUFFSIZE];	// * fullock shared memory structure version string
-	size_t				flength;							// * shared memory file size
-
-	flckpid_t			file_lock_lockid;					// * lock of shared rwlock
-															//		lock pid/tid variable for file_lock_list and free pointers
-	PFLFILELOCK			file_lock_list;						// * shared rwlock list by file
+	volatile size_t		flength;							// * shared memory file size(grows when some free list is empty)
+	PFLFILEBUCKET		file_lock_hash;						// * hash table of shared rwlock list by file
+															//		Each bucket has own lockid and top of file lock list, indexed by hash of (dev_id, ino_id).
 															//		This is shared rwlock for reading/modifying.
+	size_t				file_lock_hash_cnt;					// * bucket count(power of 2) in file_lock_hash
+	PFLNMTXBUCKET		named_mutex_hash;					// * hash index of named_mutex_list by hash of name
+	size_t				named_mutex_hash_cnt;				// * bucket count(power of 2) in named_mutex_hash
+	PFLNCONDBUCKET		named_cond_hash;					// * hash index of named_cond_list by hash of name
+	size_t				named_cond_hash_cnt;				// * bucket count(power of 2) in named_cond_hash
+	PFLMAGAZINE			magazines;							// * magazines for caching lockers and waiters by process
+	size_t				magazine_cnt;						// * count of magazines
+	char				padding_head[FLCK_HEAD_PADDING_SIZE(sizeof(flck_ver_t) + FLCK_FILE_VERSION_BUFFSIZE + sizeof(size_t) * 5 + sizeof(void*) * 4)];
 
+	// lockids
 	flckpid_t			named_mutex_lockid;					// * lock of shared mutex
 															//		lock pid/tid variable for named_mutex_list and free pointer
 	PFLNAMEDMUTEX		named_mutex_list;					// * shared mutex list for named mutex
 															//		This is shared mutex for reading/modifying.
+	size_t				named_mutex_overflow;			// * count of objects in named_mutex_list which are not in hash index(index is full after growing)
+	char				padding_named_mutex[FLCK_HEAD_PADDING_SIZE(sizeof(flckpid_t) + sizeof(PFLNAMEDMUTEX) + sizeof(size_t))];
 
 	flckpid_t			named_cond_lockid;					// * lock of shared cond
 															//		lock pid/tid variable for named_cond and free pointer
 	PFLNAMEDCOND		named_cond_list;					// * shared cond list for named cond
 															//		This is shared cond for reading/modifying.
+	size_t				named_cond_overflow;			// * count of objects in named_cond_list which are not in hash index(index is full after growing)
+	char				padding_named_cond[FLCK_HEAD_PADDING_SIZE(sizeof(flckpid_t) + sizeof(PFLNAMEDCOND) + sizeof(size_t))];
+
+	// growing
+	flckpid_t			grow_lockid;						// * lock for growing shm file(flength)
+	volatile uint64_t	grow_gen;							// * count up at each growing
+	char				padding_grow[FLCK_HEAD_PADDING_SIZE(sizeof(flckpid_t) + sizeof(uint64_t))];
 
-	PFLFILELOCK			file_lock_free;						// * free pointer list for file descriptor
-	PFLOFFLOCK			offset_lock_free;					// * free pointer list for offset locker
-	PFLLOCKER			locker_free;						// * free pointer list for locker
-	PFLNAMEDMUTEX		named_mutex_free;					// * free pointer list for named mutex
-	PFLNAMEDCOND		named_cond_free;					// * free pointer list for named cond
-	PFLWAITER			waiter_free;						// * free pointer list for waiter
+	// free lists(tagged top, these are not protected by any lockid)
+	flck_free_t			file_lock_free;						// * free pointer list for file descriptor
+	char				padding_file_lock_free[FLCK_HEAD_PADDING_SIZE(sizeof(flck_free_t))];
+	flck_free_t			offset_lock_free;					// * free pointer list for offset locker
+	char				padding_offset_lock_free[FLCK_HEAD_PADDING_SIZE(sizeof(flck_free_t))];
+	flck_free_t			locker_free;						// * free pointer list for locker
+	char				padding_locker_free[FLCK_HEAD_PADDING_SIZE(sizeof(flck_free_t))];
+	flck_free_t			named_mutex_free;					// * free pointer list for named mutex
+	char				padding_named_mutex_free[FLCK_HEAD_PADDING_SIZE(sizeof(flck_free_t))];
+	flck_free_t			named_cond_free;					// * free pointer list for named cond
+	char				padding_named_cond_free[FLCK_HEAD_PADDING_SIZE(sizeof(flck_free_t))];
+	flck_free_t			waiter_free;						// * free pointer list for waiter
+	char				padding_waiter_free[FLCK_HEAD_PADDING_SIZE(sizeof(flck_free_t))];
 }FLHEAD, *PFLHEAD;
 
+//---------------------------------------------------------
+// Layout checks
+//---------------------------------------------------------
+// [NOTE]
+// The paddings above are calculated by hand, so the cache line layout is
+// checked at compiling.
+//
+#define	FLCK_STATIC_ASSERT_CAT2(a, b)				a##b
+#define	FLCK_STATIC_ASSERT_CAT(a, b)				FLCK_STATIC_ASSERT_CAT2(a, b)
+#if	201103L <= __cplusplus
+#define	FLCK_STATIC_ASSERT(expr, msg)				static_assert(expr, msg)
+#else
+#define	FLCK_STATIC_ASSERT(expr, msg)				typedef char FLCK_STATIC_ASSERT_CAT(flck_static_assert_, __LINE__)[(expr) ? 1 : -1] __attribute__((unused))
+#endif
+#define	FLCK_HEAD_LINE_ASSERT(member)				FLCK_STATIC_ASSERT(0 == (offsetof(FLHEAD, member) % FLCK_HEAD_LINE_SIZE), "FLHEAD::" #member " is not at top of line")
+
+FLCK_STATIC_ASSERT(FLCK_CACHELINE_SIZE == sizeof(FLFILEBUCKET),	"FLFILEBUCKET is not one cache line");
+FLCK_STATIC_ASSERT(FLCK_CACHELINE_SIZE == sizeof(FLNMTXBUCKET),	"FLNMTXBUCKET is not one cache line");
+FLCK_STATIC_ASSERT(FLCK_CACHELINE_SIZE == sizeof(FLNCONDBUCKET),	"FLNCONDBUCKET is not one cache line");
+FLCK_STATIC_ASSERT(FLCK_CACHELINE_SIZE == sizeof(FLMAGAZINE),		"FLMAGAZINE is not one cache line");
+FLCK_HEAD_LINE_ASSERT(named_mutex_lockid);
+FLCK_HEAD_LINE_ASSERT(named_cond_lockid);
+FLCK_HEAD_LINE_ASSERT(grow_lockid);
+FLCK_HEAD_LINE_ASSERT(file_lock_free);
+FLCK_HEAD_LINE_ASSERT(offset_lock_free);
+FLCK_HEAD_LINE_ASSERT(locker_free);
+FLCK_HEAD_LINE_ASSERT(named_mutex_free);
+FLCK_HEAD_LINE_ASSERT(named_cond_free);
+FLCK_HEAD_LINE_ASSERT(waiter_free);
+FLCK_STATIC_ASSERT(0 == (sizeof(FLHEAD) % FLCK_HEAD_LINE_SIZE),	"FLHEAD is not aligned to line size");
+
 #endif	// FLCKSTRUCTURE_H
 
 /*
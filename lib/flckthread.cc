@@ -26,6 +26,7 @@
 
 #include "flckcommon.h"
 #include "flckshm.h"
+#include "flckpidfd.h"
 #include "flckstructure.h"
 #include "flckutil.h"
 #include "flckdbg.h"
@@ -113,6 +114,7 @@ void FlckThread::CleanupHandler(void* arg)
 	}
 
 	// close handles
+	FlckPidfd::ResetEventFd();
 	if(FLCK_INVALID_HANDLE != FlckThread::WatchFd){
 		inotify_rm_watch(FlckThread::InotifyFd, FlckThread::WatchFd);
 	}
@@ -207,18 +209,23 @@ void* FlckThread::WorkerProc(void* param)
 	// add event
 	struct epoll_event	epoolev;
 	memset(&epoolev, 0, sizeof(struct epoll_event));
-	epoolev.data.fd		= FlckThread::InotifyFd;
+	epoolev.data.u64	= static_cast<uint64_t>(FlckThread::InotifyFd);
 	epoolev.events		= EPOLLIN | EPOLLET;
 	if(-1 == epoll_ctl(FlckThread::EventFd, EPOLL_CTL_ADD, FlckThread::InotifyFd, &epoolev)){
 		ERR_FLCKPRN("Failed to add inotifyfd(%d)-watchfd(%d) to event fd(%d), error=%d", FlckThread::InotifyFd, FlckThread::WatchFd, FlckThread::EventFd, errno);
 		pthread_testcancel();												// check cancel
 		pthread_exit(NULL);
 	}
+	// add pidfds for owners
+	if(!FlckPidfd::SetEventFd(FlckThread::EventFd)){
+		WAN_FLCKPRN("Failed to set event fd(%d) for pidfd, but continue...", FlckThread::EventFd);
+	}
 	pthread_testcancel();													// check cancel
 
 	// do loop
 	struct timespec		sleepms = {(intervalms / 1000), (intervalms % 1000) * 1000 * 1000};
 	struct epoll_event  events[FLCK_WAIT_EVENT_MAX];
+	fl_pid_cache_map_t	pidcache(true);											// kept over checking
 	while(FlckThread::FLCK_THCNTL_EXIT > *pThFlag){
 		pthread_testcancel();												// check cancel
 
@@ -231,6 +238,7 @@ void* FlckThread::WorkerProc(void* param)
 			int	eventcnt;
 			if(0 < (eventcnt = epoll_pwait(FlckThread::EventFd, events, FLCK_WAIT_EVENT_MAX, intervalms, NULL))){
 				// catch event
+				bool	is_check = false;
 				for(int cnt = 0; cnt < eventcnt; cnt++){
 					pthread_testcancel();									// check cancel
 					// check flag
@@ -238,17 +246,41 @@ void* FlckThread::WorkerProc(void* param)
 					if(FlckThread::FLCK_THCNTL_EXIT <= *pThFlag){
 						break;
 					}
-					if(events[cnt].data.fd != FlckThread::InotifyFd){
-						WAN_FLCKPRN("Why event fd(%d) is not same inotify fd(%d), but continue...", events[cnt].data.fd, FlckThread::InotifyFd);
+					if(events[cnt].data.u64 != static_cast<uint64_t>(FlckThread::InotifyFd)){
+						// [NOTE]
+						// Other event is pidfd with its owner(flckpid) as data,
+						// it means that the owner exited.
+						// The pidfd is released here, and it is opened again if
+						// the owner is found in checking. The cached answers for
+						// the owner are removed.
+						//
+						flckpid_t	owner = static_cast<flckpid_t>(events[cnt].data.u64);
+						if(FlckPidfd::Release(owner)){
+							MSG_FLCKPRN("Get exit event for pidfd of pid(%d), tid(%d)", decompose_pid(owner), decompose_tid(owner));
+							pidcache.Remove(decompose_pid(owner));
+							is_check = true;
+						}
 						continue;
 					}
 					// check event
 					if(FlckThread::CheckEvent(FlckThread::InotifyFd, FlckThread::WatchFd)){
 						// CLOSE event is occurred.
-						FlShm	LocalFlShm;
-						if(!LocalFlShm.CheckProcessDead()){
-							WAN_FLCKPRN("Failed to check process dead in FlShm object, but continue...");
-						}
+						is_check = true;
+					}
+				}
+				// cppcheck-suppress knownConditionTrueFalse
+				if(is_check && FlckThread::FLCK_THCNTL_EXIT > *pThFlag){
+					// [NOTE]
+					// Some events in same time are checked at once.
+					//
+					FlShm	LocalFlShm;
+					if(!LocalFlShm.CheckProcessDead(&pidcache)){
+						WAN_FLCKPRN("Failed to check process dead in FlShm object, but continue...");
+					}
+					// close pidfds for pids which do not own any record
+					size_t	closed = FlckPidfd::Sweep();
+					if(0 < closed){
+						MSG_FLCKPRN("Closed %zu pidfds which are not checked in recent sweeps.", closed);
 					}
 				}
 
@@ -260,7 +292,13 @@ void* FlckThread::WorkerProc(void* param)
 				// signal occurred.
 
 			}else{	// 0 == eventcnt
-				// timeouted, nothing to do
+				// timeouted, resume the sweep which gave up a bucket
+				if(FlShm::IsSweepPending()){
+					FlShm	LocalFlShm;
+					if(!LocalFlShm.CheckProcessDead(&pidcache)){
+						WAN_FLCKPRN("Failed to check process dead in FlShm object, but continue...");
+					}
+				}
 			}
 		}
 	}
@@ -33,6 +33,10 @@
 // termination processing by the abnormal termination of
 // the process is not performed, but only it is required
 // processing time to be released when it has been deadlock.
+// The epoll also watches pidfds of the owners which FlckPidfd
+// keeps, then the exit of the owner starts checking too. It
+// covers the case that CLOSE event does not occur because the
+// file is shared with other process(ex. forked process).
 //
 class FlckThread
 {
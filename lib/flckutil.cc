@@ -28,12 +28,14 @@
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <pthread.h>
+#include <linux/futex.h>
 
 #include <climits>
 #include <vector>
 
 #include "flckcommon.h"
 #include "flckutil.h"
+#include "flckpidfd.h"
 #include "flckdbg.h"
 #include "fullock.h"
 
@@ -240,7 +242,30 @@ bool MakeWorkDirectory(const char* pDirPath)
 // stat(fstat) function call to /proc system takes average 100-150ns.
 // FindThreadProcess and GetFileDevNode functions for the load reduction
 // have the argument fl_pid_cache_map_t for cache.
+// While the worker thread is running, the liveness of thread(process)
+// is checked by polling pidfd which FlckPidfd keeps for each owner, and
+// /proc is used only when pidfd is not available. is_watched is set true
+// when the answer is by pidfd, its exit is caught by the worker thread.
 //
+static bool RawFindThreadProcess(pid_t pid, tid_t tid, bool& is_watched)
+{
+	FlckPidfd::PIDFDSTATE	state = FlckPidfd::Check(pid, tid);
+	is_watched = (FlckPidfd::FLCK_PIDFD_RUN == state);
+	if(FlckPidfd::FLCK_PIDFD_RUN == state){
+		return true;
+	}else if(FlckPidfd::FLCK_PIDFD_DEAD == state){
+		return false;
+	}
+
+	char		szPath[PATH_MAX];
+	struct stat	st;
+	sprintf(szPath, FLCK_PROC_PATH_FORM, pid, tid);
+	if(-1 == stat(szPath, &st)){
+		return false;
+	}
+	return true;
+}
+
 bool FindThreadProcess(pid_t pid, tid_t tid, fl_pid_cache_map_t* pcache)
 {
 	bool	is_run = false;
@@ -250,21 +275,25 @@ bool FindThreadProcess(pid_t pid, tid_t tid, fl_pid_cache_map_t* pcache)
 		}
 	}
 
-	char		szPath[PATH_MAX];
-	struct stat	st;
-	sprintf(szPath, FLCK_PROC_PATH_FORM, pid, tid);
-	if(-1 == stat(szPath, &st)){
-		is_run = false;
-	}else{
-		is_run = true;
-	}
+	bool	is_watched;
+	is_run = RawFindThreadProcess(pid, tid, is_watched);
 
 	if(pcache){
-		set_execution_cache(pcache, pid, tid, is_run);
+		set_execution_cache(pcache, pid, tid, is_run, is_watched);
 	}
 	return is_run;
 }
 
+// [NOTE]
+// Waiter calls this before parking, then FlckPidfd keeps the pidfd of the
+// owner and its exit is pushed to the worker thread. It is caught even if
+// the owner does not close the file(ex. forked process).
+//
+void WatchThreadProcess(pid_t pid, tid_t tid)
+{
+	FlckPidfd::Check(pid, tid);
+}
+
 static inline int GetFileDevNode(const char* file, dev_t& devid, ino_t& inodeid)
 {
 	struct stat	st;
@@ -302,34 +331,38 @@ bool GetFileDevNode(pid_t pid, tid_t tid, int fd, dev_t& devid, ino_t& inodeid,
 	}
 
 	int		result = 0;
+	bool	is_watched;
 	if(IS_FLCK_RWLOCK_NO_FD(fd)){
 		// [NOTE]
 		// When fd is FLCK_RWLOCK_NO_FD, it means rwlock with no-fd.
 		// On no fd mode, check only pid/tid.
 		//
-		char		szPath[PATH_MAX];
-		struct stat	st;
-		sprintf(szPath, FLCK_PROC_PATH_FORM, pid, tid);
-		if(-1 == stat(szPath, &st)){
+		if(!RawFindThreadProcess(pid, tid, is_watched)){
 			devid	= FLCK_INVALID_ID;
 			inodeid	= FLCK_INVALID_ID;
-			result	= errno;
+			result	= ESRCH;
 		}else{
 			devid	= FLCK_EACCESS_ID;
 			inodeid	= FLCK_EACCESS_ID;
 		}
+	}else if(FlckPidfd::FLCK_PIDFD_DEAD == FlckPidfd::Check(pid, static_cast<tid_t>(pid))){
+		// [NOTE]
+		// The owner process is exited, so /proc/pid/fd does not need to be
+		// checked. fd belongs to the process, then this checks process.
+		//
+		devid	= FLCK_INVALID_ID;
+		inodeid	= FLCK_INVALID_ID;
+		result	= ESRCH;
 	}else{
 		char	szPath[PATH_MAX];
 		sprintf(szPath, FLCK_PROC_FD_PATH_FORM, pid, fd);
 		if(EACCES == (result = GetFileDevNode(szPath, devid, inodeid))){
 			// Need to check thread(process) running.
 			//
-			struct stat	st;
-			sprintf(szPath, FLCK_PROC_PATH_FORM, pid, tid);
-			if(-1 == stat(szPath, &st)){
+			if(!RawFindThreadProcess(pid, tid, is_watched)){
 				devid	= FLCK_INVALID_ID;
 				inodeid	= FLCK_INVALID_ID;
-				result	= errno;
+				result	= ESRCH;
 			}
 		}
 	}
@@ -524,6 +557,45 @@ bool flck_fill_zero(int fd, size_t count, off_t offset)
 	return true;
 }
 
+//---------------------------------------------------------
+// Futex
+//---------------------------------------------------------
+// Returns	0			: woken up(or spurious wakeup)
+//			EAGAIN		: *paddr is not val
+//			ETIMEDOUT	: timeouted
+//			EINTR		: interrupted by signal
+//
+int flck_futex_wait(int* paddr, int val, const struct timespec* preltime)
+{
+	if(-1 == syscall(SYS_futex, paddr, FUTEX_WAIT, val, preltime, NULL, 0)){
+		return errno;
+	}
+	return 0;
+}
+
+// Same as flck_futex_wait, but waits until the absolute deadline of
+// CLOCK_MONOTONIC.
+//
+int flck_futex_wait_until(int* paddr, int val, const struct timespec* pdeadline)
+{
+	if(-1 == syscall(SYS_futex, paddr, FUTEX_WAIT_BITSET, val, pdeadline, NULL, FUTEX_BITSET_MATCH_ANY)){
+		return errno;
+	}
+	return 0;
+}
+
+// Returns woken up waiter count, or -1 for error.
+//
+int flck_futex_wake(int* paddr, int count)
+{
+	long	result;
+	if(-1 == (result = syscall(SYS_futex, paddr, FUTEX_WAKE, count, NULL, NULL, 0))){
+		ERR_FLCKPRN("Could not wake futex waiter on %p, errno = %d", paddr, errno);
+		return -1;
+	}
+	return static_cast<int>(result);
+}
+
 //---------------------------------------------------------
 // Other Utilities
 //---------------------------------------------------------
@@ -229,6 +229,54 @@ inline bool IS_OVER_TIMESPEC(const struct timespec* start, const struct timespec
 	return true;
 }
 
+//---------------------------------------------------------
+// Utility Functions(deadline)
+//---------------------------------------------------------
+// [NOTE]
+// Timed waiting computes the absolute deadline(CLOCK_MONOTONIC) once, and
+// checks the clock only at each FLCK_DEADLINE_CHECK_INTERVAL spins or after
+// parking. Parking waits by FUTEX_WAIT_BITSET with the absolute deadline.
+//
+#define	FLCK_DEADLINE_CHECK_INTERVAL	16				// spin count between checking clock
+
+inline bool flck_set_deadline(struct timespec* pdeadline, const struct timespec* preltime)
+{
+	if(!pdeadline || !preltime || -1 == clock_gettime(CLOCK_MONOTONIC, pdeadline)){
+		return false;
+	}
+	pdeadline->tv_sec	+= preltime->tv_sec;
+	pdeadline->tv_nsec	+= preltime->tv_nsec;
+	if((1000 * 1000 * 1000) <= pdeadline->tv_nsec){
+		pdeadline->tv_sec	+= pdeadline->tv_nsec / (1000 * 1000 * 1000);
+		pdeadline->tv_nsec	%= (1000 * 1000 * 1000);
+	}
+	return true;
+}
+
+inline bool flck_set_deadline(struct timespec* pdeadline, time_t timeout_usec)
+{
+	struct timespec	reltime = {(timeout_usec / (1000 * 1000)), ((timeout_usec % (1000 * 1000)) * 1000)};
+	return flck_set_deadline(pdeadline, &reltime);
+}
+
+// If failed to get clock, returns true(over deadline).
+//
+inline bool flck_is_over_deadline(const struct timespec* pdeadline)
+{
+	struct timespec	nowtime;
+	if(-1 == clock_gettime(CLOCK_MONOTONIC, &nowtime)){
+		return true;
+	}
+	return (pdeadline->tv_sec < nowtime.tv_sec || (pdeadline->tv_sec == nowtime.tv_sec && pdeadline->tv_nsec <= nowtime.tv_nsec));
+}
+
+// Checks the deadline only at each FLCK_DEADLINE_CHECK_INTERVAL spins.
+//
+inline bool flck_check_deadline(const struct timespec* pdeadline, int spincnt)
+{
+	return (0 == ((spincnt + 1) % FLCK_DEADLINE_CHECK_INTERVAL) && flck_is_over_deadline(pdeadline));
+}
+
 //---------------------------------------------------------
 // Other Utilities
 //---------------------------------------------------------
@@ -239,6 +287,7 @@ bool CvtNumberStringToLong(const char* str, long* presult);
 bool GetRealPath(const char* pPath, std::string& strreal);
 bool MakeWorkDirectory(const char* pDirPath);
 bool FindThreadProcess(pid_t pid, tid_t tid, fl_pid_cache_map_t* pcache = NULL);
+void WatchThreadProcess(pid_t pid, tid_t tid);
 bool GetFileDevNode(pid_t pid, tid_t tid, int fd, dev_t& devid, ino_t& inodeid, fl_pid_cache_map_t* pcache = NULL);
 bool GetFileDevNode(int fd, dev_t& devid, ino_t& inodeid);
 inline bool GetFileDevNode(flckpid_t flckpid, int fd, dev_t& devid, ino_t& inodeid, fl_pid_cache_map_t* pcache)
@@ -255,6 +304,30 @@ ssize_t flck_pread(int fd, void *buf, size_t count, off_t offset);
 ssize_t flck_pwrite(int fd, const void *buf, size_t count, off_t offset);
 bool flck_fill_zero(int fd, size_t count, off_t offset);
 
+//---------------------------------------------------------
+// Spin/Futex Utilities
+//---------------------------------------------------------
+// For spinning loop
+inline void flck_cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__asm__ __volatile__("pause" ::: "memory");
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+// [NOTE]
+// These are for lock words in shared memory(MAP_SHARED), so we do not
+// use FUTEX_PRIVATE_FLAG. The waiting is keyed by the file backed page,
+// then it works across processes.
+//
+int flck_futex_wait(int* paddr, int val, const struct timespec* preltime = NULL);
+int flck_futex_wait_until(int* paddr, int val, const struct timespec* pdeadline);
+int flck_futex_wake(int* paddr, int count);
+
 #endif	// FLCKUTIL_H
 
 /*
@@ -21,6 +21,7 @@
 #include "flckcommon.h"
 #include "fullock.h"
 #include "flckshm.h"
+#include "flckrobustlist.h"
 
 using namespace std;
 
@@ -106,6 +107,42 @@ bool fullock_set_offset_freeunit(void)
 	return true;
 }
 
+bool fullock_set_reader_preference(void)
+{
+	FlShm::SetPreferMode(FlShm::PREFER_READER);
+	return true;
+}
+
+bool fullock_set_writer_preference(void)
+{
+	FlShm::SetPreferMode(FlShm::PREFER_WRITER);
+	return true;
+}
+
+bool fullock_set_cas_rwlock(void)
+{
+	FlShm::SetRwlockType(FlShm::RWLOCK_CAS);
+	return true;
+}
+
+bool fullock_set_phase_fair_rwlock(void)
+{
+	FlShm::SetRwlockType(FlShm::RWLOCK_PHASEFAIR);
+	return true;
+}
+
+bool fullock_set_robust_list(void)
+{
+	FlShm::SetRobustListMode(FlShm::ROBUSTLIST_YES);
+	return FlckRobustList::IsSupported();
+}
+
+bool fullock_set_no_robust_list(void)
+{
+	FlShm::SetRobustListMode(FlShm::ROBUSTLIST_NO);
+	return true;
+}
+
 bool fullock_set_robust_check_count(int val)
 {
 	if(-1 == FlShm::SetRobustLoopCnt(val)){
@@ -202,12 +239,135 @@ int fullock_rwlock_unlock(int fd, off_t offset, size_t length)
 	return shm.Unlock(fd, offset, length);
 }
 
+int fullock_rwlock_upgrade(int fd, off_t offset, size_t length)
+{
+	FlShm	shm;
+	return shm.Upgrade(fd, offset, length);
+}
+
+int fullock_rwlock_downgrade(int fd, off_t offset, size_t length)
+{
+	FlShm	shm;
+	return shm.Downgrade(fd, offset, length);
+}
+
 bool fullock_rwlock_islocked(int fd, off_t offset, size_t length)
 {
 	FlShm	shm;
 	return shm.IsLocked(fd, offset, length);
 }
 
+int fullock_rwlock_lock_many(const fullock_rwlock_range_t* pranges, size_t count)
+{
+	FlShm	shm;
+	return shm.LockMany(pranges, count);
+}
+
+int fullock_rwlock_trylock_many(const fullock_rwlock_range_t* pranges, size_t count)
+{
+	FlShm	shm;
+	return shm.TryLockMany(pranges, count);
+}
+
+int fullock_rwlock_timedlock_many(const fullock_rwlock_range_t* pranges, size_t count, time_t timeout_usec)
+{
+	FlShm	shm;
+	return shm.TimeoutLockMany(pranges, count, timeout_usec);
+}
+
+int fullock_rwlock_unlock_many(const fullock_rwlock_range_t* pranges, size_t count)
+{
+	FlShm	shm;
+	return shm.UnlockMany(pranges, count);
+}
+
+//---------------------------------------------------------
+// Functions - rwlock handle
+//---------------------------------------------------------
+fullock_rwlock_handle_t fullock_rwlock_handle_open(int fd, off_t offset, size_t length)
+{
+	FlShm	shm;
+	return shm.OpenHandle(fd, offset, length);
+}
+
+int fullock_rwlock_handle_close(fullock_rwlock_handle_t handle)
+{
+	FlShm	shm;
+	return shm.CloseHandle(handle);
+}
+
+int fullock_rwlock_handle_rdlock(fullock_rwlock_handle_t handle)
+{
+	FlShm	shm;
+	return shm.ReadLock(handle);
+}
+
+int fullock_rwlock_handle_tryrdlock(fullock_rwlock_handle_t handle)
+{
+	FlShm	shm;
+	return shm.TryReadLock(handle);
+}
+
+int fullock_rwlock_handle_timedrdlock(fullock_rwlock_handle_t handle, time_t timeout_usec)
+{
+	FlShm	shm;
+	return shm.TimeoutReadLock(handle, timeout_usec);
+}
+
+int fullock_rwlock_handle_wrlock(fullock_rwlock_handle_t handle)
+{
+	FlShm	shm;
+	return shm.WriteLock(handle);
+}
+
+int fullock_rwlock_handle_trywrlock(fullock_rwlock_handle_t handle)
+{
+	FlShm	shm;
+	return shm.TryWriteLock(handle);
+}
+
+int fullock_rwlock_handle_timedwrlock(fullock_rwlock_handle_t handle, time_t timeout_usec)
+{
+	FlShm	shm;
+	return shm.TimeoutWriteLock(handle, timeout_usec);
+}
+
+int fullock_rwlock_handle_unlock(fullock_rwlock_handle_t handle)
+{
+	FlShm	shm;
+	return shm.Unlock(handle);
+}
+
+int fullock_rwlock_handle_upgrade(fullock_rwlock_handle_t handle)
+{
+	FlShm	shm;
+	return shm.Upgrade(handle);
+}
+
+int fullock_rwlock_handle_downgrade(fullock_rwlock_handle_t handle)
+{
+	FlShm	shm;
+	return shm.Downgrade(handle);
+}
+
+bool fullock_rwlock_handle_islocked(fullock_rwlock_handle_t handle)
+{
+	FlShm	shm;
+	return shm.IsLocked(handle);
+}
+
+bool fullock_rwlock_handle_set_writer_preference(fullock_rwlock_handle_t handle, bool prefer_writer)
+{
+	FlShm	shm;
+	return shm.SetPreferWriter(handle, prefer_writer);
+}
+
+bool fullock_rwlock_handle_set_phase_fair(fullock_rwlock_handle_t handle, bool phase_fair)
+{
+	FlShm	shm;
+	return shm.SetPhaseFair(handle, phase_fair);
+}
+
 //---------------------------------------------------------
 // Functions - named cond
 //---------------------------------------------------------
@@ -35,6 +35,18 @@ extern "C" {
 #define	FLCK_RWLOCK_NO_FD(intval)			(intval | 0x80000000)
 #define	IS_FLCK_RWLOCK_NO_FD(val)			((val & 0x80000000) == 0x80000000)
 
+//---------------------------------------------------------
+// Types
+//---------------------------------------------------------
+typedef struct fl_rwlock_handle*	fullock_rwlock_handle_t;	// opaque handle for rwlock
+
+typedef struct fullock_rwlock_range{								// range for locking multi ranges at once
+	int		fd;
+	off_t	offset;
+	size_t	length;
+	bool	is_write;												// true for write lock, false for read lock
+}fullock_rwlock_range_t;
+
 //---------------------------------------------------------
 // Functions - version
 //---------------------------------------------------------
@@ -53,6 +65,12 @@ extern bool fullock_set_retry_deny_nomap(void);
 extern bool fullock_set_no_freeunit(void);
 extern bool fullock_set_fd_freeunit(void);
 extern bool fullock_set_offset_freeunit(void);
+extern bool fullock_set_reader_preference(void);
+extern bool fullock_set_writer_preference(void);
+extern bool fullock_set_cas_rwlock(void);
+extern bool fullock_set_phase_fair_rwlock(void);
+extern bool fullock_set_robust_list(void);
+extern bool fullock_set_no_robust_list(void);
 extern bool fullock_set_robust_check_count(int val);
 extern bool fullock_reinitialize(const char* dirpath, const char* filename);
 extern bool fullock_reinitialize_ex(const char* dirpath, const char* filename, size_t filelockcnt, size_t offlockcnt, size_t lockercnt, size_t nmtxcnt, size_t ncondcnt, size_t waitercnt);
@@ -77,8 +95,37 @@ extern int fullock_rwlock_trywrlock(int fd, off_t offset, size_t length);
 extern int fullock_rwlock_timedwrlock(int fd, off_t offset, size_t length, time_t timeout_usec);
 
 extern int fullock_rwlock_unlock(int fd, off_t offset, size_t length);
+extern int fullock_rwlock_upgrade(int fd, off_t offset, size_t length);
+extern int fullock_rwlock_downgrade(int fd, off_t offset, size_t length);
 
 extern bool fullock_rwlock_islocked(int fd, off_t offset, size_t length);
+extern int fullock_rwlock_lock_many(const fullock_rwlock_range_t* pranges, size_t count);
+extern int fullock_rwlock_trylock_many(const fullock_rwlock_range_t* pranges, size_t count);
+extern int fullock_rwlock_timedlock_many(const fullock_rwlock_range_t* pranges, size_t count, time_t timeout_usec);
+extern int fullock_rwlock_unlock_many(const fullock_rwlock_range_t* pranges, size_t count);
+
+//---------------------------------------------------------
+// Functions - rwlock handle
+//---------------------------------------------------------
+// The handle is resolved from fd/offset/length at opening, then locking by
+// the handle does not call fstat and does not search file lock list and
+// offset lock tree. The handle must be closed before closing fd. The handle
+// belongs to the opening process, so forked child can only close it.
+//
+extern fullock_rwlock_handle_t fullock_rwlock_handle_open(int fd, off_t offset, size_t length);
+extern int fullock_rwlock_handle_close(fullock_rwlock_handle_t handle);
+extern int fullock_rwlock_handle_rdlock(fullock_rwlock_handle_t handle);
+extern int fullock_rwlock_handle_tryrdlock(fullock_rwlock_handle_t handle);
+extern int fullock_rwlock_handle_timedrdlock(fullock_rwlock_handle_t handle, time_t timeout_usec);
+extern int fullock_rwlock_handle_wrlock(fullock_rwlock_handle_t handle);
+extern int fullock_rwlock_handle_trywrlock(fullock_rwlock_handle_t handle);
+extern int fullock_rwlock_handle_timedwrlock(fullock_rwlock_handle_t handle, time_t timeout_usec);
+extern int fullock_rwlock_handle_unlock(fullock_rwlock_handle_t handle);
+extern int fullock_rwlock_handle_upgrade(fullock_rwlock_handle_t handle);
+extern int fullock_rwlock_handle_downgrade(fullock_rwlock_handle_t handle);
+extern bool fullock_rwlock_handle_islocked(fullock_rwlock_handle_t handle);
+extern bool fullock_rwlock_handle_set_writer_preference(fullock_rwlock_handle_t handle, bool prefer_writer);
+extern bool fullock_rwlock_handle_set_phase_fair(fullock_rwlock_handle_t handle, bool phase_fair);
 
 //---------------------------------------------------------
 // Functions - named cond
@@ -0,0 +1,2231 @@
+/*
+ * FULLOCK - Fast User Level LOCK library
+ *
+ * Copyright 2015 Yahoo Japan Corporation.
+ *
+ * FULLOCK is fast locking library on user level by Yahoo! JAPAN.
+ * FULLOCK is following specifications.
+ *
+ * For the full copyright and license information, please view
+ * the license file that was distributed with this source code.
+ *
+ * AUTHOR:   agent
+ * CREATE:   Sat 17 Oct 2026
+ * REVISION:
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <libgen.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include <string>
+
+#include "flckshm.h"
+#include "fullock.h"
+#include "flckutil.h"
+#include "flcklistnmtx.h"
+#include "flcklistncond.h"
+#include "flckpidfd.h"
+
+using namespace std;
+using namespace fullock;
+
+//---------------------------------------------------------
+// Symbols
+//---------------------------------------------------------
+#define	FEATURETEST_FILE_FORM		"/tmp/fullock_featuretest_%d_%s"
+#define	FEATURETEST_WAIT_USEC		(10 * 1000)					// 10ms for polling child
+#define	FEATURETEST_WAIT_COUNT		500							// total 5s
+#define	FEATURETEST_NOTIFY_MSEC		5000						// timeout for notification from child
+#define	FEATURETEST_QUIET_MSEC		200							// no notification from blocking child
+#define	FEATURETEST_HOLD_USEC		(100 * 1000)				// 100ms for holding lock in child
+#define	FEATURETEST_COND_WAITERS	3							// waiter processes for broadcast
+#define	FEATURETEST_LOCKID_WAITERS	4							// threads which park on lockid
+#define	FEATURETEST_FIFO_WAITERS	4							// threads which wait cond in order
+#define	FEATURETEST_TIMEOUT_USEC	(100 * 1000)				// 100ms for timed locking
+#define	FEATURETEST_LATE_USEC		(200 * 1000)				// allowed delay after deadline
+
+//---------------------------------------------------------
+// Structure
+//---------------------------------------------------------
+//
+// Lockers in offset locks of a file
+//
+typedef struct locker_count{
+	size_t			readers;									// locked readers
+	size_t			writers;									// locked writers
+	size_t			waiting_readers;							// readers which wait for locking
+	size_t			waiting_writers;							// writers which wait for locking
+	size_t			upgrading;									// readers which wait for upgrading
+}LOCKERCOUNT, *PLOCKERCOUNT;
+
+typedef enum locker_type{
+	LOCKER_WAITING_READER,
+	LOCKER_WAITING_WRITER,
+	LOCKER_UPGRADING
+}LOCKERTYPE;
+
+//
+// Parameter for thread which parks on lockid
+//
+typedef struct lockid_thread_param{
+	flckpid_t*		plockid;									// lockid which is shared by threads
+	bool			result;
+}LOCKIDTHPARAM, *PLOCKIDTHPARAM;
+
+//
+// Parameter for thread which waits named cond
+//
+typedef struct cond_thread_param{
+	const char*		pmutexname;
+	const char*		pcondname;
+	int				index;										// order of starting to wait
+	int*			porder;										// indexes in order of waking up(shared by threads)
+	volatile int*	pwoken;										// count of woken threads(shared by threads)
+	bool			result;
+}CONDTHPARAM, *PCONDTHPARAM;
+
+//
+// Parameter for thread which locks named mutex
+//
+typedef struct mutex_thread_param{
+	const char*		pmutexname;
+	volatile int*	pwoken;										// count of threads which got mutex
+	bool			result;
+}MUTEXTHPARAM, *PMUTEXTHPARAM;
+
+//
+// Parameter for thread which calls timed APIs
+//
+typedef enum timed_api_type{
+	TIMED_WRLOCK		= 0,
+	TIMED_RDLOCK,
+	TIMED_MUTEX,
+	TIMED_COND,
+	TIMED_API_COUNT
+}TIMEDAPITYPE;
+
+typedef struct timed_thread_param{
+	const char*		pfile;
+	const char*		pmutexname;									// locked by the other thread
+	const char*		pcondmutexname;								// locked by this thread for waiting cond
+	const char*		pcondname;
+	int				results[TIMED_API_COUNT];
+	long			elapsed[TIMED_API_COUNT];					// usec
+}TIMEDTHPARAM, *PTIMEDTHPARAM;
+
+//
+// Parameter for thread which exits with locking named mutex
+//
+typedef struct owner_thread_param{
+	const char*		pmutexname;
+	tid_t			tid;										// thread id of the owner
+	volatile bool	locked;										// set by the owner after locking
+	volatile bool	exiting;									// set by the parent to exit the owner
+	bool			result;
+}OWNERTHPARAM, *POWNERTHPARAM;
+
+//---------------------------------------------------------
+// Utility Functions
+//---------------------------------------------------------
+static inline void PRN(const char* format, ...)
+{
+	if(format){
+		va_list ap;
+		va_start(ap, format);
+		vfprintf(stdout, format, ap);
+		va_end(ap);
+	}
+	fprintf(stdout, "\n");
+	fflush(stdout);
+}
+
+static inline void ERR(const char* format, ...)
+{
+	fprintf(stderr, "[ERR] ");
+	if(format){
+		va_list ap;
+		va_start(ap, format);
+		vfprintf(stderr, format, ap);
+		va_end(ap);
+	}
+	fprintf(stderr, "\n");
+}
+
+static inline char* programname(char* prgpath)
+{
+	if(!prgpath){
+		return NULL;
+	}
+	char*	pprgname = basename(prgpath);
+	if(0 == strncmp(pprgname, "lt-", strlen("lt-"))){
+		pprgname = &pprgname[strlen("lt-")];
+	}
+	return pprgname;
+}
+
+static void Help(char* progname)
+{
+	PRN(NULL);
+	PRN("Usage: %s -help(h)",											progname ? programname(progname) : "program");
+	PRN("       %s -handle",											progname ? programname(progname) : "program");
+	PRN("       %s -lockmany",											progname ? programname(progname) : "program");
+	PRN("       %s -upgrade",											progname ? programname(progname) : "program");
+	PRN("       %s -preferwriter",										progname ? programname(progname) : "program");
+	PRN("       %s -phasefair",											progname ? programname(progname) : "program");
+	PRN("       %s -requeue",											progname ? programname(progname) : "program");
+	PRN("       %s -robustlist",										progname ? programname(progname) : "program");
+	PRN("       %s -lockidwake",										progname ? programname(progname) : "program");
+	PRN("       %s -condpark",											progname ? programname(progname) : "program");
+	PRN("       %s -condfifo",											progname ? programname(progname) : "program");
+	PRN("       %s -mutexpark",										progname ? programname(progname) : "program");
+	PRN("       %s -deadline",											progname ? programname(progname) : "program");
+	PRN("       %s -pidfd",											progname ? programname(progname) : "program");
+	PRN("       %s -pidcache",											progname ? programname(progname) : "program");
+	PRN(NULL);
+	PRN("test type:");
+	PRN("       -handle          rwlock handle API and releasing pins of dead process");
+	PRN("       -lockmany        locking ranges which share one offset lock and releasing at failure");
+	PRN("       -upgrade         upgrading and downgrading with other processes");
+	PRN("       -preferwriter    new readers back off from waiting writer in other process");
+	PRN("       -phasefair       phase order of phase-fair rwlock and releasing dead ticket");
+	PRN("       -requeue         broadcast requeues waiters to named mutex");
+	PRN("       -robustlist      kernel recovers named mutex of killed owner by robust list");
+	PRN("       -lockidwake      relocking keeps waiter bit and unlocking wakes parking threads");
+	PRN("       -condpark        cond waiter parks without using cpu and signal wakes it");
+	PRN("       -condfifo        signal wakes cond waiters in order of waiting");
+	PRN("       -mutexpark       mutex waiter parks without using cpu until recursive owner unlocks all");
+	PRN("       -deadline        timed rwlock, mutex and cond return ETIMEDOUT at deadline");
+	PRN("       -pidfd           mutex of exited owner is released by exit event of pidfd");
+	PRN("       -pidcache        mutex of exited owner is released when its cached answer expires");
+	PRN(NULL);
+	PRN("[NOTE] \"-child <type> <file> <notify fd>\" is used by this program for running child process.");
+	PRN(NULL);
+}
+
+//
+// Make test file(the file is removed at exiting test)
+//
+static int OpenTestFile(const char* ptype, string& path)
+{
+	char	szPath[PATH_MAX];
+	sprintf(szPath, FEATURETEST_FILE_FORM, getpid(), ptype);
+	path = szPath;
+
+	int		fd;
+	if(-1 == (fd = open(szPath, O_RDWR | O_CREAT | O_TRUNC, 0644))){
+		ERR("Could not open file(%s), errno=%d", szPath, errno);
+		return FLCK_INVALID_HANDLE;
+	}
+	if(-1 == write(fd, "featuretest", strlen("featuretest"))){
+		ERR("Could not write file(%s), errno=%d", szPath, errno);
+		close(fd);
+		unlink(szPath);
+		return FLCK_INVALID_HANDLE;
+	}
+	return fd;
+}
+
+static void CloseTestFile(int fd, const string& path)
+{
+	if(FLCK_INVALID_HANDLE != fd){
+		close(fd);
+	}
+	unlink(path.c_str());
+}
+
+//
+// Run this program as child process
+//
+// [NOTE]
+// The child process is executed(not only forked), because the child must
+// not take over the pid/tid cache in this process.
+//
+// The child writes a character to notifyfd at each step, the parent checks
+// the order of steps by reading them.
+//
+static pid_t RunChild(const char* progpath, const char* ptype, const char* pfile, int notifyfd = FLCK_INVALID_HANDLE)
+{
+	char	szFd[32];
+	sprintf(szFd, "%d", notifyfd);
+
+	pid_t	childpid;
+	if(-1 == (childpid = fork())){
+		ERR("Could not fork child process, errno=%d", errno);
+		return -1;
+	}else if(0 == childpid){
+		execl(progpath, progpath, "-child", ptype, pfile, szFd, static_cast<char*>(NULL));
+		ERR("Could not execute %s, errno=%d", progpath, errno);
+		_exit(EXIT_FAILURE);
+	}
+	return childpid;
+}
+
+// Returns status of child, or -1 if the child is not exited(stopped).
+//
+static int WaitChild(pid_t childpid, int options = 0)
+{
+	for(int cnt = 0; cnt < FEATURETEST_WAIT_COUNT; ++cnt){
+		int		status = 0;
+		pid_t	result = waitpid(childpid, &status, WNOHANG | options);
+		if(childpid == result){
+			return status;
+		}else if(-1 == result){
+			ERR("Could not wait child process(%d), errno=%d", childpid, errno);
+			return -1;
+		}
+		usleep(FEATURETEST_WAIT_USEC);
+	}
+	ERR("Child process(%d) is not exited.", childpid);
+	kill(childpid, SIGKILL);
+	waitpid(childpid, NULL, 0);
+	return -1;
+}
+
+//
+// Notification from child
+//
+static void Notify(int notifyfd, char step)
+{
+	if(FLCK_INVALID_HANDLE != notifyfd && 1 != write(notifyfd, &step, 1)){
+		ERR("Could not write notification(%c), errno=%d", step, errno);
+	}
+}
+
+// Returns the step, or -1 if nothing is notified in timeout.
+//
+static int ReadNotify(int notifyfd, int timeout_msec)
+{
+	struct pollfd	pfd;
+	pfd.fd		= notifyfd;
+	pfd.events	= POLLIN;
+	pfd.revents	= 0;
+	char			step;
+	if(1 != poll(&pfd, 1, timeout_msec) || 1 != read(notifyfd, &step, 1)){
+		return -1;
+	}
+	return static_cast<int>(step);
+}
+
+static bool CheckNotify(int notifyfd, const char* psteps)
+{
+	for(; '\0' != *psteps; ++psteps){
+		int	step = ReadNotify(notifyfd, FEATURETEST_NOTIFY_MSEC);
+		if(static_cast<int>(*psteps) != step){
+			ERR("Notification from child is %c(%d), but it should be %c.", (-1 == step ? '-' : static_cast<char>(step)), step, *psteps);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool CheckNoNotify(int notifyfd, const char* pmessage)
+{
+	int	step;
+	if(-1 != (step = ReadNotify(notifyfd, FEATURETEST_QUIET_MSEC))){
+		ERR("Child notified %c, %s.", static_cast<char>(step), pmessage);
+		return false;
+	}
+	return true;
+}
+
+// childpid is cleared after waiting it.
+//
+static bool CheckChildExit(pid_t& childpid)
+{
+	int	status = WaitChild(childpid);
+	childpid   = -1;
+	if(-1 == status || !WIFEXITED(status) || EXIT_SUCCESS != WEXITSTATUS(status)){
+		ERR("Child process(%d) is not exited successfully.", childpid);
+		return false;
+	}
+	return true;
+}
+
+// Kill the child which is left by failure of test.
+//
+static void KillChild(pid_t& childpid)
+{
+	if(-1 != childpid){
+		kill(childpid, SIGKILL);
+		waitpid(childpid, NULL, 0);
+		childpid = -1;
+	}
+}
+
+//
+// Inspect shm
+//
+// [NOTE]
+// These functions read shm without locking, so call these only when any
+// other process does not lock the target file.
+//
+static size_t CountTreePins(PFLOFFLOCK prelnode)
+{
+	PFLOFFLOCK	pabsnode = to_abs(prelnode);
+	if(!pabsnode){
+		return 0;
+	}
+	size_t	count = 0;
+	for(PFLLOCKER pabspin = to_abs(pabsnode->pin_list); pabspin; pabspin = to_abs(pabspin->next)){
+		++count;
+	}
+	return (count + CountTreePins(pabsnode->left) + CountTreePins(pabsnode->right));
+}
+
+static void CountTreeLockers(PFLOFFLOCK prelnode, LOCKERCOUNT& count)
+{
+	PFLOFFLOCK	pabsnode = to_abs(prelnode);
+	if(!pabsnode){
+		return;
+	}
+	for(PFLLOCKER pabslocker = to_abs(pabsnode->reader_list); pabslocker; pabslocker = to_abs(pabslocker->next)){
+		if(pabslocker->locked){
+			++count.readers;
+		}else{
+			++count.waiting_readers;
+		}
+		if(pabslocker->upgrading){
+			++count.upgrading;
+		}
+	}
+	for(PFLLOCKER pabslocker = to_abs(pabsnode->writer_list); pabslocker; pabslocker = to_abs(pabslocker->next)){
+		if(pabslocker->locked){
+			++count.writers;
+		}else{
+			++count.waiting_writers;
+		}
+	}
+	CountTreeLockers(pabsnode->left, count);
+	CountTreeLockers(pabsnode->right, count);
+}
+
+static LOCKERCOUNT CountLockers(int fd)
+{
+	LOCKERCOUNT	count	= {0, 0, 0, 0, 0};
+	dev_t		devid	= FLCK_INVALID_ID;
+	ino_t		inodeid	= FLCK_INVALID_ID;
+	if(!FlShm::pFlHead || !GetFileDevNode(fd, devid, inodeid)){
+		return count;
+	}
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(devid, inodeid);
+	for(PFLFILELOCK pabsfile = to_abs(pbucket->file_lock_list); pabsfile; pabsfile = to_abs(pabsfile->next)){
+		if(pabsfile->dev_id == devid && pabsfile->ino_id == inodeid){
+			CountTreeLockers(pabsfile->offset_lock_tree, count);
+			break;
+		}
+	}
+	return count;
+}
+
+// Wait until the child blocks in locking(or upgrading).
+//
+static bool WaitLocker(int fd, LOCKERTYPE type)
+{
+	for(int cnt = 0; cnt < FEATURETEST_WAIT_COUNT; ++cnt){
+		LOCKERCOUNT	count = CountLockers(fd);
+		if(	(LOCKER_WAITING_READER == type && 0 < count.waiting_readers)	||
+			(LOCKER_WAITING_WRITER == type && 0 < count.waiting_writers)	||
+			(LOCKER_UPGRADING == type && 0 < count.upgrading)				)
+		{
+			// [NOTE]
+			// The locker is inserted just before locking, so wait a moment
+			// for the child to reach the lock variable.
+			//
+			usleep(FEATURETEST_WAIT_USEC);
+			return true;
+		}
+		usleep(FEATURETEST_WAIT_USEC);
+	}
+	ERR("Child does not wait for %s.", (LOCKER_WAITING_READER == type ? "read locking" : LOCKER_WAITING_WRITER == type ? "write locking" : "upgrading"));
+	return false;
+}
+
+static size_t CountRequeued(const char* pmutexname)
+{
+	FlListNMtx	nmtxobj;
+	if(!FlShm::pFlHead || !nmtxobj.find(pmutexname)){
+		return 0;
+	}
+	size_t	count = 0;
+	for(PFLWAITER pabswaiter = to_abs(nmtxobj.get()->requeue_list); pabswaiter; pabswaiter = to_abs(pabswaiter->requeue_next)){
+		++count;
+	}
+	return count;
+}
+
+static size_t CountCondWaiters(const char* pcondname)
+{
+	FlListNCond	ncondobj;
+	if(!FlShm::pFlHead || !ncondobj.find(pcondname)){
+		return 0;
+	}
+	size_t	count = 0;
+	for(PFLWAITER pabswaiter = to_abs(ncondobj.get()->waiter_list); pabswaiter; pabswaiter = to_abs(pabswaiter->next)){
+		++count;
+	}
+	return count;
+}
+
+// Returns true if waiter_tail points the last waiter in waiter_list.
+//
+static bool IsCondTailLast(const char* pcondname)
+{
+	FlListNCond	ncondobj;
+	if(!FlShm::pFlHead || !ncondobj.find(pcondname)){
+		return false;
+	}
+	PFLWAITER	pabslast = NULL;
+	for(PFLWAITER pabswaiter = to_abs(ncondobj.get()->waiter_list); pabswaiter; pabswaiter = to_abs(pabswaiter->next)){
+		pabslast = pabswaiter;
+	}
+	return (pabslast == to_abs(ncondobj.get()->waiter_tail));
+}
+
+// Returns the lock value of named mutex, or FLCK_MUTEX_UNLOCK if it is not found.
+//
+static flck_mutex_t GetMutexLockval(const char* pmutexname)
+{
+	FlListNMtx	nmtxobj;
+	if(!FlShm::pFlHead || !nmtxobj.find(pmutexname)){
+		return FLCK_MUTEX_UNLOCK;
+	}
+	return nmtxobj.get()->lockval;
+}
+
+static size_t CountPins(int fd)
+{
+	dev_t	devid	= FLCK_INVALID_ID;
+	ino_t	inodeid	= FLCK_INVALID_ID;
+	if(!FlShm::pFlHead || !GetFileDevNode(fd, devid, inodeid)){
+		return 0;
+	}
+	PFLFILEBUCKET	pbucket = fl_get_filelock_bucket(devid, inodeid);
+	for(PFLFILELOCK pabsfile = to_abs(pbucket->file_lock_list); pabsfile; pabsfile = to_abs(pabsfile->next)){
+		if(pabsfile->dev_id == devid && pabsfile->ino_id == inodeid){
+			return CountTreePins(pabsfile->offset_lock_tree);
+		}
+	}
+	return 0;
+}
+
+//---------------------------------------------------------
+// Child processes
+//---------------------------------------------------------
+// Opens handle and stops itself, then the parent kills it without closing
+// the handle.
+//
+static int ChildPin(const char* pfile)
+{
+	int	fd;
+	if(-1 == (fd = open(pfile, O_RDWR))){
+		ERR("Could not open file(%s), errno=%d", pfile, errno);
+		return EXIT_FAILURE;
+	}
+	if(NULL == fullock_rwlock_handle_open(fd, 0, 1)){
+		ERR("Could not open handle in child.");
+		return EXIT_FAILURE;
+	}
+	raise(SIGSTOP);
+	return EXIT_FAILURE;
+}
+
+// Locks(reader, writer or reader and upgrading), holds it for a moment
+// and unlocks it. The steps are notified by characters:
+//	R(r)	: read locked(unlocking)
+//	W(w)	: write locked(unlocking)
+//
+static int ChildLock(const char* ptype, const char* pfile, int notifyfd)
+{
+	int	fd;
+	if(-1 == (fd = open(pfile, O_RDWR))){
+		ERR("Could not open file(%s), errno=%d", pfile, errno);
+		return EXIT_FAILURE;
+	}
+	bool	is_write	= (0 != strcmp(ptype, "rdlock"));
+	int		result;
+	if(0 == strcmp(ptype, "upgrade")){
+		if(0 != (result = fullock_rwlock_rdlock(fd, 0, 1))){
+			ERR("Could not read lock in child, error=%d", result);
+			return EXIT_FAILURE;
+		}
+		Notify(notifyfd, 'R');
+		if(0 != (result = fullock_rwlock_upgrade(fd, 0, 1))){
+			ERR("Could not upgrade in child, error=%d", result);
+			return EXIT_FAILURE;
+		}
+	}else if(0 != (result = (is_write ? fullock_rwlock_wrlock(fd, 0, 1) : fullock_rwlock_rdlock(fd, 0, 1)))){
+		ERR("Could not %s lock in child, error=%d", (is_write ? "write" : "read"), result);
+		return EXIT_FAILURE;
+	}
+	Notify(notifyfd, (is_write ? 'W' : 'R'));
+	usleep(FEATURETEST_HOLD_USEC);
+	Notify(notifyfd, (is_write ? 'w' : 'r'));
+	if(0 != (result = fullock_rwlock_unlock(fd, 0, 1))){
+		ERR("Could not unlock in child, error=%d", result);
+		return EXIT_FAILURE;
+	}
+	close(fd);
+	return EXIT_SUCCESS;
+}
+
+// Waits cond with named mutex, and holds the mutex for a moment after
+// waking up. The names are made from pname. The steps are notified by
+// characters:
+//	C		: locked mutex before waiting
+//	W(w)	: woken up with mutex(unlocking)
+//
+static int ChildCondWait(const char* pname, int notifyfd)
+{
+	string	mutexname	= string(pname) + "_mutex";
+	string	condname	= string(pname) + "_cond";
+	int		result;
+	if(0 != (result = fullock_mutex_lock(mutexname.c_str()))){
+		ERR("Could not lock mutex in child, error=%d", result);
+		return EXIT_FAILURE;
+	}
+	Notify(notifyfd, 'C');
+	if(0 != (result = fullock_cond_wait(condname.c_str(), mutexname.c_str()))){
+		ERR("Could not wait cond in child, error=%d", result);
+		return EXIT_FAILURE;
+	}
+	Notify(notifyfd, 'W');
+	usleep(FEATURETEST_HOLD_USEC);
+	Notify(notifyfd, 'w');
+	if(0 != (result = fullock_mutex_unlock(mutexname.c_str()))){
+		ERR("Could not unlock mutex in child, error=%d", result);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+// Locks named mutex with robust list, and waits to be killed. The step is
+// notified by character:
+//	M		: locked mutex
+//
+static int ChildRobustList(const char* pname, int notifyfd)
+{
+	if(!fullock_set_robust_list()){
+		ERR("Robust list is not supported in child.");
+		return EXIT_FAILURE;
+	}
+	int	result;
+	if(0 != (result = fullock_mutex_lock(pname))){
+		ERR("Could not lock mutex in child, error=%d", result);
+		return EXIT_FAILURE;
+	}
+	Notify(notifyfd, 'M');
+	while(true){
+		pause();
+	}
+	return EXIT_FAILURE;
+}
+
+static int RunChildType(const char* ptype, const char* pfile, int notifyfd)
+{
+	if(0 == strcmp(ptype, "pin")){
+		return ChildPin(pfile);
+	}else if(0 == strcmp(ptype, "rdlock") || 0 == strcmp(ptype, "wrlock") || 0 == strcmp(ptype, "upgrade")){
+		return ChildLock(ptype, pfile, notifyfd);
+	}else if(0 == strcmp(ptype, "condwait")){
+		return ChildCondWait(pfile, notifyfd);
+	}else if(0 == strcmp(ptype, "robustlist")){
+		return ChildRobustList(pfile, notifyfd);
+	}
+	ERR("Unknown child type(%s).", ptype);
+	return EXIT_FAILURE;
+}
+
+//---------------------------------------------------------
+// Test : rwlock handle
+//---------------------------------------------------------
+static bool TestHandle(const char* progpath)
+{
+	string	path;
+	int		fd;
+	int		fd2;
+	if(FLCK_INVALID_HANDLE == (fd = OpenTestFile("handle", path))){
+		return false;
+	}
+	if(-1 == (fd2 = open(path.c_str(), O_RDWR))){
+		ERR("Could not open file(%s) again, errno=%d", path.c_str(), errno);
+		CloseTestFile(fd, path);
+		return false;
+	}
+	bool	result = false;
+	do{
+		// lock and unlock by handle
+		fullock_rwlock_handle_t	handle;
+		if(NULL == (handle = fullock_rwlock_handle_open(fd, 0, 1))){
+			ERR("Could not open handle.");
+			break;
+		}
+		if(1 != CountPins(fd)){
+			ERR("Pin count(%zu) is not 1 after opening handle.", CountPins(fd));
+			break;
+		}
+		int	lockresult;
+		if(0 != (lockresult = fullock_rwlock_handle_rdlock(handle))){
+			ERR("Could not read lock by handle, error=%d", lockresult);
+			break;
+		}
+		if(!fullock_rwlock_handle_islocked(handle) || !fullock_rwlock_islocked(fd, 0, 1)){
+			ERR("Handle is not locked after read locking.");
+			break;
+		}
+		if(EBUSY != (lockresult = fullock_rwlock_trywrlock(fd2, 0, 1))){
+			ERR("Write lock by other fd is not EBUSY(%d) while read locking by handle.", lockresult);
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_handle_unlock(handle))){
+			ERR("Could not unlock by handle, error=%d", lockresult);
+			break;
+		}
+		if(fullock_rwlock_handle_islocked(handle)){
+			ERR("Handle is locked after unlocking.");
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_handle_trywrlock(handle))){
+			ERR("Could not write lock by handle, error=%d", lockresult);
+			break;
+		}
+		if(EBUSY != (lockresult = fullock_rwlock_tryrdlock(fd2, 0, 1))){
+			ERR("Read lock by other fd is not EBUSY(%d) while write locking by handle.", lockresult);
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_handle_unlock(handle))){
+			ERR("Could not unlock by handle, error=%d", lockresult);
+			break;
+		}
+
+		// forked child can not use the handle
+		pid_t	childpid;
+		if(-1 == (childpid = fork())){
+			ERR("Could not fork child process, errno=%d", errno);
+			break;
+		}else if(0 == childpid){
+			_exit(EINVAL == fullock_rwlock_handle_trywrlock(handle) && 0 == fullock_rwlock_handle_close(handle) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		int	status = WaitChild(childpid);
+		if(-1 == status || !WIFEXITED(status) || EXIT_SUCCESS != WEXITSTATUS(status)){
+			ERR("Forked child could use the handle of parent.");
+			break;
+		}
+		if(1 != CountPins(fd)){
+			ERR("Pin count(%zu) is not 1 after closing handle in forked child.", CountPins(fd));
+			break;
+		}
+
+		// close
+		if(0 != (lockresult = fullock_rwlock_handle_close(handle))){
+			ERR("Could not close handle, error=%d", lockresult);
+			break;
+		}
+		if(0 != CountPins(fd)){
+			ERR("Pin count(%zu) is not 0 after closing handle.", CountPins(fd));
+			break;
+		}
+
+		// pin by dead process
+		if(-1 == (childpid = RunChild(progpath, "pin", path.c_str()))){
+			break;
+		}
+		status = WaitChild(childpid, WUNTRACED);
+		if(-1 == status || !WIFSTOPPED(status)){
+			ERR("Child process which pins offset lock is not stopped.");
+			break;
+		}
+		if(1 != CountPins(fd)){
+			ERR("Pin count(%zu) is not 1 while child process pins it.", CountPins(fd));
+			kill(childpid, SIGKILL);
+			WaitChild(childpid);
+			break;
+		}
+		kill(childpid, SIGKILL);
+		status = WaitChild(childpid);
+		if(-1 == status || !WIFSIGNALED(status)){
+			ERR("Child process which pins offset lock is not killed.");
+			break;
+		}
+		FlShm::CheckFileLockDeadLock();
+		if(0 != CountPins(fd)){
+			ERR("Pin count(%zu) is not 0 after checking dead lock, the pin of dead process is left.", CountPins(fd));
+			break;
+		}
+		result = true;
+	}while(false);
+
+	close(fd2);
+	CloseTestFile(fd, path);
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : locking multi ranges
+//---------------------------------------------------------
+// [NOTE]
+// The handle keeps one offset lock which covers both ranges, then both
+// ranges are resolved to it. Try locking is used, because locking it twice
+// blocks forever.
+//
+static bool TestLockMany(void)
+{
+	string	path;
+	int		fd;
+	int		fd2;
+	if(FLCK_INVALID_HANDLE == (fd = OpenTestFile("lockmany", path))){
+		return false;
+	}
+	if(-1 == (fd2 = open(path.c_str(), O_RDWR))){
+		ERR("Could not open file(%s) again, errno=%d", path.c_str(), errno);
+		CloseTestFile(fd, path);
+		return false;
+	}
+	bool					result = false;
+	fullock_rwlock_handle_t	handle = NULL;
+	do{
+		if(NULL == (handle = fullock_rwlock_handle_open(fd2, 0, 100))){
+			ERR("Could not open handle for offset lock which covers ranges.");
+			break;
+		}
+
+		// two writers are merged
+		fullock_rwlock_range_t	writers[] = {{fd, 10, 10, true}, {fd, 0, 10, true}};
+		int						lockresult;
+		if(0 != (lockresult = fullock_rwlock_trylock_many(writers, 2))){
+			ERR("Could not lock two writer ranges which are covered by one offset lock, error=%d", lockresult);
+			break;
+		}
+		if(!fullock_rwlock_handle_islocked(handle) || EBUSY != (lockresult = fullock_rwlock_tryrdlock(fd2, 50, 10))){
+			ERR("Offset lock which covers ranges is not write locked(%d).", lockresult);
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_unlock_many(writers, 2))){
+			ERR("Could not unlock two writer ranges, error=%d", lockresult);
+			break;
+		}
+		if(fullock_rwlock_handle_islocked(handle)){
+			ERR("Offset lock which covers ranges is locked after unlocking.");
+			break;
+		}
+
+		// writer and reader are merged into writer
+		fullock_rwlock_range_t	mixed[] = {{fd, 0, 10, true}, {fd, 10, 10, false}};
+		if(0 != (lockresult = fullock_rwlock_trylock_many(mixed, 2))){
+			ERR("Could not lock writer and reader ranges which are covered by one offset lock, error=%d", lockresult);
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_unlock_many(mixed, 2)) || fullock_rwlock_handle_islocked(handle)){
+			ERR("Could not unlock writer and reader ranges, error=%d", lockresult);
+			break;
+		}
+
+		// reader and writer are merged into writer in any order
+		fullock_rwlock_range_t	upgrade[] = {{fd, 0, 10, false}, {fd, 10, 10, true}};
+		if(0 != (lockresult = fullock_rwlock_trylock_many(upgrade, 2))){
+			ERR("Could not lock reader and writer ranges which are covered by one offset lock, error=%d", lockresult);
+			break;
+		}
+		if(EBUSY != (lockresult = fullock_rwlock_tryrdlock(fd2, 50, 10))){
+			ERR("Offset lock which is shared by reader and writer ranges is not write locked(%d).", lockresult);
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_unlock_many(upgrade, 2)) || fullock_rwlock_handle_islocked(handle)){
+			ERR("Could not unlock reader and writer ranges, error=%d", lockresult);
+			break;
+		}
+
+		// overlapped and duplicated ranges are merged as same as covered ranges
+		fullock_rwlock_range_t	overlap[] = {{fd, 200, 20, false}, {fd2, 210, 20, true}, {fd, 200, 20, false}};
+		if(0 != (lockresult = fullock_rwlock_trylock_many(overlap, 3))){
+			ERR("Could not lock overlapped and duplicated ranges, error=%d", lockresult);
+			break;
+		}
+		if(EBUSY != (lockresult = fullock_rwlock_tryrdlock(fd2, 200, 10))){
+			ERR("Offset lock which is shared by overlapped ranges is not write locked(%d).", lockresult);
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_unlock_many(overlap, 3))){
+			ERR("Could not unlock overlapped and duplicated ranges, error=%d", lockresult);
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_trywrlock(fd2, 200, 30)) || 0 != fullock_rwlock_unlock(fd2, 200, 30)){
+			ERR("Offset lock of overlapped ranges is left locked after unlocking(%d).", lockresult);
+			break;
+		}
+
+		// all ranges are released when one range can not be locked
+		fullock_rwlock_range_t	partial[] = {{fd, 300, 10, true}, {fd, 50, 10, true}};
+		if(0 != (lockresult = fullock_rwlock_handle_rdlock(handle))){
+			ERR("Could not read lock handle, error=%d", lockresult);
+			break;
+		}
+		lockresult = fullock_rwlock_trylock_many(partial, 2);
+		fullock_rwlock_handle_unlock(handle);
+		if(EBUSY != lockresult){
+			ERR("Locking ranges which has read locked range is not EBUSY(%d).", lockresult);
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_trywrlock(fd2, 300, 10)) || 0 != fullock_rwlock_unlock(fd2, 300, 10)){
+			ERR("Range is left locked after failure of locking ranges(%d).", lockresult);
+			break;
+		}
+		if(fullock_rwlock_handle_islocked(handle)){
+			ERR("Offset lock is left locked after failure of locking ranges.");
+			break;
+		}
+		result = true;
+	}while(false);
+
+	if(handle){
+		fullock_rwlock_handle_close(handle);
+	}
+	close(fd2);
+	CloseTestFile(fd, path);
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : upgrade and downgrade
+//---------------------------------------------------------
+// [NOTE]
+// The handle keeps the offset lock for children, and it is changed to the
+// rwlock which is not phase-fair(phase-fair rwlock does not support these).
+//
+static bool TestUpgrade(const char* progpath)
+{
+	string	path;
+	int		fd;
+	int		notifyfds[2];
+	if(FLCK_INVALID_HANDLE == (fd = OpenTestFile("upgrade", path))){
+		return false;
+	}
+	if(-1 == pipe(notifyfds)){
+		ERR("Could not make pipe, errno=%d", errno);
+		CloseTestFile(fd, path);
+		return false;
+	}
+	bool					result		= false;
+	fullock_rwlock_handle_t	handle		= NULL;
+	pid_t					childpid	= -1;
+	do{
+		if(NULL == (handle = fullock_rwlock_handle_open(fd, 0, 1)) || !fullock_rwlock_handle_set_phase_fair(handle, false)){
+			ERR("Could not open handle for rwlock which is not phase-fair.");
+			break;
+		}
+
+		// waiting writer can not get lock between upgrading and downgrading
+		int		lockresult;
+		if(0 != (lockresult = fullock_rwlock_rdlock(fd, 0, 1))){
+			ERR("Could not read lock, error=%d", lockresult);
+			break;
+		}
+		if(-1 == (childpid = RunChild(progpath, "wrlock", path.c_str(), notifyfds[1])) || !WaitLocker(fd, LOCKER_WAITING_WRITER)){
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_upgrade(fd, 0, 1))){
+			ERR("Could not upgrade while other writer waits, error=%d", lockresult);
+			break;
+		}
+		if(!CheckNoNotify(notifyfds[0], "waiting writer got lock while upgraded")){
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_downgrade(fd, 0, 1))){
+			ERR("Could not downgrade while other writer waits, error=%d", lockresult);
+			break;
+		}
+		if(!CheckNoNotify(notifyfds[0], "waiting writer got lock while downgraded")){
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_unlock(fd, 0, 1))){
+			ERR("Could not unlock after downgrading, error=%d", lockresult);
+			break;
+		}
+		if(!CheckNotify(notifyfds[0], "Ww") || !CheckChildExit(childpid)){
+			break;
+		}
+
+		// upgrading fails when other reader is upgrading
+		if(0 != (lockresult = fullock_rwlock_rdlock(fd, 0, 1))){
+			ERR("Could not read lock, error=%d", lockresult);
+			break;
+		}
+		if(-1 == (childpid = RunChild(progpath, "upgrade", path.c_str(), notifyfds[1])) || !CheckNotify(notifyfds[0], "R") || !WaitLocker(fd, LOCKER_UPGRADING)){
+			break;
+		}
+		if(EDEADLK != (lockresult = fullock_rwlock_upgrade(fd, 0, 1))){
+			ERR("Upgrading is not EDEADLK(%d) while other reader is upgrading.", lockresult);
+			break;
+		}
+		if(!CheckNoNotify(notifyfds[0], "other reader upgraded while reader is left")){
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_unlock(fd, 0, 1))){
+			ERR("Could not unlock after failure of upgrading, error=%d", lockresult);
+			break;
+		}
+		if(!CheckNotify(notifyfds[0], "Ww") || !CheckChildExit(childpid)){
+			break;
+		}
+		result = true;
+	}while(false);
+
+	KillChild(childpid);
+	if(!result){
+		fullock_rwlock_unlock(fd, 0, 1);				// for recover(may not be locked)
+	}
+	if(handle){
+		fullock_rwlock_handle_close(handle);
+	}
+	close(notifyfds[0]);
+	close(notifyfds[1]);
+	CloseTestFile(fd, path);
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : writer preference
+//---------------------------------------------------------
+// [NOTE]
+// Writer preference is set to the offset lock by the handle, then it works
+// for the writer in child process. The waiting writer sets the pending
+// flag when it fails to lock, so the new reader is retried until it backs
+// off.
+//
+static bool TestPreferWriter(const char* progpath)
+{
+	string	path;
+	int		fd;
+	int		fd2;
+	int		notifyfds[2];
+	if(FLCK_INVALID_HANDLE == (fd = OpenTestFile("preferwriter", path))){
+		return false;
+	}
+	if(-1 == (fd2 = open(path.c_str(), O_RDWR))){
+		ERR("Could not open file(%s) again, errno=%d", path.c_str(), errno);
+		CloseTestFile(fd, path);
+		return false;
+	}
+	if(-1 == pipe(notifyfds)){
+		ERR("Could not make pipe, errno=%d", errno);
+		close(fd2);
+		CloseTestFile(fd, path);
+		return false;
+	}
+	bool					result		= false;
+	fullock_rwlock_handle_t	handle		= NULL;
+	pid_t					childpid	= -1;
+	do{
+		if(NULL == (handle = fullock_rwlock_handle_open(fd, 0, 1)) || !fullock_rwlock_handle_set_phase_fair(handle, false) || !fullock_rwlock_handle_set_writer_preference(handle, true)){
+			ERR("Could not open handle for rwlock with writer preference.");
+			break;
+		}
+		int	lockresult;
+		if(0 != (lockresult = fullock_rwlock_rdlock(fd, 0, 1))){
+			ERR("Could not read lock, error=%d", lockresult);
+			break;
+		}
+		if(-1 == (childpid = RunChild(progpath, "wrlock", path.c_str(), notifyfds[1])) || !WaitLocker(fd, LOCKER_WAITING_WRITER)){
+			break;
+		}
+
+		// new reader backs off
+		bool	is_backoff = false;
+		for(int cnt = 0; !is_backoff && cnt < FEATURETEST_WAIT_COUNT; ++cnt){
+			if(EBUSY == (lockresult = fullock_rwlock_tryrdlock(fd2, 0, 1))){
+				is_backoff = true;
+			}else if(0 == lockresult){
+				fullock_rwlock_unlock(fd2, 0, 1);
+				usleep(FEATURETEST_WAIT_USEC);
+			}else{
+				ERR("Could not try read lock, error=%d", lockresult);
+				break;
+			}
+		}
+		if(!is_backoff){
+			ERR("New reader does not back off from waiting writer.");
+			break;
+		}
+		if(!CheckNoNotify(notifyfds[0], "writer got lock while reader locks")){
+			break;
+		}
+
+		// writer gets lock after the reader unlocks
+		if(0 != (lockresult = fullock_rwlock_unlock(fd, 0, 1))){
+			ERR("Could not unlock, error=%d", lockresult);
+			break;
+		}
+		if(!CheckNotify(notifyfds[0], "Ww") || !CheckChildExit(childpid)){
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_tryrdlock(fd2, 0, 1)) || 0 != (lockresult = fullock_rwlock_unlock(fd2, 0, 1))){
+			ERR("Could not read lock after writer unlocked, error=%d", lockresult);
+			break;
+		}
+		result = true;
+	}while(false);
+
+	KillChild(childpid);
+	if(!result){
+		fullock_rwlock_unlock(fd, 0, 1);				// for recover(may not be locked)
+	}
+	if(handle){
+		fullock_rwlock_handle_close(handle);
+	}
+	close(notifyfds[0]);
+	close(notifyfds[1]);
+	close(fd2);
+	CloseTestFile(fd, path);
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : phase-fair ticket rwlock
+//---------------------------------------------------------
+// [NOTE]
+// The reader which comes after the waiting writer waits for the writer
+// phase, so the order of notifications is writer and reader. The writer
+// which is killed while waiting for its turn keeps the ticket, then it is
+// released by checking dead lock.
+//
+static bool TestPhaseFair(const char* progpath)
+{
+	string	path;
+	int		fd;
+	int		fd2;
+	int		notifyfds[2];
+	if(FLCK_INVALID_HANDLE == (fd = OpenTestFile("phasefair", path))){
+		return false;
+	}
+	if(-1 == (fd2 = open(path.c_str(), O_RDWR))){
+		ERR("Could not open file(%s) again, errno=%d", path.c_str(), errno);
+		CloseTestFile(fd, path);
+		return false;
+	}
+	if(-1 == pipe(notifyfds)){
+		ERR("Could not make pipe, errno=%d", errno);
+		close(fd2);
+		CloseTestFile(fd, path);
+		return false;
+	}
+	bool					result		= false;
+	fullock_rwlock_handle_t	handle		= NULL;
+	pid_t					writerpid	= -1;
+	pid_t					readerpid	= -1;
+	do{
+		if(NULL == (handle = fullock_rwlock_handle_open(fd, 0, 1)) || !fullock_rwlock_handle_set_phase_fair(handle, true)){
+			ERR("Could not open handle for phase-fair rwlock.");
+			break;
+		}
+
+		// reader after waiting writer waits for writer phase
+		int	lockresult;
+		if(0 != (lockresult = fullock_rwlock_rdlock(fd, 0, 1))){
+			ERR("Could not read lock, error=%d", lockresult);
+			break;
+		}
+		if(-1 == (writerpid = RunChild(progpath, "wrlock", path.c_str(), notifyfds[1])) || !WaitLocker(fd, LOCKER_WAITING_WRITER)){
+			break;
+		}
+		if(-1 == (readerpid = RunChild(progpath, "rdlock", path.c_str(), notifyfds[1])) || !WaitLocker(fd, LOCKER_WAITING_READER)){
+			break;
+		}
+		if(EBUSY != (lockresult = fullock_rwlock_tryrdlock(fd2, 0, 1))){
+			ERR("New reader is not EBUSY(%d) while writer waits.", lockresult);
+			if(0 == lockresult){
+				fullock_rwlock_unlock(fd2, 0, 1);
+			}
+			break;
+		}
+		if(!CheckNoNotify(notifyfds[0], "child got lock while reader locks")){
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_unlock(fd, 0, 1))){
+			ERR("Could not unlock, error=%d", lockresult);
+			break;
+		}
+		if(!CheckNotify(notifyfds[0], "WwRr") || !CheckChildExit(writerpid) || !CheckChildExit(readerpid)){
+			break;
+		}
+
+		// ticket of dead writer
+		if(0 != (lockresult = fullock_rwlock_rdlock(fd, 0, 1))){
+			ERR("Could not read lock, error=%d", lockresult);
+			break;
+		}
+		if(-1 == (writerpid = RunChild(progpath, "wrlock", path.c_str(), notifyfds[1])) || !WaitLocker(fd, LOCKER_WAITING_WRITER)){
+			break;
+		}
+		KillChild(writerpid);
+		if(0 != (lockresult = fullock_rwlock_unlock(fd, 0, 1))){
+			ERR("Could not unlock, error=%d", lockresult);
+			break;
+		}
+		FlShm::CheckFileLockDeadLock();
+		if(0 != (lockresult = fullock_rwlock_timedwrlock(fd2, 0, 1, FEATURETEST_NOTIFY_MSEC * 1000)) || 0 != (lockresult = fullock_rwlock_unlock(fd2, 0, 1))){
+			ERR("Could not write lock after writer which waits for its turn is dead, error=%d", lockresult);
+			break;
+		}
+		if(0 != (lockresult = fullock_rwlock_timedrdlock(fd2, 0, 1, FEATURETEST_NOTIFY_MSEC * 1000)) || 0 != (lockresult = fullock_rwlock_unlock(fd2, 0, 1))){
+			ERR("Could not read lock after writer which waits for its turn is dead, error=%d", lockresult);
+			break;
+		}
+		result = true;
+	}while(false);
+
+	KillChild(writerpid);
+	KillChild(readerpid);
+	if(!result){
+		fullock_rwlock_unlock(fd, 0, 1);				// for recover(may not be locked)
+	}
+	if(handle){
+		fullock_rwlock_handle_close(handle);
+	}
+	close(notifyfds[0]);
+	close(notifyfds[1]);
+	close(fd2);
+	CloseTestFile(fd, path);
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : requeue on broadcast
+//---------------------------------------------------------
+// [NOTE]
+// Broadcasting while the parent locks the mutex wakes up only the oldest
+// waiter, and the others are moved to requeue list of the mutex. After
+// unlocking, the waiters get the mutex one by one, so that the notified
+// steps are not interleaved.
+//
+static bool TestRequeue(const char* progpath)
+{
+	char	szName[64];
+	sprintf(szName, "featuretest_%d", getpid());
+	string	mutexname	= string(szName) + "_mutex";
+	string	condname	= string(szName) + "_cond";
+
+	int		notifyfds[2];
+	if(-1 == pipe(notifyfds)){
+		ERR("Could not make pipe, errno=%d", errno);
+		return false;
+	}
+	bool	result	= false;
+	bool	locked	= false;
+	pid_t	childpids[FEATURETEST_COND_WAITERS];
+	int		childcnt;
+	for(childcnt = 0; childcnt < FEATURETEST_COND_WAITERS; ++childcnt){
+		childpids[childcnt] = -1;
+	}
+	do{
+		// run waiters
+		int	lockresult;
+		for(childcnt = 0; childcnt < FEATURETEST_COND_WAITERS; ++childcnt){
+			if(-1 == (childpids[childcnt] = RunChild(progpath, "condwait", szName, notifyfds[1])) || !CheckNotify(notifyfds[0], "C")){
+				break;
+			}
+			// the mutex is unlocked after the child waits cond
+			if(0 != (lockresult = fullock_mutex_lock(mutexname.c_str())) || 0 != (lockresult = fullock_mutex_unlock(mutexname.c_str()))){
+				ERR("Could not lock mutex after child waits cond, error=%d", lockresult);
+				break;
+			}
+		}
+		if(childcnt < FEATURETEST_COND_WAITERS){
+			break;
+		}
+
+		// broadcast while locking mutex
+		if(0 != (lockresult = fullock_mutex_lock(mutexname.c_str()))){
+			ERR("Could not lock mutex, error=%d", lockresult);
+			break;
+		}
+		locked = true;
+		if(0 != (lockresult = fullock_cond_broadcast(condname.c_str()))){
+			ERR("Could not broadcast cond, error=%d", lockresult);
+			break;
+		}
+		if(FEATURETEST_COND_WAITERS - 1 != CountRequeued(mutexname.c_str())){
+			ERR("Requeued waiters are %zu, but it should be %d.", CountRequeued(mutexname.c_str()), FEATURETEST_COND_WAITERS - 1);
+			break;
+		}
+		if(!CheckNoNotify(notifyfds[0], "waiter got mutex while parent locks it")){
+			break;
+		}
+		locked = false;
+		if(0 != (lockresult = fullock_mutex_unlock(mutexname.c_str()))){
+			ERR("Could not unlock mutex, error=%d", lockresult);
+			break;
+		}
+
+		// waiters get mutex one by one
+		for(childcnt = 0; childcnt < FEATURETEST_COND_WAITERS; ++childcnt){
+			if(!CheckNotify(notifyfds[0], "Ww")){
+				break;
+			}
+		}
+		if(childcnt < FEATURETEST_COND_WAITERS){
+			break;
+		}
+		for(childcnt = 0; childcnt < FEATURETEST_COND_WAITERS && CheckChildExit(childpids[childcnt]); ++childcnt);
+		if(childcnt < FEATURETEST_COND_WAITERS){
+			break;
+		}
+		if(0 != CountRequeued(mutexname.c_str())){
+			ERR("Requeued waiters(%zu) are left.", CountRequeued(mutexname.c_str()));
+			break;
+		}
+		result = true;
+	}while(false);
+
+	if(locked){
+		fullock_mutex_unlock(mutexname.c_str());
+	}
+	for(childcnt = 0; childcnt < FEATURETEST_COND_WAITERS; ++childcnt){
+		KillChild(childpids[childcnt]);
+	}
+	close(notifyfds[0]);
+	close(notifyfds[1]);
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : robust list
+//---------------------------------------------------------
+// [NOTE]
+// This process does not run the worker thread(see main), because it
+// releases the mutex of the killed child before the kernel's mark is
+// checked. Then the mutex can be got only by the mark of kernel.
+//
+static bool TestRobustList(const char* progpath)
+{
+	if(!fullock_set_robust_list()){
+		PRN("Robust list is not supported on this platform, so skip this test.");
+		return true;
+	}
+	if(FlShm::IsRobust()){
+		PRN("The worker thread runs by environment, so skip this test.");
+		return true;
+	}
+	char	szName[64];
+	sprintf(szName, "featuretest_%d_robust", getpid());
+
+	int		notifyfds[2];
+	if(-1 == pipe(notifyfds)){
+		ERR("Could not make pipe, errno=%d", errno);
+		return false;
+	}
+	bool	result	= false;
+	bool	locked	= false;
+	pid_t	childpid= -1;
+	do{
+		// child locks mutex
+		int	lockresult;
+		if(-1 == (childpid = RunChild(progpath, "robustlist", szName, notifyfds[1])) || !CheckNotify(notifyfds[0], "M")){
+			break;
+		}
+		if(EBUSY != (lockresult = fullock_mutex_trylock(szName))){
+			ERR("Locking mutex which child locks is not EBUSY(%d).", lockresult);
+			locked = (0 == lockresult);
+			break;
+		}
+
+		// kill child
+		kill(childpid, SIGKILL);
+		int	status = WaitChild(childpid);
+		childpid = -1;
+		if(-1 == status || !WIFSIGNALED(status)){
+			ERR("Child process which locks mutex is not killed.");
+			break;
+		}
+		FlListNMtx	nmtxobj;
+		if(!nmtxobj.find(szName) || !IS_FLCK_MUTEX_OWNER_DIED(nmtxobj.get()->lockval)){
+			ERR("Kernel did not mark mutex of killed child as owner died.");
+			break;
+		}
+
+		// take over without checking dead lock
+		if(0 != (lockresult = fullock_mutex_trylock(szName))){
+			ERR("Could not take over mutex of killed child, error=%d", lockresult);
+			break;
+		}
+		locked = true;
+		if(IS_FLCK_MUTEX_OWNER_DIED(nmtxobj.get()->lockval) || 1 != nmtxobj.get()->lockcnt){
+			ERR("Mutex which is taken over has owner died mark or wrong count(%d).", nmtxobj.get()->lockcnt);
+			break;
+		}
+		locked = false;
+		if(0 != (lockresult = fullock_mutex_unlock(szName))){
+			ERR("Could not unlock mutex, error=%d", lockresult);
+			break;
+		}
+		if(FLCK_MUTEX_UNLOCK != nmtxobj.get()->lockval){
+			ERR("Mutex is not unlocked.");
+			break;
+		}
+		result = true;
+	}while(false);
+
+	if(locked){
+		fullock_mutex_unlock(szName);
+	}
+	KillChild(childpid);
+	close(notifyfds[0]);
+	close(notifyfds[1]);
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : lockid wake
+//---------------------------------------------------------
+static void* LockidThread(void* param)
+{
+	PLOCKIDTHPARAM	pparam	= reinterpret_cast<PLOCKIDTHPARAM>(param);
+	flckpid_t		flckpid	= get_flckpid();
+
+	fl_lock_lockid(pparam->plockid, flckpid);
+	fl_unlock_lockid(pparam->plockid, flckpid);
+	pparam->result = true;
+	return NULL;
+}
+
+static bool TestLockidWake(void)
+{
+	flckpid_t		lockid	= FLCK_INVALID_ID;
+	flckpid_t		flckpid	= get_flckpid();
+	LOCKIDTHPARAM	params[FEATURETEST_LOCKID_WAITERS];
+	pthread_t		threads[FEATURETEST_LOCKID_WAITERS];
+	int				started	= 0;
+	bool			result	= true;
+
+	// lock lockid, and start threads which park on it
+	fl_lock_lockid(&lockid, flckpid);
+
+	uint64_t	parkcnt = fl_get_lockid_stat().park_cnt;
+	for(; started < FEATURETEST_LOCKID_WAITERS; ++started){
+		params[started].plockid	= &lockid;
+		params[started].result	= false;
+		if(0 != pthread_create(&threads[started], NULL, LockidThread, &params[started])){
+			ERR("Could not create thread for parking on lockid.");
+			result = false;
+			break;
+		}
+	}
+	if(result){
+		int	cnt;
+		for(cnt = 0; cnt < FEATURETEST_WAIT_COUNT && (fl_get_lockid_stat().park_cnt - parkcnt) < FEATURETEST_LOCKID_WAITERS; ++cnt){
+			usleep(FEATURETEST_WAIT_USEC);
+		}
+		if(FEATURETEST_WAIT_COUNT <= cnt){
+			ERR("Threads(%d) did not park on lockid.", FEATURETEST_LOCKID_WAITERS);
+			result = false;
+		}
+	}
+	usleep(FEATURETEST_WAIT_USEC);
+
+	// [NOTE]
+	// Relocking right after unlocking is same as a thread which wins in
+	// PAUSE phase while others are parking. The waiter bit must be kept,
+	// otherwise the next unlocking does not wake parking threads and they
+	// wait until parking timeout.
+	//
+	fl_unlock_lockid(&lockid, flckpid);
+	fl_lock_lockid(&lockid, flckpid);
+	if(result && !IS_FLCK_LOCKID_WAITER(lockid)){
+		ERR("Waiter bit is cleared by relocking lockid while threads are parking.");
+		result = false;
+	}
+	fl_unlock_lockid(&lockid, flckpid);
+
+	for(int cnt = 0; cnt < started; ++cnt){
+		pthread_join(threads[cnt], NULL);
+		if(!params[cnt].result){
+			ERR("Thread(%d) could not lock lockid.", cnt);
+			result = false;
+		}
+	}
+	if(result && FLCK_INVALID_ID != lockid){
+		ERR("Lockid(0x%016llx) is not cleared after all threads unlocked it.", static_cast<unsigned long long>(lockid));
+		result = false;
+	}
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : parking cond waiter
+//---------------------------------------------------------
+// Returns cpu time(usec) used by the thread, or -1 on error.
+//
+static long GetThreadCpuUsec(pthread_t thread)
+{
+	clockid_t		clockid;
+	struct timespec	ts;
+	if(0 != pthread_getcpuclockid(thread, &clockid) || -1 == clock_gettime(clockid, &ts)){
+		ERR("Could not get cpu time of thread, errno=%d", errno);
+		return -1;
+	}
+	return (static_cast<long>(ts.tv_sec) * 1000 * 1000 + ts.tv_nsec / 1000);
+}
+
+static void* CondThread(void* param)
+{
+	PCONDTHPARAM	pparam = reinterpret_cast<PCONDTHPARAM>(param);
+	int				result;
+	if(0 != (result = fullock_mutex_lock(pparam->pmutexname))){
+		ERR("Could not lock mutex in thread(%d), error=%d", pparam->index, result);
+		return NULL;
+	}
+	if(0 != (result = fullock_cond_wait(pparam->pcondname, pparam->pmutexname))){
+		ERR("Could not wait cond in thread(%d), error=%d", pparam->index, result);
+		fullock_mutex_unlock(pparam->pmutexname);
+		return NULL;
+	}
+	// woken up with mutex
+	pparam->porder[*(pparam->pwoken)] = pparam->index;
+	++(*(pparam->pwoken));
+
+	if(0 != (result = fullock_mutex_unlock(pparam->pmutexname))){
+		ERR("Could not unlock mutex in thread(%d), error=%d", pparam->index, result);
+		return NULL;
+	}
+	pparam->result = true;
+	return NULL;
+}
+
+// Wait for the cond waiters in shm become count.
+//
+static bool WaitCondWaiters(const char* pcondname, size_t count)
+{
+	for(int cnt = 0; cnt < FEATURETEST_WAIT_COUNT; ++cnt){
+		if(count == CountCondWaiters(pcondname)){
+			return true;
+		}
+		usleep(FEATURETEST_WAIT_USEC);
+	}
+	ERR("Cond waiters are %zu, but it should be %zu.", CountCondWaiters(pcondname), count);
+	return false;
+}
+
+// Wait for the woken threads become count.
+//
+static bool WaitWoken(volatile int* pwoken, int count)
+{
+	for(int cnt = 0; cnt < FEATURETEST_WAIT_COUNT; ++cnt){
+		if(count <= *pwoken){
+			return true;
+		}
+		usleep(FEATURETEST_WAIT_USEC);
+	}
+	ERR("Woken waiters are %d, but it should be %d.", *pwoken, count);
+	return false;
+}
+
+// [NOTE]
+// The waiter yields only FLCK_COND_SPIN_LIMIT times and parks on futex,
+// then it uses few cpu time while the cond is not signaled. If it spins
+// on sched_yield, it uses almost all of the quiet time.
+//
+static bool TestCondPark(void)
+{
+	char	szName[64];
+	sprintf(szName, "featuretest_%d", getpid());
+	string	mutexname	= string(szName) + "_mutex";
+	string	condname	= string(szName) + "_cond";
+
+	int				order	= -1;
+	volatile int	woken	= 0;
+	CONDTHPARAM		param;
+	pthread_t		thread;
+	param.pmutexname	= mutexname.c_str();
+	param.pcondname		= condname.c_str();
+	param.index			= 0;
+	param.porder		= &order;
+	param.pwoken		= &woken;
+	param.result		= false;
+	if(0 != pthread_create(&thread, NULL, CondThread, &param)){
+		ERR("Could not create thread for waiting cond.");
+		return false;
+	}
+
+	bool	result = false;
+	do{
+		if(!WaitCondWaiters(condname.c_str(), 1)){
+			break;
+		}
+		usleep(FEATURETEST_WAIT_USEC);
+
+		long	startusec;
+		long	endusec;
+		if(-1 == (startusec = GetThreadCpuUsec(thread))){
+			break;
+		}
+		usleep(FEATURETEST_QUIET_MSEC * 1000);
+		if(-1 == (endusec = GetThreadCpuUsec(thread))){
+			break;
+		}
+		if((FEATURETEST_QUIET_MSEC * 1000 / 4) <= (endusec - startusec)){
+			ERR("Waiter used %ld usec cpu time in %d msec, it does not park.", endusec - startusec, FEATURETEST_QUIET_MSEC);
+			break;
+		}
+		if(0 != woken){
+			ERR("Waiter is woken up without signal.");
+			break;
+		}
+		result = true;
+	}while(false);
+
+	// signal wakes up the parking waiter
+	int	signalresult;
+	if(0 != (signalresult = fullock_cond_signal(condname.c_str()))){
+		ERR("Could not signal cond, error=%d", signalresult);
+		result = false;
+	}
+	if(!WaitWoken(&woken, 1)){
+		// the thread is left, it is stopped by exiting
+		pthread_detach(thread);
+		return false;
+	}
+	pthread_join(thread, NULL);
+	if(!param.result){
+		result = false;
+	}
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : FIFO signal for cond
+//---------------------------------------------------------
+// [NOTE]
+// Each thread starts waiting after the previous one is queued, and each
+// signal pops only the oldest waiter from waiter_list. The woken thread
+// records its index with the mutex, so the order of indexes must be same
+// as the order of waiting.
+//
+static bool TestCondFifo(void)
+{
+	char	szName[64];
+	sprintf(szName, "featuretest_%d", getpid());
+	string	mutexname	= string(szName) + "_mutex";
+	string	condname	= string(szName) + "_cond";
+
+	int				order[FEATURETEST_FIFO_WAITERS];
+	volatile int	woken	= 0;
+	CONDTHPARAM		params[FEATURETEST_FIFO_WAITERS];
+	pthread_t		threads[FEATURETEST_FIFO_WAITERS];
+	int				started;
+	bool			result	= true;
+
+	// start waiters one by one
+	for(started = 0; started < FEATURETEST_FIFO_WAITERS; ++started){
+		order[started]				= -1;
+		params[started].pmutexname	= mutexname.c_str();
+		params[started].pcondname	= condname.c_str();
+		params[started].index		= started;
+		params[started].porder		= order;
+		params[started].pwoken		= &woken;
+		params[started].result		= false;
+		if(0 != pthread_create(&threads[started], NULL, CondThread, &params[started])){
+			ERR("Could not create thread(%d) for waiting cond.", started);
+			result = false;
+			break;
+		}
+		if(!WaitCondWaiters(condname.c_str(), static_cast<size_t>(started + 1))){
+			++started;
+			result = false;
+			break;
+		}
+	}
+	if(result && !IsCondTailLast(condname.c_str())){
+		ERR("Tail of cond waiters does not point the last waiter.");
+		result = false;
+	}
+
+	// signal one by one
+	for(int cnt = 0; cnt < started; ++cnt){
+		int	signalresult;
+		if(0 != (signalresult = fullock_cond_signal(condname.c_str()))){
+			ERR("Could not signal cond, error=%d", signalresult);
+			result = false;
+		}
+		if(result && static_cast<size_t>(started - cnt - 1) != CountCondWaiters(condname.c_str())){
+			ERR("Cond waiters are %zu after signal, but it should be %d.", CountCondWaiters(condname.c_str()), started - cnt - 1);
+			result = false;
+		}
+		if(!WaitWoken(&woken, cnt + 1)){
+			// the threads are left, they are stopped by exiting
+			for(cnt = 0; cnt < started; ++cnt){
+				pthread_detach(threads[cnt]);
+			}
+			return false;
+		}
+		if(result && cnt != order[cnt]){
+			ERR("Signal(%d) woke up waiter(%d), but it should be the oldest waiter(%d).", cnt, order[cnt], cnt);
+			result = false;
+		}
+	}
+	for(int cnt = 0; cnt < started; ++cnt){
+		pthread_join(threads[cnt], NULL);
+		if(!params[cnt].result){
+			result = false;
+		}
+	}
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : parking mutex waiter
+//---------------------------------------------------------
+static void* MutexThread(void* param)
+{
+	PMUTEXTHPARAM	pparam = reinterpret_cast<PMUTEXTHPARAM>(param);
+	int				result;
+	if(0 != (result = fullock_mutex_lock(pparam->pmutexname))){
+		ERR("Could not lock mutex in thread, error=%d", result);
+		return NULL;
+	}
+	++(*(pparam->pwoken));
+
+	if(0 != (result = fullock_mutex_unlock(pparam->pmutexname))){
+		ERR("Could not unlock mutex in thread, error=%d", result);
+		return NULL;
+	}
+	pparam->result = true;
+	return NULL;
+}
+
+// [NOTE]
+// The waiter sets the waiter bit in lock value and parks on futex, then
+// it uses few cpu time while this process locks the mutex. This process
+// locks the mutex twice, so the first unlocking only counts down lockcnt
+// and must not pass the mutex to the waiter.
+//
+static bool TestMutexPark(void)
+{
+	char	szName[64];
+	sprintf(szName, "featuretest_%d_mutex", getpid());
+
+	int	lockresult;
+	if(0 != (lockresult = fullock_mutex_lock(szName)) || 0 != (lockresult = fullock_mutex_lock(szName))){
+		ERR("Could not lock mutex recursively, error=%d", lockresult);
+		return false;
+	}
+	int	lockcnt = 2;
+
+	volatile int	woken = 0;
+	MUTEXTHPARAM	param;
+	pthread_t		thread;
+	param.pmutexname	= szName;
+	param.pwoken		= &woken;
+	param.result		= false;
+	if(0 != pthread_create(&thread, NULL, MutexThread, &param)){
+		ERR("Could not create thread for locking mutex.");
+		for(; 0 < lockcnt; --lockcnt){
+			fullock_mutex_unlock(szName);
+		}
+		return false;
+	}
+
+	bool	result = false;
+	do{
+		int	cnt;
+		for(cnt = 0; cnt < FEATURETEST_WAIT_COUNT && !IS_FLCK_MUTEX_WAITER(GetMutexLockval(szName)); ++cnt){
+			usleep(FEATURETEST_WAIT_USEC);
+		}
+		if(FEATURETEST_WAIT_COUNT <= cnt){
+			ERR("Waiter bit is not set in mutex lock value.");
+			break;
+		}
+		usleep(FEATURETEST_WAIT_USEC);
+
+		long	startusec;
+		long	endusec;
+		if(-1 == (startusec = GetThreadCpuUsec(thread))){
+			break;
+		}
+		usleep(FEATURETEST_QUIET_MSEC * 1000);
+		if(-1 == (endusec = GetThreadCpuUsec(thread))){
+			break;
+		}
+		if((FEATURETEST_QUIET_MSEC * 1000 / 4) <= (endusec - startusec)){
+			ERR("Waiter used %ld usec cpu time in %d msec, it does not park.", endusec - startusec, FEATURETEST_QUIET_MSEC);
+			break;
+		}
+
+		// first unlocking keeps the mutex
+		--lockcnt;
+		if(0 != (lockresult = fullock_mutex_unlock(szName))){
+			ERR("Could not unlock mutex, error=%d", lockresult);
+			break;
+		}
+		usleep(FEATURETEST_QUIET_MSEC * 1000);
+		if(0 != woken){
+			ERR("Waiter got mutex while this process still locks it recursively.");
+			break;
+		}
+		result = true;
+	}while(false);
+
+	// unlocking all passes the mutex to the waiter
+	for(; 0 < lockcnt; --lockcnt){
+		if(0 != (lockresult = fullock_mutex_unlock(szName))){
+			ERR("Could not unlock mutex, error=%d", lockresult);
+			result = false;
+		}
+	}
+	if(!WaitWoken(&woken, 1)){
+		// the thread is left, it is stopped by exiting
+		pthread_detach(thread);
+		return false;
+	}
+	pthread_join(thread, NULL);
+	if(!param.result){
+		result = false;
+	}
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : deadline of timed APIs
+//---------------------------------------------------------
+static long GetMonotonicUsec(void)
+{
+	struct timespec	ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (static_cast<long>(ts.tv_sec) * 1000 * 1000 + ts.tv_nsec / 1000);
+}
+
+static void* TimedThread(void* param)
+{
+	PTIMEDTHPARAM	pparam = reinterpret_cast<PTIMEDTHPARAM>(param);
+	for(int cnt = 0; cnt < TIMED_API_COUNT; ++cnt){
+		pparam->results[cnt] = -1;
+		pparam->elapsed[cnt] = 0;
+	}
+	int	fd;
+	if(-1 == (fd = open(pparam->pfile, O_RDWR))){
+		ERR("Could not open file(%s) in thread, errno=%d", pparam->pfile, errno);
+		return NULL;
+	}
+	long	startusec;
+
+	startusec						= GetMonotonicUsec();
+	pparam->results[TIMED_WRLOCK]	= fullock_rwlock_timedwrlock(fd, 0, 1, FEATURETEST_TIMEOUT_USEC);
+	pparam->elapsed[TIMED_WRLOCK]	= GetMonotonicUsec() - startusec;
+
+	startusec						= GetMonotonicUsec();
+	pparam->results[TIMED_RDLOCK]	= fullock_rwlock_timedrdlock(fd, 0, 1, FEATURETEST_TIMEOUT_USEC);
+	pparam->elapsed[TIMED_RDLOCK]	= GetMonotonicUsec() - startusec;
+
+	startusec						= GetMonotonicUsec();
+	pparam->results[TIMED_MUTEX]	= fullock_mutex_timedlock(pparam->pmutexname, FEATURETEST_TIMEOUT_USEC);
+	pparam->elapsed[TIMED_MUTEX]	= GetMonotonicUsec() - startusec;
+
+	// nobody signals the cond
+	int	result;
+	if(0 != (result = fullock_mutex_lock(pparam->pcondmutexname))){
+		ERR("Could not lock mutex for cond in thread, error=%d", result);
+	}else{
+		startusec						= GetMonotonicUsec();
+		pparam->results[TIMED_COND]		= fullock_cond_timedwait(pparam->pcondname, pparam->pcondmutexname, FEATURETEST_TIMEOUT_USEC);
+		pparam->elapsed[TIMED_COND]		= GetMonotonicUsec() - startusec;
+		fullock_mutex_unlock(pparam->pcondmutexname);
+	}
+	close(fd);
+	return NULL;
+}
+
+// [NOTE]
+// This process locks the file and the mutex, and the thread calls each
+// timed API. Each call must return ETIMEDOUT at the deadline, not before
+// it and not so late after it.
+//
+static bool TestDeadline(void)
+{
+	string	path;
+	int		fd;
+	if(FLCK_INVALID_HANDLE == (fd = OpenTestFile("deadline", path))){
+		return false;
+	}
+	char	szName[64];
+	sprintf(szName, "featuretest_%d", getpid());
+	string	mutexname		= string(szName) + "_mutex";
+	string	condmutexname	= string(szName) + "_condmutex";
+	string	condname		= string(szName) + "_cond";
+
+	int	lockresult;
+	if(0 != (lockresult = fullock_rwlock_wrlock(fd, 0, 1))){
+		ERR("Could not write lock, error=%d", lockresult);
+		CloseTestFile(fd, path);
+		return false;
+	}
+	if(0 != (lockresult = fullock_mutex_lock(mutexname.c_str()))){
+		ERR("Could not lock mutex, error=%d", lockresult);
+		fullock_rwlock_unlock(fd, 0, 1);
+		CloseTestFile(fd, path);
+		return false;
+	}
+
+	bool			result = false;
+	TIMEDTHPARAM	param;
+	pthread_t		thread;
+	param.pfile				= path.c_str();
+	param.pmutexname		= mutexname.c_str();
+	param.pcondmutexname	= condmutexname.c_str();
+	param.pcondname			= condname.c_str();
+	if(0 != pthread_create(&thread, NULL, TimedThread, &param)){
+		ERR("Could not create thread for calling timed APIs.");
+	}else{
+		pthread_join(thread, NULL);
+
+		const char*	apinames[TIMED_API_COUNT] = {"fullock_rwlock_timedwrlock", "fullock_rwlock_timedrdlock", "fullock_mutex_timedlock", "fullock_cond_timedwait"};
+		int			cnt;
+		for(cnt = 0; cnt < TIMED_API_COUNT; ++cnt){
+			if(ETIMEDOUT != param.results[cnt]){
+				ERR("%s returned %d, but it should be ETIMEDOUT.", apinames[cnt], param.results[cnt]);
+				break;
+			}
+			if(param.elapsed[cnt] < FEATURETEST_TIMEOUT_USEC || (FEATURETEST_TIMEOUT_USEC + FEATURETEST_LATE_USEC) < param.elapsed[cnt]){
+				ERR("%s returned after %ld usec, but the timeout is %d usec.", apinames[cnt], param.elapsed[cnt], FEATURETEST_TIMEOUT_USEC);
+				break;
+			}
+		}
+		result = (TIMED_API_COUNT == cnt);
+	}
+
+	fullock_mutex_unlock(mutexname.c_str());
+	fullock_rwlock_unlock(fd, 0, 1);
+	CloseTestFile(fd, path);
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : releasing by pidfd
+//---------------------------------------------------------
+// Locks named mutex, and exits without unlocking when the parent sets
+// exiting flag.
+//
+static void* OwnerThread(void* param)
+{
+	POWNERTHPARAM	pparam = reinterpret_cast<POWNERTHPARAM>(param);
+	pparam->tid = decompose_tid(get_flckpid());
+
+	int	result;
+	if(0 != (result = fullock_mutex_lock(pparam->pmutexname))){
+		ERR("Could not lock mutex in owner thread, error=%d", result);
+		return NULL;
+	}
+	pparam->locked = true;
+	while(!pparam->exiting){
+		usleep(FEATURETEST_WAIT_USEC);
+	}
+	pparam->result = true;
+	return NULL;
+}
+
+// [NOTE]
+// The owner is a thread in this process, then its exit does not close
+// the shm file and the worker thread does not get inotify(CLOSE) event.
+// The waiter does not check dead lock by itself on low robust mode, and
+// the mutex is not on robust list. Thus the mutex is released only by
+// the worker thread which gets the exit event of pidfd. The pidfd of the
+// owner is opened by the waiter before parking.
+//
+static bool TestPidfd(void)
+{
+	char	szName[64];
+	sprintf(szName, "featuretest_%d_mutex", getpid());
+
+	FlShm::ROBUSTMODE		oldmode		= FlShm::SetRobustMode(FlShm::ROBUST_LOW);
+	FlShm::ROBUSTLISTMODE	oldlistmode	= FlShm::SetRobustListMode(FlShm::ROBUSTLIST_NO);
+
+	OWNERTHPARAM	ownerparam;
+	pthread_t		ownerthread;
+	ownerparam.pmutexname	= szName;
+	ownerparam.tid			= 0;
+	ownerparam.locked		= false;
+	ownerparam.exiting		= false;
+	ownerparam.result		= false;
+
+	volatile int	woken = 0;
+	MUTEXTHPARAM	param;
+	pthread_t		thread;
+	param.pmutexname		= szName;
+	param.pwoken			= &woken;
+	param.result			= false;
+
+	bool	result		= false;
+	bool	is_owner	= false;
+	bool	is_waiter	= false;
+	do{
+		// owner thread locks mutex
+		if(0 != pthread_create(&ownerthread, NULL, OwnerThread, &ownerparam)){
+			ERR("Could not create owner thread.");
+			break;
+		}
+		is_owner = true;
+
+		int	cnt;
+		for(cnt = 0; cnt < FEATURETEST_WAIT_COUNT && !ownerparam.locked; ++cnt){
+			usleep(FEATURETEST_WAIT_USEC);
+		}
+		if(FEATURETEST_WAIT_COUNT <= cnt){
+			ERR("Owner thread does not lock mutex.");
+			break;
+		}
+
+		// waiter thread parks on mutex
+		if(0 != pthread_create(&thread, NULL, MutexThread, &param)){
+			ERR("Could not create thread for locking mutex.");
+			break;
+		}
+		is_waiter = true;
+
+		for(cnt = 0; cnt < FEATURETEST_WAIT_COUNT && !IS_FLCK_MUTEX_WAITER(GetMutexLockval(szName)); ++cnt){
+			usleep(FEATURETEST_WAIT_USEC);
+		}
+		if(FEATURETEST_WAIT_COUNT <= cnt){
+			ERR("Waiter bit is not set in mutex lock value.");
+			break;
+		}
+
+		FlckPidfd::PIDFDSTATE	state = FlckPidfd::Check(getpid(), ownerparam.tid);
+		if(FlckPidfd::FLCK_PIDFD_UNKNOWN == state){
+			PRN("Could not watch thread by pidfd on this platform, so skip this test.");
+			ownerparam.exiting = true;
+			pthread_join(ownerthread, NULL);
+			is_owner = false;
+			FlShm::CheckProcessDead();
+			result = true;
+			break;
+		}else if(FlckPidfd::FLCK_PIDFD_RUN != state){
+			ERR("Owner thread which locks mutex is not running by pidfd.");
+			break;
+		}
+
+		// owner thread exits without unlocking
+		ownerparam.exiting = true;
+		pthread_join(ownerthread, NULL);
+		is_owner = false;
+		if(!ownerparam.result){
+			break;
+		}
+		if(!WaitWoken(&woken, 1)){
+			ERR("Mutex of exited owner is not released by exit event of pidfd.");
+			break;
+		}
+		result = true;
+	}while(false);
+
+	if(is_owner){
+		ownerparam.exiting = true;
+		pthread_join(ownerthread, NULL);
+	}
+	if(is_waiter){
+		if(0 == woken){
+			// the thread is left, it is stopped by exiting
+			pthread_detach(thread);
+			result = false;
+		}else{
+			pthread_join(thread, NULL);
+			if(!param.result){
+				result = false;
+			}
+		}
+	}
+	FlShm::SetRobustListMode(oldlistmode);
+	FlShm::SetRobustMode(oldmode);
+	return result;
+}
+
+//---------------------------------------------------------
+// Test : releasing by expiring cache
+//---------------------------------------------------------
+// Runs the owner thread which exits with locking mutex, and checks dead
+// lock with the cache which has the running answer for the owner. The
+// answer is given as one by pidfd(is_watched) or by /proc. Returns the
+// count of checking until the mutex is released, or -1 on error.
+//
+static int CountSweepsToRelease(const char* pmutexname, bool is_watched)
+{
+	OWNERTHPARAM	ownerparam;
+	pthread_t		ownerthread;
+	ownerparam.pmutexname	= pmutexname;
+	ownerparam.tid			= 0;
+	ownerparam.locked		= false;
+	ownerparam.exiting		= false;
+	ownerparam.result		= false;
+	if(0 != pthread_create(&ownerthread, NULL, OwnerThread, &ownerparam)){
+		ERR("Could not create owner thread.");
+		return -1;
+	}
+	int	cnt;
+	for(cnt = 0; cnt < FEATURETEST_WAIT_COUNT && !ownerparam.locked; ++cnt){
+		usleep(FEATURETEST_WAIT_USEC);
+	}
+	if(FEATURETEST_WAIT_COUNT <= cnt){
+		ERR("Owner thread does not lock mutex.");
+		ownerparam.exiting = true;
+		pthread_join(ownerthread, NULL);
+		return -1;
+	}
+
+	// [NOTE]
+	// The answer is set before the owner exits, and the exit is not told
+	// to the cache(the worker does not watch the owner in this test).
+	//
+	fl_pid_cache_map_t	cache(true);
+	set_execution_cache(&cache, getpid(), ownerparam.tid, true, is_watched);
+
+	ownerparam.exiting = true;
+	pthread_join(ownerthread, NULL);
+	if(!ownerparam.result){
+		return -1;
+	}
+	for(cnt = 1; cnt <= FLCK_PID_CACHE_WATCH_GEN * 2; ++cnt){
+		FlShm::CheckProcessDead(&cache);
+		if(FLCK_MUTEX_UNLOCK == GetMutexLockval(pmutexname)){
+			return cnt;
+		}
+	}
+	ERR("Mutex of exited owner is not released after checking %d times.", FLCK_PID_CACHE_WATCH_GEN * 2);
+	return -1;
+}
+
+// [NOTE]
+// The cache of worker is kept over checking, but the answer by /proc is
+// valid only in the checking which sets it, and the running answer by
+// pidfd expires after FLCK_PID_CACHE_WATCH_GEN checking. Then the lock of
+// exited owner is released even if the exit event of pidfd is lost. The
+// owner is a thread in this process, so that the worker thread does not
+// get inotify(CLOSE) event.
+//
+static bool TestPidCache(void)
+{
+	char	szName[64];
+	sprintf(szName, "featuretest_%d_mutex", getpid());
+
+	FlShm::ROBUSTLISTMODE	oldlistmode = FlShm::SetRobustListMode(FlShm::ROBUSTLIST_NO);
+	bool					result		= false;
+	int						sweeps;
+	do{
+		if(-1 == (sweeps = CountSweepsToRelease(szName, false))){
+			break;
+		}
+		if(1 != sweeps){
+			ERR("Answer by /proc is used in %d checking, but it should be expired in next checking.", sweeps - 1);
+			break;
+		}
+		if(-1 == (sweeps = CountSweepsToRelease(szName, true))){
+			break;
+		}
+		if(FLCK_PID_CACHE_WATCH_GEN != sweeps){
+			ERR("Answer by pidfd is used in %d checking, but it should be expired after %d checking.", sweeps - 1, FLCK_PID_CACHE_WATCH_GEN - 1);
+			break;
+		}
+		result = true;
+	}while(false);
+
+	FlShm::SetRobustListMode(oldlistmode);
+	return result;
+}
+
+//---------------------------------------------------------
+// Main
+//---------------------------------------------------------
+int main(int argc, char** argv)
+{
+	if(5 == argc && 0 == strcmp(argv[1], "-child")){
+		exit(RunChildType(argv[2], argv[3], atoi(argv[4])));
+	}
+	if(2 != argc){
+		ERR("Parameters are wrong.");
+		Help(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	if(0 == strcasecmp(argv[1], "-help") || 0 == strcasecmp(argv[1], "-h")){
+		Help(argv[0]);
+		exit(EXIT_SUCCESS);
+	}
+
+	// [NOTE]
+	// Call any function for attaching shm before inspecting it.
+	// Robust list test does not run the worker thread.
+	//
+	if(0 == strcasecmp(argv[1], "-robustlist")){
+		fullock_set_no_robust();
+	}
+	fullock_rwlock_islocked(FLCK_INVALID_HANDLE, 0, 0);
+
+	bool	result;
+	if(0 == strcasecmp(argv[1], "-handle")){
+		PRN("Test rwlock handle API and releasing pins of dead process.");
+		result = TestHandle(argv[0]);
+	}else if(0 == strcasecmp(argv[1], "-lockmany")){
+		PRN("Test locking ranges which share one offset lock and releasing at failure.");
+		result = TestLockMany();
+	}else if(0 == strcasecmp(argv[1], "-upgrade")){
+		PRN("Test upgrading and downgrading with other processes.");
+		result = TestUpgrade(argv[0]);
+	}else if(0 == strcasecmp(argv[1], "-preferwriter")){
+		PRN("Test new readers back off from waiting writer in other process.");
+		result = TestPreferWriter(argv[0]);
+	}else if(0 == strcasecmp(argv[1], "-phasefair")){
+		PRN("Test phase order of phase-fair rwlock and releasing dead ticket.");
+		result = TestPhaseFair(argv[0]);
+	}else if(0 == strcasecmp(argv[1], "-requeue")){
+		PRN("Test broadcast requeues waiters to named mutex.");
+		result = TestRequeue(argv[0]);
+	}else if(0 == strcasecmp(argv[1], "-robustlist")){
+		PRN("Test kernel recovers named mutex of killed owner by robust list.");
+		result = TestRobustList(argv[0]);
+	}else if(0 == strcasecmp(argv[1], "-lockidwake")){
+		PRN("Test relocking keeps waiter bit and unlocking wakes parking threads.");
+		result = TestLockidWake();
+	}else if(0 == strcasecmp(argv[1], "-condpark")){
+		PRN("Test cond waiter parks without using cpu and signal wakes it.");
+		result = TestCondPark();
+	}else if(0 == strcasecmp(argv[1], "-condfifo")){
+		PRN("Test signal wakes cond waiters in order of waiting.");
+		result = TestCondFifo();
+	}else if(0 == strcasecmp(argv[1], "-mutexpark")){
+		PRN("Test mutex waiter parks without using cpu until recursive owner unlocks all.");
+		result = TestMutexPark();
+	}else if(0 == strcasecmp(argv[1], "-deadline")){
+		PRN("Test timed rwlock, mutex and cond return ETIMEDOUT at deadline.");
+		result = TestDeadline();
+	}else if(0 == strcasecmp(argv[1], "-pidfd")){
+		PRN("Test mutex of exited owner is released by exit event of pidfd.");
+		result = TestPidfd();
+	}else if(0 == strcasecmp(argv[1], "-pidcache")){
+		PRN("Test mutex of exited owner is released when its cached answer expires.");
+		result = TestPidCache();
+	}else{
+		ERR("Unknown parameter(%s).", argv[1]);
+		Help(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	PRN("-> %s", result ? "SUCCEED" : "FAILED");
+
+	exit(result ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/*
+ * Local variables:
+ * tab-width: 4
+ * c-basic-offset: 4
+ * End:
+ * vim600: noexpandtab sw=4 ts=4 fdm=marker
+ * vim<600: noexpandtab sw=4 ts=4
+ */
@@ -501,6 +501,174 @@ fi
 	echo "    [Result] OK"
 	echo ""
 
+	#----------------------------------------------------------
+	# Feature test for rwlock handle
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for rwlock handle"
+
+	if ({ "${TESTDIR}"/featuretest -handle || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for locking multi ranges
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for locking multi ranges"
+
+	if ({ "${TESTDIR}"/featuretest -lockmany || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for upgrading and downgrading
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for upgrading and downgrading"
+
+	if ({ "${TESTDIR}"/featuretest -upgrade || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for writer preference
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for writer preference"
+
+	if ({ "${TESTDIR}"/featuretest -preferwriter || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for phase-fair rwlock
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for phase-fair rwlock"
+
+	if ({ "${TESTDIR}"/featuretest -phasefair || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for requeue on broadcast
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for requeue on broadcast"
+
+	if ({ "${TESTDIR}"/featuretest -requeue || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for robust list
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for robust list"
+
+	if ({ "${TESTDIR}"/featuretest -robustlist || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for lockid wake
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for lockid wake"
+
+	if ({ "${TESTDIR}"/featuretest -lockidwake || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for cond park
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for cond park"
+
+	if ({ "${TESTDIR}"/featuretest -condpark || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for cond fifo
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for cond fifo"
+
+	if ({ "${TESTDIR}"/featuretest -condfifo || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for mutex park
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for mutex park"
+
+	if ({ "${TESTDIR}"/featuretest -mutexpark || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for deadline
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for deadline"
+
+	if ({ "${TESTDIR}"/featuretest -deadline || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for pidfd
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for pidfd"
+
+	if ({ "${TESTDIR}"/featuretest -pidfd || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
+	#----------------------------------------------------------
+	# Feature test for pid cache
+	#----------------------------------------------------------
+	echo "[TEST] Feature test for pid cache"
+
+	if ({ "${TESTDIR}"/featuretest -pidcache || echo > "${PIPEFAILURE_FILE}"; } | sed -e 's/^/    /g') && rm "${PIPEFAILURE_FILE}" >/dev/null 2>&1; then
+		echo "    [Result] ERROR"
+		exit 1
+	fi
+	echo "    [Result] OK"
+	echo ""
+
 	#----------------------------------------------------------
 	# Remove file
 	#----------------------------------------------------------